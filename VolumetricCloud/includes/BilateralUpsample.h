@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+
+class DensityField;
+struct CpuCloudFrame;
+struct CpuCloudRendererSettings;
+
+/// <summary>
+/// C++ port of BilateralUpsample in MergePrimitiveAndCloud.hlsl, which brings a cloud buffer of
+/// any size up to the screen. A screen pixel takes the four cloud texels of its bilinear
+/// footprint, each weighted down by how far the primitive its march ended at is from the
+/// primitive of the pixel (view depths, relative). Colour and cloud depth are blended with the
+/// same weights and the merge's depth test runs on the result. With USE_BILATERAL_UPSAMPLE the
+/// march ends at the farthest primitive inside its own texel instead of the farthest of its
+/// neighbours (CpuCloudRendererSettings::primitiveFootprint_ false), so texels on the monolith
+/// hold only the cloud in front of it. A texel straddling an edge marches the ray through the
+/// centre of its farther pixels (CpuCloudRenderer::FootprintFarthest), and the spatial weight is
+/// a tent around where that ray crossed, so the sky pixels beside the monolith take the march
+/// that went through them.
+/// Stretch is the bilinear stretch of the widened march the merge did before.
+/// </summary>
+namespace bilateralupsample {
+
+    // the UPSAMPLE_* defines of MergePrimitiveAndCloud.hlsl
+    struct Params {
+        float depthEpsilon_ = 0.01f;    // UPSAMPLE_DEPTH_EPSILON, relative depth difference that halves the weight of a texel
+        float tentFloor_ = 1.0f / 1024.0f; // UPSAMPLE_TENT_FLOOR, least spatial weight so a pixel whose texels all moved their rays away keeps one
+    };
+
+    // cloud is the march at any size without the primitive footprint, primitive holds the
+    // reversed z of the screen in depth_. out gets the size of primitive: the cloud in front of
+    // the primitives in color_, their depth in depth_
+    void Upsample(const Params& params, const CpuCloudRendererSettings& settings, const CpuCloudFrame& cloud,
+        const CpuCloudFrame& primitive, CpuCloudFrame& out);
+    // the merge before: cloud colour and depth sampled bilinear, the depth test per screen pixel
+    void Stretch(const CpuCloudFrame& cloud, const CpuCloudFrame& primitive, CpuCloudFrame& out);
+
+    // the default view over 40100.fmap with a monolith, a two pixel pole and a slab reaching into
+    // the clouds, marched at half and a quarter of width x height. mean rgba error of Stretch and
+    // Upsample against full resolution marches of every primitive depth over the whole screen,
+    // next to the primitive edges on either side and away from them
+    std::string Report(DensityField& field, int width = 128, int height = 72, const std::string& resourceDir = "resources");
+
+} // namespace bilateralupsample
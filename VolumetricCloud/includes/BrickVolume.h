@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "HLSLMath.h"
+#include "NoiseBaker.h"
+
+// build settings of a BrickVolume
+struct BrickVolumeSettings {
+    int brickSize_ = 8;
+
+    // max abs difference (0-1) to treat a brick as uniform or as a copy of another
+    float uniformError_ = 1.0f / 255.0f;
+    float dedupError_ = 1.0f / 255.0f;
+
+    // per channel, values at or below are stored as 0.
+    // safe when the shader RemapClamps the channel with a lower bound above it.
+    float zeroBelow_[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+};
+
+/// <summary>
+/// Sparse brick storage of an RGBA8 noise volume.
+/// The volume is cut into bricks of brickSize_^3 texels. Each brick is either uniform
+/// (one RGBA8 value kept in the page table) or points at a brick in the atlas.
+/// Equal and near-equal bricks share one atlas brick.
+/// Atlas bricks carry a one texel apron copied with wrap addressing, so hardware
+/// trilinear filtering inside a brick matches filtering the dense tiling volume.
+/// </summary>
+class BrickVolume {
+public:
+    using Settings = BrickVolumeSettings;
+
+    // page table entry, mirrored by the R32G32_UINT indirection texture
+    struct PageEntry {
+        uint32_t brick_ = kUniformBrick; // atlas brick index or kUniformBrick
+        uint32_t value_ = 0;             // packed RGBA8 of a uniform brick
+    };
+
+    struct Stats {
+        int bricks_ = 0;
+        int uniformBricks_ = 0;
+        int dedupedBricks_ = 0;
+        int atlasBricks_ = 0;
+        size_t denseBytes_ = 0;
+        size_t sparseBytes_ = 0;
+        float maxError_ = 0.0f; // vs the dense source, filled by Validate
+        float exportError_ = 0.0f; // SampleExported vs the dense source, filled by Validate
+    };
+
+    static const uint32_t kUniformBrick = 0xFFFFFFFFu;
+    static const int kApron = 1;
+
+    Settings settings_;
+    int width_ = 0;
+    int height_ = 0;
+    int depth_ = 0;
+    int pagesX_ = 0;
+    int pagesY_ = 0;
+    int pagesZ_ = 0;
+
+    std::vector<PageEntry> pages_;
+
+    // atlas bricks one after another, (brickSize_ + 2 * kApron)^3 RGBA8 texels each
+    std::vector<uint8_t> bricks_;
+
+    Stats stats_;
+
+    // frame 0 of the volume is stored, the size has to be a multiple of the brick size
+    bool Build(const NoiseVolume& volume, const Settings& settings);
+
+    int StoredBrickSize() const { return settings_.brickSize_ + 2 * kApron; }
+    size_t StoredBrickBytes() const { return static_cast<size_t>(StoredBrickSize()) * StoredBrickSize() * StoredBrickSize() * 4; }
+    int AtlasBrickCount() const { return static_cast<int>(bricks_.size() / (std::max)(static_cast<size_t>(1), StoredBrickBytes())); }
+
+    // texel fetch with wrap addressing
+    hlsl::float4 Load(int x, int y, int z) const;
+
+    // what the GPU does: page lookup, then trilinear inside the atlas brick with the apron.
+    // uvw with wrap addressing, texel centers at (i + 0.5) / size like the noise sampler.
+    hlsl::float4 Sample(const hlsl::float3& uvw) const;
+
+    // trilinear wrap sampling of the dense volume for reference
+    static hlsl::float4 SampleDense(const NoiseVolume& volume, const hlsl::float3& uvw);
+
+    // max abs error of Load and Sample against the dense source, stored in stats_.maxError_,
+    // and of SampleExported on the exported textures in stats_.exportError_
+    float Validate(const NoiseVolume& volume, int samples = 1 << 16);
+
+    // GPU export: indirection texture (pagesX_ x pagesY_ x pagesZ_, R32G32_UINT)
+    // and the atlas as a 3D texture of atlasBricks bricks along x/y/z (RGBA8)
+    void ExportIndirection(std::vector<uint32_t>& texels) const;
+    void ExportAtlas(std::vector<uint8_t>& texels, int& atlasBricksX, int& atlasBricksY, int& atlasBricksZ) const;
+
+    // SampleBrickVolume of BrickVolume.hlsl on the exported textures, the atlas filtered like
+    // a linear clamp sampler
+    hlsl::float4 SampleExported(const std::vector<uint32_t>& indirection, const std::vector<uint8_t>& atlas,
+        int atlasBricksX, int atlasBricksY, int atlasBricksZ, const hlsl::float3& uvw) const;
+
+    // memory saved on the shipped recipes, one line per recipe, PASS when Sample and the
+    // exported textures stay within the brick error on all of them
+    static std::string Report(int resolution = 256, const Settings& settings = Settings());
+};
@@ -22,13 +22,19 @@ public:
         XMMATRIX view; // 4 x 4 = 16 floats
         XMMATRIX projection; // 4 x 4 = 16 floats
         XMMATRIX invViewProjMatrix; // 4 x 4 = 16 floats
-        XMMATRIX previousViewProjectionMatrix; // 4 x 4 = 16 floats
+        XMMATRIX previousViewProjectionMatrix; // 4 x 4 = 16 floats, camera relative position of this frame to the clip space of the frame before
         XMVECTOR cameraPosition; // 4 floats
         XMFLOAT2 resolution; // 2 float
-		XMFLOAT2 padding1; // 2 float
+		XMFLOAT2 history; // 2 float, x: 1 when there is a frame before, y: frame index
     };
 
-    XMMATRIX lastViewProjectionMatrix_ = XMMatrixPerspectiveFovLH(1.0, 1.0, 0.1, 100);
+    // camera relative view * projection and eye of the last UpdateBuffer, and of the frame drawn before
+    XMMATRIX viewProjectionMatrix_ = XMMatrixIdentity();
+    XMVECTOR bufferEyePos_ = XMVectorZero();
+    XMMATRIX lastViewProjectionMatrix_ = XMMatrixIdentity();
+    XMVECTOR lastEyePos_ = XMVectorZero();
+    bool hasLastFrame_ = false;
+    UINT frameIndex_ = 0;
 
 	Camera(float fov, float nearZ, float farZ, float al, float ez, float dist) : 
 		eyePos_(XMVectorSet(0.0f, 0.0f, 0.0f, 1.0f)),
@@ -61,6 +67,8 @@ public:
     void Init();
     void UpdateBuffer(UINT width, UINT height);
     void UpdateEyePosition();
+    // after the frame is drawn: the camera of the last UpdateBuffer becomes the one of the history
+    void EndFrame();
 
     void LookAt(const XMVECTOR& origin) { lookAtPos_ = origin; }
     void MoveTo(const XMVECTOR& origin) { eyePos_ = origin; }
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "HLSLMath.h"
+
+#ifdef _WIN32
+#include <d3d11.h>
+#include <wrl/client.h>
+#include "Renderer.h"
+#endif
+
+namespace cloudbvh {
+
+    using namespace hlsl;
+    using uint = uint32_t;
+
+#include "../shaders/CloudBvh.hlsl"
+
+    static_assert(sizeof(CloudBvhNode) == 32, "CloudBvhNode has to match the StructuredBuffer layout");
+
+} // namespace cloudbvh
+
+// build settings of a CloudBvh
+struct CloudBvhSettings {
+    int leafSize_ = 4;             // leaves hold at most this many instances unless the depth runs out
+    int bins_ = 16;                // SAH buckets per axis
+    float traversalCost_ = 1.0f;   // a node visit in sphere tests
+    float rebuildRatio_ = 1.5f;    // NeedsRebuild once refits grew the SAH cost by this factor
+};
+
+/// <summary>
+/// Bounding volume hierarchy over cumulus instances (sphere center xyz, radius w).
+/// Built top down with binned SAH and flattened depth first, an interior node is followed
+/// by its first child and stores the index of the second, the layout CloudBvh.hlsl
+/// traverses with a fixed stack. The depth is capped at CLOUD_BVH_STACK.
+/// Drifting clouds keep the topology and only refit the boxes bottom up; the SAH cost is
+/// tracked so the caller knows when the tree got loose enough to rebuild.
+/// The instances are reordered so every leaf reads a contiguous range.
+/// </summary>
+class CloudBvh {
+public:
+    using Settings = CloudBvhSettings;
+    using Node = cloudbvh::CloudBvhNode;
+
+    // a sphere the segment passes through, in segment distance
+    struct Hit {
+        int instance_ = 0; // index in the array given to Build
+        float enter_ = 0.0f;
+        float exit_ = 0.0f;
+    };
+
+    Settings settings_;
+    std::vector<Node> nodes_;
+    std::vector<hlsl::float4> instances_; // in leaf order, cloudInstances in the shader
+    std::vector<int> order_;              // leaf order -> index given to Build
+
+    bool Build(std::span<const hlsl::float4> instances, const Settings& settings = Settings());
+
+    // new positions and radii of the instances given to Build, same count and order.
+    // keeps the tree and grows or shrinks the boxes.
+    bool Refit(std::span<const hlsl::float4> instances);
+
+    // expected cost of a random ray, the sum of node areas over the root area
+    float SahCost() const;
+    bool NeedsRebuild() const { return SahCost() > buildSahCost_ * settings_.rebuildRatio_; }
+
+    int Depth() const { return depth_; }
+    float BuildMs() const { return buildMs_; }
+
+    // signed distance to the nearest sphere, maxDistance when none is closer
+    float Distance(const hlsl::float3& pos, float maxDistance = 1e30f, int* visits = nullptr) const;
+
+    // spheres on the segment origin + dir * [0, tMax], dir normalized
+    void Intersect(const hlsl::float3& origin, const hlsl::float3& dir, float tMax, std::vector<Hit>& hits, int* visits = nullptr) const;
+
+    // LOS from -> to through spheres of constant extinction (1 / m)
+    float Transmittance(const hlsl::float3& from, const hlsl::float3& to, float extinction) const;
+
+    // build, refit and query times at the given instance counts, checked against brute force,
+    // PASS without mismatches
+    static std::string Benchmark(std::span<const int> counts);
+
+#ifdef _WIN32
+    // StructuredBuffers t12 (nodes) and t13 (instances) of RayMarch.hlsl
+    ComPtr<ID3D11Buffer> nodeBuffer_;
+    ComPtr<ID3D11ShaderResourceView> nodeSRV_;
+    ComPtr<ID3D11Buffer> instanceBuffer_;
+    ComPtr<ID3D11ShaderResourceView> instanceSRV_;
+
+    bool CreateBuffers();
+    // after Refit, the sizes did not change
+    void UpdateBuffers();
+#endif
+
+private:
+    float buildSahCost_ = 0.0f;
+    float buildMs_ = 0.0f;
+    int depth_ = 0;
+
+    int BuildNode(std::vector<int>& indices, int begin, int end, const std::vector<hlsl::float3>& centers,
+        std::span<const hlsl::float4> instances, int depth);
+};
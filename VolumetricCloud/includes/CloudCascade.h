@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class DensityField;
+struct CpuCloudFrame;
+struct CpuCloudRendererSettings;
+
+/// <summary>
+/// Distance bands of the cloud march. Every cascade marches the ray lengths from start_ to
+/// end_ into its own target (cCascade_ of RayMarch.hlsl, Raymarch::SetCascade), at its own size
+/// against the near target and with its own step budget, the maxStep the empty step of RayMarch
+/// is spread over. The merge lays them over each other front to back with the transmittance of
+/// the nearer band: rgb is the scattered light in front of everything behind, a = 1 -
+/// transmittance, so near + (1 - near.a) * far is the march over both bands. The near band
+/// keeps the jitter and the reprojected history, the far band is small, marched every few
+/// frames and whenever the view turned too far since, and holds still between its updates.
+/// CpuCloudRenderer marches a band with inStart_, inEnd_ and stepBudget_ of its settings.
+/// </summary>
+namespace cloudcascade {
+
+    // one band, the row of the cascade table VolumetricCloud.cpp renders
+    struct Cascade {
+        float start_ = 0.0f;        // ray length the band starts at, meters
+        float end_ = 0.0f;          // and ends at, the atmosphere exit when that comes first
+        float scale_ = 1.0f;        // target size against the near target
+        int stepBudget_ = 2000;     // maxStep of RayMarch
+        int updateInterval_ = 1;    // frames from one march of the band to the next
+        float maxTurnDeg_ = 180.0f; // turn of the view direction since the last march that forces one
+        bool history_ = true;       // TemporalJitter and the history blend of StartRayMarch
+    };
+
+    // near: full size up to MAX_LENGTH * 0.10 with the history. far: half size up to
+    // MAX_LENGTH, a quarter of the budget, every 4th frame or after a 2 degree turn
+    std::vector<Cascade> DefaultCascades();
+
+    // whether the band has to be marched this frame, framesSinceUpdate counts from its last march
+    bool Due(const Cascade& cascade, uint32_t framesSinceUpdate, float turnedDeg);
+
+    // the settings a CpuCloudRenderer marches the band with, near is the full size image
+    CpuCloudRendererSettings BandSettings(const Cascade& cascade, const CpuCloudRendererSettings& near);
+
+    // bands front to back at any size, the merge reads the farther ones through its linear
+    // clamped sampler. out gets the size of the first, the depth of the nearest band that hit
+    void Composite(const std::vector<const CpuCloudFrame*>& bands, CpuCloudFrame& out);
+
+    // a cruise view inside the layers of 40100.fmap: the bands at the near settings composited
+    // against one march over the whole ray, DefaultCascades against it with the march steps of a
+    // frame, and the far band of 4 frames earlier at cruise speed and a small turn
+    std::string Report(DensityField& field, int width = 160, int height = 90, const std::string& resourceDir = "resources");
+
+} // namespace cloudcascade
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <span>
+#include <vector>
+
+#include "HLSLMath.h"
+
+class HeightProfileLut;
+
+/// <summary>
+/// C++ port of CloudDensity in RayMarch.hlsl.
+/// The shader is split in two: where the textures are sampled (the *UV helpers below)
+/// and the remap chain that turns the samples into a density. Keeping the chain free of
+/// texture access lets tools feed it with any noise source, quantized or not.
+/// The layers are data: a table of CloudLayerDesc, the struct RayMarch.hlsl reads.
+/// </summary>
+namespace clouddensity {
+
+    using namespace hlsl;
+
+#include "../shaders/CloudLayer.hlsl"
+
+    static_assert(sizeof(CloudLayerDesc) == 64, "CloudLayerDesc has to match the StructuredBuffer layout");
+
+    static const float NM_TO_M = 1852.0f;
+    static const float FT_TO_M = 0.3048f;
+
+    // world extent of the weather map and scale of the detail noise lookup in CloudDensity
+    static const float FMAP_EXTENT_M = 1000.0f * 16.0f * 64.0f;
+    static const float LARGE_NOISE_SCALE = 1.0f / (1000.0f * 16.0f);
+    static const float SMALL_NOISE_SCALE = 1.5f / NM_TO_M;
+
+    // CloudDensity returns finaldense / DENSITY_DIVISOR, used as extinction per meter
+    static const float DENSITY_DIVISOR = 64.0f;
+
+    // the band of a layer before CloudLayerSlabs narrows it to a weather map
+    static const float kUnboundedSlab = 1e20f;
+
+    // the two layers CloudDensity had hard coded
+    static const CloudLayerDesc kCumulusLayer = {
+        float4(1.0f, 0.0f, 500.0f, 2000.0f),
+        float4(0.75f, 0.0f, 0.2f, 0.35f),
+        float4(1.0f, 0.2f, 0.8f, 1.0f),
+        float4(LARGE_NOISE_SCALE, 0.0f, -kUnboundedSlab, kUnboundedSlab) };
+    static const CloudLayerDesc kCirrusLayer = {
+        float4(1.0f, 5000.0f, 10.0f, 500.0f),
+        float4(0.5f, 0.0f, 0.2f, 0.0f),
+        float4(1.0f, 0.2f, 0.8f, 1.0f),
+        float4(LARGE_NOISE_SCALE, 0.5f, -kUnboundedSlab, kUnboundedSlab) };
+
+    // flat stratus at a fixed altitude (Fmap::stratusAltFair_ / stratusAltIncl_). the fair
+    // layer shows everywhere at low coverage, the inclement one follows fmap.r.
+    CloudLayerDesc StratusLayer(float altitudeFt, bool inclement);
+
+    // cumulus and cirrus, what CloudDensity rendered before the table
+    std::vector<CloudLayerDesc> DefaultLayers();
+
+    // narrows the altitude band of every layer to what the weather texels can reach
+    void CloudLayerSlabs(std::span<CloudLayerDesc> layers, std::span<const float4> weather);
+
+    // layer geometry at one weather sample
+    inline float LayerBottomMeter(const CloudLayerDesc& layer, const float4& fmap) { return (fmap.z * layer.altitude_.x + layer.altitude_.y) * FT_TO_M; }
+    inline float LayerThickness(const CloudLayerDesc& layer, const float4& fmap) { return layer.altitude_.z + layer.altitude_.w * fmap.y; }
+    inline bool LayerInSlab(const CloudLayerDesc& layer, float rayHeightMeter) { return rayHeightMeter >= layer.noise_.z && rayHeightMeter <= layer.noise_.w; }
+
+    // texture samples for one position. layer noise after the noise sequence blend, only
+    // filled for layers whose slab holds the position.
+    struct DensitySamples {
+        float4 fmap_;
+        float4 layerNoise_[CLOUD_LAYER_MAX];
+        float4 smallNoise_;
+    };
+
+    // world position (y down, meters) -> texture coordinates of CloudDensity
+    inline float2 FmapUV(const float3& pos) { return float2(pos.x / FMAP_EXTENT_M + 0.5f, pos.z / FMAP_EXTENT_M + 0.5f); }
+    inline float3 LayerNoiseUVW(const CloudLayerDesc& layer, const float3& pos) { return pos * layer.noise_.x + layer.noise_.y; }
+    inline float3 SmallNoiseUVW(const float3& pos) { return pos * SMALL_NOISE_SCALE; }
+
+    // DISTANCE_CLOUD in CommonFunctions.hlsl
+    inline float DistanceCloud(float pos, float bottom, float thickness) {
+        return (std::min)(std::fabs(pos - bottom), std::fabs(pos - bottom) - thickness);
+    }
+
+    // the height terms of one layer: layerShape (x) and the anvil exponent (y)
+    inline float2 LayerProfile(const CloudLayerDesc& layer, float height) {
+        const float peak = layer.coverage_.z;
+        const float layerShape = RemapClamp(height, 0.00f, peak, 0.0f, 1.0f) * RemapClamp(height, peak, 1.00f, 1.0f, 0.0f);
+        // cumulus anvil
+        const float anvil = layer.anvil_.x;
+        const float slope = layer.anvil_.y;
+        const float bottomWide = layer.anvil_.z;
+        return float2(layerShape, RemapClamp(1.0f - height, slope, bottomWide, 1.0f, lerp(1.0f, 0.5f, anvil)));
+    }
+
+    // the remap chain of one layer, height is the normalized height inside it
+    float LayerDensity(const CloudLayerDesc& layer, float height, float poor, const float4& noise, bool lowFreq);
+    // the same with the height terms of LayerProfile or a HeightProfileLut fetch
+    float LayerDensity(const CloudLayerDesc& layer, const float2& profile, float poor, const float4& noise, bool lowFreq);
+
+    // the remap chain of CloudDensity, distance is the DISTANCE_CLOUD estimate.
+    // with profiles the height terms come from the table (USE_HEIGHT_PROFILE_LUT).
+    float CloudDensityFromSamples(float rayHeightMeter, const DensitySamples& samples, std::span<const CloudLayerDesc> layers, float& distance,
+        bool lowFreq = false, const HeightProfileLut* profiles = nullptr);
+
+} // namespace clouddensity
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "CpuCloudRenderer.h"
+#include "HLSLMath.h"
+
+#ifdef _WIN32
+#include <d3d11.h>
+#include <wrl/client.h>
+#include "Renderer.h"
+#endif
+
+class DensityField;
+
+namespace cloudreconstruct {
+
+    using namespace hlsl;
+
+#include "../shaders/CloudReconstruct.hlsl"
+
+    static_assert(sizeof(CloudReconstructDesc) == 160, "CloudReconstructDesc has to match the cbuffer layout");
+
+} // namespace cloudreconstruct
+
+// interleave pattern and history rejection of a CloudReconstruct
+struct CloudReconstructSettings {
+    int pattern_ = 2;               // one pixel of every pattern x pattern block is marched per frame, 2 or 4
+    float depthTolerance_ = 0.5f;   // history rejected this far outside the depth range of the fresh samples, relative
+    bool clamp_ = true;             // keep rejected history clamped to the fresh samples around instead of their blend
+    float clampGamma_ = 1.5f;       // the clamp box is their YCoCg mean +- gamma standard deviations
+};
+
+/// <summary>
+/// Interleaved cloud marching with temporal reconstruction. Every frame the ray marcher only
+/// covers one pixel of each pattern x pattern block, the block pixel rotates in Bayer order
+/// so pattern^2 frames visit all of them. CSCloudReconstruct of CloudReconstruct.hlsl builds
+/// the full resolution buffer: a pixel marched this frame is copied, any other pixel reprojects
+/// the depth of its nearest fresh sample into the history and takes the history there. When it
+/// lands on a different depth (disocclusion) the history is clamped to a YCoCg variance box of
+/// the four fresh samples around it, off screen it falls back to their bilinear blend; accepted
+/// history is not clamped, Report shows that costs error on every path. The output is the
+/// history of the next frame.
+/// Reconstruct is the CPU reference of the pass over CpuCloudRenderer frames; Report flies a
+/// camera through the shipped weather and compares against full marches every frame.
+/// No D3D is needed outside the _WIN32 section.
+/// </summary>
+class CloudReconstruct {
+public:
+    using Settings = CloudReconstructSettings;
+    using Desc = cloudreconstruct::CloudReconstructDesc;
+
+    Settings settings_;
+
+    // full resolution, a multiple of the pattern
+    bool Initialize(const Settings& settings, int width, int height);
+
+    // block pixel marched on frame, Bayer order
+    static void Phase(uint32_t frame, int pattern, int& x, int& y);
+
+    int Width() const { return width_; }
+    int Height() const { return height_; }
+    int SparseWidth() const { return width_ / settings_.pattern_; }
+    int SparseHeight() const { return height_ / settings_.pattern_; }
+
+    // the next frame with its camera, the previous camera becomes the one of the history.
+    // vFovDeg, near and far like Camera
+    void BeginFrame(const hlsl::float3& eye, const hlsl::float3& lookAt, float vFovDeg, float nearZ, float farZ);
+    // the history is dropped, the next frame is reconstructed from its fresh samples only
+    void Reset() { historyValid_ = false; }
+
+    const Desc& GetDesc() const { return desc_; }
+    // position of the marched ray inside its pixel of the sparse target, 0.5 is the centre:
+    // CpuCloudRendererSettings::pixelCenter_, Raymarch::SetPixelOffset takes it minus 0.5
+    hlsl::float2 PixelCenter() const;
+
+    // CPU reference of CSCloudReconstruct. sparse is the SparseWidth x SparseHeight march of
+    // this frame, out the full resolution result, which is kept as the history
+    void Reconstruct(const CpuCloudFrame& sparse, CpuCloudFrame& out);
+
+    // pixels of the last Reconstruct
+    struct Stats {
+        int fresh_ = 0;
+        int history_ = 0;
+        int spatial_ = 0;           // history off screen or rejected
+    };
+    const Stats& LastStats() const { return stats_; }
+
+    // fast flight over 40100.fmap: every frame a full march and the interleaved one are drawn
+    // with CpuCloudRenderer, the reconstruction is compared with the full frame next to the
+    // march steps both took, for 1/4 and 1/16, without the clamp and without history
+    static std::string Report(DensityField& field, int width = 128, int height = 72, int frames = 24,
+        const std::string& resourceDir = "resources");
+
+#ifdef _WIN32
+    // full resolution results, ping-pong: the one written this frame and the history it read
+    ComPtr<ID3D11Texture2D> colorTEX_[2];
+    ComPtr<ID3D11ShaderResourceView> colorSRV_[2];
+    ComPtr<ID3D11UnorderedAccessView> colorUAV_[2];
+    ComPtr<ID3D11Texture2D> depthTEX_[2];
+    ComPtr<ID3D11ShaderResourceView> depthSRV_[2];
+    ComPtr<ID3D11UnorderedAccessView> depthUAV_[2];
+    ComPtr<ID3D11Buffer> descBuffer_;
+    ComPtr<ID3D11ComputeShader> computeShader_;
+
+    bool CreateResources();
+    // after BeginFrame and the march of the sparse target (colour, the depth in r)
+    void Dispatch(ID3D11ShaderResourceView* sparseColor, ID3D11ShaderResourceView* sparseDepth);
+    // written by the last Dispatch, R8G8B8A8_UNORM and R32_FLOAT like the full march
+    ID3D11ShaderResourceView* ColorSRV() const { return colorSRV_[current_].Get(); }
+    ID3D11ShaderResourceView* DepthSRV() const { return depthSRV_[current_].Get(); }
+#endif
+
+private:
+    int width_ = 0;
+    int height_ = 0;
+    uint32_t frame_ = 0;
+    bool historyValid_ = false;
+    bool cameraValid_ = false;
+    int current_ = 0;
+    Desc desc_ = {};
+    CpuCloudFrame history_;
+    Stats stats_;
+};
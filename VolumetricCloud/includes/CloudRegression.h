@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CpuCloudRenderer.h"
+#include "HLSLMath.h"
+
+class DensityField;
+
+// image size and pass thresholds of a CloudRegression run
+struct CloudRegressionSettings {
+    int width_ = 64;
+    int height_ = 36;
+    double seconds_ = 10.0;          // DensityField::SetTime of every case, the noise drifts
+
+    // look: a case fails below the SSIM or above either colour error, rgba absolute
+    float minSsim_ = 0.98f;
+    float maxMeanAbs_ = 0.01f;
+    float maxP99Abs_ = 0.05f;
+    float maxDepthMismatch_ = 0.01f; // share of pixels that hit cloud in one image only
+
+    // cost: march steps per pixel against the golden, wall time against the machine baseline
+    float maxStepGrowth_ = 1.10f;
+    double speedRegression_ = 0.8;   // flagged below this fraction of the baseline speed
+};
+
+/// <summary>
+/// Golden image and cost regression suite of the cloud pipeline, no GPU needed.
+/// A fixed set of camera poses over the shipped weather maps is drawn with CpuCloudRenderer,
+/// the pixels are compared against golden images kept in resources/ (SSIM of the tone mapped
+/// luminance and rgba absolute errors) and the march steps and density samples per pixel
+/// against the ones stored with the goldens. Wall times are compared with a per machine
+/// baseline that the first run on a machine writes, like NoiseParity.
+/// Run writes a JSON report next to the baseline for tracking over time.
+/// </summary>
+class CloudRegression {
+public:
+    using Settings = CloudRegressionSettings;
+
+    struct Case {
+        std::string name_;
+        std::string fmap_;          // file name in the resource directory
+        CpuCloudView view_;
+    };
+
+    struct CaseResult {
+        std::string name_;
+        float ssim_ = 0.0f;
+        float meanAbs_ = 0.0f;
+        float p99Abs_ = 0.0f;
+        float maxAbs_ = 0.0f;
+        float depthMismatch_ = 0.0f;
+        double samplesPerPixel_ = 0.0;
+        double stepsPerPixel_ = 0.0;
+        double goldenStepsPerPixel_ = 0.0;
+        double ms_ = 0.0;
+        double baselineMs_ = 0.0;
+        bool lookRegressed_ = false;
+        bool costRegressed_ = false;
+        bool speedRegressed_ = false;
+        std::string error_;
+
+        bool Passed() const { return error_.empty() && !lookRegressed_ && !costRegressed_ && !speedRegressed_; }
+    };
+
+    struct Report {
+        std::vector<CaseResult> cases_;
+        std::string error_;
+
+        bool Passed() const;
+        std::string ToString() const;
+        std::string ToJson() const;
+    };
+
+    struct GoldenImage {
+        std::string name_;
+        int width_ = 0;
+        int height_ = 0;
+        double stepsPerPixel_ = 0.0;
+        double samplesPerPixel_ = 0.0;
+        std::vector<hlsl::float4> color_;
+        std::vector<float> depth_;
+    };
+
+    static const uint32_t kGoldenVersion = 1;
+
+    // three poses over each of the three shipped weather maps
+    static std::vector<Case> Cases();
+
+    static bool SaveGolden(const std::string& path, const std::vector<GoldenImage>& golden);
+    static bool LoadGolden(const std::string& path, std::vector<GoldenImage>& golden);
+
+    // renders every case and writes the goldens, after an intended change of the look
+    static bool WriteGolden(DensityField& field, const Settings& settings = Settings(), const std::string& resourceDir = "resources",
+        const std::string& goldenPath = "resources/CloudRegression.golden");
+
+    // renders and compares every case. the field only needs its noise, the weather and the
+    // time are set per case
+    static Report Run(DensityField& field, const Settings& settings = Settings(), const std::string& resourceDir = "resources",
+        const std::string& goldenPath = "resources/CloudRegression.golden",
+        const std::string& baselinePath = "cache/CloudRegression.bench",
+        const std::string& reportPath = "cache/CloudRegression.json");
+
+    // mean SSIM of 8x8 windows over the luminance, tone mapped like SkyRay (1 - exp(-x))
+    static float Ssim(const std::vector<hlsl::float4>& a, const std::vector<hlsl::float4>& b, int width, int height);
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "DensityField.h"
+#include "HLSLMath.h"
+#include "OccupancyGrid.h"
+
+#ifdef _WIN32
+#include <d3d11.h>
+#include <wrl/client.h>
+#include "Renderer.h"
+#endif
+
+// build settings of a CloudSdf
+struct CloudSdfSettings {
+    float threshold_ = 0.0f;        // distance to density > threshold (CloudDensity units)
+    float maxDistance_ = 65535.0f;  // meters at R16 1.0, SDF_MAX_DISTANCE in RayMarch.hlsl
+    OccupancyGridSettings grid_;    // voxels are the level 0 cells of this grid
+};
+
+/// <summary>
+/// Conservative distance from every voxel to the cloud, stored as an R16_UNORM volume.
+/// The voxels are the level 0 cells of an OccupancyGrid: a voxel is solid when its
+/// density bound exceeds the threshold, and every voxel keeps the exact distance from its
+/// box to the nearest solid box. So the value is a safe sphere tracing step from any point
+/// in the voxel, also along the curved rays of the pixel marcher (arc length >= chord).
+/// The transform runs per axis (x, z, altitude) on the thread pool: a one voxel min filter
+/// turns the center distance into the box distance, then the lower envelope of parabolas
+/// gives the exact squared distance. x and z wrap like the weather map.
+/// Build is cheap enough to run per weather snapshot, BuildAsync moves it off the caller.
+/// </summary>
+class CloudSdf {
+public:
+    using Settings = CloudSdfSettings;
+
+    Settings settings_;
+    int sizeX_ = 0;
+    int sizeY_ = 0; // altitude
+    int sizeZ_ = 0;
+    std::vector<uint16_t> distance_; // x fastest, then z, then altitude, like the 3D texture
+
+    // voxelizes the bounds of grid level 0, the grid has to be built
+    bool Build(const OccupancyGrid& grid, const Settings& settings = Settings());
+
+    // builds the grid and the distances of one weather snapshot on a worker thread
+    static std::future<CloudSdf> BuildAsync(int weatherWidth, int weatherHeight, std::vector<hlsl::float4> weather, NoiseBounds noise, Settings settings = Settings());
+
+    // safe step in meters at a world position, 0 outside the volume
+    float Distance(const hlsl::float3& pos) const;
+
+    // the CPU marcher: 50 m steps (the near branch of misStep in RayMarch) or DISTANCE_CLOUD,
+    // and with useSdf at least the volume distance. skipped cloud samples go to violations.
+    int MarchSteps(const DensityField& field, const hlsl::float3& origin, const hlsl::float3& dir, float tMax, bool useSdf, int* violations = nullptr) const;
+
+    // mean step count with and without the volume on random view rays
+    std::string Report(const DensityField& field, int rays = 256) const;
+
+#ifdef _WIN32
+    // R16_UNORM Texture3D (x, z, altitude), t9 of RayMarch.hlsl
+    ComPtr<ID3D11Texture3D> sdfTEX_;
+    ComPtr<ID3D11ShaderResourceView> sdfSRV_;
+
+    bool CreateTexture();
+    void UpdateTexture();
+#endif
+
+private:
+    int weatherWidth_ = 0;
+    int weatherHeight_ = 0;
+    float buildMs_ = 0.0f;
+
+    size_t Index(int x, int y, int z) const { return (static_cast<size_t>(y) * sizeZ_ + z) * sizeX_ + x; }
+};
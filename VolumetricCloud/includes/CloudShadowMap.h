@@ -0,0 +1,135 @@
+#pragma once
+
+#include <future>
+#include <string>
+#include <vector>
+
+#include "HLSLMath.h"
+
+#ifdef _WIN32
+#include <d3d11.h>
+#include <wrl/client.h>
+#include "Renderer.h"
+#endif
+
+class DensityField;
+class DensityPacket;
+
+namespace cloudshadowmap {
+
+    using namespace hlsl;
+
+#include "../shaders/CloudShadowMap.hlsl"
+
+    static_assert(sizeof(CloudShadowMapDesc) == 48, "CloudShadowMapDesc has to match the StructuredBuffer layout");
+
+} // namespace cloudshadowmap
+
+// layout, quality and refresh rules of a CloudShadowMap
+struct CloudShadowMapSettings {
+    int resolution_ = 192;          // texels along x and z
+    float texelSize_ = 48.0f;       // meters
+    float altitudeMin_ = 0.0f;      // the altitude band in meters, the app sets DensityClipmap::AltitudeBand of the layers
+    float altitudeMax_ = 16000.0f;
+    int knots_ = 256;               // optical depth knots per column, a multiple of 4
+    int samplesPerKnot_ = 2;        // density samples between two knots
+    float minElevationDeg_ = 5.0f;  // lower suns are baked at this elevation, the shear grows without bound
+    int rowsPerStep_ = 8;           // rows baked per Step
+    float recenterRatio_ = 0.25f;   // NeedsRefresh once the camera moved this share of the map
+    float sunAngleDeg_ = 1.0f;      // or the sun moved this much
+    float refreshSeconds_ = 4.0f;   // or the last pass started this long ago, the noise drifts
+};
+
+/// <summary>
+/// Top-down cloud shadow map: a camera centred grid of columns along the sun direction,
+/// each holding the optical depth up to the top of the cloud band at knots_ evenly spaced
+/// altitudes. The columns are sheared by the sun, a position finds its column by following
+/// the sun line to the band bottom, so the transmittance toward the sun from any position
+/// (a cloud sample, the ground) is an altitude lerp of two knots of one texel, one or two
+/// fetches with four knots per slice of an RGBA texture array.
+/// Baked with the packet kernel, rowsPerStep_ rows per Step into a back buffer that
+/// replaces the front one when the pass is done. BeginAsync runs the Steps of a pass on a
+/// worker thread with a copy of the field, PickUp swaps the result in.
+/// No D3D is needed outside the _WIN32 section.
+/// </summary>
+class CloudShadowMap {
+public:
+    using Settings = CloudShadowMapSettings;
+    using Desc = cloudshadowmap::CloudShadowMapDesc;
+
+    Settings settings_;
+
+    bool Initialize(const Settings& settings = Settings());
+
+    // starts a pass centred on center for the direction toward the sun (y down like the
+    // ray marcher). seconds is the clock NeedsRefresh compares against.
+    void Begin(const hlsl::float3& center, const hlsl::float3& toSun, double seconds = 0.0);
+
+    // bakes the next rows of the pass, true when this finished it and the front map changed
+    bool Step(const DensityPacket& packet);
+
+    // a whole pass at once
+    void Bake(const DensityPacket& packet, const hlsl::float3& center, const hlsl::float3& toSun);
+
+    // Begin and every Step of the pass on a worker thread. field is copied with its weather
+    // and time, the caller may change its own right after
+    void BeginAsync(const DensityField& field, const hlsl::float3& center, const hlsl::float3& toSun, double seconds = 0.0);
+    // true when the worker finished the pass and the front map changed, never waits
+    bool PickUp();
+
+    bool Baking() const { return job_.valid() || nextRow_ < settings_.resolution_; }
+    bool NeedsRefresh(const hlsl::float3& center, const hlsl::float3& toSun, double seconds) const;
+
+    // the StructuredBuffer the shader reads
+    const Desc& GetDesc() const { return desc_; }
+    // knots four per slice, x fastest then z, then slice
+    const std::vector<hlsl::float4>& Texels() const { return front_; }
+
+    // CloudShadowDepth / CloudShadowSegment of CloudShadowMap.hlsl, negative outside the map,
+    // SegmentDepth also below CLOUD_SHADOW_SEGMENT_MIN_UP
+    float OpticalDepth(const hlsl::float3& pos) const;
+    float SegmentDepth(const hlsl::float3& pos, float length) const;
+
+    // plain march of the field from pos toward the sun up to altitudeMax, midpoint rule
+    static float OpticalDepthReference(const DensityField& field, const hlsl::float3& pos, const hlsl::float3& toSun,
+        float length, float altitudeMax, float step = 10.0f);
+
+    // the light segment of a cloud sample may take over from the 8 step light march of
+    // RayMarch once its mean transmittance error is within this factor of the march's
+    static constexpr double kSegmentErrorRatio = 2.0;
+
+    // map lookups against plain marching at random cloud and ground positions for a few
+    // sun elevations, next to the 8 step light march of RayMarch, with bake times. the band
+    // of settings is narrowed to the layers of the field like the app does. passes when the
+    // ground shadow holds, the light segment is within kSegmentErrorRatio of the march for
+    // every sun it is read for and BeginAsync bakes what Bake does
+    static std::string Validate(const DensityField& field, const Settings& settings = Settings(), int samples = 2048);
+
+#ifdef _WIN32
+    // R32G32B32A32_FLOAT Texture2DArray, knots_ / 4 slices, t16 of RayMarch.hlsl and Primitive.hlsl
+    ComPtr<ID3D11Texture2D> shadowTEX_;
+    ComPtr<ID3D11ShaderResourceView> shadowSRV_;
+    // StructuredBuffer<CloudShadowMapDesc>, t17
+    ComPtr<ID3D11Buffer> descBuffer_;
+    ComPtr<ID3D11ShaderResourceView> descSRV_;
+
+    bool CreateResources();
+    // after Step returned true
+    void UpdateTexture();
+#endif
+
+private:
+    std::vector<hlsl::float4> front_;
+    std::vector<hlsl::float4> back_;
+    Desc desc_ = {};
+    Desc passDesc_ = {};
+    hlsl::float3 passCenter_ = hlsl::float3(0.0f);
+    hlsl::float3 passSun_ = hlsl::float3(0.0f, -1.0f, 0.0f);
+    double passSeconds_ = 0.0;
+    int nextRow_ = 0;
+    // the pass of BeginAsync, last so it is waited for before the buffers go
+    std::future<bool> job_;
+
+    void BakeRows(const DensityPacket& packet);
+    float ColumnDepth(int x, int z, float alt) const;
+};
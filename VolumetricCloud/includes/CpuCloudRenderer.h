@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "AdaptiveStep.h"
+#include "HLSLMath.h"
+#include "TemporalReprojection.h"
+#include "ThreadPool.h"
+
+class CloudSdf;
+class CloudShadowMap;
+class DensityField;
+class DepthPyramid;
+class OccupancyGrid;
+
+// image size, tiling and the RayMarch constants of a CpuCloudRenderer
+struct CpuCloudRendererSettings {
+    int width_ = 320;
+    int height_ = 180;
+    int tileSize_ = 16;             // pixels along both sides, tiles are the ParallelFor items
+    float vFovDeg_ = 80.0f;         // the Camera of VolumetricCloud.cpp
+    float near_ = 0.1f;
+    float far_ = 422440.0f;         // also the primitive depth when Sources has none
+    int sunSteps_ = 8;              // PS of RayMarch.hlsl
+    float inStart_ = 0.0f;
+    float inEnd_ = 0.0f;            // above 0 the march ends there too, the band of a cloudcascade::Cascade
+    int stepBudget_ = 2000;         // maxStep of RayMarch, the step budget of the cascade
+    bool primitiveFootprint_ = false; // !USE_BILATERAL_UPSAMPLE: the farthest primitive of the pixel and its
+                                      // four neighbours ends the march instead of its own
+    bool useOccupancy_ = true;      // USE_OCCUPANCY_GRID, when Sources has a grid
+    bool useSdf_ = true;            // USE_CLOUD_SDF, when Sources has a distance volume
+    bool useLightCache_ = true;     // USE_CLOUD_SHADOW_MAP, when Sources has a map
+    bool useDepthPyramid_ = false;  // USE_DEPTH_PYRAMID, when Sources has a pyramid of the primitive depth
+    bool layerCull_ = true;         // the return of RayMarch when the view ray can not reach a layer
+    bool adaptiveStep_ = false;     // USE_ADAPTIVE_STEP, the other reports keep the legacy march
+    adaptivestep::Params adaptive_;
+    float referenceStep_ = 0.0f;    // above 0 every step has this length and there is no step limit,
+                                    // the brute force reference of adaptivestep::Report
+    hlsl::float2 pixelCenter_ = hlsl::float2(0.5f, 0.5f); // where the ray crosses its pixel, CloudReconstruct::PixelCenter
+    bool temporalJitter_ = false;   // USE_TEMPORAL_ACCUMULATION, the ray crosses the pixel at PixelJitter instead of
+                                    // pixelCenter_, its start moves per pixel and frame and its steps are longer
+    uint32_t jitterFrame_ = 0;      // cHistory_.y
+    temporalreprojection::Params temporal_;
+};
+
+// camera and sun of one frame, the values Camera::UpdateBuffer and the environment buffer take
+struct CpuCloudView {
+    hlsl::float3 eye_ = hlsl::float3(-1879.4f, -3724.0f, 0.0f); // Camera::eyePos_
+    hlsl::float3 lookAt_ = hlsl::float3(0.0f, -3040.0f, 0.0f);  // Camera::lookAtPos_
+    hlsl::float3 lightDir_ = hlsl::float3(0.7071f, 0.7071f, 0.0f); // environment::GetLightDir(), y up
+};
+
+struct CpuCloudFrame;
+
+// the CPU copies of the optional volumes RayMarch.hlsl reads, null ones are skipped
+struct CpuCloudSources {
+    const OccupancyGrid* occupancy_ = nullptr;
+    const CloudSdf* sdf_ = nullptr;
+    const CloudShadowMap* shadowMap_ = nullptr;
+    const CpuCloudFrame* primitive_ = nullptr;  // depthTexture, the reversed z of the primitives in depth_, any size
+    const DepthPyramid* depthPyramid_ = nullptr; // depthPyramidTexture, built from primitive_
+};
+
+// output of CpuCloudRenderer::Render, rows top down like the render target
+struct CpuCloudFrame {
+    int width_ = 0;
+    int height_ = 0;
+    std::vector<hlsl::float4> color_;   // linear scattered light in rgb, 1 - transmittance in a
+    std::vector<float> depth_;          // reversed z of the first cloud sample, 0 without cloud
+    int tilesX_ = 0;
+    int tilesY_ = 0;
+    std::vector<float> tileMs_;         // render time of every tile, x fastest
+    uint64_t marchSteps_ = 0;           // iterations of the view ray loops, summed over the pixels
+    uint64_t densitySamples_ = 0;       // density evaluations, the light march included
+    uint64_t culledPixels_ = 0;         // left empty without marching, by layerCull_ or the depth pyramid
+    unsigned threads_ = 0;
+    float totalMs_ = 0.0f;
+};
+
+/// <summary>
+/// Headless port of StartRayMarch / RayMarch for machines without a GPU: mission planner
+/// thumbnails, regression images and offline analysis.
+/// The image is split into square tiles the thread pool hands out one at a time, so tiles
+/// full of cloud do not hold back threads that drew empty sky. Every pixel runs the same
+/// march as the shader: the camera basis and reversed projection of Camera::UpdateBuffer,
+/// DensityField for the noise and weather, the occupancy skip and distance volume steps,
+/// the shadow map / 8 step light chain, the sun colour of
+/// CalculateSunlightColor and the ambient the sky irradiance cube map gives, with the sky
+/// of SkyRay.hlsl evaluated on the CPU. Pixels do not depend on the thread count.
+/// </summary>
+class CpuCloudRenderer {
+public:
+    using Settings = CpuCloudRendererSettings;
+    using View = CpuCloudView;
+    using Sources = CpuCloudSources;
+
+    Settings settings_;
+
+    bool Initialize(const Settings& settings = Settings());
+
+    // draws every tile of the frame on the pool, the field has to be Ready
+    bool Render(const DensityField& field, const View& view, CpuCloudFrame& frame, const Sources& sources = Sources(),
+        ThreadPool& pool = ThreadPool::Shared()) const;
+
+    // the pixel march along any directions from view.eye_ without a primitive, the texels of a
+    // panorama like CSFarCloudCache. color gets one entry per direction, returns the march steps
+    uint64_t March(const DensityField& field, const View& view, const std::vector<hlsl::float3>& dirs,
+        std::vector<hlsl::float4>& color, const Sources& sources = Sources(), ThreadPool& pool = ThreadPool::Shared()) const;
+
+    // primDepth of StartRayMarch with USE_BILATERAL_UPSAMPLE: the smallest reversed depth of the
+    // depth texels the pixel at uv of a width x height target covers, the bilinear read of
+    // depthSampler when it covers no texel centre. centroid gets the mean uv of the texels at
+    // that depth when the others are nearer, uv otherwise: where the ray of the pixel goes
+    static float FootprintFarthest(const CpuCloudFrame& depth, float u, float v, int width, int height, hlsl::float2* centroid = nullptr);
+
+    // Forward, Right and Up of Camera::UpdateBuffer, the axes of XMMatrixLookAtLH
+    static void CameraBasis(const View& view, hlsl::float3& forward, hlsl::float3& right, hlsl::float3& up);
+
+    // SkyRay.hlsl for one direction, the colour the sky cube map holds
+    static hlsl::float3 SkyColor(const hlsl::float3& eye, const hlsl::float3& dir, const hlsl::float3& lightDir);
+    // SampleDiffuseIrradiance of SkyMapIrradiance.hlsl over SkyColor
+    static hlsl::float3 SkyIrradiance(const hlsl::float3& eye, const hlsl::float3& normal, const hlsl::float3& lightDir);
+
+    // portable float map, rgb of the colour (the alpha is dropped) or the depth
+    static bool WriteColorPfm(const CpuCloudFrame& frame, const std::string& path);
+    static bool WriteDepthPfm(const CpuCloudFrame& frame, const std::string& path);
+
+    // renders one frame with 1, 2, 4 .. maxThreads threads (hardware threads when 0): tile
+    // times, scaling efficiency against one thread and whether every image matched
+    static std::string Benchmark(const DensityField& field, const Settings& settings = Settings(), const View& view = View(),
+        const Sources& sources = Sources(), unsigned maxThreads = 0);
+};
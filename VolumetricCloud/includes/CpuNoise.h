@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstdint>
+
+#include "HLSLMath.h"
+
+/// <summary>
+/// C++ ports of the noise functions in FBM.hlsl, FBM2.hlsl and Alligator.hlsl.
+/// Names and argument order follow the shader so the two can be diffed side by side.
+/// Integer hashes are bit exact with the GPU, functions that use sin/cos differ by
+/// the GPU trig precision only.
+/// </summary>
+namespace cpunoise {
+
+    using namespace hlsl;
+
+    static const float PI = 3.14159265359f;
+    static const float TWO_PI = 6.28318530718f;
+
+    // integer hashes
+    uint32_t hash(uint32_t x);
+    float hashToFloat(uint32_t x);
+    uint32_t hash3(uint3 p);
+    uint32_t hash4(uint4 p);
+    float hash01(uint32_t x);
+
+    // gradient noise
+    float fade(float t);
+    float4 grad4(uint4 p);
+    float Perlin4D(float4 p);
+    float PerlinPeriodic(float3 p, int frequency = 1);
+    // CPU only: PerlinPeriodic walking a circle through the 4D domain, loopTime 0 and 1 match
+    float PerlinPeriodicLoop(float3 p, int frequency, float loopTime);
+    float WorleyPeriodic(float3 p, int frequency);
+
+    // Dave_Hoskins hashes and the shadertoy noise built on top of them
+    float3 hash33(float3 p);
+    float hash13(float3 p);
+    float valueNoise(float3 x, float freq);
+    float perlinFbm(float3 p, float freq, int octaves);
+    float worleyFbm(float3 p, float freq, bool tileable);
+    float blueNoise(float3 p, float freq);
+
+    // Alligator.hlsl, its Hash13/Hash33 are the frac based hashes and not the ones above
+    static const float ALLIGATOR_LACUNARITY = 2.0f;
+    static const float ALLIGATOR_PERSISTENCE = 0.5f;
+
+    float SmoothValue(float x);
+    float Hash13(float3 p);
+    float3 Hash33(float3 p);
+    float AlligatorNoiseSingle(float3 position, uint32_t gridsize, uint3 seed, bool tiling);
+    // seed is fixed to 421 in the shader, every octave offsets it by its grid size
+    float AlligatorNoise(float3 position, float gridsize, int octaves, float lacunarity, float persistence, bool tiling,
+                         uint3 seed = uint3(421, 421, 421));
+    float AlligatorNoiseDefault(float3 position);
+
+    // FBM2.hlsl, tiling over [0, 1) at the given integer frequency
+    float PerlinWorleyPeriodic(float3 p, int frequency);
+    float WorleyF2MinusF1(float3 p, int frequency);
+    float AlligatorPeriodic(float3 p, int frequency);
+
+} // namespace cpunoise
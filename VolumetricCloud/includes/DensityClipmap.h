@@ -0,0 +1,164 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <vector>
+
+#include "CloudDensity.h"
+#include "HLSLMath.h"
+
+#ifdef _WIN32
+#include <d3d11.h>
+#include <wrl/client.h>
+#include "Renderer.h"
+#endif
+
+class DensityField;
+class DensityPacket;
+
+namespace densityclipmap {
+
+    using namespace hlsl;
+
+#include "../shaders/DensityClipmap.hlsl"
+
+    static_assert(sizeof(DensityClipmapLevel) == 32, "DensityClipmapLevel has to match the StructuredBuffer layout");
+
+} // namespace densityclipmap
+
+// layout and update budget of a DensityClipmap
+struct DensityClipmapSettings {
+    int levels_ = 5;               // nested levels, each with twice the texel size of the one inside
+    int resolution_ = 128;         // texels along x and z per level
+    int rows_ = 96;                // texels over the altitude band, about 90 m for the layers of a weather map
+    float texelSize_ = 256.0f;     // meters per texel of level 0
+    float altitudeMin_ = 0.0f;     // the altitude band in meters, see AltitudeBand
+    float altitudeMax_ = 16000.0f;
+    int budgetTexels_ = 32768;     // texels refreshed per Update, one strip more when nothing fits
+    bool sweep_ = true;            // spend the leftover budget on the oldest texels, the density drifts with time
+};
+
+/// <summary>
+/// Camera centred clipmap of CloudDensity(pos, .., lowFreq = true): a few nested levels of
+/// resolution_ x resolution_ texel columns around the camera, rows_ texels over the
+/// altitude band of the layers. The levels are stacked along the altitude axis of one
+/// Texture3D (x, z, row) and addressed toroidally: a texel keeps its place while the
+/// window slides, so a camera move only refreshes the strips that scrolled in.
+/// Update plans that work: every level keeps a rect of fresh texels inside its window,
+/// stale strips next to the rect are handed out finest level first until the budget of
+/// the frame is spent. Regions are refreshed by the caller, on the GPU (CSDensityClipmap)
+/// or on the CPU (Fill). No D3D is needed outside the _WIN32 section.
+/// A texel holds two channels: the density at its centre, filtered for the far samples of
+/// the ray marcher, and the densest point of a lattice over its box, read unfiltered. The
+/// low frequency density bounds the full one, so a 0 there lets CloudDensity skip its noise.
+/// </summary>
+class DensityClipmap {
+public:
+    using Settings = DensityClipmapSettings;
+    using Level = densityclipmap::DensityClipmapLevel;
+
+    // world texels [x0_, x1_) x [z0_, z1_) of a level
+    struct Rect {
+        int x0_ = 0;
+        int z0_ = 0;
+        int x1_ = 0;
+        int z1_ = 0;
+
+        bool Empty() const { return x1_ <= x0_ || z1_ <= z0_; }
+        int Area() const { return Empty() ? 0 : (x1_ - x0_) * (z1_ - z0_); }
+        bool operator==(const Rect& other) const = default;
+    };
+
+    // texel columns to evaluate, every row of the altitude band
+    struct Region {
+        int level_ = 0;
+        int x_ = 0;      // first world texel
+        int z_ = 0;
+        int sizeX_ = 0;
+        int sizeZ_ = 0;
+    };
+
+    // Validate tolerances per level. the lattice misses clouds smaller than its spacing,
+    // kMaxSkippedCloud bounds the skipped samples that had cloud
+    static constexpr float kMaxMeanError = 0.02f;
+    static constexpr float kMaxP99Error = 0.35f;
+    static constexpr float kMaxFalseCloud = 0.04f;     // of the samples
+    static constexpr float kMaxSkippedCloud = 0.001f;  // of the skipped samples
+
+    Settings settings_;
+    std::vector<float> texels_; // Fill target, x fastest, then z, then row with the levels stacked
+    std::vector<float> maxTexels_; // the skip channel, laid out like texels_
+
+    bool Initialize(const Settings& settings = Settings());
+    bool Ready() const { return !valid_.empty(); }
+
+    // altitude band in meters every layer can reach, from the slabs CloudLayerSlabs
+    // stores in CloudLayerDesc::noise_.zw
+    static hlsl::float2 AltitudeBand(std::span<const clouddensity::CloudLayerDesc> layers);
+
+    // slides the windows to the camera and returns the regions to refresh this frame.
+    // they count as fresh from here on, the caller has to evaluate them before the next draw.
+    const std::vector<Region>& Update(const hlsl::float3& cameraPos);
+
+    // the weather or the layers changed, every texel is stale
+    void Invalidate();
+
+    const std::vector<Region>& Regions() const { return regions_; }
+    Rect Window(int level) const { return window_[level]; }
+    Rect Valid(int level) const { return valid_[level]; }
+    int StaleTexels() const;
+    float TexelSize(int level) const { return settings_.texelSize_ * static_cast<float>(1 << level); }
+
+    // the StructuredBuffer the shader reads, one entry per level
+    std::vector<Level> Levels() const;
+
+    // toroidal texel of a world texel
+    int Wrap(int i) const { return ((i % settings_.resolution_) + settings_.resolution_) % settings_.resolution_; }
+    size_t TexelIndex(int level, int x, int z, int row) const;
+
+    // evaluates the regions of the last Update into texels_ and maxTexels_ with the packet kernel,
+    // quantized like the R16G16_UNORM texture
+    void Fill(const DensityPacket& packet);
+
+    // ClipmapDensity of RayMarch.hlsl on texels_, negative outside every fresh window
+    float Sample(const hlsl::float3& pos) const;
+
+    // ClipmapMaxDensity of RayMarch.hlsl on maxTexels_, the texel holding pos without filtering
+    float SampleMax(const hlsl::float3& pos) const;
+
+    // camera paths against the update rules: fresh texels hold the world texel they map to,
+    // fresh rects stay inside the windows, the budget holds and a still camera converges
+    static std::string TestUpdates(const Settings& settings = Settings(), int frames = 4096);
+
+    // Sample and SampleMax against the low frequency field at random positions of every level
+    static std::string Validate(const DensityField& field, const Settings& settings = Settings(), int samples = 16384);
+
+#ifdef _WIN32
+    // R16G16_UNORM Texture3D (x, z, row), t14 of RayMarch.hlsl, written by CSDensityClipmap
+    ComPtr<ID3D11Texture3D> clipmapTEX_;
+    ComPtr<ID3D11ShaderResourceView> clipmapSRV_;
+    ComPtr<ID3D11UnorderedAccessView> clipmapUAV_;
+    // StructuredBuffer<DensityClipmapLevel>, t15
+    ComPtr<ID3D11Buffer> levelBuffer_;
+    ComPtr<ID3D11ShaderResourceView> levelSRV_;
+
+    bool CreateResources();
+
+    // runs CSDensityClipmap over the regions of the last Update and uploads the levels.
+    // srvs are the ray marcher inputs up to t13, samplers s0 to s4
+    void UpdateTexture(UINT numViews, ID3D11ShaderResourceView* const* srvs, UINT bufferCount, ID3D11Buffer** buffers,
+        UINT numSamplers, ID3D11SamplerState* const* samplers);
+#endif
+
+private:
+    std::vector<Rect> window_;
+    std::vector<Rect> valid_;
+    std::vector<Region> regions_;
+    int sweepLevel_ = 0;
+    int sweepColumn_ = 0;
+
+#ifdef _WIN32
+    ComPtr<ID3D11ComputeShader> computeShader_;
+    ComPtr<ID3D11Buffer> regionBuffer_;
+#endif
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <vector>
+
+#include "CloudDensity.h"
+#include "Fmap.h"
+#include "HLSLMath.h"
+#include "HeightProfileLut.h"
+#include "NoiseBaker.h"
+
+// settings of a DensityField
+struct DensityFieldSettings {
+    // sizes of the Noise objects in VolumetricCloud.cpp
+    int noiseResolution_ = 128;
+    int noiseSmallResolution_ = 32;
+    int noiseSequenceResolution_ = 64;
+
+    // noiseTexture as the GPU holds it: FBMTex.hlsl PS, or the channels of the last
+    // "Bake Large Noise on CPU"
+    NoiseBaker::VolumeRecipe noiseRecipe_ = NoiseBaker::RecipeFbm();
+
+    bool useNoiseSequence_ = true; // USE_NOISE_SEQUENCE in RayMarch.hlsl
+    bool useHeightProfileLut_ = true; // USE_HEIGHT_PROFILE_LUT in RayMarch.hlsl
+    bool lowFreq_ = false;         // skip the worley erosion and the detail noise
+
+    std::string cacheDir_ = "cache";
+};
+
+/// <summary>
+/// Cloud density queries on the CPU, no GPU or D3D needed.
+/// Holds CPU copies of the textures CloudDensity in RayMarch.hlsl samples (fMapTexture,
+/// noiseTexture, noiseSmallTexture and noiseSequenceTexture) and samples them the way the
+/// ray marcher samplers do: linear filtering, wrap addressing, mip 0.
+/// The noise copies are the 8 bit values the GPU textures hold (NoiseBaker::BakeCached),
+/// the remap chain is clouddensity::CloudDensityFromSamples.
+/// Evaluate is const and can be called from any number of threads.
+/// </summary>
+class DensityField {
+public:
+    using Settings = DensityFieldSettings;
+
+    // NOISE_SEQUENCE_PERIOD_SEC, the blend into the base noise is per layer (coverage_.w)
+    static constexpr float kSequencePeriodSec = 120.0f;
+
+    // batches from this size on are split over the thread pool
+    static const size_t kParallelBatch = 4096;
+
+    // bakes the noise volumes or loads them from the cache
+    bool Initialize(const Settings& settings = Settings());
+
+    // noiseTexture got another recipe on the GPU: bakes it (or loads it from the cache) in
+    // place of the large noise. Everything built from the field has to be built again
+    bool SetNoiseRecipe(const NoiseBaker::VolumeRecipe& recipe);
+    // the same with the noise baked already, by a background job
+    bool SetNoiseRecipe(const NoiseBaker::VolumeRecipe& recipe, NoiseVolume noise);
+
+    // weather map texels as Fmap::ColorTexel, rows along +z.
+    // the Fmap overload also takes its layer table (Fmap::CloudLayers).
+    void SetWeather(const Fmap& fmap);
+    void SetWeather(int width, int height, std::vector<hlsl::float4> texels);
+
+    // layer table of CloudDensity, clouddensity::DefaultLayers until set.
+    // also rebuilds the height profiles of the layers.
+    void SetLayers(std::vector<clouddensity::CloudLayerDesc> layers);
+
+    // seconds since start, cTime_.x * 1e-6 on the GPU
+    void SetTime(double seconds);
+
+    // world position in meters, y down like the ray marcher (altitude = -pos.y)
+    float Evaluate(const hlsl::float3& pos) const;
+    float Evaluate(const hlsl::float3& pos, float& distance) const;
+
+    // densities[i] = Evaluate(positions[i]), the spans have to be the same size
+    void Evaluate(std::span<const hlsl::float3> positions, std::span<float> densities) const;
+
+    // texture lookups of CloudDensity for one position
+    clouddensity::DensitySamples Samples(const hlsl::float3& pos) const;
+    hlsl::float4 SampleWeather(const hlsl::float2& uv) const;
+    hlsl::float4 SampleNoiseSequence(const hlsl::float3& uvw) const;
+
+    const Settings& GetSettings() const { return settings_; }
+    const NoiseVolume& NoiseLarge() const { return noise_; }
+    const NoiseVolume& NoiseSmall() const { return noiseSmall_; }
+    const NoiseVolume& NoiseSequence() const { return noiseSequence_; }
+    const std::vector<hlsl::float4>& Weather() const { return weather_; }
+    const std::vector<clouddensity::CloudLayerDesc>& Layers() const { return layers_; }
+    const HeightProfileLut& HeightProfiles() const { return profiles_; }
+    int WeatherWidth() const { return weatherWidth_; }
+    int WeatherHeight() const { return weatherHeight_; }
+
+    // sequence frames blended at the time of the last SetTime
+    void SequenceFrames(int& frame0, int& frame1, float& blend) const { frame0 = frame0_; frame1 = frame1_; blend = frameBlend_; }
+    bool Ready() const { return !noise_.texels_.empty() && !weather_.empty(); }
+
+private:
+    Settings settings_;
+
+    NoiseVolume noise_;
+    NoiseVolume noiseSmall_;
+    NoiseVolume noiseSequence_;
+
+    int weatherWidth_ = 0;
+    int weatherHeight_ = 0;
+    std::vector<hlsl::float4> weather_;
+    std::vector<clouddensity::CloudLayerDesc> layers_ = clouddensity::DefaultLayers();
+    HeightProfileLut profiles_;
+
+    int frame0_ = 0;
+    int frame1_ = 1;
+    float frameBlend_ = 0.0f;
+};
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "DensityField.h"
+#include "HLSLMath.h"
+
+// RGBA8 volume as packed 32 bit words (r in the low byte), x fastest then y, z, frame
+struct PackedVolume {
+    const uint32_t* texels_ = nullptr;
+    int width_ = 0;
+    int height_ = 0;
+    int depth_ = 0;
+};
+
+// everything a packet kernel reads, filled by DensityPacket for every Evaluate
+struct DensityPacketData {
+    PackedVolume noise_;
+    PackedVolume noiseSmall_;
+    PackedVolume noiseSequence_;
+    int sequenceFrame0_ = 0;
+    int sequenceFrame1_ = 0;
+    float sequenceBlend_ = 0.0f;
+    bool useNoiseSequence_ = false;
+
+    const float* weather_ = nullptr; // RGBA float texels
+    int weatherWidth_ = 0;
+    int weatherHeight_ = 0;
+
+    bool lowFreq_ = false; // used when no per sample lowFreq flags are given
+
+    const clouddensity::CloudLayerDesc* layers_ = nullptr;
+    int layerCount_ = 0;
+};
+
+/// <summary>
+/// Packet evaluation of CloudDensity: 8 positions per AVX2 and 16 per AVX-512 instruction.
+/// The noise volumes are sampled as packed RGBA8 words with gathers in SoA layout, the
+/// RemapClamp chains are branch free and the anvil pow is a log2/exp2 polynomial with
+/// an absolute error below kPowMaxError on [0, 1].
+/// Whole packets skip the noise fetches of a layer when no lane is inside it and the
+/// detail noise when every lane is empty or flagged lowFreq.
+/// Reads the textures and the time of the DensityField it is built from, Build has to run
+/// again after the field changes its weather or noise.
+/// </summary>
+class DensityPacket {
+public:
+    enum Isa {
+        kScalar = 0, // same kernel one lane wide, the reference of the SIMD paths
+        kAvx2,
+        kAvx512,
+        kIsaCount
+    };
+
+    static constexpr float kPowMaxError = 4e-6f;
+
+    // runs of this many samples are handed to the thread pool by EvaluateParallel
+    static const size_t kParallelChunk = 1024;
+
+    static Isa BestIsa();
+    static bool Supported(Isa isa);
+    static int Width(Isa isa);
+    static const char* IsaName(Isa isa);
+
+    // x^e for x in [0, 1], e in [0.5, 1] as the kernels compute it
+    static float PowApprox(float x, float e);
+
+    bool Build(const DensityField& field);
+
+    // SoA positions (world meters, y down). lowFreq holds one flag per sample or is nullptr
+    // for the field setting. The calling thread does all the work.
+    void Evaluate(const float* x, const float* y, const float* z, float* densities, size_t count,
+        const uint8_t* lowFreq = nullptr, Isa isa = BestIsa()) const;
+
+    // AoS convenience, transposed in packet sized runs
+    void Evaluate(std::span<const hlsl::float3> positions, std::span<float> densities, Isa isa = BestIsa()) const;
+
+    // Evaluate split over ThreadPool::Shared
+    void EvaluateParallel(const float* x, const float* y, const float* z, float* densities, size_t count,
+        const uint8_t* lowFreq = nullptr, Isa isa = BestIsa()) const;
+
+    // samples per second of DensityField::Evaluate and of every supported packet path,
+    // on the calling thread and on the whole pool, with the max error against the scalar field
+    static std::string Benchmark(const DensityField& field, size_t samples = 1 << 20);
+
+private:
+    DensityPacketData Data() const;
+
+    const DensityField* field_ = nullptr;
+    std::vector<uint32_t> noise_;
+    std::vector<uint32_t> noiseSmall_;
+    std::vector<uint32_t> noiseSequence_;
+};
+
+// one entry per instruction set, count is a multiple of the width, defined in DensityPacket*.cpp
+void EvaluateDensityPacketsScalar(const DensityPacketData& data, const float* x, const float* y, const float* z,
+    const uint8_t* lowFreq, float* densities, size_t count);
+void EvaluateDensityPacketsAvx2(const DensityPacketData& data, const float* x, const float* y, const float* z,
+    const uint8_t* lowFreq, float* densities, size_t count);
+void EvaluateDensityPacketsAvx512(const DensityPacketData& data, const float* x, const float* y, const float* z,
+    const uint8_t* lowFreq, float* densities, size_t count);
@@ -0,0 +1,249 @@
+#pragma once
+
+// Packet kernel of DensityPacket, private to DensityPacket.cpp, DensityPacketAvx2.cpp and
+// DensityPacketAvx512.cpp. Each of them includes it after selecting its instruction set
+// and instantiates it with its vector type V, so everything stays in an anonymous
+// namespace and only calls V: no function compiled for AVX-512 can be picked by the
+// linker for another path.
+//
+// V provides
+//   F, I, M           float, int32 and mask vectors, F and I broadcast from scalars
+//   kWidth            lanes
+//   + - * / on F, + * on I, < > on F and == on I giving M, & | on M
+//   Max(a, b) returns b when a is NaN, like maxps
+//   Load Store LoadFlags SetMask Min Max Floor Select SelectI MinI Any All AndNot
+//   ToInt ToFloat AsInt AsFloat AndI OrI Srl Sll Gather GatherF
+
+#include "CloudDensity.h"
+#include "DensityPacket.h"
+
+namespace {
+namespace densitypacket {
+
+    // log2(1 + t) for t in [0, 1), abs error 2.1e-6
+    const float kLog2Poly[6] = { 1.44255313f, -0.718281762f, 0.458270048f, -0.279536535f, 0.12344995f, -0.0264569027f };
+    // 2^f for f in [0, 1), rel error 7.5e-8
+    const float kExp2Poly[6] = { 0.999999925f, 0.693153073f, 0.240153615f, 0.0558263267f, 0.00898932652f, 0.00187758332f };
+
+    const float kMinNormal = 1.17549435e-38f;
+
+    // same operation order as hlsl::RemapClamp. Max(r, lo) returns lo when r is NaN
+    // (0/0 of an empty input range) like std::max and the HLSL max do.
+    template <class V>
+    inline typename V::F RemapClamp(typename V::F v, typename V::F l0, typename V::F h0, typename V::F n0, typename V::F n1) {
+        const typename V::F r = n0 + ((v - l0) / (h0 - l0)) * (n1 - n0);
+        return V::Min(V::Max(r, V::Min(n1, n0)), V::Max(n1, n0));
+    }
+
+    template <class V>
+    inline typename V::F Lerp(typename V::F a, typename V::F b, typename V::F t) {
+        return a + (b - a) * t;
+    }
+
+    // x^e through log2/exp2 polynomials, x <= 0 gives 0
+    template <class V>
+    inline typename V::F Pow(typename V::F x, typename V::F e) {
+        using F = typename V::F;
+        using I = typename V::I;
+
+        const I bits = V::AsInt(x);
+        const F exponent = V::ToFloat(V::Srl(bits, 23) + I(-127));
+        const F t = V::AsFloat(V::OrI(V::AndI(bits, 0x007fffff), 0x3f800000)) - F(1.0f);
+        F poly = F(kLog2Poly[5]);
+        for (int i = 4; i >= 0; i--) { poly = poly * t + F(kLog2Poly[i]); }
+        const F log2x = exponent + poly * t;
+
+        const F y = V::Max(log2x * e, F(-126.0f));
+        const F n = V::Floor(y);
+        const F f = y - n;
+        F p = F(kExp2Poly[5]);
+        for (int i = 4; i >= 0; i--) { p = p * f + F(kExp2Poly[i]); }
+        const F result = V::AsFloat(V::AsInt(p) + V::Sll(V::ToInt(n), 23));
+
+        return V::Select(x > F(kMinNormal), result, F(0.0f));
+    }
+
+    // linear filter taps along one axis with wrap addressing, texel centers at (i + 0.5) / size
+    template <class V>
+    inline void WrapAxis(typename V::F uv, int size, typename V::I& i0, typename V::I& i1, typename V::F& t) {
+        using F = typename V::F;
+        using I = typename V::I;
+
+        const F p = uv * F(static_cast<float>(size)) - F(0.5f);
+        const F wrapped = p - F(static_cast<float>(size)) * V::Floor(p * F(1.0f / size));
+        const F fl = V::Floor(wrapped);
+        t = wrapped - fl;
+        i0 = V::MinI(V::ToInt(fl), I(size - 1));
+        i1 = i0 + I(1);
+        i1 = V::SelectI(i1 == I(size), I(0), i1);
+    }
+
+    template <class V>
+    inline typename V::F Unpack(typename V::I rgba, int channel) {
+        return V::ToFloat(V::AndI(V::Srl(rgba, 8 * channel), 0xff)) * typename V::F(1.0f / 255.0f);
+    }
+
+    // trilinear sampling of the channels in channelMask, the others are left untouched
+    template <class V>
+    inline void SampleVolume(const PackedVolume& volume, int frame, typename V::F u, typename V::F v, typename V::F w,
+        unsigned channelMask, typename V::F out[4]) {
+        using F = typename V::F;
+        using I = typename V::I;
+
+        I x0, x1, y0, y1, z0, z1;
+        F tx, ty, tz;
+        WrapAxis<V>(u, volume.width_, x0, x1, tx);
+        WrapAxis<V>(v, volume.height_, y0, y1, ty);
+        WrapAxis<V>(w, volume.depth_, z0, z1, tz);
+
+        const I row = I(volume.width_);
+        const I slice = I(volume.width_ * volume.height_);
+        y0 = y0 * row;
+        y1 = y1 * row;
+        z0 = z0 * slice;
+        z1 = z1 * slice;
+
+        const uint32_t* texels = volume.texels_ + static_cast<size_t>(frame) * volume.width_ * volume.height_ * volume.depth_;
+        const I g000 = V::Gather(texels, x0 + y0 + z0);
+        const I g100 = V::Gather(texels, x1 + y0 + z0);
+        const I g010 = V::Gather(texels, x0 + y1 + z0);
+        const I g110 = V::Gather(texels, x1 + y1 + z0);
+        const I g001 = V::Gather(texels, x0 + y0 + z1);
+        const I g101 = V::Gather(texels, x1 + y0 + z1);
+        const I g011 = V::Gather(texels, x0 + y1 + z1);
+        const I g111 = V::Gather(texels, x1 + y1 + z1);
+
+        for (int c = 0; c < 4; c++) {
+            if ((channelMask & (1u << c)) == 0) { continue; }
+            out[c] = Lerp<V>(
+                Lerp<V>(Lerp<V>(Unpack<V>(g000, c), Unpack<V>(g100, c), tx), Lerp<V>(Unpack<V>(g010, c), Unpack<V>(g110, c), tx), ty),
+                Lerp<V>(Lerp<V>(Unpack<V>(g001, c), Unpack<V>(g101, c), tx), Lerp<V>(Unpack<V>(g011, c), Unpack<V>(g111, c), tx), ty),
+                tz);
+        }
+    }
+
+    // bilinear r, g, b of the RGBA float weather map
+    template <class V>
+    inline void SampleWeather(const DensityPacketData& data, typename V::F u, typename V::F v, typename V::F out[3]) {
+        using F = typename V::F;
+        using I = typename V::I;
+
+        I x0, x1, y0, y1;
+        F tx, ty;
+        WrapAxis<V>(u, data.weatherWidth_, x0, x1, tx);
+        WrapAxis<V>(v, data.weatherHeight_, y0, y1, ty);
+
+        const I row = I(data.weatherWidth_ * 4);
+        x0 = x0 * I(4);
+        x1 = x1 * I(4);
+        y0 = y0 * row;
+        y1 = y1 * row;
+        for (int c = 0; c < 3; c++) {
+            const I channel = I(c);
+            out[c] = Lerp<V>(
+                Lerp<V>(V::GatherF(data.weather_, x0 + y0 + channel), V::GatherF(data.weather_, x1 + y0 + channel), tx),
+                Lerp<V>(V::GatherF(data.weather_, x0 + y1 + channel), V::GatherF(data.weather_, x1 + y1 + channel), tx),
+                ty);
+        }
+    }
+
+    // normalized height inside a layer, 0-1 inside
+    template <class V>
+    inline typename V::F LayerHeight(const clouddensity::CloudLayerDesc& layer, typename V::F rayHeightMeter, const typename V::F fmap[3]) {
+        using F = typename V::F;
+        const F thickness = F(layer.altitude_.z) + F(layer.altitude_.w) * fmap[1];
+        const F bottomAltMeter = (fmap[2] * F(layer.altitude_.x) + F(layer.altitude_.y)) * F(clouddensity::FT_TO_M);
+        return (rayHeightMeter - bottomAltMeter) / thickness;
+    }
+
+    // LayerDensity of CloudDensity.cpp, lanes in low keep the low frequency shape
+    template <class V>
+    inline typename V::F LayerDensity(const clouddensity::CloudLayerDesc& layer, typename V::F height, typename V::F poor,
+        const typename V::F noise[4], typename V::M low, bool anyFull) {
+        using F = typename V::F;
+        const F zero(0.0f), one(1.0f), half(0.5f);
+
+        F dense = RemapClamp<V>(noise[0] * half + half, one - (poor * F(layer.coverage_.x) + F(layer.coverage_.y)), one, zero, one); // perlinWorley
+        if (anyFull && layer.anvil_.w > 0.0f) {
+            F full = dense;
+            full = RemapClamp<V>(full, one - (noise[1] * half + half), one, zero, one); // worley
+            full = RemapClamp<V>(full, one - (noise[2] * half + half), one, zero, one); // worley
+            full = RemapClamp<V>(full, one - (noise[3] * half + half), one, zero, one); // worley
+            dense = V::Select(low, dense, full);
+        }
+        const F peak(layer.coverage_.z);
+        const F layerShape = RemapClamp<V>(height, zero, peak, zero, one) * RemapClamp<V>(height, peak, one, one, zero);
+        dense = RemapClamp<V>(dense, one - layerShape, one, zero, one);
+        // cumulus anvil
+        const float anvilEnd = 1.0f + (0.5f - 1.0f) * layer.anvil_.x;
+        return Pow<V>(dense, RemapClamp<V>(one - height, F(layer.anvil_.y), F(layer.anvil_.z), one, F(anvilEnd)));
+    }
+
+    template <class V>
+    inline void EvaluatePacket(const DensityPacketData& data, const float* px, const float* py, const float* pz,
+        const uint8_t* lowFreq, float* out) {
+        using namespace clouddensity;
+        using F = typename V::F;
+        using M = typename V::M;
+
+        const F x = V::Load(px);
+        const F y = V::Load(py);
+        const F z = V::Load(pz);
+        const M low = lowFreq ? V::LoadFlags(lowFreq) : V::SetMask(data.lowFreq_);
+        const bool anyFull = !V::All(low);
+
+        F fmap[3];
+        SampleWeather<V>(data, x * F(1.0f / FMAP_EXTENT_M) + F(0.5f), z * F(1.0f / FMAP_EXTENT_M) + F(0.5f), fmap);
+        const F rayHeightMeter = F(0.0f) - y;
+        const F poor = RemapClamp<V>(fmap[0], F(0.0f), F(1.0f), F(0.0f), F(1.0f));
+        const unsigned noiseChannels = anyFull ? 0xFu : 0x1u;
+        F finaldense(0.0f);
+
+        // a lane outside (0, 1) of a layer ends at 0 whatever the noise, a packet without
+        // any lane inside skips the fetches
+        for (int l = 0; l < data.layerCount_; l++) {
+            const CloudLayerDesc& layer = data.layers_[l];
+            const F height = LayerHeight<V>(layer, rayHeightMeter, fmap);
+            if (!V::Any((height > F(0.0f)) & (height < F(1.0f)))) { continue; }
+
+            const F scale(layer.noise_.x), offset(layer.noise_.y);
+            const F u = x * scale + offset, v = y * scale + offset, w = z * scale + offset;
+            F noise[4];
+            SampleVolume<V>(data.noise_, 0, u, v, w, noiseChannels, noise);
+            if (data.useNoiseSequence_ && layer.coverage_.w > 0.0f) {
+                // frames are sampled half a texel inside like NoiseSequenceTex
+                const float halfTexel = 0.5f / data.noiseSequence_.depth_;
+                const F sw = V::Min(V::Max(w - V::Floor(w), F(halfTexel)), F(1.0f - halfTexel));
+                F frame0[4], frame1[4];
+                SampleVolume<V>(data.noiseSequence_, data.sequenceFrame0_, u, v, sw, 0x2u, frame0);
+                SampleVolume<V>(data.noiseSequence_, data.sequenceFrame1_, u, v, sw, 0x2u, frame1);
+                noise[0] = Lerp<V>(noise[0], Lerp<V>(frame0[1], frame1[1], F(data.sequenceBlend_)), F(layer.coverage_.w));
+            }
+            finaldense = V::Max(finaldense, LayerDensity<V>(layer, height, poor, noise, low, anyFull));
+        }
+
+        // detail erosion keeps 0 at 0, only lanes with density and without lowFreq need it
+        if (V::Any(V::AndNot(low, finaldense > F(0.0f)))) {
+            const F zero(0.0f), one(1.0f), half(0.5f);
+            F small[4];
+            SampleVolume<V>(data.noiseSmall_, 0, x * F(SMALL_NOISE_SCALE), y * F(SMALL_NOISE_SCALE), z * F(SMALL_NOISE_SCALE), 0x7u, small);
+            F full = finaldense;
+            full = RemapClamp<V>(full, one - (small[0] * half + half), one, zero, one); // worley
+            full = RemapClamp<V>(full, one - (small[1] * half + half), one, zero, one); // worley
+            full = RemapClamp<V>(full, one - (small[2] * half + half), one, zero, one); // worley
+            finaldense = V::Select(low, finaldense, full);
+        }
+
+        V::Store(out, finaldense * F(1.0f / DENSITY_DIVISOR));
+    }
+
+    template <class V>
+    inline void EvaluatePackets(const DensityPacketData& data, const float* x, const float* y, const float* z,
+        const uint8_t* lowFreq, float* densities, size_t count) {
+        for (size_t i = 0; i < count; i += V::kWidth) {
+            EvaluatePacket<V>(data, x + i, y + i, z + i, lowFreq ? lowFreq + i : nullptr, densities + i);
+        }
+    }
+
+} // namespace densitypacket
+} // namespace
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "CloudDensity.h"
+#include "HLSLMath.h"
+
+#ifdef _WIN32
+#include <d3d11.h>
+#include <wrl/client.h>
+#include "Renderer.h"
+#endif
+
+class DensityField;
+
+// tile size of a DepthPyramid
+struct DepthPyramidSettings {
+    int tileLevel_ = 4;             // DEPTH_PYRAMID_TILE_LEVEL in RayMarch.hlsl, the mip whose texels are the culling tiles (16 x 16 pixels)
+};
+
+/// <summary>
+/// Min / max mips of the reversed primitive depth, built by the compute passes of DepthPyramid.hlsl
+/// right after the monolith is drawn. Level 0 copies the depth target, every further level
+/// halves it rounding up like D3D mips: texel j covers the children 2j and 2j + 1 that exist,
+/// so texel j of level k covers the pixels j * 2^k up to (j + 1) * 2^k of any odd size.
+/// x keeps the smallest reversed depth (the farthest primitive, 0 where there is sky), y the
+/// largest (the nearest).
+/// StartRayMarch reads the tile level under the bilinear footprint of its depth sample: when
+/// the ray can not reach the altitude slab of any layer before the farthest primitive of the
+/// tile the pixel is empty without marching. RayMarch makes the same check with the depth of
+/// the pixel, which culls every pixel the tile does, so USE_DEPTH_PYRAMID is off (Report) and
+/// the app neither creates nor builds the pyramid.
+/// Build and Culled are the CPU ports CpuCloudRenderer runs with a pyramid in its Sources.
+/// No D3D is needed outside the _WIN32 section.
+/// </summary>
+class DepthPyramid {
+public:
+    using Settings = DepthPyramidSettings;
+
+    struct Level {
+        int width_ = 0;
+        int height_ = 0;
+        std::vector<hlsl::float2> minMax_;  // x fastest, rows top down like the depth target
+    };
+
+    Settings settings_;
+    std::vector<Level> levels_;
+
+    // CPU reduction of CSDepthPyramidCopy / CSDepthPyramidReduce over a reversed depth target, rows top down
+    bool Build(const std::vector<float>& depth, int width, int height, const Settings& settings = Settings());
+
+    int Width() const { return width_; }
+    int Height() const { return height_; }
+    // the tile level, clamped to the coarsest mip
+    int TileLevel() const;
+
+    // DepthPyramidFarthest of RayMarch.hlsl: the smallest reversed depth of the tiles under the
+    // four texels a bilinear, wrapped depthSampler read at uv takes
+    float TileFarthest(float u, float v) const;
+
+    // DepthPyramidCulled of RayMarch.hlsl: true when the curved ray from rayStart can not come
+    // within CLOUD_LAYER_SLAB_PAD of any layer slab before rayEnd, the ray length of the farthest
+    // primitive of its tile. with the ray end of the pixel it is the layer check of RayMarch
+    static bool Culled(const std::vector<clouddensity::CloudLayerDesc>& layers, const hlsl::float3& rayStart,
+        const hlsl::float3& rayDir, float inStart, float rayEnd);
+
+    // the reduction against brute force on odd sizes, TileFarthest against the texels of the
+    // footprint, and a low camera over synthetic terrain, a ridge and a tower reaching into the
+    // clouds of 40100.fmap marched by CpuCloudRenderer without a cull, with the layer check and
+    // with the pyramid on top: culled pixels and tiles, march steps, and identical images
+    static std::string Report(DensityField& field, int width = 160, int height = 90, const std::string& resourceDir = "resources");
+
+#ifdef _WIN32
+    // R32G32_FLOAT Texture2D of the screen size with the full mip chain, t21 of RayMarch.hlsl
+    ComPtr<ID3D11Texture2D> pyramidTEX_;
+    ComPtr<ID3D11ShaderResourceView> pyramidSRV_;
+    std::vector<ComPtr<ID3D11ShaderResourceView>> levelSRVs_;   // one mip each, the source of the next level
+    std::vector<ComPtr<ID3D11UnorderedAccessView>> levelUAVs_;
+    ComPtr<ID3D11Buffer> sizeBuffer_;
+    ComPtr<ID3D11ComputeShader> copyShader_;
+    ComPtr<ID3D11ComputeShader> reduceShader_;
+
+    // again on every resize of the depth target
+    bool CreateResources(int width, int height);
+    // depth is the R32_FLOAT view of the primitive depth target, unbound from the output merger here
+    void Dispatch(ID3D11ShaderResourceView* depth);
+#endif
+
+private:
+    int width_ = 0;
+    int height_ = 0;
+};
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+#include "HLSLMath.h"
+
+/// <summary>
+/// C++ port of CurvedRayPosition / CurvedRayTangent in RayMarch.hlsl.
+/// A view ray of length d bends down with the earth surface below it:
+/// start + R sin(d / R) dir - (0, R (1 - cos(d / R)), 0), y pointing down.
+/// The shader evaluates sin and cos as short polynomials in d^2 instead of normalizing
+/// and calling sin / cos every step; Report checks them against the arc in double.
+/// </summary>
+namespace earthcurvature {
+
+    using namespace hlsl;
+
+    // EARTH_RADIUS and MAX_LENGTH in RayMarch.hlsl
+    static const float EARTH_RADIUS_M = 6371e3f;
+    static const float MAX_LENGTH_M = 422440.0f;
+
+    // the Report PASS bound on the position error
+    static const float MAX_ERROR_M = 1.0f;
+
+    // position at distance d on the bent ray, dir normalized
+    inline float3 CurvedRayPosition(const float3& start, const float3& dir, float d) {
+        const float d2 = d * d;
+        const float along = d * (1.0f - d2 * (1.0f / (6.0f * EARTH_RADIUS_M * EARTH_RADIUS_M)) * (1.0f - d2 * (1.0f / (20.0f * EARTH_RADIUS_M * EARTH_RADIUS_M))));
+        const float drop = d2 * (1.0f / (2.0f * EARTH_RADIUS_M)) * (1.0f - d2 * (1.0f / (12.0f * EARTH_RADIUS_M * EARTH_RADIUS_M)));
+        return start + dir * along - float3(0.0f, drop, 0.0f);
+    }
+
+    // unit tangent of CurvedRayPosition at distance d
+    inline float3 CurvedRayTangent(const float3& dir, float d) {
+        const float d2 = d * d;
+        const float cosA = 1.0f - d2 * (1.0f / (2.0f * EARTH_RADIUS_M * EARTH_RADIUS_M)) * (1.0f - d2 * (1.0f / (12.0f * EARTH_RADIUS_M * EARTH_RADIUS_M)));
+        const float sinA = d * (1.0f / EARTH_RADIUS_M) * (1.0f - d2 * (1.0f / (6.0f * EARTH_RADIUS_M * EARTH_RADIUS_M)));
+        return dir * cosA - float3(0.0f, sinA, 0.0f);
+    }
+
+    // altitude range of CurvedRayPosition(start, dir, d) for d in [dBegin, dEnd], CurvedRayAltitudeRange
+    inline float2 CurvedRayAltitudeRange(const float3& start, const float3& dir, float dBegin, float dEnd) {
+        // alt(A) = alt0 - R sin(A) dir.y + R (1 - cos(A)) with A = d / R, lowest where tan(A) = dir.y
+        const float dLowest = (std::min)((std::max)(EARTH_RADIUS_M * std::atan(dir.y), dBegin), dEnd);
+        const float altBegin = -CurvedRayPosition(start, dir, dBegin).y;
+        const float altEnd = -CurvedRayPosition(start, dir, dEnd).y;
+        const float altLowest = -CurvedRayPosition(start, dir, dLowest).y;
+        return float2((std::min)({ altBegin, altEnd, altLowest }), (std::max)(altBegin, altEnd));
+    }
+
+    // the transform the shader used before, on a point of the straight ray
+    float3 AdjustForEarthCurvature(const float3& rayPos, const float3& rayStart);
+
+    // max position and tangent error of the polynomial (and of AdjustForEarthCurvature)
+    // against the exact arc, on random rays out to MAX_LENGTH_M
+    std::string Report(int rays = 1024, int steps = 1024);
+
+} // namespace earthcurvature
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "CloudCascade.h"
+#include "HLSLMath.h"
+
+#ifdef _WIN32
+#include <d3d11.h>
+#include <wrl/client.h>
+#include "Renderer.h"
+#endif
+
+class DensityField;
+struct CpuCloudFrame;
+struct CpuCloudRendererSettings;
+struct CpuCloudSources;
+struct CpuCloudView;
+
+// layout and refresh budget of a FarCloudCache
+struct FarCloudCacheSettings {
+    int faceSize_ = 256;                // texels along both sides of a cube face
+    int tileSize_ = 32;                 // texels along both sides of a tile, what one refresh marches
+    int tilesPerFrame_ = 8;             // tiles marched per Update at most, clears of unreachable tiles come on top
+    float maxParallaxTexels_ = 0.5f;    // sideways camera move since the march, in texels at the band start
+    float maxSunTurnDeg_ = 0.5f;        // sun direction change since the march
+    int maxAgeFrames_ = 600;            // the clouds drift with time, every tile is marched again this often
+    float offscreenWeight_ = 0.25f;     // staleness of the tiles outside the view counts this much
+};
+
+// camera and sun of the frame an Update plans for
+struct FarCloudCacheView {
+    hlsl::float3 eye_ = hlsl::float3(0.0f);
+    hlsl::float3 forward_ = hlsl::float3(0.0f, 0.0f, 1.0f);
+    hlsl::float3 sunDir_ = hlsl::float3(0.7071f, 0.7071f, 0.0f);
+    float viewHalfAngleDeg_ = 60.0f;    // from the view direction to the screen corners
+    hlsl::float2 cloudAltitude_ = hlsl::float2(0.0f, 16000.0f); // DensityClipmap::AltitudeBand of the layers
+    uint32_t frame_ = 0;
+};
+
+/// <summary>
+/// Camera centred cube map of the far cloud band: scattered light and 1 - transmittance of
+/// the rays from the camera through every texel, marched from the band start to its end like
+/// the far cascade did in screen space. Clouds that far hardly move on screen while cruising,
+/// so the cube is refreshed a few tiles per frame and the far target only looks it up
+/// (PS_FAR_CACHE), the near band composites over it in the merge.
+/// Every tile remembers the camera, the sun and the frame it was marched with. Its staleness
+/// is the largest of the sideways parallax of that camera at the band start in texels, the sun
+/// turn and the age, each over its limit, times offscreenWeight_ outside the view. Update
+/// hands out tiles never marched first, then the stalest at or above 1, up to the budget.
+/// Tiles whose rays can not reach the cloud altitudes inside the band (looking up, or down
+/// through the layers) are never marched, a tile that becomes one is cleared once.
+/// Tiles are marched by the caller, on the GPU (CSFarCloudCache) or on the CPU (Fill).
+/// No D3D is needed outside the _WIN32 section.
+/// </summary>
+class FarCloudCache {
+public:
+    using Settings = FarCloudCacheSettings;
+    using View = FarCloudCacheView;
+
+    struct Tile {
+        int face_ = 0;
+        int x_ = 0;                     // first texel
+        int y_ = 0;
+        hlsl::float3 center_;           // direction through the middle of the tile
+        float radiusDeg_ = 0.0f;        // from the middle to the farthest corner
+        hlsl::float2 elevationDeg_;     // lowest and highest elevation of its rays, padded
+        bool marched_ = false;          // holds a march, otherwise it is clear
+        hlsl::float3 eye_;              // camera, sun and frame of the march
+        hlsl::float3 sunDir_;
+        uint32_t frame_ = 0;
+    };
+
+    // a tile to march, or to clear when its rays can not reach a cloud any more
+    struct Region {
+        int tile_ = 0;
+        bool clear_ = false;
+    };
+
+    Settings settings_;
+    cloudcascade::Cascade band_;
+    std::vector<hlsl::float4> texels_;  // Fill target: x fastest, then y, then face
+
+    bool Initialize(const cloudcascade::Cascade& band, const Settings& settings = Settings());
+    bool Ready() const { return !tiles_.empty(); }
+
+    int TilesPerFace() const { return settings_.faceSize_ / settings_.tileSize_; }
+    const std::vector<Tile>& Tiles() const { return tiles_; }
+
+    // D3D TextureCube addressing: the direction through (u, v) of a face, both in [0, 1], y down
+    static hlsl::float3 FaceDirection(int face, float u, float v);
+    // and back, the face the largest component picks
+    static void DirectionToFace(const hlsl::float3& dir, int& face, float& u, float& v);
+
+    // parallax, sun and age over their limits, the largest of them. 1 and above is due
+    float Staleness(const Tile& tile, const View& view) const;
+    // whether rays of the tile come within the cloud altitudes between band start and end
+    bool Reachable(const Tile& tile, const View& view) const;
+    bool Visible(const Tile& tile, const View& view) const;
+
+    // plans the tiles of this frame. they count as marched with this view from here on, the
+    // caller has to march or clear them before the far target reads the cube
+    const std::vector<Region>& Update(const View& view);
+    // the weather changed, every tile is due
+    void Invalidate();
+
+    const std::vector<Region>& Regions() const { return regions_; }
+    int MarchedTiles() const;
+
+    // marches the regions of the last Update into texels_ from the eye of the view with the
+    // band of band_, returns the march steps
+    uint64_t Fill(const DensityField& field, const CpuCloudView& view, const CpuCloudSources& sources);
+
+    // linear lookup of texels_ in a direction, clamped at the face edges
+    hlsl::float4 Sample(const hlsl::float3& dir) const;
+
+    // PS_FAR_CACHE on the CPU without primitives: the cube looked up through every pixel of a
+    // frame of the size and field of view of settings
+    void Resolve(const CpuCloudRendererSettings& settings, const CpuCloudView& view, CpuCloudFrame& frame) const;
+
+    // the planner on camera paths: the first fill goes to the view first, a still camera comes
+    // to rest, cruising and a turning sun keep the visible tiles within their limits. then the
+    // cruise view of cloudcascade::Report: near band over the cube against one march of the
+    // whole ray, and the far steps per frame against the far cascade
+    static std::string Report(DensityField& field, int width = 160, int height = 90, const std::string& resourceDir = "resources");
+
+#ifdef _WIN32
+    // R16G16B16A16_FLOAT cube, t22 of RayMarch.hlsl, written as a Texture2DArray by CSFarCloudCache
+    ComPtr<ID3D11Texture2D> cacheTEX_;
+    ComPtr<ID3D11ShaderResourceView> cacheSRV_;
+    ComPtr<ID3D11UnorderedAccessView> cacheUAV_;
+
+    bool CreateResources();
+
+    // runs CSFarCloudCache over the regions of the last Update. srvs are the ray marcher inputs
+    // up to t21, samplers s0 to s4
+    void UpdateTexture(UINT numViews, ID3D11ShaderResourceView* const* srvs, UINT bufferCount, ID3D11Buffer** buffers,
+        UINT numSamplers, ID3D11SamplerState* const* samplers);
+#endif
+
+private:
+    std::vector<Tile> tiles_;
+    std::vector<Region> regions_;
+
+#ifdef _WIN32
+    ComPtr<ID3D11ComputeShader> computeShader_;
+    ComPtr<ID3D11Buffer> tileBuffer_;
+#endif
+};
@@ -5,12 +5,18 @@
 #include <string>
 #include <vector>
 
-#include "Fmap.h"
-#include <wtypes.h>
 #include <functional>
+
+#include "CloudDensity.h"
+#include "HLSLMath.h"
+
+// the reader and ColorTexel are portable, the texture is only built on Windows
+#ifdef _WIN32
+#include <wtypes.h>
 #include <d3d11.h>
 #include <wrl/client.h>
 #include "Renderer.h"
+#endif
 
 class FmapCell {
 public:
@@ -49,9 +55,24 @@ public:
 
 	std::vector<std::vector<FmapCell>> cells_; // [X][Y]
 
+	// texel of fMapTexture: R cumulus density, G cumulus size, B cumulus altitude (ft), A 1
+	hlsl::float4 ColorTexel(int x, int y) const;
+	std::vector<hlsl::float4> ColorTexels() const; // X_ * Y_, rows along y
+
+	// cumulus, cirrus and the two stratus layers, slabs narrowed to this map
+	std::vector<clouddensity::CloudLayerDesc> CloudLayers() const;
+
+#ifdef _WIN32
 	ComPtr<ID3D11Texture2D> colorTEX_;
 	ComPtr<ID3D11ShaderResourceView> colorSRV_;
 
+	// CloudLayers as StructuredBuffer, t10 of RayMarch.hlsl. the slabs follow the texels,
+	// create it again after they change
+	ComPtr<ID3D11Buffer> layerBuffer_;
+	ComPtr<ID3D11ShaderResourceView> layerSRV_;
+
 	bool CreateTexture2DFromData();
 	void UpdateTextureData();
+	bool CreateLayerBuffer();
+#endif
 };
\ No newline at end of file
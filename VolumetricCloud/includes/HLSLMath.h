@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+// Minimal HLSL-like vector types and intrinsics for CPU ports of the shaders.
+//
+// The CPU side (noise bakers, density queries, headless rendering) has to match what
+// the shaders compute, so ported functions are written against these types and read
+// almost line by line like the HLSL they come from.
+// This header has no Windows/D3D dependency on purpose.
+namespace hlsl {
+
+    struct float2 {
+        float x = 0, y = 0;
+        float2() = default;
+        constexpr float2(float v) : x(v), y(v) {}
+        constexpr float2(float x, float y) : x(x), y(y) {}
+        float& operator[](int i) { return (&x)[i]; }
+        float operator[](int i) const { return (&x)[i]; }
+    };
+
+    struct float3 {
+        float x = 0, y = 0, z = 0;
+        float3() = default;
+        constexpr float3(float v) : x(v), y(v), z(v) {}
+        constexpr float3(float x, float y, float z) : x(x), y(y), z(z) {}
+        float& operator[](int i) { return (&x)[i]; }
+        float operator[](int i) const { return (&x)[i]; }
+        float2 xz() const { return float2(x, z); }
+    };
+
+    struct float4 {
+        float x = 0, y = 0, z = 0, w = 0;
+        float4() = default;
+        constexpr float4(float v) : x(v), y(v), z(v), w(v) {}
+        constexpr float4(float x, float y, float z, float w) : x(x), y(y), z(z), w(w) {}
+        constexpr float4(const float3& v, float w) : x(v.x), y(v.y), z(v.z), w(w) {}
+        float& operator[](int i) { return (&x)[i]; }
+        float operator[](int i) const { return (&x)[i]; }
+        float3 xyz() const { return float3(x, y, z); }
+    };
+
+    struct int3 {
+        int32_t x = 0, y = 0, z = 0;
+        int3() = default;
+        constexpr int3(int32_t x, int32_t y, int32_t z) : x(x), y(y), z(z) {}
+    };
+
+    struct int4 {
+        int32_t x = 0, y = 0, z = 0, w = 0;
+        int4() = default;
+        constexpr int4(int32_t x, int32_t y, int32_t z, int32_t w) : x(x), y(y), z(z), w(w) {}
+    };
+
+    struct uint3 {
+        uint32_t x = 0, y = 0, z = 0;
+        uint3() = default;
+        constexpr uint3(uint32_t x, uint32_t y, uint32_t z) : x(x), y(y), z(z) {}
+    };
+
+    struct uint4 {
+        uint32_t x = 0, y = 0, z = 0, w = 0;
+        uint4() = default;
+        constexpr uint4(uint32_t x, uint32_t y, uint32_t z, uint32_t w) : x(x), y(y), z(z), w(w) {}
+    };
+
+#define HLSL_VECTOR_OP2(T, OP) \
+    inline T operator OP(const T& a, const T& b) { T r; for (int i = 0; i < (int)(sizeof(T) / sizeof(float)); i++) r[i] = a[i] OP b[i]; return r; } \
+    inline T operator OP(const T& a, float b) { T r; for (int i = 0; i < (int)(sizeof(T) / sizeof(float)); i++) r[i] = a[i] OP b; return r; } \
+    inline T operator OP(float a, const T& b) { T r; for (int i = 0; i < (int)(sizeof(T) / sizeof(float)); i++) r[i] = a OP b[i]; return r; } \
+    inline T& operator OP##=(T& a, const T& b) { a = a OP b; return a; } \
+    inline T& operator OP##=(T& a, float b) { a = a OP b; return a; }
+
+#define HLSL_VECTOR_FUNC1(T, NAME, EXPR) \
+    inline T NAME(const T& a) { T r; for (int i = 0; i < (int)(sizeof(T) / sizeof(float)); i++) { const float v = a[i]; r[i] = (EXPR); } return r; }
+
+    inline float frac(float v) { return v - std::floor(v); }
+    inline float saturate(float v) { return (std::min)(1.0f, (std::max)(0.0f, v)); }
+    inline float lerp(float a, float b, float t) { return a + (b - a) * t; }
+    inline float step(float edge, float v) { return v >= edge ? 1.0f : 0.0f; }
+    inline float smoothstep(float a, float b, float v) {
+        const float t = saturate((v - a) / (b - a));
+        return t * t * (3.0f - 2.0f * t);
+    }
+    inline float clamp(float v, float lo, float hi) { return (std::min)(hi, (std::max)(lo, v)); }
+
+    HLSL_VECTOR_OP2(float2, +) HLSL_VECTOR_OP2(float2, -) HLSL_VECTOR_OP2(float2, *) HLSL_VECTOR_OP2(float2, /)
+    HLSL_VECTOR_OP2(float3, +) HLSL_VECTOR_OP2(float3, -) HLSL_VECTOR_OP2(float3, *) HLSL_VECTOR_OP2(float3, /)
+    HLSL_VECTOR_OP2(float4, +) HLSL_VECTOR_OP2(float4, -) HLSL_VECTOR_OP2(float4, *) HLSL_VECTOR_OP2(float4, /)
+
+    HLSL_VECTOR_FUNC1(float2, floor, std::floor(v)) HLSL_VECTOR_FUNC1(float2, frac, v - std::floor(v))
+    HLSL_VECTOR_FUNC1(float3, floor, std::floor(v)) HLSL_VECTOR_FUNC1(float3, frac, v - std::floor(v))
+    HLSL_VECTOR_FUNC1(float4, floor, std::floor(v)) HLSL_VECTOR_FUNC1(float4, frac, v - std::floor(v))
+    HLSL_VECTOR_FUNC1(float3, abs, std::fabs(v)) HLSL_VECTOR_FUNC1(float3, saturate, (std::min)(1.0f, (std::max)(0.0f, v)))
+    HLSL_VECTOR_FUNC1(float4, fade, v * v * v * (v * (v * 6 - 15) + 10))
+
+#undef HLSL_VECTOR_OP2
+#undef HLSL_VECTOR_FUNC1
+
+    inline float3 operator-(const float3& a) { return float3(-a.x, -a.y, -a.z); }
+
+    inline float dot(const float2& a, const float2& b) { return a.x * b.x + a.y * b.y; }
+    inline float dot(const float3& a, const float3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+    inline float dot(const float4& a, const float4& b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+    inline float length(const float3& a) { return std::sqrt(dot(a, a)); }
+    inline float distance(const float3& a, const float3& b) { return length(a - b); }
+    inline float3 normalize(const float3& a) { return a * (1.0f / length(a)); }
+    inline float4 normalize(const float4& a) { return a * (1.0f / std::sqrt(dot(a, a))); }
+    inline float3 cross(const float3& a, const float3& b) {
+        return float3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+    }
+    inline float3 lerp(const float3& a, const float3& b, float t) { return a + (b - a) * t; }
+    inline float4 lerp(const float4& a, const float4& b, float t) { return a + (b - a) * t; }
+    inline float3 (min)(const float3& a, const float3& b) { return float3((std::min)(a.x, b.x), (std::min)(a.y, b.y), (std::min)(a.z, b.z)); }
+    inline float3 (max)(const float3& a, const float3& b) { return float3((std::max)(a.x, b.x), (std::max)(a.y, b.y), (std::max)(a.z, b.z)); }
+    inline float3 fmod(const float3& a, const float3& b) { return float3(std::fmod(a.x, b.x), std::fmod(a.y, b.y), std::fmod(a.z, b.z)); }
+
+    // the int(v) and uint(i) casts of HLSL: float -> int truncates toward zero, int -> uint keeps
+    // the bit pattern. asint/asuint/asfloat reinterpret the bits like their HLSL namesakes
+    inline int32_t toint(float v) { return static_cast<int32_t>(v); }
+    inline uint32_t touint(int32_t v) { return static_cast<uint32_t>(v); }
+    inline int32_t asint(float v) { return std::bit_cast<int32_t>(v); }
+    inline uint32_t asuint(float v) { return std::bit_cast<uint32_t>(v); }
+    inline float asfloat(uint32_t v) { return std::bit_cast<float>(v); }
+
+    // ported from CommonFunctions.hlsl
+    // from https://www.guerrilla-games.com/read/nubis-authoring-real-time-volumetric-cloudscapes-with-the-decima-engine
+
+    inline float Remap(float value, float original_min, float original_max, float new_min, float new_max) {
+        return new_min + (((value - original_min) / (original_max - original_min)) * (new_max - new_min));
+    }
+
+    inline float RemapClamp(float value, float original_min, float original_max, float new_min, float new_max) {
+        // completly set out range value to 0
+        return (std::min)((std::max)(new_max, new_min), (std::max)((std::min)(new_max, new_min), Remap(value, original_min, original_max, new_min, new_max)));
+    }
+
+} // namespace hlsl
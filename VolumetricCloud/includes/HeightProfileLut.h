@@ -0,0 +1,59 @@
+#pragma once
+
+#include <span>
+#include <string>
+#include <vector>
+
+#include "CloudDensity.h"
+#include "HLSLMath.h"
+
+#ifdef _WIN32
+#include <d3d11.h>
+#include <wrl/client.h>
+#include "Renderer.h"
+#endif
+
+// build settings of a HeightProfileLut
+struct HeightProfileLutSettings {
+    // texels over the normalized height [0, 1]. kinks at multiples of 1 / (heightSamples_ - 1)
+    // land on texel centers, 321 puts every tenth (0.2 peak, 0.8 bottom wide) on one
+    int heightSamples_ = 321;
+};
+
+/// <summary>
+/// Height profiles of the cloud layers baked into a small 2D table: one row per
+/// CloudLayerDesc, heightSamples_ texels over the normalized height of the layer.
+/// A texel holds the layerShape term (x) and the anvil exponent (y) of CloudDensity, the
+/// part of the remap chain that only depends on the height and the layer. The cloud size
+/// (fmap.g) is already divided out of the normalized height, so one row serves every
+/// thickness of its layer. Both terms are piecewise linear in the height and constant
+/// outside [0, 1], a clamped linear fetch reproduces them where the kinks sit on texels.
+/// </summary>
+class HeightProfileLut {
+public:
+    using Settings = HeightProfileLutSettings;
+
+    Settings settings_;
+    std::vector<clouddensity::CloudLayerDesc> layers_;
+    std::vector<hlsl::float2> texels_; // heightSamples_ per row, one row per layer
+
+    bool Build(std::span<const clouddensity::CloudLayerDesc> layers, const Settings& settings = Settings());
+    bool Ready() const { return !texels_.empty(); }
+    int Rows() const { return static_cast<int>(layers_.size()); }
+
+    // linear filtered fetch of HeightProfile in RayMarch.hlsl, height clamped to [0, 1].
+    // filterBits > 0 rounds the filter weight like the GPU sampler (8 on D3D11 hardware).
+    hlsl::float2 Sample(int layer, float height, int filterBits = 0) const;
+
+    // max error of the profiles, of the layer density and of CloudDensity against the
+    // analytic path, on random heights and samples
+    std::string Validate(int samples = 65536) const;
+
+#ifdef _WIN32
+    // R32G32_FLOAT Texture2D (height, layer), t11 of RayMarch.hlsl
+    ComPtr<ID3D11Texture2D> profileTEX_;
+    ComPtr<ID3D11ShaderResourceView> profileSRV_;
+
+    bool CreateTexture();
+#endif
+};
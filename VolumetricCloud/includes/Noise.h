@@ -12,6 +12,9 @@
 #include <windows.h>
 #include <wrl/client.h>
 
+#include "BrickVolume.h"
+#include "NoiseBaker.h"
+
 using namespace DirectX;
 using Microsoft::WRL::ComPtr;
 
@@ -57,4 +60,15 @@ public:
     void CreateNoiseTexture3DResource();
     void RenderNoiseTexture3D();
 
+    // upload a CPU baked volume, frames of a sequence are stacked along the depth
+    void CreateNoiseTexture3DFromVolume(const NoiseVolume& volume);
+
+    // brick compressed copy of the volume, sampled with SampleBrickVolume in BrickVolume.hlsl
+    ComPtr<ID3D11Texture3D> brickIndirectionTEX_;
+    ComPtr<ID3D11ShaderResourceView> brickIndirectionSRV_;
+    ComPtr<ID3D11Texture3D> brickAtlasTEX_;
+    ComPtr<ID3D11ShaderResourceView> brickAtlasSRV_;
+
+    void CreateBrickTextures(const BrickVolume& bricks);
+
 };
\ No newline at end of file
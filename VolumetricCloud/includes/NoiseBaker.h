@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "HLSLMath.h"
+#include "ThreadPool.h"
+
+/// <summary>
+/// CPU baked RGBA noise volume.
+/// A sequence of frames is stored frame after frame, which is also how it is
+/// laid out along the depth of the GPU texture (see Noise::CreateNoiseTexture3DFromVolume).
+/// </summary>
+struct NoiseVolume {
+    int width_ = 0;
+    int height_ = 0;
+    int depth_ = 0;
+    int frames_ = 1;
+
+    // RGBA float, x fastest then y, z, frame
+    std::vector<float> texels_;
+
+    void Allocate(int width, int height, int depth, int frames) {
+        width_ = width;
+        height_ = height;
+        depth_ = depth;
+        frames_ = frames;
+        texels_.assign(TexelCount() * 4, 0.0f);
+    }
+
+    size_t TexelCount() const { return static_cast<size_t>(width_) * height_ * depth_ * frames_; }
+    size_t Index(int x, int y, int z, int frame = 0) const {
+        return (((static_cast<size_t>(frame) * depth_ + z) * height_ + y) * width_ + x) * 4;
+    }
+
+    hlsl::float4 Load(int x, int y, int z, int frame = 0) const {
+        const float* t = &texels_[Index(x, y, z, frame)];
+        return hlsl::float4(t[0], t[1], t[2], t[3]);
+    }
+
+    // saturated and rounded the same way the GPU writes R8G8B8A8_UNORM
+    std::vector<uint8_t> ToUnorm8() const;
+
+    // trilinear filtering with wrap addressing like the noise sampler, values are not saturated
+    hlsl::float4 Sample(const hlsl::float3& uvw, int frame = 0) const;
+};
+
+/// <summary>
+/// Bakes noise volumes on the CPU with the ports in CpuNoise.h.
+/// A volume is described by a recipe: one function per channel, evaluated at the
+/// same texel coordinates Noise::RenderNoiseTexture3D feeds the pixel shader.
+/// Bakes are spread over the thread pool slice by slice and can be cached on disk.
+/// </summary>
+class NoiseBaker {
+public:
+    // uvw in texture space, loopTime in [0, 1) for sequences and 0 for static volumes
+    using ChannelFunc = std::function<float(const hlsl::float3& uvw, float loopTime)>;
+
+    struct ChannelRecipe {
+        std::string name_;
+        ChannelFunc func_;
+    };
+
+    struct VolumeRecipe {
+        std::string name_;
+        ChannelRecipe channels_[4];
+        int frames_ = 1;
+    };
+
+    // bump when a recipe changes its output so stale caches are rebaked
+    static const uint32_t kCacheVersion = 2;
+
+    // frames in the looping noise sequence, has to match NOISE_SEQUENCE_FRAMES in RayMarch.hlsl
+    static const int kSequenceFrames = 16;
+
+    // texel -> uvw, same mapping as the full screen quad + cCurrentSlice_ in FBMTex.hlsl
+    static hlsl::float3 TexelUVW(int x, int y, int z, int width, int height, int depth);
+
+    static NoiseVolume Bake(const VolumeRecipe& recipe, int width, int height, int depth, ThreadPool& pool = ThreadPool::Shared());
+
+    // loads the bake from cacheDir when present and valid, bakes and stores it otherwise.
+    // the cache keeps the 8 bit values the GPU texture gets.
+    static NoiseVolume BakeCached(const VolumeRecipe& recipe, int width, int height, int depth, const std::string& cacheDir = "cache");
+
+    static std::string CachePath(const VolumeRecipe& recipe, int width, int height, int depth, const std::string& cacheDir);
+    static bool SaveVolume(const std::string& path, const NoiseVolume& volume);
+    static bool LoadVolume(const std::string& path, NoiseVolume& volume);
+
+    // channel generators, the name carries the parameters so it can key the cache
+    static ChannelRecipe ChannelAlligatorNoise(float gridsize, int octaves, bool tiling = true, hlsl::uint3 seed = hlsl::uint3(421, 421, 421));
+    static ChannelRecipe ChannelAlligatorPeriodic(int frequency);
+    static ChannelRecipe ChannelWorleyF2MinusF1(int frequency);
+    static ChannelRecipe ChannelPerlinWorleyPeriodic(int frequency);
+
+    // channels offered in the noise editor (INFO > Rendering Resource: 3D noise)
+    static const std::vector<ChannelRecipe>& ChannelPresets();
+
+    // volume from four presets, named after its channels
+    static VolumeRecipe RecipeFromChannels(const ChannelRecipe& r, const ChannelRecipe& g, const ChannelRecipe& b, const ChannelRecipe& a);
+
+    // shipped recipes
+    static VolumeRecipe RecipeFbm();       // FBMTex.hlsl PS
+    static VolumeRecipe RecipeFbmSmall();  // FBMTex.hlsl PS_SMALL
+    static VolumeRecipe RecipeNoiseSequence(int frames = kSequenceFrames);
+    static VolumeRecipe RecipeAlligator(); // Alligator.hlsl + FBM2.hlsl cloud shapes
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "HLSLMath.h"
+
+/// <summary>
+/// Parity harness between the shader noise and its C++ port in CpuNoise.h.
+/// Every function is fed a seeded random input set, the outputs are compared against
+/// golden outputs kept in resources/ with a per function ULP / absolute tolerance,
+/// and the throughput of the C++ port is measured against a per machine baseline.
+/// Inputs and outputs are raw 32 bit words so integer hashes and floats share one path,
+/// the GPU side (shaders/NoiseParity.hlsl) reads and writes the very same layout.
+/// The golden is written from the shader by NoiseParityGpu::WriteGolden (D3D) or
+/// NoiseParityGl::WriteGolden (headless, the checked in one). A golden from MakeGolden holds
+/// the C++ port's own outputs, the report then fails as it proves nothing about the shader.
+/// </summary>
+class NoiseParity {
+public:
+    // order matches the switch in NoiseParity.hlsl
+    enum Function : uint32_t {
+        kHash = 0,
+        kHash3,
+        kHash33,
+        kPerlinPeriodic,
+        kWorleyPeriodic,
+        kAlligatorNoise,
+        kFunctionCount
+    };
+
+    // who produced the golden outputs
+    enum Source : uint32_t {
+        kSourceCpu = 0,         // MakeGolden, the port against itself
+        kSourceGpu,             // NoiseParityGpu / NoiseParityGl::WriteGolden, the shader
+    };
+
+    struct FunctionSpec {
+        const char* name_;
+        int components_;        // used words of the output uint4
+        bool integer_;          // compare bit exact
+        uint32_t ulpTolerance_; // float outputs pass within either tolerance
+        float absTolerance_;
+    };
+
+    struct FunctionResult {
+        std::string name_;
+        int samples_ = 0;
+        int failures_ = 0;
+        int firstFailure_ = -1;
+        uint32_t maxUlp_ = 0;
+        float maxAbs_ = 0.0f;
+        double evalsPerSec_ = 0.0;
+        double baselineEvalsPerSec_ = 0.0;
+        bool speedRegressed_ = false;
+
+        bool Passed() const { return failures_ == 0 && !speedRegressed_; }
+    };
+
+    struct Report {
+        std::vector<FunctionResult> functions_;
+        std::string error_;
+        Source source_ = kSourceCpu;    // of the golden Run compared against
+
+        bool Passed() const;
+        std::string ToString() const;
+    };
+
+    // one output set per function, words packed as uint4 like the GPU buffer
+    struct Golden {
+        Source source_ = kSourceCpu;
+        uint32_t seed_ = 0;
+        int samples_ = 0;
+        std::vector<hlsl::uint4> outputs_[kFunctionCount];
+    };
+
+    static const uint32_t kGoldenVersion = 2;
+    static const uint32_t kDefaultSeed = 20240917;
+    static const int kGoldenSamples = 4096;
+
+    // a run is flagged slower when it is below this fraction of the baseline
+    static constexpr double kSpeedRegression = 0.8;
+
+    static const FunctionSpec& Spec(Function function);
+
+    // deterministic across compilers, does not depend on <random> distributions
+    static std::vector<hlsl::uint4> MakeInputs(Function function, int count, uint32_t seed);
+    static hlsl::uint4 EvaluateCpu(Function function, const hlsl::uint4& input);
+    static std::vector<hlsl::uint4> EvaluateCpu(Function function, const std::vector<hlsl::uint4>& inputs);
+
+    static Golden MakeGolden(uint32_t seed = kDefaultSeed, int samples = kGoldenSamples);
+    static bool SaveGolden(const std::string& path, const Golden& golden);
+    static bool LoadGolden(const std::string& path, Golden& golden);
+
+    // compares candidate outputs (CPU port or GPU readback) with reference outputs
+    static FunctionResult Compare(Function function, const std::vector<hlsl::uint4>& reference, const std::vector<hlsl::uint4>& candidate);
+
+    // evaluations per second of the C++ port, single threaded
+    static double Benchmark(Function function, int evaluations);
+
+    // golden check + benchmark of every function, a parity check only against a GPU golden. the baseline file is per machine,
+    // it is written when missing so the first run on a machine defines the reference.
+    static Report Run(const std::string& goldenPath = "resources/NoiseParity.golden",
+                      const std::string& baselinePath = "cache/NoiseParity.bench",
+                      int benchmarkEvaluations = 1 << 18);
+
+    static uint32_t UlpDistance(float a, float b);
+};
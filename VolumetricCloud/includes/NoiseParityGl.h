@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "NoiseParity.h"
+
+/// <summary>
+/// NoiseParityGpu for machines without D3D, the headless CI runs and the golden in resources/.
+/// ParityEvaluate of shaders/NoiseParity.hlsl and the functions it calls are cut out of the
+/// shader sources, put through a thin HLSL -> GLSL rewrite (type and intrinsic names, casts,
+/// attributes, default arguments) and dispatched as an OpenGL 4.5 compute shader on a
+/// surfaceless EGL context, Mesa llvmpipe when there is no GPU. The rewrite covers what the
+/// noise functions use, not HLSL in general. No D3D and no window are needed.
+/// </summary>
+class NoiseParityGl {
+public:
+    // EGLDisplay / EGLContext, kept opaque so the header does not pull in EGL
+    void* display_ = nullptr;
+    void* context_ = nullptr;
+    unsigned int program_ = 0;
+    std::string renderer_;      // GL_RENDERER of the context, recorded in the reports
+
+    NoiseParityGl() = default;
+    NoiseParityGl(const NoiseParityGl&) = delete;
+    NoiseParityGl& operator=(const NoiseParityGl&) = delete;
+    ~NoiseParityGl();
+
+    // context and compute program, error says which step failed
+    bool Initialize(const std::string& shaderDir, std::string& error);
+
+    bool Evaluate(NoiseParity::Function function, const std::vector<hlsl::uint4>& inputs, std::vector<hlsl::uint4>& outputs);
+
+    // CPU port vs the shader on the golden input set, like NoiseParityGpu::CompareWithCpu
+    NoiseParity::Report CompareWithCpu(int samples = NoiseParity::kGoldenSamples, uint32_t seed = NoiseParity::kDefaultSeed);
+
+    // the shader outputs become resources/NoiseParity.golden
+    bool WriteGolden(const std::string& path = "resources/NoiseParity.golden");
+
+    // compute shader source of entry and its callees in the .hlsl at path, includes resolved
+    // from its directory without regard to case
+    static bool Translate(const std::string& path, const std::string& entry, std::string& glsl, std::string& error);
+};
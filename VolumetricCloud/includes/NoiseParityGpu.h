@@ -0,0 +1,27 @@
+#pragma once
+
+#include <d3d11.h>
+#include <string>
+#include <vector>
+#include <wrl/client.h>
+
+#include "NoiseParity.h"
+
+using Microsoft::WRL::ComPtr;
+
+// runs the NoiseParity input sets through shaders/NoiseParity.hlsl and reads the outputs back
+class NoiseParityGpu {
+public:
+    ComPtr<ID3D11ComputeShader> computeShader_;
+    ComPtr<ID3D11Buffer> paramsCB_;
+
+    void CreateShader();
+
+    bool Evaluate(NoiseParity::Function function, const std::vector<hlsl::uint4>& inputs, std::vector<hlsl::uint4>& outputs);
+
+    // CPU port vs GPU on the golden input set, optionally with a larger random set
+    NoiseParity::Report CompareWithCpu(int samples = NoiseParity::kGoldenSamples, uint32_t seed = NoiseParity::kDefaultSeed);
+
+    // GPU outputs are the ground truth, this is how resources/NoiseParity.golden is produced
+    bool WriteGolden(const std::string& path = "resources/NoiseParity.golden");
+};
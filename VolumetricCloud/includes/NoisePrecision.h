@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "HLSLMath.h"
+#include "NoiseBaker.h"
+
+/// <summary>
+/// Storage format study for the noise volumes.
+/// The large and small noise recipes are baked at float precision, quantized to the
+/// candidate formats and pushed through the CPU CloudDensity remap chain along a fixed
+/// set of rays. The density and transmittance errors against the float bake tell which
+/// format is the smallest one that is still visually safe.
+/// </summary>
+class NoisePrecision {
+public:
+    enum Format {
+        kFloat = 0, // R32_FLOAT reference
+        kR16F,
+        kR16,
+        kR8,
+        kBC4,
+        kFormatCount
+    };
+
+    struct FormatResult {
+        Format format_ = kFloat;
+        float maxTexelError_ = 0.0f;
+        float maxDensityError_ = 0.0f;   // in CloudDensity output * DENSITY_DIVISOR, 0-1
+        float rmsDensityError_ = 0.0f;
+        float maxTransmittanceError_ = 0.0f;
+        float meanTransmittanceError_ = 0.0f;
+        size_t bytes_ = 0;               // large + small volume, 4 channels
+
+        bool VisuallySafe() const;
+    };
+
+    struct Report {
+        int largeResolution_ = 0;
+        int smallResolution_ = 0;
+        int rays_ = 0;
+        bool saturatedReference_ = false;
+        std::vector<FormatResult> formats_;
+
+        std::string ToString() const;
+    };
+
+    // transmittance error one 8 bit step of the final image can not show
+    static constexpr float kVisualTransmittanceError = 0.5f / 255.0f;
+
+    static const char* FormatName(Format format);
+    static float BitsPerChannel(Format format);
+
+    // every channel is quantized on its own, BC4 per 4x4 block of every slice
+    static NoiseVolume Quantize(const NoiseVolume& volume, Format format);
+    static float QuantizeHalf(float value);
+
+    // raysPerWeather rays for each of the representative weather states.
+    // saturateReference compares against the float bake clamped to 0-1, the range UNORM can hold.
+    static Report Run(int largeResolution = 128, int smallResolution = 32, int raysPerWeather = 64, bool saturateReference = false);
+};
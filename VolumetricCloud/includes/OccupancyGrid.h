@@ -0,0 +1,129 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "DensityField.h"
+#include "HLSLMath.h"
+
+#ifdef _WIN32
+#include <d3d11.h>
+#include <wrl/client.h>
+#include "Renderer.h"
+#endif
+
+// upper bounds of the noise channels CloudDensity reads. 1 holds for any UNORM volume,
+// FromField takes the real maxima of the baked volumes.
+struct NoiseBounds {
+    float large_[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    float small_[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    float sequence_ = 1.0f; // g of the noise sequence
+    bool useNoiseSequence_ = true;
+    bool lowFreq_ = false;
+
+    static NoiseBounds FromField(const DensityField& field);
+};
+
+// build settings of an OccupancyGrid
+struct OccupancyGridSettings {
+    int cellsPerTexel_ = 4;       // macro-cells per weather texel along x and z
+    float cellHeight_ = 256.0f;   // meters, OCCUPANCY_CELL_HEIGHT in RayMarch.hlsl
+    int levels_ = 64;             // the grid covers altitudes 0 to levels_ * cellHeight_
+    float curvatureMargin_ = 64.0f; // meters every cell bound reaches past the cell, see OCCUPANCY_MAX_SKIP
+    std::vector<clouddensity::CloudLayerDesc> layers_ = clouddensity::DefaultLayers(); // the layer table CloudDensity reads
+};
+
+/// <summary>
+/// Coarse occupancy of the cloud density for empty space skipping.
+/// Every macro-cell keeps a conservative max of CloudDensity: the weather channels are
+/// bounded by the bilinear values at the cell corners, the noise by NoiseBounds, and the
+/// bounds are pushed through the remap chain, which only grows with each of its inputs.
+/// Cells are aligned to the weather texel centers so the bilinear bound is exact.
+/// A cell bound also holds curvatureMargin_ meters around the cell: the pixel marcher skips
+/// along the tangent of its curved ray and drifts off it by up to skip^2 / (2 * earth radius).
+/// Mips keep the max of their children with the D3D mip sizes, the last cell of an odd
+/// sized level also covers the leftover child. x and z wrap like the weather map sampler.
+/// </summary>
+class OccupancyGrid {
+public:
+    using Settings = OccupancyGridSettings;
+
+    struct Mip {
+        int sizeX_ = 0;
+        int sizeY_ = 0; // altitude
+        int sizeZ_ = 0;
+        std::vector<float> maxDensity_; // x fastest, then z, then altitude, like the 3D texture
+
+        size_t Index(int x, int y, int z) const { return (static_cast<size_t>(y) * sizeZ_ + z) * sizeX_ + x; }
+    };
+
+    // stretch of a ray, in ray distance, that may hold cloud
+    struct Segment {
+        float begin_ = 0.0f;
+        float end_ = 0.0f;
+    };
+
+    Settings settings_;
+    NoiseBounds noise_;
+    std::vector<Mip> mips_;
+
+    // skipping above the grid is only safe when every layer top is inside it
+    bool aboveEmpty_ = true;
+    bool belowEmpty_ = true;
+
+    bool Build(int weatherWidth, int weatherHeight, const std::vector<hlsl::float4>& weather, const NoiseBounds& noise, const Settings& settings = Settings());
+    // takes the layer table of the field
+    bool Build(const DensityField& field, const Settings& settings = Settings());
+
+    // rebuilds the cell columns next to changed weather texels and their mips.
+    // returns the number of rebuilt level 0 columns.
+    int Update(const std::vector<hlsl::float4>& weather);
+
+    int MipCount() const { return static_cast<int>(mips_.size()); }
+    int WeatherWidth() const { return weatherWidth_; }
+    int WeatherHeight() const { return weatherHeight_; }
+    float Top() const { return settings_.levels_ * settings_.cellHeight_; }
+
+    // level 0 cell coordinates of a world position, x and z wrapped
+    hlsl::float3 CellCoord(const hlsl::float3& pos) const;
+
+    // conservative max density around pos, negative outside the grid altitudes
+    float MaxDensity(const hlsl::float3& pos, int mip = 0) const;
+
+    // hierarchical traversal: every step jumps over the coarsest empty cell around the ray
+    std::vector<Segment> OccupiedSegments(const hlsl::float3& origin, const hlsl::float3& dir, float tMin, float tMax, int* cellVisits = nullptr) const;
+
+    // LOS transmittance from -> to, sampled at every step like a plain march but only inside occupied segments
+    float Transmittance(const DensityField& field, const hlsl::float3& from, const hlsl::float3& to, float step = 50.0f, int* samples = nullptr) const;
+
+    // the same march without the grid, for reference
+    static float TransmittanceReference(const DensityField& field, const hlsl::float3& from, const hlsl::float3& to, float step = 50.0f, int* samples = nullptr);
+
+    // checks the bound against the field on random positions and the traversal and LOS
+    // against plain marching on random rays
+    std::string Validate(const DensityField& field, int rays = 256) const;
+
+    // occupied share of every mip
+    std::string Report() const;
+
+#ifdef _WIN32
+    // R32_FLOAT Texture3D (x, z, altitude) with every mip, t8 of RayMarch.hlsl
+    ComPtr<ID3D11Texture3D> occupancyTEX_;
+    ComPtr<ID3D11ShaderResourceView> occupancySRV_;
+
+    bool CreateTexture();
+    void UpdateTexture();
+#endif
+
+private:
+    int weatherWidth_ = 0;
+    int weatherHeight_ = 0;
+    std::vector<hlsl::float4> weather_;
+
+    hlsl::float4 WeatherTexel(int x, int y) const;
+    void WeatherRange(int cellX, int cellZ, hlsl::float4& lo, hlsl::float4& hi) const;
+    float CellMax(const hlsl::float4& weatherLo, const hlsl::float4& weatherHi, float altLo, float altHi) const;
+    void UpdateOutsideBounds();
+    void BuildColumns(const std::vector<char>& dirty);
+    void BuildMips(const std::vector<char>& dirty);
+};
@@ -54,6 +54,7 @@ public:
     ComPtr<ID3D11InputLayout> inputLayout_;
     ComPtr<ID3D11VertexShader> vertexShader_;
     ComPtr<ID3D11PixelShader> pixelShader_;
+    ComPtr<ID3D11SamplerState> shadowSampler_;
 
 	UINT indexCount_ = 0;
 
@@ -66,7 +67,9 @@ public:
     void RecompileShader();
     void CreateShaders(const std::wstring& fileName, const std::string& entryPointVS, const std::string& entryPointPS);
     void CreateGeometry(std::function<void(std::vector<Primitive::Vertex>& vtx, std::vector<UINT>& idx)> vertexFunc);
-    void Render(float width, float height, ID3D11Buffer** buffers, UINT bufferCount);
+    // srvs are bound to the pixel shader from startSlot, the cloud shadow map at t16 and t17
+    void Render(float width, float height, ID3D11Buffer** buffers, UINT bufferCount,
+        UINT startSlot = 0, UINT numViews = 0, ID3D11ShaderResourceView* const* srvs = nullptr);
     void Cleanup();
 
 	static void CreateTopologyIssueMonolith(std::vector<Vertex>& vertices, std::vector<UINT>& indices);
@@ -23,9 +23,11 @@ public:
 
     struct InputData {
         DirectX::XMFLOAT4 pixelsize;
+        DirectX::XMFLOAT4 cascade;  // cCascade_: band start and end, step budget, 1 with history
     };
 
     ComPtr<ID3D11Buffer> inputData_;
+    InputData input_ = {};
 
     // Vertex structure
     struct Vertex {
@@ -39,7 +41,12 @@ public:
     int width_ = 512;
     int height_ = 512;
 
-    Raymarch(int width, int height) : width_(width), height_(height) {};
+    // the whole ray (MAX_LENGTH of RayMarch.hlsl) with the old step budget until SetCascade,
+    // set once here so RecompileShader keeps the cascade and pixel offset
+    Raymarch(int width, int height) : width_(width), height_(height) {
+        input_.pixelsize = XMFLOAT4(static_cast<float>(width), static_cast<float>(height), 0.0f, 0.0f);
+        input_.cascade = XMFLOAT4(0.0f, 422440.0f, 2000.0f, 1.0f);
+    };
 	~Raymarch() {};
 
     ComPtr<ID3D11Texture2D> colorTEX_;
@@ -83,6 +90,10 @@ public:
     void CompileShader(const std::wstring& fileName, const std::string& entryPointVS, const std::string& entryPointPS);
     void CreateGeometry();
     void Render(UINT NumViews, ID3D11ShaderResourceView* const* ppShaderResourceViews, UINT bufferCount, ID3D11Buffer** buffers);
+    // where the ray crosses its pixel, in pixels from the centre: CloudReconstruct::PixelCenter - 0.5
+    void SetPixelOffset(float x, float y);
+    // the distance band of a cloudcascade::Cascade the target marches
+    void SetCascade(float start, float end, int stepBudget, bool history);
 
     bool ComputeShaderFromPointToPoint(DirectX::XMVECTOR startPoint, DirectX::XMVECTOR endPoint, UINT NumViews, ID3D11ShaderResourceView* const* ppShaderResourceViews, std::vector<float>& result);
 };
\ No newline at end of file
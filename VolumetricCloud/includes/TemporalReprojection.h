@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <string>
+
+#include "HLSLMath.h"
+
+class DensityField;
+struct CpuCloudFrame;
+struct CpuCloudRendererSettings;
+struct CpuCloudView;
+
+/// <summary>
+/// C++ port of the history step of StartRayMarch in RayMarch.hlsl. Camera::UpdateBuffer hands
+/// the shader cPreviousViewProjection_, the eye motion since the frame before followed by its
+/// camera relative view and projection, so a camera relative point of this frame lands where
+/// the frame before saw it. The ray crosses its pixel at a Halton point per frame and marches
+/// with steps TEMPORAL_STEP_SCALE times longer, its start and every occupancy skip jittered by
+/// up to one near step, so the history converges on the footprint of the pixel at fewer steps
+/// per frame. The pixel centre at the depth of the first cloud sample (the direction alone for
+/// sky) is reprojected and the history there blended in exponentially unless it is off screen
+/// or behind the camera before. The depth of the frame before is not compared: the first
+/// sample of a jittered march moves by whole steps from frame to frame, and that rejection
+/// left the history worse than no history on every moving path. Report drives the same steps
+/// over synthetic camera paths.
+/// </summary>
+namespace temporalreprojection {
+
+    // the TEMPORAL_* defines of RayMarch.hlsl
+    struct Params {
+        float blend_ = 0.2f;            // TEMPORAL_BLEND, weight of the fresh march
+        float stepScale_ = 2.0f;        // TEMPORAL_STEP_SCALE, the march step against the march without history
+        float jitterLength_ = 100.0f;   // TEMPORAL_JITTER_LENGTH, the march step near the camera
+    };
+
+    // interleaved gradient noise of TemporalJitter, pixel is SV_Position (the pixel centre)
+    inline float Jitter(float pixelX, float pixelY, uint32_t frame) {
+        const float shift = 5.588238f * static_cast<float>(frame % 64);
+        const float d = (pixelX + shift) * 0.06711056f + (pixelY + shift) * 0.00583715f;
+        return hlsl::frac(52.9829189f * hlsl::frac(d));
+    }
+
+    // TemporalPixelJitter: where the ray crosses its pixel, Halton (2, 3) over 8 frames
+    inline hlsl::float2 PixelJitter(uint32_t frame) {
+        static const hlsl::float2 kHalton[8] = { { 0.5f, 1.0f / 3.0f }, { 0.25f, 2.0f / 3.0f }, { 0.75f, 1.0f / 9.0f }, { 0.125f, 4.0f / 9.0f },
+                                                 { 0.625f, 7.0f / 9.0f }, { 0.375f, 2.0f / 9.0f }, { 0.875f, 5.0f / 9.0f }, { 0.0625f, 8.0f / 9.0f } };
+        return kHalton[frame % 8];
+    }
+
+    // row vector matrix like XMMATRIX, rows_[3] is the translation
+    struct Matrix {
+        hlsl::float4 rows_[4];
+    };
+
+    Matrix Multiply(const Matrix& a, const Matrix& b);
+    hlsl::float4 Transform(const hlsl::float4& v, const Matrix& m);
+
+    // XMMatrixLookAtLH from the origin times the reversed XMMatrixPerspectiveFovLH of Camera::UpdateBuffer
+    Matrix ViewProjection(const CpuCloudRendererSettings& settings, const CpuCloudView& view);
+    // cPreviousViewProjection_: a camera relative point of current into the clip space of previous
+    Matrix PreviousViewProjection(const CpuCloudRendererSettings& settings, const CpuCloudView& current, const CpuCloudView& previous);
+
+    // ReprojectPreviousFrame without the texture read: the camera relative point of a pixel of
+    // direction dir and reversed depth (0 for sky) in the frame before, uv with y down and the
+    // view depth there. false behind the camera or off screen
+    bool Reproject(const CpuCloudRendererSettings& settings, const Matrix& previousViewProjection, const hlsl::float3& forward,
+        const hlsl::float3& dir, float depth, hlsl::float2& uv, float& previousViewZ);
+
+    // pixels of the last Accumulate
+    struct Stats {
+        int history_ = 0;
+        int offScreen_ = 0;             // or behind the camera before
+    };
+
+    // the history step of StartRayMarch over a frame: fresh is the jittered march of view, history
+    // the accumulated frame before seen from previous. history null is the first frame
+    Stats Accumulate(const Params& params, const CpuCloudRendererSettings& settings, const CpuCloudView& view, const CpuCloudView& previous,
+        const CpuCloudFrame& fresh, const CpuCloudFrame* history, CpuCloudFrame& out);
+
+    // synthetic camera paths: the composed matrix against projecting the world point into the
+    // camera before, then jittered marches at the longer step accumulated with the reprojection
+    // and with the history of the same pixel, and a jittered march at the plain step without
+    // history, against a reference that averages plain step marches over the pixel of every frame
+    std::string Report(DensityField& field, int width = 64, int height = 36, int frames = 12, const std::string& resourceDir = "resources");
+
+} // namespace temporalreprojection
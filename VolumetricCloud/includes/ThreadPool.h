@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// Small persistent thread pool for the CPU side bakers.
+/// ParallelFor hands out indices through an atomic counter so slow items
+/// (e.g. noise slices near the detail octaves) do not stall a static split.
+/// The calling thread takes part in the work, so a pool of 0 workers still runs.
+/// </summary>
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threadCount = (std::max)(1u, std::thread::hardware_concurrency()) - 1) {
+        for (unsigned i = 0; i < threadCount; i++) {
+            workers_.emplace_back([this]() { WorkerLoop(); });
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            quit_ = true;
+        }
+        wake_.notify_all();
+        for (auto& worker : workers_) {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // number of threads taking part in ParallelFor, including the caller
+    unsigned ThreadCount() const { return static_cast<unsigned>(workers_.size()) + 1; }
+
+    // run func(i) for i in [begin, end), blocks until every index is done
+    void ParallelFor(int begin, int end, const std::function<void(int)>& func) {
+        if (end <= begin) { return; }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        // one batch at a time, nested calls from inside func run inline
+        if (busy_) {
+            lock.unlock();
+            for (int i = begin; i < end; i++) { func(i); }
+            return;
+        }
+        busy_ = true;
+        // publish the batch before the counter, a late worker from the previous
+        // batch may grab an index as soon as next_ is reset
+        func_ = &func;
+        end_ = end;
+        pending_ = end - begin;
+        next_ = begin;
+        generation_++;
+        lock.unlock();
+        wake_.notify_all();
+
+        RunItems();
+
+        lock.lock();
+        done_.wait(lock, [this]() { return pending_ == 0; });
+        // park the counter far beyond any range so a late worker never picks up a stale index
+        next_ = kParked;
+        func_ = nullptr;
+        busy_ = false;
+    }
+
+    // process wide pool for bakers that do not own one
+    static ThreadPool& Shared() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+private:
+    void WorkerLoop() {
+        unsigned seenGeneration = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&]() { return quit_ || generation_ != seenGeneration; });
+                if (quit_) { return; }
+                seenGeneration = generation_;
+            }
+            RunItems();
+        }
+    }
+
+    void RunItems() {
+        int finished = 0;
+        while (true) {
+            const int i = next_.fetch_add(1);
+            if (i >= end_) { break; }
+            (*func_.load())(i);
+            finished++;
+        }
+        if (finished > 0) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            pending_ -= finished;
+            if (pending_ == 0) { done_.notify_all(); }
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    std::atomic<const std::function<void(int)>*> func_ = nullptr;
+    static constexpr int kParked = 0x3fffffff;
+    std::atomic<int> next_ = kParked;
+    std::atomic<int> end_ = 0;
+    int pending_ = 0;
+    unsigned generation_ = 0;
+    bool busy_ = false;
+    bool quit_ = false;
+};
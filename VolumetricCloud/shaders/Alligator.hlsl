@@ -17,19 +17,25 @@ float SmoothValue(float x)
 }
 
 // Simple deterministic hash: float3 -> float
+// the frac of products near 2000 keeps about 12 bits, so a fused or reordered dot moves the
+// result. precise and the dot written out pin the order, like the C++ port computes it
 float Hash13(float3 p)
 {
-    p = frac(p * 0.1031);
-    p += dot(p, p.yzx + 33.33);
-    return frac((p.x + p.y) * p.z);
+    precise float3 q = frac(p * 0.1031);
+    precise float d = q.x * (q.y + 33.33) + q.y * (q.z + 33.33) + q.z * (q.x + 33.33);
+    q += d;
+    precise float h = frac((q.x + q.y) * q.z);
+    return h;
 }
 
 // Simple deterministic hash: float3 -> float3
 float3 Hash33(float3 p)
 {
-    p = frac(p * float3(0.1031, 0.1030, 0.0973));
-    p += dot(p, p.yxz + 33.33);
-    return frac((p.xxy + p.yxx) * p.zyx);
+    precise float3 q = frac(p * float3(0.1031, 0.1030, 0.0973));
+    precise float d = q.x * (q.y + 33.33) + q.y * (q.x + 33.33) + q.z * (q.z + 33.33);
+    q += d;
+    precise float3 h = frac((q.xxy + q.yxx) * q.zyx);
+    return h;
 }
 
 // Single octave Alligator Noise
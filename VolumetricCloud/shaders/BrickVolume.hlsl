@@ -0,0 +1,48 @@
+#ifndef BRICK_VOLUME_HLSL
+#define BRICK_VOLUME_HLSL
+
+// Sampling of a brick compressed noise volume exported by BrickVolume (BrickVolume.h).
+// indirection: one R32G32_UINT texel per brick, x = atlas brick index or BRICK_UNIFORM,
+//              y = packed RGBA8 value of a uniform brick
+// atlas:       RGBA8 bricks of (BRICK_SIZE + 2 * BRICK_APRON)^3 texels, the apron holds
+//              the wrapped neighbours so linear filtering never leaves the brick
+
+#ifndef BRICK_SIZE
+#define BRICK_SIZE 8
+#endif
+#define BRICK_APRON 1
+#define BRICK_UNIFORM 0xFFFFFFFF
+
+float4 UnpackBrickValue(uint v) {
+    return float4(v & 0xFF, (v >> 8) & 0xFF, (v >> 16) & 0xFF, v >> 24) / 255.0;
+}
+
+// same result as sampling the dense tiling volume with a linear wrap sampler
+float4 SampleBrickVolume(Texture3D<uint2> indirection, Texture3D atlas, SamplerState linearClamp, float3 uvw) {
+    uint3 pages;
+    indirection.GetDimensions(pages.x, pages.y, pages.z);
+    float3 atlasSize;
+    atlas.GetDimensions(atlasSize.x, atlasSize.y, atlasSize.z);
+
+    const float storedSize = BRICK_SIZE + 2 * BRICK_APRON;
+    const uint3 atlasBricks = (uint3)(atlasSize / storedSize);
+
+    // texel space of the dense volume
+    const float3 p = frac(uvw) * pages * BRICK_SIZE;
+    const uint3 page = min((uint3)p / BRICK_SIZE, pages - 1);
+
+    const uint2 entry = indirection.Load(int4(page, 0));
+    if (entry.x == BRICK_UNIFORM) {
+        return UnpackBrickValue(entry.y);
+    }
+
+    const uint3 brick = uint3(
+        entry.x % atlasBricks.x,
+        (entry.x / atlasBricks.x) % atlasBricks.y,
+        entry.x / (atlasBricks.x * atlasBricks.y));
+
+    const float3 local = p - page * BRICK_SIZE + BRICK_APRON;
+    return atlas.SampleLevel(linearClamp, (brick * storedSize + local) / atlasSize, 0);
+}
+
+#endif // BRICK_VOLUME_HLSL
@@ -0,0 +1,111 @@
+// BVH over the cumulus instances, built by CloudBvh on the CPU.
+// the node struct is shared with CloudBvh.h, which includes this file with hlsl::float3
+// and uint, the traversal below is shader only.
+#ifndef CLOUD_BVH_HLSL
+#define CLOUD_BVH_HLSL
+
+// traversal stack, CloudBvh limits the tree depth to it
+#define CLOUD_BVH_STACK 32
+
+// nodes in depth first order, an interior node is followed by its first child
+struct CloudBvhNode {
+    float3 min_;
+    uint offset_; // interior: index of the second child, leaf: first instance
+    float3 max_;
+    uint count_;  // instances of a leaf, 0 for interior nodes
+};
+
+#ifndef __cplusplus
+
+StructuredBuffer<CloudBvhNode> cloudBvhNodes : register(t12);
+StructuredBuffer<float4> cloudInstances : register(t13); // xyz center, w radius, in node order
+
+float CloudBvhBoxDistance(float3 pos, CloudBvhNode node) {
+    return length(max(max(node.min_ - pos, pos - node.max_), 0.0));
+}
+
+// distance to the nearest instance sphere, maxDistance when none is closer
+float CloudInstanceDistance(float3 pos, float maxDistance) {
+    uint count, stride;
+    cloudBvhNodes.GetDimensions(count, stride);
+    if (count == 0) { return maxDistance; }
+
+    float best = maxDistance;
+    uint stack[CLOUD_BVH_STACK];
+    int top = 0;
+    stack[top++] = 0;
+
+    [loop]
+    while (top > 0) {
+        const uint INDEX = stack[--top];
+        const CloudBvhNode NODE = cloudBvhNodes[INDEX];
+        // inside a box the spheres may reach below 0, only boxes away from pos bound them
+        const float BOX_DISTANCE = CloudBvhBoxDistance(pos, NODE);
+        if (BOX_DISTANCE > 0.0 && BOX_DISTANCE >= best) { continue; }
+
+        if (NODE.count_ > 0) {
+            for (uint i = NODE.offset_; i < NODE.offset_ + NODE.count_; i++) {
+                const float4 INSTANCE = cloudInstances[i];
+                best = min(best, length(pos - INSTANCE.xyz) - INSTANCE.w);
+            }
+            continue;
+        }
+
+        // the nearer child goes on top
+        const float NEAR_FIRST = CloudBvhBoxDistance(pos, cloudBvhNodes[INDEX + 1]);
+        const float NEAR_SECOND = CloudBvhBoxDistance(pos, cloudBvhNodes[NODE.offset_]);
+        stack[top++] = NEAR_FIRST <= NEAR_SECOND ? NODE.offset_ : INDEX + 1;
+        stack[top++] = NEAR_FIRST <= NEAR_SECOND ? INDEX + 1 : NODE.offset_;
+    }
+    return best;
+}
+
+// summed chord length through the instance spheres on the segment from + dir * [0, tMax],
+// dir normalized. the LOS transmittance is exp(-extinction * chord).
+float CloudInstanceChord(float3 from, float3 dir, float tMax) {
+    uint count, stride;
+    cloudBvhNodes.GetDimensions(count, stride);
+    if (count == 0) { return 0.0; }
+
+    const float3 INV_DIR = 1.0 / dir;
+    float chord = 0.0;
+    uint stack[CLOUD_BVH_STACK];
+    int top = 0;
+    stack[top++] = 0;
+
+    [loop]
+    while (top > 0) {
+        const uint INDEX = stack[--top];
+        const CloudBvhNode NODE = cloudBvhNodes[INDEX];
+
+        // slab test against the node box
+        const float3 T0 = (NODE.min_ - from) * INV_DIR;
+        const float3 T1 = (NODE.max_ - from) * INV_DIR;
+        const float3 T_NEAR = min(T0, T1);
+        const float3 T_FAR = max(T0, T1);
+        const float ENTER = max(max(T_NEAR.x, T_NEAR.y), max(T_NEAR.z, 0.0));
+        const float EXIT = min(min(T_FAR.x, T_FAR.y), min(T_FAR.z, tMax));
+        if (ENTER > EXIT) { continue; }
+
+        if (NODE.count_ > 0) {
+            for (uint i = NODE.offset_; i < NODE.offset_ + NODE.count_; i++) {
+                const float4 INSTANCE = cloudInstances[i];
+                // the perpendicular offset keeps the discriminant precise far from the center
+                const float B = dot(INSTANCE.xyz - from, dir);
+                const float3 H = (INSTANCE.xyz - from) - B * dir;
+                const float DISC = INSTANCE.w * INSTANCE.w - dot(H, H);
+                if (DISC <= 0.0) { continue; }
+                const float ROOT = sqrt(DISC);
+                chord += max(0.0, min(B + ROOT, tMax) - max(B - ROOT, 0.0));
+            }
+            continue;
+        }
+        stack[top++] = NODE.offset_;
+        stack[top++] = INDEX + 1;
+    }
+    return chord;
+}
+
+#endif // __cplusplus
+
+#endif // CLOUD_BVH_HLSL
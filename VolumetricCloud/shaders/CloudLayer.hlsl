@@ -0,0 +1,22 @@
+// cloud layer descriptor shared by RayMarch.hlsl (StructuredBuffer at t10) and the C++
+// port in CloudDensity.h, which includes this file with hlsl::float4.
+// float4 members only, so both sides agree on the 64 byte layout.
+#ifndef CLOUD_LAYER_HLSL
+#define CLOUD_LAYER_HLSL
+
+#define CLOUD_LAYER_MAX 8
+
+struct CloudLayerDesc {
+    // bottom = (fmap.b * x + y) ft, thickness = z + w * fmap.g meters
+    float4 altitude_;
+    // x: coverage per fmap.r, y: coverage without fmap.r, z: height of the shape peak,
+    // w: blend of the noise sequence into the base noise
+    float4 coverage_;
+    // x: anvil, y: slope, z: bottom wide, w: 1 erodes the base shape with the worley channels
+    float4 anvil_;
+    // x: noise uvw per meter, y: noise uvw offset, zw: altitude band in meters the layer can
+    // reach over the whole weather map, samples outside skip the layer
+    float4 noise_;
+};
+
+#endif // CLOUD_LAYER_HLSL
@@ -0,0 +1,190 @@
+// interleaved cloud marching: every frame one pixel of each pattern x pattern block is marched
+// into a small target, CSCloudReconstruct fills the full resolution buffer from it and from the
+// reprojected history. the desc struct is shared with CloudReconstruct.h, which includes this
+// file with hlsl::float4, the pass below is shader only and CloudReconstruct::Reconstruct is
+// its line by line port.
+#ifndef CLOUD_RECONSTRUCT_HLSL
+#define CLOUD_RECONSTRUCT_HLSL
+
+// cameras of this frame and of the history, axes of XMMatrixLookAtLH, y down world
+struct CloudReconstructDesc {
+    // xyz: eye, w: 1 when the history holds a frame
+    float4 eye_;
+    // xyz: forward, w: tan of half the horizontal fov
+    float4 forward_;
+    // xyz: right, w: tan of half the vertical fov
+    float4 right_;
+    // xyz: up, w: near / (near - far) of the reversed depth
+    float4 up_;
+    // xyz: eye of the history, w: far
+    float4 previousEye_;
+    // xyz: forward of the history, w: history rejected past this relative view depth difference
+    float4 previousForward_;
+    // xyz: right of the history, w: gamma of the variance clamp of rejected history, 0 for the spatial blend
+    float4 previousRight_;
+    // xyz: up of the history
+    float4 previousUp_;
+    // xy: full resolution, z: pattern, w: frame index
+    int4 size_;
+    // xy: pixel of the pattern block marched this frame
+    int4 phase_;
+};
+
+#ifndef __cplusplus
+
+Texture2D<float4> sparseColorTexture : register(t0);
+Texture2D<float4> sparseDepthTexture : register(t1);
+Texture2D<float4> historyColorTexture : register(t2);
+Texture2D<float> historyDepthTexture : register(t3);
+
+RWTexture2D<unorm float4> reconstructColor : register(u0);
+RWTexture2D<float> reconstructDepth : register(u1);
+
+cbuffer CloudReconstructBuffer : register(b0) {
+    CloudReconstructDesc cReconstruct_;
+};
+
+// view depth of a reversed depth value, 0 is the far plane
+float ReconstructViewDepth(float depth, CloudReconstructDesc desc) {
+    return desc.up_.w * desc.previousEye_.w / (desc.up_.w - depth);
+}
+
+// reversed depth of a view depth
+float ReconstructDepth(float viewZ, CloudReconstructDesc desc) {
+    return desc.up_.w * (viewZ - desc.previousEye_.w) / viewZ;
+}
+
+float4 HistoryBilinear(float2 texel, int2 size) {
+    const float2 BASE = floor(texel);
+    const float2 F = texel - BASE;
+    const int2 T0 = clamp(int2(BASE), 0, size - 1);
+    const int2 T1 = clamp(int2(BASE) + 1, 0, size - 1);
+    return lerp(lerp(historyColorTexture.Load(int3(T0.x, T0.y, 0)), historyColorTexture.Load(int3(T1.x, T0.y, 0)), F.x),
+                lerp(historyColorTexture.Load(int3(T0.x, T1.y, 0)), historyColorTexture.Load(int3(T1.x, T1.y, 0)), F.x), F.y);
+}
+
+// YCoCg of an rgb, alpha kept
+float4 ReconstructYCoCg(float4 c) {
+    return float4(0.25 * c.r + 0.5 * c.g + 0.25 * c.b, 0.5 * c.r - 0.5 * c.b, -0.25 * c.r + 0.5 * c.g - 0.25 * c.b, c.a);
+}
+
+float4 ReconstructRgb(float4 c) {
+    return float4(c.x + c.y - c.z, c.x + c.z, c.x - c.y - c.z, c.w);
+}
+
+[numthreads(8, 8, 1)]
+void CSCloudReconstruct(uint3 id : SV_DispatchThreadID) {
+    const CloudReconstructDesc D = cReconstruct_;
+    const int2 SIZE = D.size_.xy;
+    const int N = D.size_.z;
+    const int2 P = int2(id.xy);
+    if (any(P >= SIZE)) { return; }
+    const int2 SPARSE_SIZE = SIZE / N;
+
+    // marched this frame
+    if (all(P % N == D.phase_.xy)) {
+        const int2 S = P / N;
+        reconstructColor[P] = sparseColorTexture.Load(int3(S, 0));
+        reconstructDepth[P] = sparseDepthTexture.Load(int3(S, 0)).r;
+        return;
+    }
+
+    // the four fresh samples around, in sparse texels
+    const float2 U = float2(P - D.phase_.xy) / N;
+    const float2 BASE = floor(U);
+    const float2 F = U - BASE;
+    const int2 S0 = clamp(int2(BASE), 0, SPARSE_SIZE - 1);
+    const int2 S1 = clamp(int2(BASE) + 1, 0, SPARSE_SIZE - 1);
+    const float4 C00 = sparseColorTexture.Load(int3(S0.x, S0.y, 0));
+    const float4 C10 = sparseColorTexture.Load(int3(S1.x, S0.y, 0));
+    const float4 C01 = sparseColorTexture.Load(int3(S0.x, S1.y, 0));
+    const float4 C11 = sparseColorTexture.Load(int3(S1.x, S1.y, 0));
+    const float4 SPATIAL = lerp(lerp(C00, C10, F.x), lerp(C01, C11, F.x), F.y);
+
+    // view depth range of the fresh samples around, sky is past every cloud
+    const float4 DEPTHS = float4(sparseDepthTexture.Load(int3(S0.x, S0.y, 0)).r, sparseDepthTexture.Load(int3(S1.x, S0.y, 0)).r,
+                                 sparseDepthTexture.Load(int3(S0.x, S1.y, 0)).r, sparseDepthTexture.Load(int3(S1.x, S1.y, 0)).r);
+    float minZ = 1e30, maxZ = 0.0;
+    bool anySky = false;
+    [unroll]
+    for (int n = 0; n < 4; n++) {
+        if (DEPTHS[n] > 0.0) {
+            const float Z = ReconstructViewDepth(DEPTHS[n], D);
+            minZ = min(minZ, Z);
+            maxZ = max(maxZ, Z);
+        }
+        else {
+            anySky = true;
+        }
+    }
+
+    // the nearest fresh sample gives the depth to reproject with
+    const int2 NEAREST = clamp(int2(floor(U + 0.5)), 0, SPARSE_SIZE - 1);
+    const float DEPTH = sparseDepthTexture.Load(int3(NEAREST, 0)).r;
+    float depth = DEPTH;
+
+    // world point of the pixel, a direction only when there is no cloud
+    const float2 NDC = float2((P.x + 0.5) / SIZE.x * 2.0 - 1.0, 1.0 - (P.y + 0.5) / SIZE.y * 2.0);
+    const float3 DIR = normalize(D.forward_.xyz + D.right_.xyz * (NDC.x * D.forward_.w) + D.up_.xyz * (NDC.y * D.right_.w));
+    float3 rel = DIR;
+    float viewZ = 0.0;
+    if (DEPTH > 0.0) {
+        viewZ = ReconstructViewDepth(DEPTH, D);
+        rel = D.eye_.xyz + DIR * (viewZ / dot(DIR, D.forward_.xyz)) - D.previousEye_.xyz;
+    }
+
+    // into the history
+    const float PZ = dot(rel, D.previousForward_.xyz);
+    bool valid = D.eye_.w > 0.0 && PZ > 0.0;
+    float2 texel = 0.0;
+    if (valid) {
+        const float2 PREV_NDC = float2(dot(rel, D.previousRight_.xyz) / (PZ * D.forward_.w), dot(rel, D.previousUp_.xyz) / (PZ * D.right_.w));
+        texel = float2((PREV_NDC.x + 1.0) * 0.5 * SIZE.x, (1.0 - PREV_NDC.y) * 0.5 * SIZE.y) - 0.5;
+        valid = all(texel >= -0.5) && all(texel <= float2(SIZE) - 0.5);
+    }
+    const bool ON_SCREEN = valid;
+
+    // disocclusion: the history shows sky or cloud none of the fresh samples around shows, or a
+    // cloud outside their depth range moved into the history camera by the reprojected depth
+    if (valid) {
+        const int2 T = clamp(int2(floor(texel + 0.5)), 0, SIZE - 1);
+        const float HISTORY_DEPTH = historyDepthTexture.Load(int3(T, 0));
+        if (HISTORY_DEPTH <= 0.0) {
+            valid = anySky;
+            depth = 0.0;
+        }
+        else if (maxZ <= 0.0) {
+            valid = false;
+        }
+        else {
+            const float SHIFT = DEPTH > 0.0 ? PZ - viewZ : 0.0;
+            const float HISTORY_Z = ReconstructViewDepth(HISTORY_DEPTH, D);
+            const float TOLERANCE = D.previousForward_.w * HISTORY_Z;
+            valid = HISTORY_Z >= minZ + SHIFT - TOLERANCE && HISTORY_Z <= maxZ + SHIFT + TOLERANCE;
+            // the history keeps the depth of its own march
+            depth = ReconstructDepth(max(HISTORY_Z - SHIFT, 1.0), D);
+        }
+    }
+
+    if (!valid) {
+        // rejected history still on screen is clamped to the mean +- gamma sigma of the fresh
+        // samples in YCoCg, it keeps detail they do not resolve where the spatial blend has none
+        float4 color = SPATIAL;
+        if (ON_SCREEN && D.previousRight_.w > 0.0) {
+            const float4 Y00 = ReconstructYCoCg(C00), Y10 = ReconstructYCoCg(C10), Y01 = ReconstructYCoCg(C01), Y11 = ReconstructYCoCg(C11);
+            const float4 MEAN = (Y00 + Y10 + Y01 + Y11) * 0.25;
+            const float4 SQUARE = (Y00 * Y00 + Y10 * Y10 + Y01 * Y01 + Y11 * Y11) * 0.25;
+            const float4 SIGMA = sqrt(max(SQUARE - MEAN * MEAN, 0.0)) * D.previousRight_.w;
+            color = ReconstructRgb(clamp(ReconstructYCoCg(HistoryBilinear(texel, SIZE)), MEAN - SIGMA, MEAN + SIGMA));
+        }
+        reconstructColor[P] = color;
+        reconstructDepth[P] = DEPTH;
+        return;
+    }
+    reconstructDepth[P] = depth;
+    reconstructColor[P] = HistoryBilinear(texel, SIZE);
+}
+
+#endif // __cplusplus
+
+#endif // CLOUD_RECONSTRUCT_HLSL
@@ -0,0 +1,83 @@
+// top-down cloud shadow map baked by CloudShadowMap on the CPU.
+// the desc struct is shared with CloudShadowMap.h, which includes this file with hlsl::float4,
+// the lookups below are shader only.
+#ifndef CLOUD_SHADOW_MAP_HLSL
+#define CLOUD_SHADOW_MAP_HLSL
+
+// knots are packed four per slice of the texture array
+#define CLOUD_SHADOW_KNOTS_MAX 256
+
+// the 400 m light segment of a cloud sample reads the map only with the sun this high
+// (sin 30 degrees). lower, a knot spans more path than the march step and the march wins
+#define CLOUD_SHADOW_SEGMENT_MIN_UP 0.5
+
+// a texel is a column along the sun through the altitude band, holding the optical depth
+// from knot k up to the top of the band. the knots are evenly spaced in altitude, the top
+// of the band is an implicit last knot with 0
+struct CloudShadowMapDesc {
+    // xy: world xz of the map corner at the band bottom, z: meters per texel, w: 1 / resolution
+    float4 origin_;
+    // xy: xz offset per meter of altitude along the sun, z: knots, w: 1 when baked
+    float4 shear_;
+    // x: band bottom (knot 0), y: meters between knots, z: band top, w: altitude per meter along the sun
+    float4 band_;
+};
+
+#ifndef __cplusplus
+
+Texture2DArray<float4> cloudShadowTexture : register(t16);
+StructuredBuffer<CloudShadowMapDesc> cloudShadowDesc : register(t17);
+
+// optical depth from altitude alt up to the top of the band in the column at uv
+float CloudShadowColumnDepth(float2 uv, float alt, CloudShadowMapDesc desc, SamplerState samplerState) {
+    if (alt >= desc.band_.z) { return 0.0; }
+    const uint KNOTS = (uint)desc.shear_.z;
+    const float K = max(alt - desc.band_.x, 0.0) / desc.band_.y;
+    const uint K0 = min((uint)K, KNOTS - 1);
+
+    // the two knots around alt, a second fetch only across a slice
+    const float4 A = cloudShadowTexture.SampleLevel(samplerState, float3(uv, K0 / 4), 0);
+    const float4 B = (K0 % 4 == 3 && K0 + 1 < KNOTS) ? cloudShadowTexture.SampleLevel(samplerState, float3(uv, K0 / 4 + 1), 0) : A;
+    const float D0 = A[K0 % 4];
+    const float D1 = K0 + 1 >= KNOTS ? 0.0 : (K0 % 4 == 3 ? B.x : A[K0 % 4 + 1]);
+    return lerp(D0, D1, saturate(K - K0));
+}
+
+// column of pos in the map, false outside it or before the first bake
+bool CloudShadowColumn(float3 pos, out float2 uv, out CloudShadowMapDesc desc) {
+    uv = 0.0;
+    desc = (CloudShadowMapDesc)0;
+    uint count, stride;
+    cloudShadowDesc.GetDimensions(count, stride);
+    if (count == 0) { return false; }
+    desc = cloudShadowDesc[0];
+    if (desc.shear_.w <= 0.0) { return false; }
+
+    // follow the sun line through pos down (or up) to the band bottom
+    const float2 BOTTOM = pos.xz - desc.shear_.xy * (-pos.y - desc.band_.x);
+    uv = (BOTTOM - desc.origin_.xy) / desc.origin_.z * desc.origin_.w;
+    // between the border texel centres, outside the caller marches the sun
+    return all(uv >= 0.5 * desc.origin_.w) && all(uv <= 1.0 - 0.5 * desc.origin_.w);
+}
+
+// optical depth from pos to the sun through the whole band, negative outside the map
+float CloudShadowDepth(float3 pos, SamplerState samplerState) {
+    float2 uv;
+    CloudShadowMapDesc desc;
+    if (!CloudShadowColumn(pos, uv, desc)) { return -1.0; }
+    return CloudShadowColumnDepth(uv, -pos.y, desc, samplerState);
+}
+
+// optical depth of the segment pos + toSun * [0, len], negative outside the map or below
+// CLOUD_SHADOW_SEGMENT_MIN_UP
+float CloudShadowSegment(float3 pos, float len, SamplerState samplerState) {
+    float2 uv;
+    CloudShadowMapDesc desc;
+    if (!CloudShadowColumn(pos, uv, desc) || desc.band_.w < CLOUD_SHADOW_SEGMENT_MIN_UP) { return -1.0; }
+    const float ALT = -pos.y;
+    return max(CloudShadowColumnDepth(uv, ALT, desc, samplerState) - CloudShadowColumnDepth(uv, ALT + len * desc.band_.w, desc, samplerState), 0.0);
+}
+
+#endif // __cplusplus
+
+#endif // CLOUD_SHADOW_MAP_HLSL
@@ -7,7 +7,7 @@ cbuffer CameraBuffer : register(b0) {
     matrix cPreviousViewProjection_;
     float4 cCameraPosition_; 
     float2 cResolution_;
-    float2 cPadding_;
+    float2 cHistory_; // x: 1 when cPreviousViewProjection_ holds the frame before, y: frame index
 };
 
 cbuffer EnvironmentBuffer : register(b1) {
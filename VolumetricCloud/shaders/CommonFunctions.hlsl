@@ -8,6 +8,44 @@
 #define earth_radius_meter 6371e3
 #define ft_to_meter 0.3048
 
+// the cloud march ends at the farthest primitive inside its own pixel and MergePrimitiveAndCloud.hlsl
+// brings it to the screen with BilateralUpsample. 0: the march ends at the farthest primitive of
+// the pixel and its neighbours, and is stretched bilinear
+#define USE_BILATERAL_UPSAMPLE 1
+
+// the smallest reversed depth of the depth texels the pixel at uv of a target of targetSize covers,
+// the bilinear read when it covers no texel centre. rayUv gets the mean uv of the texels at that
+// depth when the others are nearer, uv otherwise: a pixel straddling a depth edge marches through
+// its farther part. C++ port CpuCloudRenderer::FootprintFarthest
+float FootprintFarthest(Texture2D depth, SamplerState fallbackSampler, float2 uv, float2 targetSize, out float2 rayUv) {
+    uint width, height;
+    depth.GetDimensions(width, height);
+    const int2 SIZE = int2(width, height);
+    const int2 LO = int2(ceil((uv - 0.5 / targetSize) * float2(SIZE) - 0.5));
+    const int2 HI = int2(ceil((uv + 0.5 / targetSize) * float2(SIZE) - 0.5)) - 1;
+    rayUv = uv;
+    if (any(HI < LO)) {
+        return depth.SampleLevel(fallbackSampler, uv, 0).r;
+    }
+
+    float farthest = 3.402823466e+38;
+    float2 sum = 0.0;
+    int count = 0;
+    for (int y = LO.y; y <= HI.y; ++y) {
+        for (int x = LO.x; x <= HI.x; ++x) {
+            // wrapped like the depthSampler of RayMarch.hlsl
+            const int2 TEXEL = ((int2(x, y) % SIZE) + SIZE) % SIZE;
+            const float DEPTH = depth.Load(int3(TEXEL, 0)).r;
+            if (DEPTH < farthest) { farthest = DEPTH; sum = 0.0; count = 0; }
+            if (DEPTH == farthest) { sum += float2(x, y) + 0.5; count++; }
+        }
+    }
+    if (count < (HI.x - LO.x + 1) * (HI.y - LO.y + 1)) {
+        rayUv = sum / count / float2(SIZE);
+    }
+    return farthest;
+}
+
 float2 RaySphereIntersectForSunColor(
     float3 start, // starting position of the ray
     float3 dir, // the direction of the ray
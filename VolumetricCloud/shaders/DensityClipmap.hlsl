@@ -0,0 +1,21 @@
+// camera centred clipmap of the low frequency cloud density, planned by DensityClipmap.
+// the level struct is shared with DensityClipmap.h, which includes this file with hlsl::float4.
+#ifndef DENSITY_CLIPMAP_HLSL
+#define DENSITY_CLIPMAP_HLSL
+
+#define DENSITY_CLIPMAP_LEVELS_MAX 8
+// points per axis of the lattice over a texel box whose densest point is the skip channel
+#define DENSITY_CLIPMAP_SKIP_LATTICE 3
+
+// one nested level, finest first. texel (x, z) holds world texel x + k * resolution along
+// both axes, so the hardware wrap addressing does the toroidal lookup
+struct DensityClipmapLevel {
+    // xz meters, min (xy) and max (zw), where the linear filter only reads fresh texels.
+    // empty when min >= max
+    float4 window_;
+    // x: meters per texel, y: 1 / (meters per texel * resolution),
+    // z: bottom of the altitude band in meters, w: 1 / height of the band
+    float4 texel_;
+};
+
+#endif // DENSITY_CLIPMAP_HLSL
@@ -0,0 +1,36 @@
+// min / max mips of the reversed primitive depth, DepthPyramid builds one level per dispatch.
+// level 0 copies the depth target, every further level halves the one before rounding up, the
+// last texel of an odd sized level also covers the leftover child. x: the smallest reversed
+// depth (the farthest primitive), y: the largest. C++ port DepthPyramid::Build
+
+Texture2D<float> depthTexture : register(t0);
+Texture2D<float2> sourceLevel : register(t1);
+
+RWTexture2D<float2> targetLevel : register(u0);
+
+cbuffer DepthPyramidBuffer : register(b0) {
+    // xy: size of the level written, zw: size of the level read
+    int4 cSize_;
+};
+
+[numthreads(8, 8, 1)]
+void CSDepthPyramidCopy(uint3 DTid : SV_DispatchThreadID) {
+    if (any(int2(DTid.xy) >= cSize_.xy)) { return; }
+
+    const float DEPTH = depthTexture.Load(int3(DTid.xy, 0));
+    targetLevel[DTid.xy] = float2(DEPTH, DEPTH);
+}
+
+[numthreads(8, 8, 1)]
+void CSDepthPyramidReduce(uint3 DTid : SV_DispatchThreadID) {
+    if (any(int2(DTid.xy) >= cSize_.xy)) { return; }
+
+    // children past the edge of an odd level repeat the last one
+    const int2 C0 = int2(DTid.xy) * 2;
+    const int2 C1 = min(C0 + 1, cSize_.zw - 1);
+    const float2 A = sourceLevel.Load(int3(C0.x, C0.y, 0));
+    const float2 B = sourceLevel.Load(int3(C1.x, C0.y, 0));
+    const float2 C = sourceLevel.Load(int3(C0.x, C1.y, 0));
+    const float2 D = sourceLevel.Load(int3(C1.x, C1.y, 0));
+    targetLevel[DTid.xy] = float2(min(min(A.x, B.x), min(C.x, D.x)), max(max(A.y, B.y), max(C.y, D.y)));
+}
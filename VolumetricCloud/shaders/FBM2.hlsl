@@ -143,6 +143,9 @@ float WorleyPeriodic(float3 p, int frequency)
     int3 cell = (int3)floor(p);
     float3 f = frac(p);
 
+    // whole periods off first, % of a negative dividend is undefined in HLSL
+    cell -= frequency * (int3)floor(floor(p) / frequency);
+
     float minDist = 1e6;
 
     [fastopt]
@@ -183,6 +186,9 @@ float WorleyF2MinusF1(float3 p, int frequency)
     int3 cell = (int3)floor(p);
     float3 f = frac(p);
 
+    // whole periods off first, % of a negative dividend is undefined in HLSL
+    cell -= frequency * (int3)floor(floor(p) / frequency);
+
     float d1 = 1e6;
     float d2 = 1e6;
 
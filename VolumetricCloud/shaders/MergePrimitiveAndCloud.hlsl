@@ -11,6 +11,9 @@ Texture2D cloudDepthTexture : register(t5);
 SamplerState linearSampler : register(s0);
 SamplerState pixelSampler : register(s1);
 
+#define UPSAMPLE_DEPTH_EPSILON 0.01 // relative depth difference that halves the weight of a texel
+#define UPSAMPLE_TENT_FLOOR (1.0 / 1024.0) // least spatial weight, a pixel whose texels all moved their rays away keeps one
+
 /* constants */
 static const float2 g_kernel[4] = {
     float2(+0.0f, +1.0f),
@@ -31,101 +34,59 @@ VS_OUTPUT VS(float4 Pos : POSITION, float2 Tex : TEXCOORD0) {
     return output;
 }
 
-float4 BU(VS_OUTPUT input)
-{
-    const float2 g_ScreenParam = float2(1024.0, 1024.0); // TBD
-    const float2 kScreenSize = g_ScreenParam.xy * 2.0;
-    const float2 kScreenHalfSize = float2(512.0, 512.0); // TBD
-    const float4 kBilinearWeights[4] =
-    {
-        float4( 9.0/16.0, 3.0/16.0, 3.0/16.0, 1.0/16.0 ),
-        float4( 3.0/16.0, 9.0/16.0, 1.0/16.0, 3.0/16.0 ),
-        float4( 3.0/16.0, 1.0/16.0, 9.0/16.0, 3.0/16.0 ),
-        float4( 1.0/16.0, 3.0/16.0, 3.0/16.0, 9.0/16.0 )
-    };
-
-    int2 hiResUV = (int2)(input.Tex * kScreenSize + float2(0.1, 0.1));
-    int hiResIndex = (1 - (hiResUV.y & 0x01)) * 2 + (1 - (hiResUV.x & 0x01));
-    float4 hiResND = primitiveDepthTexture.Sample(linearSampler, input.Tex);
+// cloud buffer of any size to the screen: the four texels of the bilinear footprint are weighted
+// down by how far the primitive their march ended at is from the primitive of the pixel, colour
+// and cloud depth alike. the spatial weight is a tent around where the ray of the texel crossed,
+// the texel centre unless it straddled a depth edge (FootprintFarthest).
+// C++ port bilateralupsample, edge bleeding checked by bilateralupsample::Report
+float4 BilateralUpsample(float2 uv, float primitiveDepth, out float cloudDepth) {
+    uint width, height;
+    cloudTexture.GetDimensions(width, height);
+    const float2 SIZE = float2(width, height);
+    const float2 POS = uv * SIZE - 0.5;
+    const float2 BASE = floor(POS);
+    const float VIEW_Z = DepthToMeter(primitiveDepth);
 
-    float2 lowResUV = (input.Tex * kScreenHalfSize.xy + float2(0.1, 0.1));
-    float4 lowResND[4];
-    float4 lowResCol[4];
-    switch (hiResIndex)
-    {
-    case 0:
-        lowResND[0] = cloudDepthTexture.Sample(linearSampler, input.Tex);
-        lowResND[1] = cloudDepthTexture.Sample(linearSampler, input.Tex + float2(1.0 / kScreenHalfSize.x, 0.0));
-        lowResND[2] = cloudDepthTexture.Sample(linearSampler, input.Tex + float2(0.0, 1.0 / kScreenHalfSize.y));
-        lowResND[3] = cloudDepthTexture.Sample(linearSampler, input.Tex + float2(1.0 / kScreenHalfSize.x, 1.0 / kScreenHalfSize.y));
-        lowResCol[0] = cloudTexture.Sample(linearSampler, input.Tex);
-        lowResCol[1] = cloudTexture.Sample(linearSampler, input.Tex + float2(1.0 / kScreenHalfSize.x, 0.0));
-        lowResCol[2] = cloudTexture.Sample(linearSampler, input.Tex + float2(0.0, 1.0 / kScreenHalfSize.y));
-        lowResCol[3] = cloudTexture.Sample(linearSampler, input.Tex + float2(1.0 / kScreenHalfSize.x, 1.0 / kScreenHalfSize.y));
-        break;
-    case 1:
-        lowResND[0] = cloudDepthTexture.Sample(linearSampler, input.Tex - float2(1.0 / kScreenHalfSize.x, 0.0));
-        lowResND[1] = cloudDepthTexture.Sample(linearSampler, input.Tex);
-        lowResND[2] = cloudDepthTexture.Sample(linearSampler, input.Tex - float2(1.0 / kScreenHalfSize.x, 1.0 / kScreenHalfSize.y));
-        lowResND[3] = cloudDepthTexture.Sample(linearSampler, input.Tex + float2(0.0, 1.0 / kScreenHalfSize.y));
-        lowResCol[0] = cloudTexture.Sample(linearSampler, input.Tex - float2(1.0 / kScreenHalfSize.x, 0.0));
-        lowResCol[1] = cloudTexture.Sample(linearSampler, input.Tex);
-        lowResCol[2] = cloudTexture.Sample(linearSampler, input.Tex - float2(1.0 / kScreenHalfSize.x, 1.0 / kScreenHalfSize.y));
-        lowResCol[3] = cloudTexture.Sample(linearSampler, input.Tex + float2(0.0, 1.0 / kScreenHalfSize.y));
-        break;
-    case 2:
-        lowResND[0] = cloudDepthTexture.Sample(linearSampler, input.Tex - float2(0.0, 1.0 / kScreenHalfSize.y));
-        lowResND[1] = cloudDepthTexture.Sample(linearSampler, input.Tex + float2(1.0 / kScreenHalfSize.x, -1.0 / kScreenHalfSize.y));
-        lowResND[2] = cloudDepthTexture.Sample(linearSampler, input.Tex);
-        lowResND[3] = cloudDepthTexture.Sample(linearSampler, input.Tex + float2(1.0 / kScreenHalfSize.x, 0.0));
-        lowResCol[0] = cloudTexture.Sample(linearSampler, input.Tex - float2(0.0, 1.0 / kScreenHalfSize.y));
-        lowResCol[1] = cloudTexture.Sample(linearSampler, input.Tex + float2(1.0 / kScreenHalfSize.x, -1.0 / kScreenHalfSize.y));
-        lowResCol[2] = cloudTexture.Sample(linearSampler, input.Tex);
-        lowResCol[3] = cloudTexture.Sample(linearSampler, input.Tex + float2(1.0 / kScreenHalfSize.x, 0.0));
-        break;
-    case 3:
-        lowResND[0] = cloudDepthTexture.Sample(linearSampler, input.Tex - float2(1.0 / kScreenHalfSize.x, 1.0 / kScreenHalfSize.y));
-        lowResND[1] = cloudDepthTexture.Sample(linearSampler, input.Tex - float2(0.0, 1.0 / kScreenHalfSize.y));
-        lowResND[2] = cloudDepthTexture.Sample(linearSampler, input.Tex - float2(1.0 / kScreenHalfSize.x, 0.0));
-        lowResND[3] = cloudDepthTexture.Sample(linearSampler, input.Tex);
-        lowResCol[0] = cloudTexture.Sample(linearSampler, input.Tex - float2(1.0 / kScreenHalfSize.x, 1.0 / kScreenHalfSize.y));
-        lowResCol[1] = cloudTexture.Sample(linearSampler, input.Tex - float2(0.0, 1.0 / kScreenHalfSize.y));
-        lowResCol[2] = cloudTexture.Sample(linearSampler, input.Tex - float2(1.0 / kScreenHalfSize.x, 0.0));
-        lowResCol[3] = cloudTexture.Sample(linearSampler, input.Tex);
-        break;
-    }
-
-    float totalWeight = 0.0;
     float4 color = 0.0;
-    for( int i = 0; i < 4; ++i )
-    {
-        float depthDiff = hiResND.r - lowResND[i].r;
-        float depthWeight = 1.0 / (0.0001 + abs(depthDiff)); // Add epsilon to avoid division by zero
-
-		// inside cloud it gets all black so we need min value
-        float weight = 0.0001 + depthWeight * kBilinearWeights[hiResIndex][i];
-        totalWeight += weight;
-        color += lowResCol[i] * weight;
+    float depth = 0.0;
+    float totalWeight = 0.0;
+    [unroll]
+    for (int i = 0; i < 4; ++i) {
+        const int2 CORNER = int2(i & 1, i >> 1);
+        const int2 TEXEL = clamp(int2(BASE) + CORNER, int2(0, 0), int2(width, height) - 1);
+
+        // where the march of the texel ended and the point its ray crossed, primDepth of StartRayMarch
+        float2 rayUv;
+        const float TEXEL_VIEW_Z = DepthToMeter(FootprintFarthest(primitiveDepthTexture, linearSampler, (TEXEL + 0.5) / SIZE, SIZE, rayUv));
+        const float2 TENT = saturate(1.0 - abs(POS + 0.5 - rayUv * SIZE));
+        const float DIFFERENCE = abs(VIEW_Z - TEXEL_VIEW_Z) / min(VIEW_Z, TEXEL_VIEW_Z);
+        const float WEIGHT = max(TENT.x * TENT.y, UPSAMPLE_TENT_FLOOR) / (UPSAMPLE_DEPTH_EPSILON + DIFFERENCE);
+
+        color += cloudTexture.Load(int3(TEXEL, 0)) * WEIGHT;
+        depth += cloudDepthTexture.Load(int3(TEXEL, 0)).r * WEIGHT;
+        totalWeight += WEIGHT;
     }
 
-    color /= totalWeight;
-
-    return color;
+    cloudDepth = depth / totalWeight;
+    return color / totalWeight;
 }
 
 float4 PS(VS_OUTPUT input) : SV_TARGET {
     float4 primitiveColor = primitiveTexture.Sample(linearSampler, input.Tex);
     float primitiveDepthValue = primitiveDepthTexture.Sample(linearSampler, input.Tex).r;
     float4 farCloudColor = farCloudTexture.Sample(linearSampler, input.Tex);
+#if USE_BILATERAL_UPSAMPLE
+    float cloudDepthValue;
+    float4 cloudColor = BilateralUpsample(input.Tex, primitiveDepthValue, cloudDepthValue);
+#else
     float4 cloudColor = cloudTexture.Sample(linearSampler, input.Tex);
-    float4 cloudDepthValue = cloudDepthTexture.Sample(linearSampler, input.Tex);
+    float cloudDepthValue = cloudDepthTexture.Sample(linearSampler, input.Tex).r;
+#endif
     float4 skyBoxColor = skyBoxTexture.Sample(linearSampler, input.Tex);
 
-    //float4 upscaledCloud = BU(input);
-
     float4 finalColor = skyBoxColor * (1.0 - primitiveColor.a) + primitiveColor;
     finalColor = finalColor * (1.0 - farCloudColor.a) + farCloudColor;
-    if (cloudDepthValue.r > primitiveDepthValue.r) {
+    if (cloudDepthValue > primitiveDepthValue) {
         finalColor = finalColor * (1.0 - cloudColor.a) + cloudColor;
     }
 
@@ -0,0 +1,64 @@
+// GPU side of the noise parity harness (NoiseParity.h / NoiseParityGpu.cpp, NoiseParityGl.cpp).
+// Inputs and outputs are raw 32 bit words, the layout per function is defined by
+// NoiseParity::MakeInputs and NoiseParity::EvaluateCpu and has to stay in sync.
+
+#include "FBM.hlsl"
+#include "Alligator.hlsl"
+
+#define PARITY_HASH             0u
+#define PARITY_HASH3            1u
+#define PARITY_HASH33           2u
+#define PARITY_PERLIN_PERIODIC  3u
+#define PARITY_WORLEY_PERIODIC  4u
+#define PARITY_ALLIGATOR_NOISE  5u
+
+// matches kAlligatorOctaves in NoiseParity.cpp
+#define PARITY_ALLIGATOR_OCTAVES 3
+
+cbuffer ParityParams : register(b5) {
+    uint cParityFunction_;
+    uint cParityCount_;
+    uint2 cParityPadding_;
+};
+
+StructuredBuffer<uint4> parityInputs : register(t0);
+RWStructuredBuffer<uint4> parityOutputs : register(u0);
+
+// one input of one function, NoiseParityGl compiles this and what it calls as GLSL
+uint4 ParityEvaluate(uint function, uint4 words)
+{
+    float3 p = asfloat(words.xyz);
+    uint4 result = uint4(0, 0, 0, 0);
+
+    switch (function) {
+    case PARITY_HASH:
+        result.x = hash(words.x);
+        break;
+    case PARITY_HASH3:
+        result.x = hash3(words.xyz);
+        break;
+    case PARITY_HASH33:
+        result.xyz = asuint(hash33(p));
+        break;
+    case PARITY_PERLIN_PERIODIC:
+        result.x = asuint(PerlinPeriodic(p, (int)words.w));
+        break;
+    case PARITY_WORLEY_PERIODIC:
+        result.x = asuint(WorleyPeriodic(p, (int)words.w));
+        break;
+    case PARITY_ALLIGATOR_NOISE:
+        result.x = asuint(AlligatorNoise(p, asfloat(words.w), PARITY_ALLIGATOR_OCTAVES, ALLIGATOR_LACUNARITY, ALLIGATOR_PERSISTENCE, true));
+        break;
+    }
+    return result;
+}
+
+[numthreads(64, 1, 1)]
+void CSMain(uint3 id : SV_DispatchThreadID)
+{
+    if (id.x >= cParityCount_) {
+        return;
+    }
+
+    parityOutputs[id.x] = ParityEvaluate(cParityFunction_, parityInputs[id.x]);
+}
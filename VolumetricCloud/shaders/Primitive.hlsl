@@ -1,5 +1,8 @@
 #include "CommonFunctions.hlsl"
 #include "CommonBuffer.hlsl"
+#include "CloudShadowMap.hlsl"
+
+SamplerState shadowSampler : register(s0);
 
 cbuffer TransformBuffer : register(b3) {
     matrix scaleMatrix;
@@ -64,6 +67,10 @@ PS_OUTPUT PS(PS_INPUT input) {
     float3 cLightColor_ = CalculateSunlightColor(-fixedLightDir);
     cLightColor_ *= col;
 
+    // cloud shadow, the sun through the whole cloud band above the surface
+    const float SHADOW_DEPTH = CloudShadowDepth(input.Worldpos.xyz + cCameraPosition_.xyz, shadowSampler);
+    cLightColor_ *= SHADOW_DEPTH >= 0.0 ? exp(-SHADOW_DEPTH) : 1.0;
+
     output.Color = float4(cLightColor_, 1.0);
     output.Normal = float4(n, 1.0);
     output.Depth = input.depth;
@@ -21,14 +21,113 @@ Texture3D noiseTexture : register(t3);
 Texture3D noiseSmallTexture : register(t4);
 Texture2D cloudMapTexture : register(t5);
 Texture2D<float4> fMapTexture : register(t6);
+Texture3D noiseSequenceTexture : register(t7);
+Texture3D<float> occupancyTexture : register(t8);
+Texture3D<float> cloudSdfTexture : register(t9);
+Texture2D<float2> depthPyramidTexture : register(t21); // min / max reversed depth of the primitives per mip, DepthPyramid
+TextureCube farCloudCacheTexture : register(t22); // the far band around the camera, FarCloudCache
 
 #define MAX_LENGTH 422440.0f
 #define LIGHT_MARCH_SIZE 400.0f
 
+// view rays bend down with the earth surface, CurvedRayPosition / CurvedRayTangent.
+// the polynomial is checked against the exact arc by earthcurvature::Report
+#define EARTH_RADIUS 6371e3
+
+// looping noise sequence baked by NoiseBaker::RecipeNoiseSequence
+// frames has to match NoiseBaker::kSequenceFrames
+#define NOISE_SEQUENCE_FRAMES 16
+#define NOISE_SEQUENCE_PERIOD_SEC 120.0
+#define USE_NOISE_SEQUENCE 1
+
+// macro-cell max density built by OccupancyGrid, x/z/altitude with mips
+// the skip follows the tangent of the curved ray, OccupancyGridSettings::curvatureMargin_
+// has to cover the drift MAX_SKIP^2 / (2 * EARTH_RADIUS) plus the nudge
+#define USE_OCCUPANCY_GRID 1
+#define OCCUPANCY_CELL_HEIGHT 256.0
+#define OCCUPANCY_MAX_SKIP 24000.0
+#define OCCUPANCY_NUDGE 1.0
+
+// distance to the cloud built by CloudSdf on the occupancy cells, R16_UNORM
+// SDF_MAX_DISTANCE has to match CloudSdfSettings::maxDistance_
+#define USE_CLOUD_SDF 1
+#define SDF_MAX_DISTANCE 65535.0
+
+// layer table built by Fmap::CloudLayers, one CloudLayerDesc per layer.
+// rays skip layers whose altitude slab they can not reach, the pad covers the float
+// error of CurvedRayPosition
+#define CLOUD_LAYER_SLAB_PAD 16.0
+
+// layerShape and the anvil exponent per layer baked by HeightProfileLut, one row per layer
+#define USE_HEIGHT_PROFILE_LUT 1
+
+// low frequency density around the camera kept by DensityClipmap. samples further than
+// DENSITY_CLIPMAP_FAR_DISTANCE read it in one fetch instead of CloudDensity, without erosion
+// and detail. CloudDensity skips its noise fetches where the texel holds no cloud at all.
+// DensityClipmap::Validate bounds both. kUseDensityClipmap of VolumetricCloud.cpp
+#define USE_DENSITY_CLIPMAP 1
+#define DENSITY_CLIPMAP_FAR_DISTANCE 40000.0
+
+// optical depth toward the sun baked by CloudShadowMap, the light of a cloud sample is two
+// lookups of its column instead of sunSteps CloudDensity calls. outside the map and with the sun
+// below CLOUD_SHADOW_SEGMENT_MIN_UP the sun is marched. CloudShadowMap::Validate keeps the
+// segment within twice the error of the 8 step march
+#define USE_CLOUD_SHADOW_MAP 1
+
+// step controller of the pixel and LOS marches inside the cloud, C++ port adaptivestep::NextStep.
+// a long empty step that lands in cloud walks back and enters in ADAPTIVE_ENTRY_SPLIT pieces, so
+// the empty step floor can sit above the 50 m near step. adaptivestep::Report: less error than the
+// fixed steps with a tenth fewer steps and density samples on the regression poses
+#define USE_ADAPTIVE_STEP 1
+#define ADAPTIVE_STEP_ERROR 0.005
+#define ADAPTIVE_MIN_STEP 70.0
+#define ADAPTIVE_MAX_STEP 800.0
+#define ADAPTIVE_MAX_OPTICAL_DEPTH 2.0
+#define ADAPTIVE_FOOTPRINT 0.002
+#define ADAPTIVE_GROWTH 2.0
+#define ADAPTIVE_ENTRY_SPLIT 6.0
+
+// history of the pixel march: the first cloud sample is reprojected with cPreviousViewProjection_
+// into the frame before and blended in unless it went off screen. the ray crosses its pixel at a
+// Halton point per frame and marches TEMPORAL_STEP_SCALE times the step, starting up to one near
+// step later per pixel and frame and again after every skip, so the blend averages the footprint
+// and the step pattern. the first sample of such a march moves by whole steps, no depth test.
+// C++ port temporalreprojection, checked on camera paths by temporalreprojection::Report.
+// half the error of a plain march on every path at two thirds of its steps. the near band only
+#define USE_TEMPORAL_ACCUMULATION 1
+#define TEMPORAL_BLEND 0.2
+#define TEMPORAL_STEP_SCALE 2.0
+#define TEMPORAL_JITTER_LENGTH 100.0
+
+// min / max mips of the primitive depth built by DepthPyramid after the monolith. a pixel whose
+// ray can not reach any layer slab before the farthest primitive of its tile stays empty without
+// marching. C++ port DepthPyramid::Culled, checked over terrain by DepthPyramid::Report.
+// off: RayMarch makes the same check with the depth of the pixel itself, which is never farther
+// than its tile, so the tile fetch culls no pixel that RayMarch would march. t21 stays unbound
+#define USE_DEPTH_PYRAMID 0
+#define DEPTH_PYRAMID_TILE_LEVEL 4
+
 #include "CommonBuffer.hlsl"
 #include "CommonFunctions.hlsl"
 #include "FBM.hlsl"
 #include "SDF.hlsl"
+#include "CloudLayer.hlsl"
+#include "CloudBvh.hlsl"
+#include "DensityClipmap.hlsl"
+#include "CloudShadowMap.hlsl"
+
+StructuredBuffer<CloudLayerDesc> cloudLayers : register(t10);
+Texture2D<float2> heightProfileTexture : register(t11);
+
+// bit per layer the current ray can reach, set by RayMarch and CSMain
+static uint sCloudLayerMask = 0xffffffff;
+
+// TemporalJitter of the pixel march, in meters. added to the start and after every occupancy
+// skip, which would put every ray of a cell on the same samples again
+static float sRayJitter = 0.0;
+
+// TEMPORAL_STEP_SCALE on the marches with history, the march step is that much longer
+static float sRayStepScale = 1.0;
 
 cbuffer TransformBuffer : register(b3) {
     matrix cScaleMatrix_;
@@ -39,6 +138,9 @@ cbuffer TransformBuffer : register(b3) {
 
 cbuffer InputData : register(b3) {
     float4 cPixelSize_;
+    // the distance band of this target, C++ port cloudcascade::Cascade. x, y: ray lengths the
+    // march starts and ends at, z: step budget, w: 1 jitters the start and blends the history
+    float4 cCascade_;
 };
 
 #define NM_TO_M 1852
@@ -138,6 +240,26 @@ float4 Noise3DSmallTex(float3 pos, float mip) {
     return noiseSmallTexture.SampleLevel(noiseSampler, pos, mip);
 }
 
+// evolving noise: two fetches from the baked sequence blended by time.
+// frames are stacked along the texture depth, so w is kept half a texel away from
+// the frame borders to stop the filter from reading into the neighbouring frame.
+float4 NoiseSequenceTex(float3 pos) {
+    uint width, height, slices;
+    noiseSequenceTexture.GetDimensions(width, height, slices);
+    const float frameSlices = slices / NOISE_SEQUENCE_FRAMES;
+
+    // cTime_.x is micro seconds since start
+    const float t = frac(cTime_.x * 1e-6 / NOISE_SEQUENCE_PERIOD_SEC) * NOISE_SEQUENCE_FRAMES;
+    const float frame0 = floor(t);
+    const float frame1 = fmod(frame0 + 1.0, NOISE_SEQUENCE_FRAMES);
+    const float blend = t - frame0;
+
+    const float w = clamp(frac(pos.z), 0.5 / frameSlices, 1.0 - 0.5 / frameSlices);
+    const float4 a = noiseSequenceTexture.SampleLevel(noiseSampler, float3(pos.xy, (frame0 + w) / NOISE_SEQUENCE_FRAMES), 0);
+    const float4 b = noiseSequenceTexture.SampleLevel(noiseSampler, float3(pos.xy, (frame1 + w) / NOISE_SEQUENCE_FRAMES), 0);
+    return lerp(a, b, blend);
+}
+
 float4 CloudMapTex(float3 pos, float mip) {
     // value input expected within 0 to 1 when R8G8B8A8_UNORM
     // value output expected within 0 to +1 by normalize
@@ -218,31 +340,247 @@ float3 monteCarloAmbient(float3 normal) {
         //     sampleDir = -sampleDir;
         // }
         
-        float3 envColor = skyTexture.Sample(skySampler, sampleDir).rgb;
+        // level 0 like a pixel would pick, CSFarCloudCache marches without derivatives
+        float3 envColor = skyTexture.SampleLevel(skySampler, sampleDir, 0).rgb;
         
         ambientColor += envColor;
     }
     return ambientColor / float(NUM_SAMPLES_MONTE_CARLO);
 }
 
-// Function to adjust for Earth's curvature
-float3 AdjustForEarthCurvature(float3 raypos, float3 raystart) {
+// Position at distance d along a view ray bent by Earth's curvature,
+// rayStart + R sin(d / R) rayDir - (0, R (1 - cos(d / R)), 0) with rayDir normalized.
+// sin and cos as Taylor polynomials in d^2, below 1e-3 m of the arc out to MAX_LENGTH
+// and no cancellation in 1 - cos. matches earthcurvature::CurvedRayPosition
+float3 CurvedRayPosition(float3 rayStart, float3 rayDir, float d) {
+    const float D2 = d * d;
+    const float ALONG = d * (1.0 - D2 * (1.0 / (6.0 * EARTH_RADIUS * EARTH_RADIUS)) * (1.0 - D2 * (1.0 / (20.0 * EARTH_RADIUS * EARTH_RADIUS))));
+    const float DROP = D2 * (1.0 / (2.0 * EARTH_RADIUS)) * (1.0 - D2 * (1.0 / (12.0 * EARTH_RADIUS * EARTH_RADIUS)));
+    return rayStart + rayDir * ALONG - float3(0, DROP, 0);
+}
 
-    const float EARTH_RADIUS = 6371e3;
-    
-    // Calculate the direction from the camera to the position
-    const float3 DIR = normalize(raypos - raystart);
+// unit tangent of CurvedRayPosition at distance d, cos(d / R) rayDir - (0, sin(d / R), 0)
+float3 CurvedRayTangent(float3 rayDir, float d) {
+    const float D2 = d * d;
+    const float COS_A = 1.0 - D2 * (1.0 / (2.0 * EARTH_RADIUS * EARTH_RADIUS)) * (1.0 - D2 * (1.0 / (12.0 * EARTH_RADIUS * EARTH_RADIUS)));
+    const float SIN_A = d * (1.0 / EARTH_RADIUS) * (1.0 - D2 * (1.0 / (6.0 * EARTH_RADIUS * EARTH_RADIUS)));
+    return rayDir * COS_A - float3(0, SIN_A, 0);
+}
+
+// cell coordinates of the occupancy grid and the cloud sdf, x and z wrap.
+// level 0 cells are aligned to the weather texel centers.
+float3 MacroCellCoord(float3 pos, float3 size) {
+    uint fmapWidth, fmapHeight;
+    fMapTexture.GetDimensions(fmapWidth, fmapHeight);
+    const float2 FMAP_SIZE = float2(fmapWidth, fmapHeight);
+    const float2 UV = Pos2UVW(pos, 0.0, 1000*16*64).xz;
+    float3 coord = float3((UV * FMAP_SIZE - 0.5) * (size.xy / FMAP_SIZE), -pos.y / OCCUPANCY_CELL_HEIGHT);
+    coord.xy -= floor(coord.xy / size.xy) * size.xy;
+    return coord;
+}
+
+// distance along dir that stays inside empty macro-cells, 0 where pos may hold cloud
+float OccupancySkip(float3 pos, float3 dir) {
+    uint width, height, depth, mips;
+    occupancyTexture.GetDimensions(0, width, height, depth, mips);
+
+    const float alt = -pos.y;
+    if (mips == 0 || alt < 0.0 || alt >= depth * OCCUPANCY_CELL_HEIGHT) { return 0.0; }
+
+    const float3 SIZE = float3(width, height, depth);
+    const float3 coord = MacroCellCoord(pos, SIZE);
+
+    // cells per meter along the ray
+    const float3 SPEED = float3(dir.x * SIZE.x / (1000*16*64), dir.z * SIZE.y / (1000*16*64), -dir.y / OCCUPANCY_CELL_HEIGHT);
+
+    // coarsest empty cell first
+    [loop]
+    for (int mip = mips - 1; mip >= 0; mip--) {
+        const int3 MIP_SIZE = max(int3(SIZE) >> mip, 1);
+        const int3 CELL = min(int3(coord) >> mip, MIP_SIZE - 1);
+        if (occupancyTexture.Load(int4(CELL, mip)) > 0.0) { continue; }
+
+        // the last cell of an odd sized mip reaches to the end of level 0
+        const float3 LO = CELL << mip;
+        const float3 HI = (CELL == MIP_SIZE - 1) ? SIZE : float3((CELL + 1) << mip);
+        const float3 EXIT = SPEED > 0 ? (HI - coord) / SPEED : (SPEED < 0 ? (LO - coord) / SPEED : OCCUPANCY_MAX_SKIP);
+        return clamp(min(EXIT.x, min(EXIT.y, EXIT.z)), 0.0, OCCUPANCY_MAX_SKIP);
+    }
+    return 0.0;
+}
+
+// safe step to the cloud from pos in any direction, 0 outside the volume
+float CloudSdfDistance(float3 pos) {
+#if USE_CLOUD_SDF
+    uint width, height, depth, mips;
+    cloudSdfTexture.GetDimensions(0, width, height, depth, mips);
+    const float alt = -pos.y;
+    if (mips == 0 || alt < 0.0 || alt >= depth * OCCUPANCY_CELL_HEIGHT) { return 0.0; }
+
+    // the stored distance holds for every point of the voxel, no filtering
+    const float3 SIZE = float3(width, height, depth);
+    const int3 CELL = min(int3(MacroCellCoord(pos, SIZE)), int3(SIZE) - 1);
+    return cloudSdfTexture.Load(int4(CELL, 0)) * SDF_MAX_DISTANCE;
+#else
+    return 0.0;
+#endif
+}
+
+// per ray state of AdaptiveStep, zero at the ray start and after an occupancy skip
+struct AdaptiveStepState {
+    float previousDensity;
+    float previousStep;
+    float refineEnd;    // ray distance of the cloud hit being walked again
+    float refineStep;
+};
+
+// step after a sample of density at rayDistance, emptyStep is the step outside the cloud.
+// inside, the step keeps the transmittance weighted error 0.5 |d density / ds| h^2 below
+// ADAPTIVE_STEP_ERROR. a negative step goes back to the last empty sample when a long empty
+// step landed in cloud, the caller moves the ray and drops the sample
+float AdaptiveStep(inout AdaptiveStepState state, float density, float transmittance, float rayDistance, float emptyStep) {
+    const float FLOOR_STEP = max(ADAPTIVE_MIN_STEP, rayDistance * ADAPTIVE_FOOTPRINT);
+    float next;
+    [branch]
+    if (density <= 0.0) {
+        next = rayDistance < state.refineEnd ? state.refineStep : max(emptyStep, FLOOR_STEP);
+    }
+    else if (state.previousDensity <= 0.0 && rayDistance > state.refineEnd + 0.5 * state.refineStep
+        && state.previousStep > 2.0 * max(FLOOR_STEP, state.previousStep / ADAPTIVE_ENTRY_SPLIT)) {
+        state.refineStep = max(FLOOR_STEP, state.previousStep / ADAPTIVE_ENTRY_SPLIT);
+        state.refineEnd = rayDistance;
+        const float BACK = state.previousStep - state.refineStep;
+        state.previousStep = state.refineStep;
+        return -BACK;
+    }
+    else {
+        const float GRADIENT = abs(density - state.previousDensity) / max(state.previousStep, 1e-3);
+        const float BY_ERROR = sqrt(2.0 * ADAPTIVE_STEP_ERROR / max(transmittance * GRADIENT, 1e-12));
+        const float BY_DEPTH = ADAPTIVE_MAX_OPTICAL_DEPTH / density;
+        const float BY_GROWTH = max(state.previousStep, FLOOR_STEP) * ADAPTIVE_GROWTH;
+        next = min(min(BY_ERROR, BY_DEPTH), BY_GROWTH);
+        next = min(max(next, FLOOR_STEP), max(FLOOR_STEP, ADAPTIVE_MAX_STEP));
+    }
+    state.previousDensity = max(density, 0.0);
+    state.previousStep = next;
+    return next;
+}
 
-    // Calculate the distance from the camera to the position
-    const float DISTANCE = length(raypos - raystart);
+// bit per layer whose altitude slab overlaps [altLo, altHi] meters
+uint CloudLayerMask(float altLo, float altHi) {
+    uint count, stride;
+    cloudLayers.GetDimensions(count, stride);
+    uint mask = 0;
+    [loop]
+    for (uint l = 0; l < min(count, CLOUD_LAYER_MAX); l++) {
+        const float4 LAYER_NOISE = cloudLayers[l].noise_;
+        if (altHi >= LAYER_NOISE.z && altLo <= LAYER_NOISE.w) { mask |= 1u << l; }
+    }
+    return mask;
+}
 
-    // Calculate the angle subtended by the distance on the sphere
-    const float ANGLE = DISTANCE / EARTH_RADIUS;
+// altitude range of CurvedRayPosition(rayStart, rayDir, d) for d in [dBegin, dEnd]
+float2 CurvedRayAltitudeRange(float3 rayStart, float3 rayDir, float dBegin, float dEnd) {
+    // alt(A) = alt0 - R sin(A) dir.y + R (1 - cos(A)) with A = d / R, lowest where tan(A) = dir.y
+    const float D_LOWEST = clamp(EARTH_RADIUS * atan(rayDir.y), dBegin, dEnd);
+    const float3 ALT = -float3(CurvedRayPosition(rayStart, rayDir, dBegin).y,
+        CurvedRayPosition(rayStart, rayDir, dEnd).y, CurvedRayPosition(rayStart, rayDir, D_LOWEST).y);
+    return float2(min(ALT.x, min(ALT.y, ALT.z)), max(ALT.x, ALT.y));
+}
 
-    // Calculate the new position considering Earth's curvature
-    float3 NEWPOS = raystart + EARTH_RADIUS * sin(ANGLE) * DIR - float3(0, EARTH_RADIUS * (1 - cos(ANGLE)), 0);
+// smallest reversed depth of the pyramid tiles under the four texels a depthSampler read at uv takes
+float DepthPyramidFarthest(float2 uv) {
+    uint width, height, levels;
+    depthPyramidTexture.GetDimensions(0, width, height, levels);
+    const int LEVEL = min(DEPTH_PYRAMID_TILE_LEVEL, int(levels) - 1);
+    const int2 SIZE = int2(width, height);
+
+    // depthSampler wraps
+    const int2 BASE = int2(floor(uv * float2(SIZE) - 0.5));
+    const int2 T0 = (((BASE % SIZE) + SIZE) % SIZE) >> LEVEL;
+    const int2 T1 = ((((BASE + 1) % SIZE) + SIZE) % SIZE) >> LEVEL;
+    const float A = depthPyramidTexture.Load(int3(T0.x, T0.y, LEVEL)).x;
+    const float B = depthPyramidTexture.Load(int3(T1.x, T0.y, LEVEL)).x;
+    const float C = depthPyramidTexture.Load(int3(T0.x, T1.y, LEVEL)).x;
+    const float D = depthPyramidTexture.Load(int3(T1.x, T1.y, LEVEL)).x;
+    return min(min(A, B), min(C, D));
+}
 
-    return NEWPOS;
+// true when the view ray can not come within reach of any layer slab before the farthest
+// primitive of its tile. only the view ray decides whether a pixel gets cloud, the light march
+// starts from cloud samples
+bool DepthPyramidCulled(float3 rayStart, float3 rayDir, float in_start, float2 uv) {
+    const float FARTHEST = DepthPyramidFarthest(uv);
+    if (FARTHEST <= 0.0) { return false; }
+
+    // view depth to ray length
+    const float RAY_END = DepthToMeter(FARTHEST) / mul(float4(rayDir, 0.0), cView_).z;
+    const float2 RAY_ALT = CurvedRayAltitudeRange(rayStart, rayDir, in_start, max(in_start, RAY_END));
+    return CloudLayerMask(RAY_ALT.x - CLOUD_LAYER_SLAB_PAD, RAY_ALT.y + CLOUD_LAYER_SLAB_PAD) == 0;
+}
+
+// layerShape (x) and anvil exponent (y) of a layer at a normalized height
+float2 HeightProfile(uint layer, float height) {
+    uint width, rows;
+    heightProfileTexture.GetDimensions(width, rows);
+    // clamped by hand, linearSampler wraps. both terms are constant outside [0, 1]
+    const float2 UV = float2((saturate(height) * (width - 1) + 0.5) / width, (layer + 0.5) / rows);
+    return heightProfileTexture.SampleLevel(linearSampler, UV, 0);
+}
+
+Texture3D<float2> densityClipmapTexture : register(t14);
+StructuredBuffer<DensityClipmapLevel> densityClipmapLevels : register(t15);
+
+// CloudDensity(pos, .., true) * 64 from the finest clipmap level holding pos, negative when
+// no level does. matches DensityClipmap::Sample
+float ClipmapDensity(float3 pos) {
+    uint levels, stride;
+    densityClipmapLevels.GetDimensions(levels, stride);
+    uint width, height, depth, mips;
+    densityClipmapTexture.GetDimensions(0, width, height, depth, mips);
+    if (levels == 0 || depth == 0) { return -1.0; }
+    const float ROWS = depth / levels;
+
+    [loop]
+    for (uint l = 0; l < levels; l++) {
+        const DensityClipmapLevel LEVEL = densityClipmapLevels[l];
+        if (any(pos.xz < LEVEL.window_.xy) || any(pos.xz >= LEVEL.window_.zw)) { continue; }
+
+        // no layer reaches outside the band
+        const float BAND = (-pos.y - LEVEL.texel_.z) * LEVEL.texel_.w;
+        if (BAND < 0.0 || BAND > 1.0) { return 0.0; }
+
+        // x and z wrap with the sampler, the row is clamped inside the level
+        const float ROW = l * ROWS + clamp(BAND * ROWS, 0.5, ROWS - 0.5);
+        const float3 UVW = float3(pos.x * LEVEL.texel_.y, pos.z * LEVEL.texel_.y, ROW / depth);
+        return densityClipmapTexture.SampleLevel(linearSampler, UVW, 0).x;
+    }
+    return -1.0;
+}
+
+// densest low frequency point of the clipmap texel holding pos, unfiltered: 0 means no cloud
+// there at any frequency. negative outside the fresh windows. matches DensityClipmap::SampleMax
+float ClipmapMaxDensity(float3 pos) {
+    uint levels, stride;
+    densityClipmapLevels.GetDimensions(levels, stride);
+    uint width, height, depth, mips;
+    densityClipmapTexture.GetDimensions(0, width, height, depth, mips);
+    if (levels == 0 || depth == 0) { return -1.0; }
+    const uint ROWS = depth / levels;
+
+    [loop]
+    for (uint l = 0; l < levels; l++) {
+        const DensityClipmapLevel LEVEL = densityClipmapLevels[l];
+        if (any(pos.xz < LEVEL.window_.xy) || any(pos.xz >= LEVEL.window_.zw)) { continue; }
+
+        const float BAND = (-pos.y - LEVEL.texel_.z) * LEVEL.texel_.w;
+        if (BAND < 0.0 || BAND > 1.0) { return 0.0; }
+
+        const int2 CELL = int2(floor(pos.xz / LEVEL.texel_.x));
+        const int2 TEXEL = ((CELL % int(width)) + int(width)) % int(width);
+        return densityClipmapTexture.Load(int4(TEXEL, l * ROWS + min(uint(BAND * ROWS), ROWS - 1), 0)).y;
+    }
+    return -1.0;
 }
 
 float CloudDensity(float3 pos, out float distance, out float3 normal, bool lowFreq = false) {
@@ -253,64 +591,71 @@ float CloudDensity(float3 pos, out float distance, out float3 normal, bool lowFr
 
     float4 fmap = fMapTexture.SampleLevel(linearSampler, Pos2UVW(pos, 0.0, 1000*16*64).xz, 0.0);     
     float poor = RemapClamp( fmap.r, 0.0, 1.0, 0.0, 1.0 );
-    float finaldense = 1.0;
+    float finaldense = 0.0;
+
+    // cumulus, cirrus and stratus come from the layer table, see CloudLayer.hlsl
+    uint layerCount, layerStride;
+    cloudLayers.GetDimensions(layerCount, layerStride);
+    layerCount = min(layerCount, CLOUD_LAYER_MAX);
+
+#if USE_DENSITY_CLIPMAP
+    // no low frequency cloud in the clipmap texel and erosion only takes away: no noise to fetch
+    const uint LAYER_MASK = !lowFreq && ClipmapMaxDensity(pos) == 0.0 ? 0 : sCloudLayerMask;
+#else
+    const uint LAYER_MASK = sCloudLayerMask;
+#endif
 
-    // first later: cumulus and stratocumulus
-    {
-        // the narrower UV you use, the more noise but performance worse
-        // the wider UV you use, the less noise but performance better
-        float4 largeNoiseValue = Noise3DTex(pos * (1.0) / (1000*16), 0); // Large scale noise
-        float dense = 1.0;
-        dense = RemapClamp( (largeNoiseValue.r * 0.5 + 0.5), 1.0 - poor * 0.75, 1.0, 0.0, 1.0); // perlinWorley
-        if (!lowFreq) {
-            dense = RemapClamp( dense, 1.0 - (largeNoiseValue.g * 0.5 + 0.5), 1.0, 0.0, 1.0); // worley
-            dense = RemapClamp( dense, 1.0 - (largeNoiseValue.b * 0.5 + 0.5), 1.0, 0.0, 1.0); // worley
-            dense = RemapClamp( dense, 1.0 - (largeNoiseValue.a * 0.5 + 0.5), 1.0, 0.0, 1.0); // worley
-        }
-        const float cumulusThickness = 500 + 2000 * fmap.g;
-        const float cumulusBottomAltMeter = fmap.b * 0.3048;
-        const float height = (rayHeightMeter - cumulusBottomAltMeter) / cumulusThickness;
-        distance = DISTANCE_CLOUD(rayHeightMeter, cumulusBottomAltMeter, cumulusThickness);
-        const float cumulusLayer = RemapClamp(height, 0.00, 0.20, 0.0, 1.0) * RemapClamp(height, 0.20, 1.00, 1.0, 0.0);
-        dense = RemapClamp( dense, 1.0 - cumulusLayer, 1.0, 0.0, 1.0);
-        // cumulus anvil
-        const float anvil = 1.0;
-        const float slope = 0.2;
-        const float bottomWide = 0.8;
-        dense = pow(dense, RemapClamp( 1.0 - height, slope, bottomWide, 1.0, lerp(1.0, 0.5, anvil)));
-        finaldense = dense;
-    }
+    [loop]
+    for (uint l = 0; l < layerCount; l++) {
+        const CloudLayerDesc LAYER = cloudLayers[l];
+        const float thickness = LAYER.altitude_.z + LAYER.altitude_.w * fmap.g;
+        const float bottomAltMeter = (fmap.b * LAYER.altitude_.x + LAYER.altitude_.y) * 0.3048;
+        const float layerDistance = DISTANCE_CLOUD(rayHeightMeter, bottomAltMeter, thickness);
+        distance = l == 0 ? layerDistance : min(distance, layerDistance);
+
+        // outside the slab the layer shape is 0 for any weather, skip the fetches
+        if ((LAYER_MASK & (1u << l)) == 0) { continue; }
+        if (rayHeightMeter < LAYER.noise_.z || rayHeightMeter > LAYER.noise_.w) { continue; }
 
-    // second later: cirrus
-    {        
         // the narrower UV you use, the more noise but performance worse
         // the wider UV you use, the less noise but performance better
-        float4 largeNoiseValue = Noise3DTex(pos * (1.0) / (1000*16) + 0.5, 0); // Large scale noise
+        const float3 UVW = pos * LAYER.noise_.x + LAYER.noise_.y;
+        float4 largeNoiseValue = Noise3DTex(UVW, 0); // Large scale noise
+#if USE_NOISE_SEQUENCE
+        // let the base shape evolve over time
+        if (LAYER.coverage_.w > 0.0) {
+            largeNoiseValue.r = lerp(largeNoiseValue.r, NoiseSequenceTex(UVW).g, LAYER.coverage_.w);
+        }
+#endif
         float dense = 1.0;
-        dense = RemapClamp( (largeNoiseValue.r * 0.5 + 0.5), 1.0 - poor * 0.5, 1.0, 0.0, 1.0); // perlinWorley
-        if (!lowFreq) {
+        dense = RemapClamp( (largeNoiseValue.r * 0.5 + 0.5), 1.0 - (poor * LAYER.coverage_.x + LAYER.coverage_.y), 1.0, 0.0, 1.0); // perlinWorley
+        if (!lowFreq && LAYER.anvil_.w > 0.0) {
             dense = RemapClamp( dense, 1.0 - (largeNoiseValue.g * 0.5 + 0.5), 1.0, 0.0, 1.0); // worley
             dense = RemapClamp( dense, 1.0 - (largeNoiseValue.b * 0.5 + 0.5), 1.0, 0.0, 1.0); // worley
             dense = RemapClamp( dense, 1.0 - (largeNoiseValue.a * 0.5 + 0.5), 1.0, 0.0, 1.0); // worley
         }
-        const float cumulusThickness = 10 + 500 * fmap.g;
-        const float cumulusBottomAltMeter = (fmap.b + 5000) * 0.3048;
-        const float height = (rayHeightMeter - cumulusBottomAltMeter) / cumulusThickness;
-        distance = min(distance, DISTANCE_CLOUD(rayHeightMeter, cumulusBottomAltMeter, cumulusThickness));
-        const float cumulusLayer = RemapClamp(height, 0.00, 0.20, 0.0, 1.0) * RemapClamp(height, 0.20, 1.00, 1.0, 0.0);
-        dense = RemapClamp( dense, 1.0 - cumulusLayer, 1.0, 0.0, 1.0);
+        const float height = (rayHeightMeter - bottomAltMeter) / thickness;
+#if USE_HEIGHT_PROFILE_LUT
+        const float2 PROFILE = HeightProfile(l, height);
+        dense = RemapClamp( dense, 1.0 - PROFILE.x, 1.0, 0.0, 1.0);
+        dense = pow(dense, PROFILE.y);
+#else
+        const float peak = LAYER.coverage_.z;
+        const float layerShape = RemapClamp(height, 0.00, peak, 0.0, 1.0) * RemapClamp(height, peak, 1.00, 1.0, 0.0);
+        dense = RemapClamp( dense, 1.0 - layerShape, 1.0, 0.0, 1.0);
         // cumulus anvil
-        const float anvil = 1.0;
-        const float slope = 0.2;
-        const float bottomWide = 0.8;
+        const float anvil = LAYER.anvil_.x;
+        const float slope = LAYER.anvil_.y;
+        const float bottomWide = LAYER.anvil_.z;
         dense = pow(dense, RemapClamp( 1.0 - height, slope, bottomWide, 1.0, lerp(1.0, 0.5, anvil)));
+#endif
         finaldense = max(dense, finaldense);
     }
 
     // apply noise detail
     // the narrower UV you use, the more noise but performance worse
     // the wider UV you use, the less noise but performance better
-    if (!lowFreq) {
+    if (!lowFreq && finaldense > 0.0) {
         float4 smallNoiseValue = Noise3DSmallTex(pos * 1.5 / (1.0 * NM_TO_M), 0); // small scale noise   
         finaldense = RemapClamp(finaldense, 1.0 - (smallNoiseValue.r * 0.5 + 0.5), 1.0, 0.0, 1.0); // worley
         finaldense = RemapClamp(finaldense, 1.0 - (smallNoiseValue.g * 0.5 + 0.5), 1.0, 0.0, 1.0); // worley
@@ -319,32 +664,25 @@ float CloudDensity(float3 pos, out float distance, out float3 normal, bool lowFr
     return finaldense / 64.0;
 }
 
-void iterateCheck(float3 rayOriginFeet, float3 rayDir, float primDepthFeet, inout float rayDistance) {
-
-    const float iterate_check_count = 10;
-    float2 p = intersectAtmo(rayOriginFeet, rayDir);
-    float iStepSize = (p.y - p.x) / iterate_check_count;
-
-    const float originalRayDistance = rayDistance;
-    // iterate for cloud check.
-    [fastopt]
-    for (int v = 0; v <= iterate_check_count; v++) {
-        const float3 rayPos = (rayOriginFeet + rayDir * rayDistance) + rayDir * iStepSize;
-
-        float distance;
-        float3 normal;
-        const float dense = CloudDensity(rayPos, distance, normal, true);
-
-        if (dense > MIN_DENSE) {
-            rayDistance = iStepSize * max(0, v - 1);
-            break;
+// CloudDensity of a sample rayDistance away from the camera, far samples only keep the
+// low frequency shape and take it from the clipmap
+float CloudDensityAt(float3 pos, float rayDistance, out float distance, out float3 normal) {
+#if USE_DENSITY_CLIPMAP
+    if (rayDistance > DENSITY_CLIPMAP_FAR_DISTANCE) {
+        const float CACHED = ClipmapDensity(pos);
+        if (CACHED >= 0.0) {
+            // the occupancy grid and the SDF do the skipping out there
+            distance = 0.0;
+            normal = float3(0, 1, 0);
+            return CACHED / 64.0;
         }
     }
-    rayDistance = originalRayDistance;
+#endif
+    return CloudDensity(pos, distance, normal);
 }
 
 // For Heat Map Strategy
-float4 RayMarch(float3 rayStart, float3 rayDir, int sunSteps, float in_start, float in_end, float2 screenPosPx, float primDepthMeter, out float output_cloud_depth) {
+float4 RayMarch(float3 rayStart, float3 rayDir, int sunSteps, float in_start, float in_end, int maxStep, float2 screenPosPx, float primDepthMeter, out float output_cloud_depth) {
 
     // initialize
     output_cloud_depth = 0;
@@ -369,31 +707,65 @@ float4 RayMarch(float3 rayStart, float3 rayDir, int sunSteps, float in_start, fl
 
     bool hit = false;
 
-    const float maxStep = 2000;
     float2 p = intersectAtmo(rayStart, rayDir);
     const float maxLength = p.y - p.x;
+    // the primitive, the atmosphere or the end of the cascade band, whichever comes first
+    const float RAY_END = min(min(primDepthMeter, maxLength), in_end);
+
+    // layers this ray and its light march can reach
+    const float2 RAY_ALT = CurvedRayAltitudeRange(rayStart, rayDir, in_start, max(in_start, RAY_END));
+    sCloudLayerMask = CloudLayerMask(RAY_ALT.x - LIGHT_MARCH_SIZE - CLOUD_LAYER_SLAB_PAD, RAY_ALT.y + LIGHT_MARCH_SIZE + CLOUD_LAYER_SLAB_PAD);
+
+    // no layer within reach of the view ray before the primitive: no cloud sample, no light march.
+    // terrain below the cloud base costs no steps
+    if (CloudLayerMask(RAY_ALT.x - CLOUD_LAYER_SLAB_PAD, RAY_ALT.y + CLOUD_LAYER_SLAB_PAD) == 0) { return 0; }
+
+#if USE_ADAPTIVE_STEP
+    AdaptiveStepState adaptive = (AdaptiveStepState)0;
+#endif
 
     [fastopt]
     for (int i = 0; i < maxStep; i++) {
 
         // Translate the ray position each iterate
-        float3 rayPos = rayStart + rayDir * rayDistance;
-        rayPos = AdjustForEarthCurvature(rayPos, cCameraPosition_.xyz);
+        const float3 rayPos = CurvedRayPosition(rayStart, rayDir, rayDistance);
+
+#if USE_OCCUPANCY_GRID
+        // jump over empty macro-cells along the tangent of the curved ray
+        const float SKIP = OccupancySkip(rayPos, CurvedRayTangent(rayDir, rayDistance));
+        if (SKIP > 0.0) {
+            rayDistance += SKIP + OCCUPANCY_NUDGE + sRayJitter;
+#if USE_ADAPTIVE_STEP
+            adaptive = (AdaptiveStepState)0;
+#endif
+            if (rayDistance > RAY_END) { break; }
+            continue;
+        }
+#endif
 
         // Get the density at the current position
         float distance;
         float3 normal;
-        const float DENSE = CloudDensity(rayPos, distance, normal);
+        const float DENSE = CloudDensityAt(rayPos, rayDistance, distance, normal);
 
         float2 p = intersectAtmo(rayPos, rayDir);
         
         // for Next Iteration
-        float misStep = rayDistance < 10000 ? 50 : (p.y - p.x) / (maxStep - i);
-        const float RAY_ADVANCE_LENGTH = max(misStep, distance * 1.00);
+        float misStep = (rayDistance < 10000 ? 50 : (p.y - p.x) / (maxStep - i)) * sRayStepScale;
+        const float EMPTY_STEP = max(max(misStep, distance * 1.00), CloudSdfDistance(rayPos));
+#if USE_ADAPTIVE_STEP
+        const float RAY_ADVANCE_LENGTH = AdaptiveStep(adaptive, DENSE, intScattTrans.a, rayDistance, EMPTY_STEP);
+        if (RAY_ADVANCE_LENGTH < 0.0) {
+            rayDistance += RAY_ADVANCE_LENGTH;
+            continue;
+        }
+#else
+        const float RAY_ADVANCE_LENGTH = EMPTY_STEP;
+#endif
         rayDistance += RAY_ADVANCE_LENGTH; 
 
-        // primitive depth check
-        if (rayDistance > min(primDepthMeter, maxLength)) { break; }
+        // primitive depth and band end check
+        if (rayDistance > RAY_END) { break; }
 
         // // No intersection with atmosphere, break the loop
         // [branch]
@@ -420,23 +792,32 @@ float4 RayMarch(float3 rayStart, float3 rayDir, int sunSteps, float in_start, fl
                                   //* lightScatter;
         float lightVisibility = 1.0;
 
-        // light ray march
-        float previousDensity = DENSE;
-
-        [unroll]
-        for (int s = 1; s <= sunSteps; s++)
+#if USE_CLOUD_SHADOW_MAP
+        const float SHADOW_DEPTH = CloudShadowSegment(rayPos, LIGHT_MARCH_SIZE, linearSampler);
+        if (SHADOW_DEPTH >= 0.0) {
+            lightVisibility = Energy(SHADOW_DEPTH, 1.0, lightScatter);
+        }
+        else
+#endif
         {
-            const float TO_SUN_RAY_ADVANCED_LENGTH = (LIGHT_MARCH_SIZE / sunSteps);
-            const float3 TO_SUN_RAY_POS = rayPos + SUNDIR * TO_SUN_RAY_ADVANCED_LENGTH * s;
-
-            float nd;
-            float3 nn;
-            const float DENSE_2 = CloudDensity(TO_SUN_RAY_POS, nd, nn);
+            // light ray march
+            float previousDensity = DENSE;
+
+            [unroll]
+            for (int s = 1; s <= sunSteps; s++)
+            {
+                const float TO_SUN_RAY_ADVANCED_LENGTH = (LIGHT_MARCH_SIZE / sunSteps);
+                const float3 TO_SUN_RAY_POS = rayPos + SUNDIR * TO_SUN_RAY_ADVANCED_LENGTH * s;
+
+                float nd;
+                float3 nn;
+                const float DENSE_2 = CloudDensityAt(TO_SUN_RAY_POS, rayDistance, nd, nn);
             
-            // Trapezoidal integration
-            float averageDensity = (previousDensity + DENSE_2) * 0.5;
-            lightVisibility *= Energy(UnsignedDensity(averageDensity), TO_SUN_RAY_ADVANCED_LENGTH, lightScatter);
-            previousDensity = DENSE_2;
+                // Trapezoidal integration
+                float averageDensity = (previousDensity + DENSE_2) * 0.5;
+                lightVisibility *= Energy(UnsignedDensity(averageDensity), TO_SUN_RAY_ADVANCED_LENGTH, lightScatter);
+                previousDensity = DENSE_2;
+            }
         }
 
         // Integrate scattering
@@ -464,62 +845,154 @@ float4 RayMarch(float3 rayStart, float3 rayDir, int sunSteps, float in_start, fl
     return float4(intScattTrans.rgb, 1 - intScattTrans.a);
 }
 
-float4 ReprojectPreviousFrame(float4 currentPos) {
-    // Transform current position to previous frame's view space
-    float4 previousPos = mul(cPreviousViewProjection_, currentPos);
-    previousPos /= previousPos.w;
+// view depth of a reversed depth value of cProjection_
+float ViewDepthFromDepth(float depth) {
+    return cProjection_._43 / (depth - cProjection_._33);
+}
 
-    // Convert to UV coordinates
-    float2 previousUV = previousPos.xy * 0.5 + 0.5;
+// interleaved gradient noise per pixel and frame, temporalreprojection::Jitter
+float TemporalJitter(float2 pixel) {
+    const float2 P = pixel + 5.588238 * fmod(cHistory_.y, 64.0);
+    return frac(52.9829189 * frac(dot(P, float2(0.06711056, 0.00583715))));
+}
+
+// where the ray crosses its pixel, Halton (2, 3) over 8 frames, temporalreprojection::PixelJitter
+float2 TemporalPixelJitter() {
+    static const float2 HALTON[8] = { float2(0.5, 1.0 / 3.0), float2(0.25, 2.0 / 3.0), float2(0.75, 1.0 / 9.0), float2(0.125, 4.0 / 9.0),
+                                      float2(0.625, 7.0 / 9.0), float2(0.375, 2.0 / 9.0), float2(0.875, 5.0 / 9.0), float2(0.0625, 8.0 / 9.0) };
+    return HALTON[uint(cHistory_.y) % 8];
+}
+
+// the frame before where it saw the first cloud sample of the ray (rd and its reversed depth,
+// the direction alone for sky). valid is false without history and behind or off screen of
+// the camera before
+float4 ReprojectPreviousFrame(float3 rd, float depth, out bool valid) {
+    valid = false;
+    if (cHistory_.x <= 0.0) { return 0.0; }
+
+    // camera relative position, w 0 keeps the sky at infinity
+    const float3 FORWARD = float3(cView_._13, cView_._23, cView_._33);
+    float4 pos = float4(rd, 0.0);
+    if (depth > 0.0) {
+        pos = float4(rd * (ViewDepthFromDepth(depth) / dot(rd, FORWARD)), 1.0);
+    }
 
-    // Sample the previous frame texture
-    return previousTexture.Sample(linearSampler, currentPos.xy / 360);
+    const float4 CLIP = mul(pos, cPreviousViewProjection_);
+    if (CLIP.w <= 0.0) { return 0.0; }
+    const float2 NDC = CLIP.xy / CLIP.w;
+    const float2 UV = float2(NDC.x * 0.5 + 0.5, 0.5 - NDC.y * 0.5);
+    if (any(UV < 0.0) || any(UV > 1.0)) { return 0.0; }
+
+    // linearSampler wraps, stay half a texel inside
+    uint width, height;
+    previousTexture.GetDimensions(width, height);
+    const float2 HALF_TEXEL = 0.5 / float2(width, height);
+    valid = true;
+    return previousTexture.SampleLevel(linearSampler, clamp(UV, HALF_TEXEL, 1.0 - HALF_TEXEL), 0);
 }
 
-PS_OUTPUT StartRayMarch(PS_INPUT input, int sunSteps, float in_start, float in_end) {
+PS_OUTPUT StartRayMarch(PS_INPUT input, int sunSteps, float in_start, float in_end, int maxStep, bool history) {
     PS_OUTPUT output;
     
     // TODO : pass cResolution_ some way
-    float2 screenPos = input.Pos.xy;
+    // zw: ray offset inside the pixel, the interleaved march of CloudReconstruct.hlsl
+    const float2 OFFSET = cPixelSize_.zw;
+    float2 screenPos = input.Pos.xy + OFFSET;
     float2 pixelPos = screenPos.xy / cPixelSize_.xy;
 
 	float3 ro = cCameraPosition_.xyz; // Ray origin
 
     // consider camera position is always 0
     // no normalize to reduce ring anomaly
-    float3 rd = normalize(input.Worldpos.xyz - 0); // Ray direction
-    
+    const float3 WORLD_DX = ddx(input.Worldpos.xyz);
+    const float3 WORLD_DY = ddy(input.Worldpos.xyz);
+
     // primitive depth in meter.
+#if USE_BILATERAL_UPSAMPLE
+    // the farthest primitive inside the pixel, the ray through its texels (BilateralUpsample)
+    float2 rayPos;
+    float primDepth = FootprintFarthest(depthTexture, depthSampler, pixelPos, cPixelSize_.xy, rayPos);
+    const float2 RAY_OFFSET = OFFSET + (rayPos - pixelPos) * cPixelSize_.xy;
+#else
     float primDepth = depthTexture.Sample(depthSampler, pixelPos).r;
     primDepth = min(primDepth, depthTexture.Sample(depthSampler, pixelPos + float2(+1.0, 0.0) / cPixelSize_.xy).r);
     primDepth = min(primDepth, depthTexture.Sample(depthSampler, pixelPos + float2(-1.0, 0.0) / cPixelSize_.xy).r);
     primDepth = min(primDepth, depthTexture.Sample(depthSampler, pixelPos + float2(0.0, +1.0) / cPixelSize_.xy).r);
     primDepth = min(primDepth, depthTexture.Sample(depthSampler, pixelPos + float2(0.0, -1.0) / cPixelSize_.xy).r);
+    const float2 RAY_OFFSET = OFFSET;
+#endif
+    float3 rd = normalize(input.Worldpos.xyz + WORLD_DX * RAY_OFFSET.x + WORLD_DY * RAY_OFFSET.y); // Ray direction
+    
+#if USE_DEPTH_PYRAMID && USE_BILATERAL_UPSAMPLE
+    // terrain in front of every layer, no cloud and no history. the tile covers the depth
+    // texels of this pixel only, not the neighbours the widened march below reads
+    if (DepthPyramidCulled(ro, rd, in_start, pixelPos)) {
+        output.Color = 0;
+        output.DepthColor = 0;
+        output.Depth = 0;
+        return output;
+    }
+#endif
+
     float primDepthMeter = DepthToMeter( primDepth );
     float cloudDepth = 0;
 
     // dither effect to reduce anomaly
     //float dither = frac(screenPos.x * 0.5) + frac(screenPos.y * 0.5);
 
+#if USE_TEMPORAL_ACCUMULATION
+    // previousTexture holds the near band, the other cascades march without jitter and history.
+    // the history is kept at pixel centres, the fresh ray crosses the pixel elsewhere each frame
+    const float3 CENTER_RD = rd;
+    if (history) {
+        const float2 PIXEL_JITTER = TemporalPixelJitter() - 0.5;
+        rd = normalize(input.Worldpos.xyz + WORLD_DX * (RAY_OFFSET.x + PIXEL_JITTER.x) + WORLD_DY * (RAY_OFFSET.y + PIXEL_JITTER.y));
+        sRayJitter = TemporalJitter(input.Pos.xy) * TEMPORAL_JITTER_LENGTH;
+        sRayStepScale = TEMPORAL_STEP_SCALE;
+        in_start += sRayJitter;
+    }
+#endif
+
     // Ray march the cloud
-    float4 cloud = RayMarch(ro, rd, sunSteps, in_start, in_end, screenPos, primDepthMeter, cloudDepth);
+    float4 cloud = RayMarch(ro, rd, sunSteps, in_start, in_end, maxStep, screenPos, primDepthMeter, cloudDepth);
+
+#if USE_TEMPORAL_ACCUMULATION
+    // exponential history, restarted where the reprojection fails
+    bool historyValid = false;
+    const float4 HISTORY = history ? ReprojectPreviousFrame(CENTER_RD, cloudDepth, historyValid) : 0;
+    if (historyValid) {
+        cloud = lerp(HISTORY, cloud, TEMPORAL_BLEND);
+    }
+#endif
 
     // output
-    output.Color = cloud;// lerp(cloud, ReprojectPreviousFrame(float4(input.Pos.xy, 0.0, 1.0)), 0.5);
+    output.Color = cloud;
     output.DepthColor = cloudDepth;
     output.Depth = cloudDepth;
 
     return output;
 }
 
+// every cascade target, near and far, runs this with its own cCascade_
 PS_OUTPUT PS(PS_INPUT input) {
 
-    return StartRayMarch(input, 8, 0, MAX_LENGTH * 0.10);
+    return StartRayMarch(input, 8, cCascade_.x, cCascade_.y, int(cCascade_.z), cCascade_.w > 0.5);
 }
 
-PS_OUTPUT PS_FAR(PS_INPUT input) {
+// the far band out of the cube CSFarCloudCache keeps, instead of marching it. a primitive
+// nearer than the band start hides it. C++ port FarCloudCache::Resolve
+PS_OUTPUT PS_FAR_CACHE(PS_INPUT input) {
+    PS_OUTPUT output;
+
+    const float2 pixelPos = (input.Pos.xy + cPixelSize_.zw) / cPixelSize_.xy;
+    const float3 rd = normalize(input.Worldpos.xyz);
+    const float primDepthMeter = DepthToMeter(depthTexture.Sample(depthSampler, pixelPos).r);
+
+    output.Color = primDepthMeter > cCascade_.x ? farCloudCacheTexture.SampleLevel(linearSampler, rd, 0) : 0;
+    output.DepthColor = 0;
+    output.Depth = 0;
 
-    return StartRayMarch(input, 8, MAX_LENGTH * 0.25, MAX_LENGTH * 1.0);
+    return output;
 }
 
 PS_OUTPUT PS_SKYBOX(PS_INPUT input) {
@@ -555,17 +1028,46 @@ void CSMain(uint3 DTid : SV_DispatchThreadID) {
     const float EXP = 0.00004;
     int i = 0;
 
+    // bent like the view ray through the same pixel
+    const float2 RAY_ALT = CurvedRayAltitudeRange(ro, rd, 0, END);
+    sCloudLayerMask = CloudLayerMask(RAY_ALT.x - CLOUD_LAYER_SLAB_PAD, RAY_ALT.y + CLOUD_LAYER_SLAB_PAD);
+
+#if USE_ADAPTIVE_STEP
+    AdaptiveStepState adaptive = (AdaptiveStepState)0;
+#endif
+
     [loop]
     while (rayDistance <= END) {
         i++;
 
-        float3 pos = ro + rd * rayDistance;
+        const float3 pos = CurvedRayPosition(ro, rd, rayDistance);
+
+#if USE_OCCUPANCY_GRID
+        const float SKIP = OccupancySkip(pos, CurvedRayTangent(rd, rayDistance));
+        if (SKIP > 0.0) {
+            rayDistance += SKIP + OCCUPANCY_NUDGE;
+#if USE_ADAPTIVE_STEP
+            adaptive = (AdaptiveStepState)0;
+#endif
+            continue;
+        }
+#endif
+
         float distance;
         float3 normal;
-        const float DENSE = CloudDensity(pos, distance, normal);
+        const float DENSE = CloudDensityAt(pos, rayDistance, distance, normal);
 
         // for Next Iteration
-        const float RAY_ADVANCE_LENGTH = max(((END - 0) / cPixelSize_.x) * (exp(i * EXP) - 1), distance * 0.25);
+        const float EMPTY_STEP = max(max(((END - 0) / cPixelSize_.x) * (exp(i * EXP) - 1), distance * 0.25), CloudSdfDistance(pos));
+#if USE_ADAPTIVE_STEP
+        const float RAY_ADVANCE_LENGTH = AdaptiveStep(adaptive, DENSE, los, rayDistance, EMPTY_STEP);
+        if (RAY_ADVANCE_LENGTH < 0.0) {
+            rayDistance += RAY_ADVANCE_LENGTH;
+            continue;
+        }
+#else
+        const float RAY_ADVANCE_LENGTH = EMPTY_STEP;
+#endif
         rayDistance += RAY_ADVANCE_LENGTH; 
 
         if (-pos.y < -400 || -pos.y > 25000) { break; }
@@ -577,4 +1079,78 @@ void CSMain(uint3 DTid : SV_DispatchThreadID) {
     }
 
     OutputBuffer[0] = los;
-}
\ No newline at end of file
+}
+
+cbuffer DensityClipmapRegion : register(b5) {
+    int4 cClipmapRegion_; // xy: first world texel along x and z, z: level, w: rows per level
+    int4 cClipmapSize_;   // xy: texels along x and z, z: resolution
+};
+
+RWTexture3D<unorm float2> densityClipmapOutput : register(u1);
+
+// evaluates one region DensityClipmap::Update handed out, a thread per texel: the density at
+// the texel centre and the densest point of the DENSITY_CLIPMAP_SKIP_LATTICE lattice over its box
+[numthreads(4, 4, 4)]
+void CSDensityClipmap(uint3 DTid : SV_DispatchThreadID) {
+    if (any(int3(DTid) >= int3(cClipmapSize_.xy, cClipmapRegion_.w))) { return; }
+
+    const DensityClipmapLevel LEVEL = densityClipmapLevels[cClipmapRegion_.z];
+    const int2 CELL = cClipmapRegion_.xy + int2(DTid.xy);
+    const float ROW_HEIGHT = 1.0 / (cClipmapRegion_.w * LEVEL.texel_.w);
+    const float3 CORNER = float3(CELL.x * LEVEL.texel_.x, -(LEVEL.texel_.z + DTid.z * ROW_HEIGHT), CELL.y * LEVEL.texel_.x);
+    const float3 SIZE = float3(LEVEL.texel_.x, -ROW_HEIGHT, LEVEL.texel_.x);
+
+    // every layer, the mask of the pixel marcher is per ray
+    sCloudLayerMask = 0xffffffff;
+    float distance;
+    float3 normal;
+    const float DENSE = CloudDensity(CORNER + 0.5 * SIZE, distance, normal, true) * 64.0;
+
+    float densest = 0.0;
+    [loop]
+    for (int i = 0; i < DENSITY_CLIPMAP_SKIP_LATTICE * DENSITY_CLIPMAP_SKIP_LATTICE * DENSITY_CLIPMAP_SKIP_LATTICE; i++) {
+        const int3 LATTICE = int3(i, i / DENSITY_CLIPMAP_SKIP_LATTICE, i / (DENSITY_CLIPMAP_SKIP_LATTICE * DENSITY_CLIPMAP_SKIP_LATTICE)) % DENSITY_CLIPMAP_SKIP_LATTICE;
+        const float3 POS = CORNER + SIZE * float3(LATTICE.xzy) / (DENSITY_CLIPMAP_SKIP_LATTICE - 1);
+        densest = max(densest, CloudDensity(POS, distance, normal, true) * 64.0);
+    }
+
+    const int RES = cClipmapSize_.z;
+    const uint3 TEXEL = uint3((CELL.x % RES + RES) % RES, (CELL.y % RES + RES) % RES, cClipmapRegion_.z * cClipmapRegion_.w + DTid.z);
+    // rounded up, a texel with any cloud on its lattice never reads 0
+    densityClipmapOutput[TEXEL] = float2(saturate(DENSE), densest > 0.0 ? max(saturate(densest), 1.0 / 65535.0) : 0.0);
+}
+
+cbuffer FarCloudCacheTile : register(b6) {
+    int4 cFarCacheTile_;    // x: face, yz: first texel, w: face size
+    float4 cFarCacheBand_;  // x, y: ray lengths the band starts and ends at (end 0 clears), z: step budget
+};
+
+RWTexture2DArray<float4> farCloudCacheOutput : register(u2);
+
+// D3D TextureCube addressing, the direction through uv of a face. C++ port FarCloudCache::FaceDirection
+float3 FarCloudCacheDirection(int face, float2 uv) {
+    const float2 ST = uv * 2.0 - 1.0;
+    switch (face) {
+    case 0: return float3(1.0, -ST.y, -ST.x);
+    case 1: return float3(-1.0, -ST.y, ST.x);
+    case 2: return float3(ST.x, 1.0, ST.y);
+    case 3: return float3(ST.x, -1.0, -ST.y);
+    case 4: return float3(ST.x, -ST.y, 1.0);
+    default: return float3(-ST.x, -ST.y, -1.0);
+    }
+}
+
+// marches one tile FarCloudCache::Update handed out, a thread per texel, from the camera of
+// this frame through the far band. no primitive, no jitter and no history
+[numthreads(8, 8, 1)]
+void CSFarCloudCache(uint3 DTid : SV_DispatchThreadID) {
+    const int2 TEXEL = cFarCacheTile_.yz + int2(DTid.xy);
+    if (any(TEXEL >= cFarCacheTile_.w)) { return; }
+
+    const float3 RD = normalize(FarCloudCacheDirection(cFarCacheTile_.x, (TEXEL + 0.5) / cFarCacheTile_.w));
+    float cloudDepth;
+    const float4 CLOUD = cFarCacheBand_.y > cFarCacheBand_.x
+        ? RayMarch(cCameraPosition_.xyz, RD, 8, cFarCacheBand_.x, cFarCacheBand_.y, int(cFarCacheBand_.z), float2(0, 0), MAX_LENGTH, cloudDepth)
+        : 0;
+    farCloudCacheOutput[uint3(TEXEL, cFarCacheTile_.x)] = CLOUD;
+}
@@ -0,0 +1,164 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
+#include <vector>
+
+#include "../includes/AdaptiveStep.h"
+#include "../includes/CloudRegression.h"
+#include "../includes/CloudSdf.h"
+#include "../includes/CpuCloudRenderer.h"
+#include "../includes/DensityField.h"
+#include "../includes/Fmap.h"
+#include "../includes/OccupancyGrid.h"
+
+using namespace hlsl;
+
+namespace adaptivestep {
+
+    namespace {
+
+        // error against the reference and cost of one march setting over every case
+        struct Tally {
+            std::string name_;
+            std::vector<float> errors_;
+            uint64_t steps_ = 0;
+            uint64_t samples_ = 0;
+            double ms_ = 0.0;
+
+            double MeanError() const {
+                double sum = 0.0;
+                for (const float e : errors_) { sum += e; }
+                return errors_.empty() ? 0.0 : sum / errors_.size();
+            }
+            float P99Error() const {
+                std::vector<float> sorted = errors_;
+                std::sort(sorted.begin(), sorted.end());
+                return sorted.empty() ? 0.0f : sorted[(sorted.size() - 1) * 99 / 100];
+            }
+            double StepsPerPixel() const { return errors_.empty() ? 0.0 : static_cast<double>(steps_) / errors_.size(); }
+            double SamplesPerPixel() const { return errors_.empty() ? 0.0 : static_cast<double>(samples_) / errors_.size(); }
+        };
+
+        void Add(Tally& tally, const CpuCloudFrame& frame, const CpuCloudFrame& reference) {
+            for (size_t i = 0; i < frame.color_.size(); i++) {
+                const float4 d = frame.color_[i] - reference.color_[i];
+                tally.errors_.push_back((std::max)((std::max)(std::fabs(d.x), std::fabs(d.y)), (std::max)(std::fabs(d.z), std::fabs(d.w))));
+            }
+            tally.steps_ += frame.marchSteps_;
+            tally.samples_ += frame.densitySamples_;
+            tally.ms_ += frame.totalMs_;
+        }
+
+    } // namespace
+
+    std::string Report(DensityField& field, int width, int height, const std::string& resourceDir) {
+        std::ostringstream ss;
+        if (field.NoiseLarge().texels_.empty()) {
+            ss << "adaptive step: density field not initialized\n";
+            return ss.str();
+        }
+
+        const float referenceStep = 5.0f;
+        const float stepErrors[] = { 0.002f, 0.005f, 0.01f, 0.02f, 0.05f };
+        const Params defaults;
+
+        CpuCloudRendererSettings settings;
+        settings.width_ = width;
+        settings.height_ = height;
+        // the reference has no step limit, keep its rays within the near pass clouds
+        settings.far_ = 30000.0f;
+
+        Tally legacy{ "legacy", {} };
+        std::vector<Tally> adaptive;
+        for (const float stepError : stepErrors) {
+            char name[32];
+            snprintf(name, sizeof(name), "error %.4f%s", stepError, stepError == defaults.stepError_ ? " *" : "");
+            adaptive.push_back({ name, {} });
+        }
+
+        const CloudRegressionSettings regression;
+        for (const CloudRegression::Case& c : CloudRegression::Cases()) {
+            const std::string path = resourceDir + "/" + c.fmap_;
+            if (!std::filesystem::exists(path)) {
+                ss << "adaptive step: missing weather map " << path << "\n";
+                return ss.str();
+            }
+            field.SetWeather(Fmap(path));
+            field.SetTime(regression.seconds_);
+
+            OccupancyGrid grid;
+            CloudSdf sdf;
+            if (!grid.Build(field) || !sdf.Build(grid)) {
+                ss << "adaptive step: occupancy grid or distance volume build failed\n";
+                return ss.str();
+            }
+            CpuCloudSources sources;
+            sources.occupancy_ = &grid;
+            sources.sdf_ = &sdf;
+
+            CpuCloudRenderer renderer;
+            CpuCloudFrame reference, frame;
+
+            CpuCloudRendererSettings s = settings;
+            s.referenceStep_ = referenceStep;
+            renderer.Initialize(s);
+            renderer.Render(field, c.view_, reference, sources);
+
+            s.referenceStep_ = 0.0f;
+            s.adaptiveStep_ = false;
+            renderer.Initialize(s);
+            renderer.Render(field, c.view_, frame, sources);
+            Add(legacy, frame, reference);
+
+            s.adaptiveStep_ = true;
+            s.adaptive_ = defaults;
+            for (size_t b = 0; b < adaptive.size(); b++) {
+                s.adaptive_.stepError_ = stepErrors[b];
+                renderer.Initialize(s);
+                renderer.Render(field, c.view_, frame, sources);
+                Add(adaptive[b], frame, reference);
+            }
+        }
+
+        ss << "adaptive step on " << CloudRegression::Cases().size() << " regression poses at " << width << "x" << height
+           << ", rgba error against a " << referenceStep << " m step reference out to " << settings.far_ << " m\n";
+        char line[200];
+        snprintf(line, sizeof(line), "  %-16s %10s %10s %10s %10s %10s\n", "march", "mean err", "p99 err", "steps/px", "spp", "ms");
+        ss << line;
+        auto row = [&](const Tally& t) {
+            snprintf(line, sizeof(line), "  %-16s %10.2e %10.2e %10.1f %10.1f %10.1f\n", t.name_.c_str(), t.MeanError(), t.P99Error(),
+                t.StepsPerPixel(), t.SamplesPerPixel(), t.ms_);
+            ss << line;
+        };
+        row(legacy);
+        for (const Tally& t : adaptive) { row(t); }
+
+        // the cheapest step error that is at least as accurate as the legacy march
+        const Tally* equal = nullptr;
+        for (const Tally& t : adaptive) {
+            if (t.MeanError() <= legacy.MeanError() && t.P99Error() <= legacy.P99Error()
+                && (!equal || t.SamplesPerPixel() < equal->SamplesPerPixel())) {
+                equal = &t;
+            }
+        }
+        if (equal) {
+            snprintf(line, sizeof(line), "  at the legacy error (%s): steps %+.1f%%, density samples %+.1f%% against the legacy march\n",
+                equal->name_.c_str(), 100.0 * (equal->StepsPerPixel() / legacy.StepsPerPixel() - 1.0),
+                100.0 * (equal->SamplesPerPixel() / legacy.SamplesPerPixel() - 1.0));
+            ss << line;
+        }
+        else {
+            ss << "  no step error reaches the legacy error\n";
+        }
+
+        // the default step error has to be at least as accurate as the legacy march, at fewer steps and samples
+        const auto current = std::find_if(adaptive.begin(), adaptive.end(), [&](const Tally& t) { return t.name_.back() == '*'; });
+        const bool pass = current != adaptive.end() && current->MeanError() <= legacy.MeanError() && current->P99Error() <= legacy.P99Error()
+            && current->steps_ < legacy.steps_ && current->samples_ < legacy.samples_;
+        ss << (pass ? "  PASS\n" : "  FAIL\n");
+        return ss.str();
+    }
+
+} // namespace adaptivestep
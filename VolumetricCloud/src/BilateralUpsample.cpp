@@ -0,0 +1,271 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
+#include <vector>
+
+#include "../includes/BilateralUpsample.h"
+#include "../includes/CloudSdf.h"
+#include "../includes/CpuCloudRenderer.h"
+#include "../includes/DensityField.h"
+#include "../includes/Fmap.h"
+#include "../includes/OccupancyGrid.h"
+
+using namespace hlsl;
+
+namespace bilateralupsample {
+
+    namespace {
+
+        // DepthToMeter, R = near / (near - far), the far plane for the cleared target
+        float ViewDepth(const CpuCloudRendererSettings& settings, float depth) {
+            const float range = settings.near_ / (settings.near_ - settings.far_);
+            return -range * settings.far_ / (depth - range);
+        }
+
+        float ReversedDepth(const CpuCloudRendererSettings& settings, float viewZ) {
+            const float range = settings.near_ / (settings.near_ - settings.far_);
+            return range * (1.0f - settings.far_ / viewZ);
+        }
+
+        float MaxAbs(const float4& a, const float4& b) {
+            const float4 d = a - b;
+            return (std::max)((std::max)(std::fabs(d.x), std::fabs(d.y)), (std::max)(std::fabs(d.z), std::fabs(d.w)));
+        }
+
+        // linearSampler of DrawQuad clamps
+        template <typename T>
+        T Bilinear(const std::vector<T>& texels, int width, int height, float u, float v) {
+            const float tx = u * width - 0.5f, ty = v * height - 0.5f;
+            const float bx = std::floor(tx), by = std::floor(ty);
+            const float fx = tx - bx, fy = ty - by;
+            const int x0 = std::clamp(static_cast<int>(bx), 0, width - 1);
+            const int y0 = std::clamp(static_cast<int>(by), 0, height - 1);
+            const int x1 = std::clamp(static_cast<int>(bx) + 1, 0, width - 1);
+            const int y1 = std::clamp(static_cast<int>(by) + 1, 0, height - 1);
+            const auto at = [&](int x, int y) { return texels[static_cast<size_t>(y) * width + x]; };
+            return (at(x0, y0) * (1.0f - fx) + at(x1, y0) * fx) * (1.0f - fy) + (at(x0, y1) * (1.0f - fx) + at(x1, y1) * fx) * fy;
+        }
+
+        // the merge keeps the cloud where its first sample is in front of the primitive
+        void DepthTest(const CpuCloudFrame& cloud, const CpuCloudFrame& primitive, CpuCloudFrame& out) {
+            out.width_ = primitive.width_;
+            out.height_ = primitive.height_;
+            out.depth_ = primitive.depth_;
+            out.color_.resize(primitive.depth_.size());
+            for (size_t i = 0; i < out.color_.size(); i++) {
+                out.color_[i] = cloud.depth_[i] > primitive.depth_[i] ? cloud.color_[i] : float4(0.0f);
+            }
+        }
+
+    } // namespace
+
+    void Upsample(const Params& params, const CpuCloudRendererSettings& settings, const CpuCloudFrame& cloud,
+        const CpuCloudFrame& primitive, CpuCloudFrame& out) {
+        const int W = primitive.width_, H = primitive.height_;
+        const int w = cloud.width_, h = cloud.height_;
+        out.width_ = W;
+        out.height_ = H;
+        out.depth_ = primitive.depth_;
+        out.color_.assign(primitive.depth_.size(), float4(0.0f));
+
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                const size_t i = static_cast<size_t>(y) * W + x;
+                const float depth = primitive.depth_[i];
+                const float viewZ = ViewDepth(settings, depth);
+
+                // the four texels of the bilinear footprint, clamped like linearSampler
+                const float tx = (x + 0.5f) / W * w - 0.5f, ty = (y + 0.5f) / H * h - 0.5f;
+                const float bx = std::floor(tx), by = std::floor(ty);
+                float4 color(0.0f);
+                float cloudDepth = 0.0f;
+                float total = 0.0f;
+                for (int k = 0; k < 4; k++) {
+                    const int cx = std::clamp(static_cast<int>(bx) + (k & 1), 0, w - 1);
+                    const int cy = std::clamp(static_cast<int>(by) + (k >> 1), 0, h - 1);
+
+                    // where the march of the texel ended and the point its ray crossed, primDepth of
+                    // StartRayMarch. the tent around that point is the bilinear weight of a texel
+                    // whose ray kept its centre
+                    float2 rayPos;
+                    const float marchEnd = CpuCloudRenderer::FootprintFarthest(primitive, (cx + 0.5f) / w, (cy + 0.5f) / h, w, h, &rayPos);
+                    const float dx = std::fabs(tx + 0.5f - rayPos.x * w), dy = std::fabs(ty + 0.5f - rayPos.y * h);
+                    const float tent = (std::max)((std::max)(1.0f - dx, 0.0f) * (std::max)(1.0f - dy, 0.0f), params.tentFloor_);
+
+                    const float texelViewZ = ViewDepth(settings, marchEnd);
+                    const float difference = std::fabs(viewZ - texelViewZ) / (std::min)(viewZ, texelViewZ);
+                    const float weight = tent / (params.depthEpsilon_ + difference);
+
+                    const size_t c = static_cast<size_t>(cy) * w + cx;
+                    color += cloud.color_[c] * weight;
+                    cloudDepth += cloud.depth_[c] * weight;
+                    total += weight;
+                }
+                // the depth test of the merge on the upsampled cloud
+                out.color_[i] = cloudDepth > depth * total ? color * (1.0f / total) : float4(0.0f);
+            }
+        }
+    }
+
+    void Stretch(const CpuCloudFrame& cloud, const CpuCloudFrame& primitive, CpuCloudFrame& out) {
+        const int W = primitive.width_, H = primitive.height_;
+        CpuCloudFrame stretched;
+        stretched.color_.resize(primitive.depth_.size());
+        stretched.depth_.resize(primitive.depth_.size());
+        for (int y = 0; y < H; y++) {
+            for (int x = 0; x < W; x++) {
+                const size_t i = static_cast<size_t>(y) * W + x;
+                const float u = (x + 0.5f) / W, v = (y + 0.5f) / H;
+                stretched.color_[i] = Bilinear(cloud.color_, cloud.width_, cloud.height_, u, v);
+                stretched.depth_[i] = Bilinear(cloud.depth_, cloud.width_, cloud.height_, u, v);
+            }
+        }
+        DepthTest(stretched, primitive, out);
+    }
+
+    std::string Report(DensityField& field, int width, int height, const std::string& resourceDir) {
+        std::ostringstream ss;
+        if (field.NoiseLarge().texels_.empty()) {
+            ss << "bilateral upsample: density field not initialized\n";
+            return ss.str();
+        }
+
+        const std::string path = resourceDir + "/40100.fmap";
+        if (!std::filesystem::exists(path)) {
+            ss << "bilateral upsample: missing weather map " << path << "\n";
+            return ss.str();
+        }
+        field.SetWeather(Fmap(path));
+        field.SetTime(10.0);
+
+        OccupancyGrid grid;
+        CloudSdf sdf;
+        if (!grid.Build(field) || !sdf.Build(grid)) {
+            ss << "bilateral upsample: occupancy grid or distance volume build failed\n";
+            return ss.str();
+        }
+
+        CpuCloudRendererSettings settings;
+        settings.width_ = width;
+        settings.height_ = height;
+        const Params params;
+
+        // the clouds of the default view are 3.5 to 25 km away in the upper third: a monolith,
+        // a two pixel pole and a slab reaching into them
+        struct Box {
+            float x0_, x1_, y0_;
+            float viewZ_;
+        };
+        const Box boxes[] = {
+            { 0.42f, 0.58f, 0.08f, 6000.0f },
+            { 0.20f, 0.20f + 2.0f / width, 0.05f, 5000.0f },
+            { 0.66f, 0.90f, 0.20f, 12000.0f },
+        };
+        CpuCloudFrame primitive;
+        primitive.width_ = width;
+        primitive.height_ = height;
+        primitive.depth_.assign(static_cast<size_t>(width) * height, 0.0f);
+        for (const Box& b : boxes) {
+            for (int y = static_cast<int>(b.y0_ * height); y < height; y++) {
+                for (int x = static_cast<int>(b.x0_ * width); x < static_cast<int>(b.x1_ * width); x++) {
+                    primitive.depth_[static_cast<size_t>(y) * width + x] = ReversedDepth(settings, b.viewZ_);
+                }
+            }
+        }
+
+        // the band: pixels within a quarter resolution texel of a depth edge, on its nearer or farther side
+        const int reach = 4;
+        std::vector<int> band(primitive.depth_.size(), 0); // 0 away, 1 over the nearer side, 2 the farther side
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                const float depth = primitive.depth_[static_cast<size_t>(y) * width + x];
+                for (int dy = -reach; dy <= reach; dy++) {
+                    for (int dx = -reach; dx <= reach; dx++) {
+                        const int nx = x + dx, ny = y + dy;
+                        if (nx < 0 || ny < 0 || nx >= width || ny >= height) { continue; }
+                        const float other = primitive.depth_[static_cast<size_t>(ny) * width + nx];
+                        int& b = band[static_cast<size_t>(y) * width + x];
+                        if (other < depth) { b = 1; }
+                        else if (other > depth && b == 0) { b = 2; }
+                    }
+                }
+            }
+        }
+
+        CpuCloudSources sources;
+        sources.occupancy_ = &grid;
+        sources.sdf_ = &sdf;
+        sources.primitive_ = &primitive;
+
+        // the full march for the step counts
+        CpuCloudRenderer renderer;
+        renderer.Initialize(settings);
+        CpuCloudFrame full;
+        renderer.Render(field, CpuCloudView(), full, sources);
+
+        // the reference: every pixel from the full resolution march of its own primitive depth
+        // over the whole screen, no edge for the march to cross
+        CpuCloudFrame reference = primitive;
+        reference.color_.assign(primitive.depth_.size(), float4(0.0f));
+        std::vector<float> layers = { 0.0f };
+        for (const Box& b : boxes) { layers.push_back(ReversedDepth(settings, b.viewZ_)); }
+        for (const float layer : layers) {
+            CpuCloudFrame flat = primitive;
+            std::fill(flat.depth_.begin(), flat.depth_.end(), layer);
+            CpuCloudSources flatSources = sources;
+            flatSources.primitive_ = &flat;
+            CpuCloudFrame layerCloud;
+            renderer.Render(field, CpuCloudView(), layerCloud, flatSources);
+            for (size_t i = 0; i < reference.color_.size(); i++) {
+                if (primitive.depth_[i] == layer) { reference.color_[i] = layerCloud.color_[i]; }
+            }
+        }
+
+        char line[256];
+        ss << "bilateral upsample, " << width << "x" << height << " over 40100.fmap, primitives at 5, 6 and 12 km\n";
+        ss << "  mean rgba error against full resolution marches without depth edges, band " << reach << " px around the edges\n";
+        snprintf(line, sizeof(line), "  %-6s %-9s %12s %12s %12s %9s\n", "scale", "merge", "over prim", "beside prim", "away", "steps");
+        ss << line;
+        bool pass = true;
+        for (const int scale : { 2, 4 }) {
+            // the stretch takes the march widened to the farthest neighbour, the bilateral
+            // upsample the one that ends at the primitive of its own texel
+            CpuCloudFrame marches[2];
+            for (int m = 0; m < 2; m++) {
+                CpuCloudRendererSettings low = settings;
+                low.width_ = width / scale;
+                low.height_ = height / scale;
+                low.primitiveFootprint_ = m == 0;
+                renderer.Initialize(low);
+                renderer.Render(field, CpuCloudView(), marches[m], sources);
+            }
+
+            double bandErrors[2][3] = {};
+            for (int m = 0; m < 2; m++) {
+                CpuCloudFrame out;
+                if (m == 0) { Stretch(marches[m], primitive, out); }
+                else { Upsample(params, settings, marches[m], primitive, out); }
+
+                int counts[3] = {};
+                for (size_t i = 0; i < out.color_.size(); i++) {
+                    const int b = band[i] == 0 ? 2 : band[i] - 1;
+                    bandErrors[m][b] += MaxAbs(out.color_[i], reference.color_[i]);
+                    counts[b]++;
+                }
+                for (int b = 0; b < 3; b++) { bandErrors[m][b] /= (std::max)(counts[b], 1); }
+                snprintf(line, sizeof(line), "  1/%-4d %-9s %12.3e %12.3e %12.3e %8.3fx\n", scale, m == 0 ? "stretch" : "bilateral",
+                    bandErrors[m][0], bandErrors[m][1], bandErrors[m][2], static_cast<double>(marches[m].marchSteps_) / full.marchSteps_);
+                ss << line;
+            }
+            // no cloud from behind bleeding over the primitives, the sky beside them closer than
+            // the stretch of the widened march, nothing changes away from the edges
+            pass = pass && bandErrors[1][0] < bandErrors[0][0] && bandErrors[1][1] < bandErrors[0][1]
+                && bandErrors[1][2] <= bandErrors[0][2] * 1.001;
+        }
+        ss << (pass ? "  PASS\n" : "  FAIL\n");
+        return ss.str();
+    }
+
+} // namespace bilateralupsample
@@ -0,0 +1,411 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../includes/BrickVolume.h"
+#include "../includes/ThreadPool.h"
+
+using namespace hlsl;
+
+namespace {
+
+    int Wrap(int v, int size) {
+        const int m = v % size;
+        return m < 0 ? m + size : m;
+    }
+
+    uint64_t HashBytes(const uint8_t* data, size_t size) {
+        // FNV-1a
+        uint64_t h = 1469598103934665603ull;
+        for (size_t i = 0; i < size; i++) {
+            h = (h ^ data[i]) * 1099511628211ull;
+        }
+        return h;
+    }
+
+    int MaxByteDifference(const uint8_t* a, const uint8_t* b, size_t size, int limit) {
+        int maxDiff = 0;
+        for (size_t i = 0; i < size; i++) {
+            maxDiff = (std::max)(maxDiff, std::abs(static_cast<int>(a[i]) - static_cast<int>(b[i])));
+            if (maxDiff > limit) { break; }
+        }
+        return maxDiff;
+    }
+
+    float4 Unpack(uint32_t v) {
+        return float4((v & 0xFF) / 255.0f, ((v >> 8) & 0xFF) / 255.0f, ((v >> 16) & 0xFF) / 255.0f, (v >> 24) / 255.0f);
+    }
+
+    // near-equal candidates are only searched among bricks with a close mean
+    const int kMaxCandidates = 32;
+
+} // namespace
+
+bool BrickVolume::Build(const NoiseVolume& volume, const Settings& settings) {
+    const int b = settings.brickSize_;
+    if (b <= 0 || volume.width_ % b || volume.height_ % b || volume.depth_ % b) {
+        std::cerr << "Brick size " << b << " does not divide the volume size" << std::endl;
+        return false;
+    }
+
+    settings_ = settings;
+    width_ = volume.width_;
+    height_ = volume.height_;
+    depth_ = volume.depth_;
+    pagesX_ = width_ / b;
+    pagesY_ = height_ / b;
+    pagesZ_ = depth_ / b;
+
+    const int s = StoredBrickSize();
+    const size_t brickBytes = StoredBrickBytes();
+    const int pageCount = pagesX_ * pagesY_ * pagesZ_;
+
+    uint8_t zeroBelow[4];
+    for (int c = 0; c < 4; c++) {
+        zeroBelow[c] = static_cast<uint8_t>(saturate(settings.zeroBelow_[c]) * 255.0f + 0.5f);
+    }
+
+    // quantize every brick including its apron, bricks are independent so this runs on the pool
+    std::vector<uint8_t> candidates(brickBytes * pageCount);
+    ThreadPool::Shared().ParallelFor(0, pageCount, [&](int page) {
+        const int px = page % pagesX_;
+        const int py = (page / pagesX_) % pagesY_;
+        const int pz = page / (pagesX_ * pagesY_);
+
+        uint8_t* out = &candidates[brickBytes * page];
+        for (int z = 0; z < s; z++)
+        for (int y = 0; y < s; y++)
+        for (int x = 0; x < s; x++) {
+            const float* t = &volume.texels_[volume.Index(
+                Wrap(px * b + x - kApron, width_), Wrap(py * b + y - kApron, height_), Wrap(pz * b + z - kApron, depth_))];
+            for (int c = 0; c < 4; c++) {
+                const uint8_t v = static_cast<uint8_t>(saturate(t[c]) * 255.0f + 0.5f);
+                *out++ = v <= zeroBelow[c] ? 0 : v;
+            }
+        }
+    });
+
+    const int uniformLimit = static_cast<int>(settings.uniformError_ * 255.0f + 0.5f);
+    const int dedupLimit = static_cast<int>(settings.dedupError_ * 255.0f + 0.5f);
+
+    pages_.assign(pageCount, PageEntry());
+    bricks_.clear();
+    stats_ = Stats();
+    stats_.bricks_ = pageCount;
+
+    std::unordered_map<uint64_t, std::vector<uint32_t>> exact;
+    std::unordered_map<uint32_t, std::vector<uint32_t>> near;
+
+    for (int page = 0; page < pageCount; page++) {
+        const uint8_t* brick = &candidates[brickBytes * page];
+
+        int lo[4] = { 255, 255, 255, 255 };
+        int hi[4] = { 0, 0, 0, 0 };
+        uint32_t sum[4] = { 0, 0, 0, 0 };
+        for (size_t i = 0; i < brickBytes; i++) {
+            const int c = static_cast<int>(i & 3);
+            lo[c] = (std::min)(lo[c], static_cast<int>(brick[i]));
+            hi[c] = (std::max)(hi[c], static_cast<int>(brick[i]));
+            sum[c] += brick[i];
+        }
+
+        // uniform bricks live in the page table only
+        if (std::max({ hi[0] - lo[0], hi[1] - lo[1], hi[2] - lo[2], hi[3] - lo[3] }) <= uniformLimit) {
+            uint32_t packed = 0;
+            for (int c = 0; c < 4; c++) {
+                packed |= static_cast<uint32_t>((lo[c] + hi[c] + 1) / 2) << (8 * c);
+            }
+            pages_[page].brick_ = kUniformBrick;
+            pages_[page].value_ = packed;
+            stats_.uniformBricks_++;
+            continue;
+        }
+
+        // exact copy
+        const uint64_t hash = HashBytes(brick, brickBytes);
+        int found = -1;
+        for (uint32_t index : exact[hash]) {
+            if (std::memcmp(&bricks_[brickBytes * index], brick, brickBytes) == 0) {
+                found = static_cast<int>(index);
+                break;
+            }
+        }
+
+        // near copy among bricks with the same coarse mean
+        uint32_t meanKey = 0;
+        for (int c = 0; c < 4; c++) {
+            meanKey |= ((sum[c] / static_cast<uint32_t>(brickBytes / 4)) >> 4) << (4 * c);
+        }
+        if (found < 0 && dedupLimit > 0) {
+            const std::vector<uint32_t>& bucket = near[meanKey];
+            for (size_t i = 0; i < bucket.size() && i < kMaxCandidates; i++) {
+                if (MaxByteDifference(&bricks_[brickBytes * bucket[i]], brick, brickBytes, dedupLimit) <= dedupLimit) {
+                    found = static_cast<int>(bucket[i]);
+                    break;
+                }
+            }
+        }
+
+        if (found >= 0) {
+            pages_[page].brick_ = static_cast<uint32_t>(found);
+            stats_.dedupedBricks_++;
+            continue;
+        }
+
+        const uint32_t index = static_cast<uint32_t>(bricks_.size() / brickBytes);
+        bricks_.insert(bricks_.end(), brick, brick + brickBytes);
+        exact[hash].push_back(index);
+        near[meanKey].push_back(index);
+        pages_[page].brick_ = index;
+    }
+
+    stats_.atlasBricks_ = AtlasBrickCount();
+    stats_.denseBytes_ = static_cast<size_t>(width_) * height_ * depth_ * 4;
+    stats_.sparseBytes_ = pages_.size() * sizeof(uint32_t) * 2 + bricks_.size();
+    return true;
+}
+
+float4 BrickVolume::Load(int x, int y, int z) const {
+    const int b = settings_.brickSize_;
+    x = Wrap(x, width_);
+    y = Wrap(y, height_);
+    z = Wrap(z, depth_);
+
+    const PageEntry& page = pages_[((z / b) * pagesY_ + (y / b)) * pagesX_ + (x / b)];
+    if (page.brick_ == kUniformBrick) {
+        return Unpack(page.value_);
+    }
+
+    const int s = StoredBrickSize();
+    const uint8_t* t = &bricks_[StoredBrickBytes() * page.brick_ +
+        ((static_cast<size_t>(z % b + kApron) * s + (y % b + kApron)) * s + (x % b + kApron)) * 4];
+    return float4(t[0] / 255.0f, t[1] / 255.0f, t[2] / 255.0f, t[3] / 255.0f);
+}
+
+float4 BrickVolume::Sample(const float3& uvw) const {
+    const int b = settings_.brickSize_;
+    const int s = StoredBrickSize();
+
+    // texel space, texel i covers [i, i + 1)
+    const float3 p = frac(uvw) * float3((float)width_, (float)height_, (float)depth_);
+    const int px = (std::min)(static_cast<int>(p.x) / b, pagesX_ - 1);
+    const int py = (std::min)(static_cast<int>(p.y) / b, pagesY_ - 1);
+    const int pz = (std::min)(static_cast<int>(p.z) / b, pagesZ_ - 1);
+
+    const PageEntry& page = pages_[(pz * pagesY_ + py) * pagesX_ + px];
+    if (page.brick_ == kUniformBrick) {
+        return Unpack(page.value_);
+    }
+
+    // position inside the stored brick, centers at i + 0.5
+    const float3 local = p - float3((float)(px * b), (float)(py * b), (float)(pz * b)) + (float)kApron - 0.5f;
+    const float3 fl = floor(local);
+    const float3 f = local - fl;
+    const int x0 = static_cast<int>(fl.x), y0 = static_cast<int>(fl.y), z0 = static_cast<int>(fl.z);
+
+    const uint8_t* brick = &bricks_[StoredBrickBytes() * page.brick_];
+    auto texel = [&](int x, int y, int z) {
+        const uint8_t* t = &brick[((static_cast<size_t>(z) * s + y) * s + x) * 4];
+        return float4(t[0] / 255.0f, t[1] / 255.0f, t[2] / 255.0f, t[3] / 255.0f);
+    };
+
+    return lerp(
+        lerp(lerp(texel(x0, y0, z0), texel(x0 + 1, y0, z0), f.x), lerp(texel(x0, y0 + 1, z0), texel(x0 + 1, y0 + 1, z0), f.x), f.y),
+        lerp(lerp(texel(x0, y0, z0 + 1), texel(x0 + 1, y0, z0 + 1), f.x), lerp(texel(x0, y0 + 1, z0 + 1), texel(x0 + 1, y0 + 1, z0 + 1), f.x), f.y),
+        f.z);
+}
+
+float4 BrickVolume::SampleDense(const NoiseVolume& volume, const float3& uvw) {
+    const float3 p = uvw * float3((float)volume.width_, (float)volume.height_, (float)volume.depth_) - 0.5f;
+    const float3 fl = floor(p);
+    const float3 f = p - fl;
+    const int x0 = static_cast<int>(fl.x), y0 = static_cast<int>(fl.y), z0 = static_cast<int>(fl.z);
+
+    auto texel = [&](int x, int y, int z) {
+        const float4 v = volume.Load(Wrap(x, volume.width_), Wrap(y, volume.height_), Wrap(z, volume.depth_));
+        return float4(saturate(v.x), saturate(v.y), saturate(v.z), saturate(v.w));
+    };
+
+    return lerp(
+        lerp(lerp(texel(x0, y0, z0), texel(x0 + 1, y0, z0), f.x), lerp(texel(x0, y0 + 1, z0), texel(x0 + 1, y0 + 1, z0), f.x), f.y),
+        lerp(lerp(texel(x0, y0, z0 + 1), texel(x0 + 1, y0, z0 + 1), f.x), lerp(texel(x0, y0 + 1, z0 + 1), texel(x0 + 1, y0 + 1, z0 + 1), f.x), f.y),
+        f.z);
+}
+
+float BrickVolume::Validate(const NoiseVolume& volume, int samples) {
+    float maxError = 0.0f;
+    auto track = [&](const float4& a, const float4& b) {
+        for (int c = 0; c < 4; c++) {
+            maxError = (std::max)(maxError, std::fabs(a[c] - b[c]));
+        }
+    };
+
+    // every texel through Load
+    for (int z = 0; z < depth_; z++)
+    for (int y = 0; y < height_; y++)
+    for (int x = 0; x < width_; x++) {
+        const float4 v = volume.Load(x, y, z);
+        track(Load(x, y, z), float4(saturate(v.x), saturate(v.y), saturate(v.z), saturate(v.w)));
+    }
+
+    // random positions through the filtered path, deterministic
+    uint32_t state = 0x12345678u;
+    auto next = [&]() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    };
+    std::vector<uint32_t> indirection;
+    std::vector<uint8_t> atlas;
+    int atlasX = 0, atlasY = 0, atlasZ = 0;
+    ExportIndirection(indirection);
+    ExportAtlas(atlas, atlasX, atlasY, atlasZ);
+    float exportError = 0.0f;
+    for (int i = 0; i < samples; i++) {
+        const float3 uvw(next(), next(), next());
+        const float4 dense = SampleDense(volume, uvw);
+        track(Sample(uvw), dense);
+        const float4 exported = SampleExported(indirection, atlas, atlasX, atlasY, atlasZ, uvw);
+        for (int c = 0; c < 4; c++) {
+            exportError = (std::max)(exportError, std::fabs(exported[c] - dense[c]));
+        }
+    }
+
+    stats_.maxError_ = maxError;
+    stats_.exportError_ = exportError;
+    return (std::max)(maxError, exportError);
+}
+
+void BrickVolume::ExportIndirection(std::vector<uint32_t>& texels) const {
+    texels.resize(pages_.size() * 2);
+    for (size_t i = 0; i < pages_.size(); i++) {
+        texels[i * 2 + 0] = pages_[i].brick_;
+        texels[i * 2 + 1] = pages_[i].value_;
+    }
+}
+
+void BrickVolume::ExportAtlas(std::vector<uint8_t>& texels, int& atlasBricksX, int& atlasBricksY, int& atlasBricksZ) const {
+    const int count = (std::max)(1, AtlasBrickCount());
+    const int s = StoredBrickSize();
+
+    // close to a cube so no dimension runs into the 2048 texel limit early
+    atlasBricksX = static_cast<int>(std::ceil(std::cbrt(static_cast<double>(count))));
+    atlasBricksY = atlasBricksX;
+    atlasBricksZ = (count + atlasBricksX * atlasBricksY - 1) / (atlasBricksX * atlasBricksY);
+
+    const int w = atlasBricksX * s;
+    const int h = atlasBricksY * s;
+    const int d = atlasBricksZ * s;
+    texels.assign(static_cast<size_t>(w) * h * d * 4, 0);
+
+    for (int i = 0; i < AtlasBrickCount(); i++) {
+        const int bx = i % atlasBricksX;
+        const int by = (i / atlasBricksX) % atlasBricksY;
+        const int bz = i / (atlasBricksX * atlasBricksY);
+        const uint8_t* brick = &bricks_[StoredBrickBytes() * i];
+        for (int z = 0; z < s; z++)
+        for (int y = 0; y < s; y++) {
+            std::memcpy(
+                &texels[((static_cast<size_t>(bz * s + z) * h + (by * s + y)) * w + bx * s) * 4],
+                &brick[(static_cast<size_t>(z) * s + y) * s * 4],
+                static_cast<size_t>(s) * 4);
+        }
+    }
+}
+
+float4 BrickVolume::SampleExported(const std::vector<uint32_t>& indirection, const std::vector<uint8_t>& atlas,
+    int atlasBricksX, int atlasBricksY, int atlasBricksZ, const float3& uvw) const {
+    const int b = settings_.brickSize_;
+    const float storedSize = static_cast<float>(StoredBrickSize());
+    const float3 atlasSize(atlasBricksX * storedSize, atlasBricksY * storedSize, atlasBricksZ * storedSize);
+
+    const float3 p = frac(uvw) * float3((float)pagesX_, (float)pagesY_, (float)pagesZ_) * (float)b;
+    const int px = (std::min)(static_cast<int>(p.x) / b, pagesX_ - 1);
+    const int py = (std::min)(static_cast<int>(p.y) / b, pagesY_ - 1);
+    const int pz = (std::min)(static_cast<int>(p.z) / b, pagesZ_ - 1);
+
+    const size_t page = (static_cast<size_t>(pz) * pagesY_ + py) * pagesX_ + px;
+    if (indirection[page * 2] == kUniformBrick) {
+        return Unpack(indirection[page * 2 + 1]);
+    }
+    const uint32_t entry = indirection[page * 2];
+    const float3 brick((float)(entry % atlasBricksX), (float)((entry / atlasBricksX) % atlasBricksY), (float)(entry / (atlasBricksX * atlasBricksY)));
+
+    const float3 local = p - float3((float)(px * b), (float)(py * b), (float)(pz * b)) + (float)kApron;
+    const float3 uvwAtlas = (brick * storedSize + local) / atlasSize;
+
+    // SampleLevel with a linear clamp sampler
+    const float3 t = uvwAtlas * atlasSize - 0.5f;
+    const float3 fl = floor(t);
+    const float3 f = t - fl;
+    const int w = static_cast<int>(atlasSize.x), h = static_cast<int>(atlasSize.y), d = static_cast<int>(atlasSize.z);
+    auto texel = [&](int x, int y, int z) {
+        x = (std::clamp)(x, 0, w - 1);
+        y = (std::clamp)(y, 0, h - 1);
+        z = (std::clamp)(z, 0, d - 1);
+        const uint8_t* v = &atlas[((static_cast<size_t>(z) * h + y) * w + x) * 4];
+        return float4(v[0] / 255.0f, v[1] / 255.0f, v[2] / 255.0f, v[3] / 255.0f);
+    };
+    const int x0 = static_cast<int>(fl.x), y0 = static_cast<int>(fl.y), z0 = static_cast<int>(fl.z);
+    return lerp(
+        lerp(lerp(texel(x0, y0, z0), texel(x0 + 1, y0, z0), f.x), lerp(texel(x0, y0 + 1, z0), texel(x0 + 1, y0 + 1, z0), f.x), f.y),
+        lerp(lerp(texel(x0, y0, z0 + 1), texel(x0 + 1, y0, z0 + 1), f.x), lerp(texel(x0, y0 + 1, z0 + 1), texel(x0 + 1, y0 + 1, z0 + 1), f.x), f.y),
+        f.z);
+}
+
+std::string BrickVolume::Report(int resolution, const Settings& settings) {
+    const NoiseBaker::VolumeRecipe recipes[] = {
+        NoiseBaker::RecipeFbm(),
+        NoiseBaker::RecipeFbmSmall(),
+        NoiseBaker::RecipeAlligator(),
+        NoiseBaker::RecipeNoiseSequence(1),
+    };
+
+    std::ostringstream out;
+    char line[256];
+    snprintf(line, sizeof(line), "brick %d^3, uniform <= %.4f, dedup <= %.4f, %d^3 volumes\n",
+        settings.brickSize_, settings.uniformError_, settings.dedupError_, resolution);
+    out << line;
+    snprintf(line, sizeof(line), "%-14s %7s %7s %7s %7s %10s %10s %7s %8s %9s\n",
+        "recipe", "bricks", "uniform", "dedup", "atlas", "dense MB", "sparse MB", "saved", "maxErr", "exportErr");
+    out << line;
+
+    // uniform and dedup error plus the RGBA8 rounding of the filtered atlas
+    const float tolerance = (std::max)(settings.uniformError_, settings.dedupError_) + 1.0f / 255.0f;
+    bool passed = true;
+    double saved = 0.0;
+
+    for (const NoiseBaker::VolumeRecipe& recipe : recipes) {
+        const NoiseVolume volume = NoiseBaker::BakeCached(recipe, resolution, resolution, resolution);
+
+        BrickVolume bricks;
+        if (!bricks.Build(volume, settings)) {
+            continue;
+        }
+        const float error = bricks.Validate(volume, 1 << 14);
+        passed = passed && error <= tolerance;
+
+        const Stats& st = bricks.stats_;
+        const double recipeSaved = 1.0 - static_cast<double>(st.sparseBytes_) / st.denseBytes_;
+        saved = (std::max)(saved, recipeSaved);
+        snprintf(line, sizeof(line), "%-14s %7d %7d %7d %7d %10.2f %10.2f %6.1f%% %8.4f %9.4f\n",
+            recipe.name_.c_str(), st.bricks_, st.uniformBricks_, st.dedupedBricks_, st.atlasBricks_,
+            st.denseBytes_ / 1048576.0, st.sparseBytes_ / 1048576.0,
+            100.0 * recipeSaved, st.maxError_, st.exportError_);
+        out << line;
+    }
+    // the verdict is on the error of Sample and of the exported textures; a recipe without
+    // empty or repeated bricks saves nothing and keeps its dense texture in the app
+    snprintf(line, sizeof(line), "%s: error <= %.4f on all recipes, best saving %.1f%%%s\n",
+        passed ? "PASS" : "FAIL", tolerance, 100.0 * saved,
+        saved > 0.0 ? "" : ", no saving on these recipes");
+    out << line;
+    return out.str();
+}
@@ -46,18 +46,33 @@ void Camera::UpdateBuffer(UINT width, UINT height) {
 
     CameraBuffer bf;
     // consider camera position is always 0
-    bf.view = XMMatrixTranspose(XMMatrixLookAtLH(XMVectorSet(0.0, 0.0, 0.0, 1.0), XMVectorSubtract(lookAtPos_, eyePos_), Up));
+    const XMMATRIX view = XMMatrixLookAtLH(XMVectorSet(0.0, 0.0, 0.0, 1.0), XMVectorSubtract(lookAtPos_, eyePos_), Up);
     // Inverting near-far on purpose, don't change it
-    bf.projection = XMMatrixTranspose(XMMatrixPerspectiveFovLH(vFov_ * (XM_PI / 180), aspectRatio, far_, near_));
+    const XMMATRIX projection = XMMatrixPerspectiveFovLH(vFov_ * (XM_PI / 180), aspectRatio, far_, near_);
+    bf.view = XMMatrixTranspose(view);
+    bf.projection = XMMatrixTranspose(projection);
     bf.invViewProjMatrix = XMMatrixInverse(nullptr, XMMatrixMultiply(bf.view, bf.projection));
-    bf.previousViewProjectionMatrix = lastViewProjectionMatrix_;
+
+    // the view is camera relative: move a point of this frame by the eye motion before the view
+    // and projection of the frame before, no history yet reprojects onto itself
+    viewProjectionMatrix_ = view * projection;
+    bufferEyePos_ = eyePos_;
+    const XMMATRIX previous = hasLastFrame_
+        ? XMMatrixTranslationFromVector(XMVectorSubtract(eyePos_, lastEyePos_)) * lastViewProjectionMatrix_
+        : viewProjectionMatrix_;
+    bf.previousViewProjectionMatrix = XMMatrixTranspose(previous);
     bf.cameraPosition = eyePos_;
     bf.resolution = XMFLOAT2(width, height);
-	bf.padding1 = XMFLOAT2(0.0f, 0.0f);
+	bf.history = XMFLOAT2(hasLastFrame_ ? 1.0f : 0.0f, static_cast<float>(frameIndex_));
 
     Renderer::context->UpdateSubresource(buffer.Get(), 0, nullptr, &bf, 0, 0);
+}
 
-	lastViewProjectionMatrix_ = bf.view * bf.projection;
+void Camera::EndFrame() {
+    lastViewProjectionMatrix_ = viewProjectionMatrix_;
+    lastEyePos_ = bufferEyePos_;
+    hasLastFrame_ = true;
+    frameIndex_++;
 }
 
 void Camera::UpdateEyePosition() {
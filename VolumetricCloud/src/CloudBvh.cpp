@@ -0,0 +1,425 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <sstream>
+
+#include "../includes/CloudBvh.h"
+#include "../includes/CloudDensity.h"
+
+using namespace hlsl;
+
+namespace {
+
+    const float kInf = std::numeric_limits<float>::infinity();
+
+    float SurfaceArea(const float3& lo, const float3& hi) {
+        const float3 d = hi - lo;
+        return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    // segment origin + dir * [0, tMax] against a sphere, dir normalized. the perpendicular
+    // offset keeps the discriminant precise far from the center, like CloudInstanceChord.
+    bool SphereHit(const float4& sphere, const float3& origin, const float3& dir, float tMax, float& enter, float& exit) {
+        const float3 oc = sphere.xyz() - origin;
+        const float b = dot(oc, dir);
+        const float3 h = oc - dir * b;
+        const float disc = sphere.w * sphere.w - dot(h, h);
+        if (disc <= 0.0f) { return false; }
+        const float root = std::sqrt(disc);
+        enter = (std::max)(b - root, 0.0f);
+        exit = (std::min)(b + root, tMax);
+        return enter < exit;
+    }
+
+    bool BoxHit(const CloudBvh::Node& node, const float3& origin, const float3& invDir, float tMax) {
+        float enter = 0.0f, exit = tMax;
+        for (int a = 0; a < 3; a++) {
+            float t0 = (node.min_[a] - origin[a]) * invDir[a];
+            float t1 = (node.max_[a] - origin[a]) * invDir[a];
+            if (t0 > t1) { std::swap(t0, t1); }
+            enter = (std::max)(enter, t0);
+            exit = (std::min)(exit, t1);
+        }
+        return enter <= exit;
+    }
+
+    float BoxDistance(const CloudBvh::Node& node, const float3& pos) {
+        return length((max)((max)(node.min_ - pos, pos - node.max_), float3(0.0f)));
+    }
+
+} // namespace
+
+bool CloudBvh::Build(std::span<const float4> instances, const Settings& settings) {
+    if (instances.empty() || settings.leafSize_ < 1 || settings.bins_ < 2) {
+        std::cerr << "CloudBvh: " << instances.size() << " instances, leaf size " << settings.leafSize_ << ", " << settings.bins_ << " bins" << std::endl;
+        return false;
+    }
+    const auto start = std::chrono::steady_clock::now();
+
+    settings_ = settings;
+    const int count = static_cast<int>(instances.size());
+    std::vector<float3> centers(count);
+    for (int i = 0; i < count; i++) { centers[i] = instances[i].xyz(); }
+    std::vector<int> indices(count);
+    std::iota(indices.begin(), indices.end(), 0);
+
+    nodes_.clear();
+    nodes_.reserve(2 * (count / settings_.leafSize_ + 1));
+    depth_ = 0;
+    BuildNode(indices, 0, count, centers, instances, 0);
+
+    order_ = std::move(indices);
+    instances_.resize(count);
+    for (int i = 0; i < count; i++) { instances_[i] = instances[order_[i]]; }
+
+    buildSahCost_ = SahCost();
+    buildMs_ = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+int CloudBvh::BuildNode(std::vector<int>& indices, int begin, int end, const std::vector<float3>& centers,
+    std::span<const float4> instances, int depth) {
+    const int index = static_cast<int>(nodes_.size());
+    nodes_.push_back(Node());
+    depth_ = (std::max)(depth_, depth + 1);
+
+    float3 lo(kInf), hi(-kInf), centerLo(kInf), centerHi(-kInf);
+    for (int i = begin; i < end; i++) {
+        const float4& s = instances[indices[i]];
+        lo = (min)(lo, s.xyz() - s.w);
+        hi = (max)(hi, s.xyz() + s.w);
+        centerLo = (min)(centerLo, centers[indices[i]]);
+        centerHi = (max)(centerHi, centers[indices[i]]);
+    }
+    nodes_[index].min_ = lo;
+    nodes_[index].max_ = hi;
+
+    // the traversal stack holds at most one entry per level plus one
+    const int count = end - begin;
+    if (count <= settings_.leafSize_ || depth + 1 >= CLOUD_BVH_STACK) {
+        nodes_[index].offset_ = begin;
+        nodes_[index].count_ = count;
+        return index;
+    }
+
+    // binned SAH over the centroid extent
+    struct Bin {
+        float3 lo = float3(kInf);
+        float3 hi = float3(-kInf);
+        int count = 0;
+    };
+    const int bins = settings_.bins_;
+    const float parentArea = (std::max)(SurfaceArea(lo, hi), 1e-6f);
+    int bestAxis = -1, bestSplit = 0;
+    float bestCost = kInf;
+    std::vector<Bin> bin(bins);
+    std::vector<float> rightCost(bins);
+    for (int axis = 0; axis < 3; axis++) {
+        const float extent = centerHi[axis] - centerLo[axis];
+        if (extent <= 0.0f) { continue; }
+        const float scale = bins / extent;
+
+        std::fill(bin.begin(), bin.end(), Bin());
+        for (int i = begin; i < end; i++) {
+            const float4& s = instances[indices[i]];
+            const int b = (std::min)(static_cast<int>((s[axis] - centerLo[axis]) * scale), bins - 1);
+            bin[b].lo = (min)(bin[b].lo, s.xyz() - s.w);
+            bin[b].hi = (max)(bin[b].hi, s.xyz() + s.w);
+            bin[b].count++;
+        }
+
+        // right side area * count for a split after bin b, then sweep from the left
+        Bin right;
+        for (int b = bins - 1; b > 0; b--) {
+            right.lo = (min)(right.lo, bin[b].lo);
+            right.hi = (max)(right.hi, bin[b].hi);
+            right.count += bin[b].count;
+            rightCost[b - 1] = right.count ? SurfaceArea(right.lo, right.hi) * right.count : 0.0f;
+        }
+        Bin left;
+        for (int b = 0; b < bins - 1; b++) {
+            left.lo = (min)(left.lo, bin[b].lo);
+            left.hi = (max)(left.hi, bin[b].hi);
+            left.count += bin[b].count;
+            if (left.count == 0 || left.count == count) { continue; }
+            const float cost = settings_.traversalCost_ + (SurfaceArea(left.lo, left.hi) * left.count + rightCost[b]) / parentArea;
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = b;
+            }
+        }
+    }
+
+    int mid = (begin + end) / 2;
+    if (bestAxis >= 0) {
+        const float scale = bins / (centerHi[bestAxis] - centerLo[bestAxis]);
+        const auto it = std::partition(indices.begin() + begin, indices.begin() + end, [&](int i) {
+            return (std::min)(static_cast<int>((centers[i][bestAxis] - centerLo[bestAxis]) * scale), bins - 1) <= bestSplit;
+        });
+        mid = static_cast<int>(it - indices.begin());
+    }
+
+    // the first child follows, the second one is linked
+    BuildNode(indices, begin, mid, centers, instances, depth + 1);
+    const int second = BuildNode(indices, mid, end, centers, instances, depth + 1);
+    nodes_[index].offset_ = second;
+    nodes_[index].count_ = 0;
+    return index;
+}
+
+bool CloudBvh::Refit(std::span<const float4> instances) {
+    if (instances.size() != order_.size()) {
+        std::cerr << "CloudBvh: Refit with " << instances.size() << " instances, built with " << order_.size() << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < order_.size(); i++) { instances_[i] = instances[order_[i]]; }
+
+    // children come after their parent
+    for (int n = static_cast<int>(nodes_.size()) - 1; n >= 0; n--) {
+        Node& node = nodes_[n];
+        if (node.count_ > 0) {
+            float3 lo(kInf), hi(-kInf);
+            for (uint32_t i = node.offset_; i < node.offset_ + node.count_; i++) {
+                lo = (min)(lo, instances_[i].xyz() - instances_[i].w);
+                hi = (max)(hi, instances_[i].xyz() + instances_[i].w);
+            }
+            node.min_ = lo;
+            node.max_ = hi;
+        }
+        else {
+            const Node& first = nodes_[n + 1];
+            const Node& second = nodes_[node.offset_];
+            node.min_ = (min)(first.min_, second.min_);
+            node.max_ = (max)(first.max_, second.max_);
+        }
+    }
+    return true;
+}
+
+float CloudBvh::SahCost() const {
+    if (nodes_.empty()) { return 0.0f; }
+    const float rootArea = (std::max)(SurfaceArea(nodes_[0].min_, nodes_[0].max_), 1e-6f);
+    double cost = 0.0;
+    for (const Node& node : nodes_) {
+        const float area = SurfaceArea(node.min_, node.max_) / rootArea;
+        cost += area * (node.count_ > 0 ? static_cast<float>(node.count_) : settings_.traversalCost_);
+    }
+    return static_cast<float>(cost);
+}
+
+float CloudBvh::Distance(const float3& pos, float maxDistance, int* visits) const {
+    if (nodes_.empty()) { return maxDistance; }
+
+    float best = maxDistance;
+    uint32_t stack[CLOUD_BVH_STACK + 1];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const uint32_t index = stack[--top];
+        const Node& node = nodes_[index];
+        if (visits) { (*visits)++; }
+        // inside a box the spheres may reach below 0, only boxes away from pos bound them
+        const float boxDistance = BoxDistance(node, pos);
+        if (boxDistance > 0.0f && boxDistance >= best) { continue; }
+
+        if (node.count_ > 0) {
+            for (uint32_t i = node.offset_; i < node.offset_ + node.count_; i++) {
+                best = (std::min)(best, length(pos - instances_[i].xyz()) - instances_[i].w);
+            }
+            continue;
+        }
+
+        // the nearer child goes on top
+        const bool firstNear = BoxDistance(nodes_[index + 1], pos) <= BoxDistance(nodes_[node.offset_], pos);
+        stack[top++] = firstNear ? node.offset_ : index + 1;
+        stack[top++] = firstNear ? index + 1 : node.offset_;
+    }
+    return best;
+}
+
+void CloudBvh::Intersect(const float3& origin, const float3& dir, float tMax, std::vector<Hit>& hits, int* visits) const {
+    hits.clear();
+    if (nodes_.empty()) { return; }
+
+    const float3 invDir(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+    uint32_t stack[CLOUD_BVH_STACK + 1];
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const uint32_t index = stack[--top];
+        const Node& node = nodes_[index];
+        if (visits) { (*visits)++; }
+        if (!BoxHit(node, origin, invDir, tMax)) { continue; }
+
+        if (node.count_ > 0) {
+            for (uint32_t i = node.offset_; i < node.offset_ + node.count_; i++) {
+                Hit hit;
+                if (SphereHit(instances_[i], origin, dir, tMax, hit.enter_, hit.exit_)) {
+                    hit.instance_ = order_[i];
+                    hits.push_back(hit);
+                }
+            }
+            continue;
+        }
+        stack[top++] = node.offset_;
+        stack[top++] = index + 1;
+    }
+    std::sort(hits.begin(), hits.end(), [](const Hit& a, const Hit& b) { return a.enter_ < b.enter_; });
+}
+
+float CloudBvh::Transmittance(const float3& from, const float3& to, float extinction) const {
+    const float tMax = length(to - from);
+    if (tMax <= 0.0f) { return 1.0f; }
+
+    std::vector<Hit> hits;
+    Intersect(from, (to - from) * (1.0f / tMax), tMax, hits);
+    float chord = 0.0f;
+    for (const Hit& hit : hits) { chord += hit.exit_ - hit.enter_; }
+    return std::exp(-extinction * chord);
+}
+
+std::string CloudBvh::Benchmark(std::span<const int> counts) {
+    using clock = std::chrono::steady_clock;
+    auto ms = [](clock::time_point a, clock::time_point b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+
+    const int kRays = 4096;
+    const int kBruteRays = 256;
+    const float kLength = 42244.0f; // MAX_LENGTH * 0.1, the near pass
+    const float half = clouddensity::FMAP_EXTENT_M * 0.5f;
+
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << "instances   build ms  refit ms  sah build/refit  depth  LOS us/ray (brute)  distance us (brute)  mismatches\n";
+    int totalMismatches = 0;
+    for (int count : counts) {
+        std::mt19937 rng(37);
+        std::uniform_real_distribution<float> horizontal(-half, half);
+        std::uniform_real_distribution<float> altitude(500.0f, 3000.0f);
+        std::uniform_real_distribution<float> radius(200.0f, 2000.0f);
+        std::uniform_real_distribution<float> jitter(-20.0f, 20.0f);
+        std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+        std::vector<float4> instances(count);
+        for (float4& s : instances) { s = float4(horizontal(rng), -altitude(rng), horizontal(rng), radius(rng)); }
+
+        CloudBvh bvh;
+        bvh.Build(instances);
+        const float buildCost = bvh.SahCost();
+
+        // one frame of wind drift
+        for (float4& s : instances) { s = s + float4(50.0f + jitter(rng), jitter(rng), jitter(rng), 0.0f); }
+        const auto refitStart = clock::now();
+        bvh.Refit(instances);
+        const double refitMs = ms(refitStart, clock::now());
+
+        struct Ray { float3 origin, dir; };
+        std::vector<Ray> rays(kRays);
+        for (Ray& r : rays) {
+            r.origin = float3(horizontal(rng), -altitude(rng), horizontal(rng));
+            r.dir = normalize(float3(unit(rng), unit(rng) * 0.2f, unit(rng)));
+        }
+
+        std::vector<Hit> hits;
+        int mismatches = 0;
+        float chordSum = 0.0f;
+        const auto losStart = clock::now();
+        for (const Ray& r : rays) {
+            bvh.Intersect(r.origin, r.dir, kLength, hits);
+            for (const Hit& hit : hits) { chordSum += hit.exit_ - hit.enter_; }
+        }
+        const double losUs = ms(losStart, clock::now()) * 1000.0 / kRays;
+
+        double bruteLosUs = 0.0;
+        for (int i = 0; i < kBruteRays; i++) {
+            const Ray& r = rays[i];
+            const auto t0 = clock::now();
+            int bruteHits = 0;
+            float bruteChord = 0.0f;
+            for (const float4& s : instances) {
+                float enter, exit;
+                if (SphereHit(s, r.origin, r.dir, kLength, enter, exit)) {
+                    bruteHits++;
+                    bruteChord += exit - enter;
+                }
+            }
+            bruteLosUs += ms(t0, clock::now()) * 1000.0;
+
+            bvh.Intersect(r.origin, r.dir, kLength, hits);
+            float chord = 0.0f;
+            for (const Hit& hit : hits) { chord += hit.exit_ - hit.enter_; }
+            mismatches += static_cast<int>(hits.size()) != bruteHits || std::fabs(chord - bruteChord) > 1e-3f * (1.0f + bruteChord);
+        }
+        bruteLosUs /= kBruteRays;
+
+        float distanceSum = 0.0f;
+        const auto distanceStart = clock::now();
+        for (const Ray& r : rays) { distanceSum += bvh.Distance(r.origin); }
+        const double distanceUs = ms(distanceStart, clock::now()) * 1000.0 / kRays;
+
+        double bruteDistanceUs = 0.0;
+        for (int i = 0; i < kBruteRays; i++) {
+            const auto t0 = clock::now();
+            float best = kInf;
+            for (const float4& s : instances) { best = (std::min)(best, length(rays[i].origin - s.xyz()) - s.w); }
+            bruteDistanceUs += ms(t0, clock::now()) * 1000.0;
+            mismatches += std::fabs(bvh.Distance(rays[i].origin) - best) > 1e-3f * (1.0f + std::fabs(best));
+        }
+        bruteDistanceUs /= kBruteRays;
+
+        ss << std::setw(9) << count << std::setw(11) << bvh.BuildMs() << std::setw(10) << refitMs
+           << std::setw(9) << buildCost << "/" << std::left << std::setw(8) << bvh.SahCost() << std::right
+           << std::setw(6) << bvh.Depth()
+           << std::setw(11) << losUs << " (" << bruteLosUs << ")"
+           << std::setw(11) << distanceUs << " (" << bruteDistanceUs << ")"
+           << std::setw(8) << mismatches << "\n";
+        // keeps the query loops from being optimized out
+        if (std::isnan(chordSum + distanceSum)) { ss << "nan\n"; }
+        totalMismatches += mismatches;
+    }
+    ss << "  queries after the refit against brute force: " << totalMismatches << " mismatches" << (totalMismatches == 0 ? "  PASS\n" : "  FAIL\n");
+    return ss.str();
+}
+
+#ifdef _WIN32
+bool CloudBvh::CreateBuffers() {
+    if (nodes_.empty()) { return false; }
+
+    auto create = [](const void* data, UINT stride, UINT count, ComPtr<ID3D11Buffer>& buffer, ComPtr<ID3D11ShaderResourceView>& srv) {
+        D3D11_BUFFER_DESC desc = {};
+        desc.ByteWidth = stride * count;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+        desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+        desc.StructureByteStride = stride;
+
+        D3D11_SUBRESOURCE_DATA initData = {};
+        initData.pSysMem = data;
+
+        HRESULT hr = Renderer::device->CreateBuffer(&desc, &initData, &buffer);
+        if (FAILED(hr)) return false;
+
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+        srvDesc.Buffer.NumElements = count;
+
+        hr = Renderer::device->CreateShaderResourceView(buffer.Get(), &srvDesc, &srv);
+        return SUCCEEDED(hr);
+    };
+
+    return create(nodes_.data(), sizeof(Node), static_cast<UINT>(nodes_.size()), nodeBuffer_, nodeSRV_)
+        && create(instances_.data(), sizeof(float4), static_cast<UINT>(instances_.size()), instanceBuffer_, instanceSRV_);
+}
+
+void CloudBvh::UpdateBuffers() {
+    if (!nodeBuffer_ || !instanceBuffer_) { return; }
+    Renderer::context->UpdateSubresource(nodeBuffer_.Get(), 0, nullptr, nodes_.data(), 0, 0);
+    Renderer::context->UpdateSubresource(instanceBuffer_.Get(), 0, nullptr, instances_.data(), 0, 0);
+}
+#endif
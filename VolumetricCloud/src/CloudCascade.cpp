@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+#include "../includes/CloudCascade.h"
+#include "../includes/CloudSdf.h"
+#include "../includes/CpuCloudRenderer.h"
+#include "../includes/DensityField.h"
+#include "../includes/EarthCurvature.h"
+#include "../includes/Fmap.h"
+#include "../includes/OccupancyGrid.h"
+
+using namespace hlsl;
+
+namespace {
+
+    // the far target through the linear, clamped sampler of the merge
+    float4 SampleLinear(const CpuCloudFrame& frame, float u, float v) {
+        const float tx = std::clamp(u * frame.width_ - 0.5f, 0.0f, frame.width_ - 1.0f);
+        const float ty = std::clamp(v * frame.height_ - 0.5f, 0.0f, frame.height_ - 1.0f);
+        const int x0 = static_cast<int>(tx), y0 = static_cast<int>(ty);
+        const int x1 = (std::min)(x0 + 1, frame.width_ - 1), y1 = (std::min)(y0 + 1, frame.height_ - 1);
+        const float fx = tx - x0, fy = ty - y0;
+        const auto at = [&](int x, int y) { return frame.color_[static_cast<size_t>(y) * frame.width_ + x]; };
+        return (at(x0, y0) * (1.0f - fx) + at(x1, y0) * fx) * (1.0f - fy) + (at(x0, y1) * (1.0f - fx) + at(x1, y1) * fx) * fy;
+    }
+
+    float DepthLinear(const CpuCloudFrame& frame, float u, float v) {
+        const int x = std::clamp(static_cast<int>(u * frame.width_), 0, frame.width_ - 1);
+        const int y = std::clamp(static_cast<int>(v * frame.height_), 0, frame.height_ - 1);
+        return frame.depth_[static_cast<size_t>(y) * frame.width_ + x];
+    }
+
+    // mean absolute rgba difference per pixel, over the 4 channels
+    double MeanError(const CpuCloudFrame& a, const CpuCloudFrame& b) {
+        double sum = 0.0;
+        for (size_t i = 0; i < a.color_.size(); i++) {
+            const float4 d = a.color_[i] - b.color_[i];
+            sum += (std::fabs(d.x) + std::fabs(d.y) + std::fabs(d.z) + std::fabs(d.w)) * 0.25;
+        }
+        return sum / (std::max)(a.color_.size(), size_t(1));
+    }
+
+    // the view turned by deg about the vertical through the eye
+    CpuCloudView Turned(const CpuCloudView& view, float deg) {
+        const float r = deg * 3.14159265f / 180.0f;
+        const float3 d = view.lookAt_ - view.eye_;
+        CpuCloudView turned = view;
+        turned.lookAt_ = view.eye_ + float3(d.x * std::cos(r) + d.z * std::sin(r), d.y, -d.x * std::sin(r) + d.z * std::cos(r));
+        return turned;
+    }
+
+} // namespace
+
+namespace cloudcascade {
+
+    std::vector<Cascade> DefaultCascades() {
+        const float split = earthcurvature::MAX_LENGTH_M * 0.10f;
+
+        Cascade nearBand;
+        nearBand.start_ = 0.0f;
+        nearBand.end_ = split;
+
+        Cascade farBand;
+        farBand.start_ = split;
+        farBand.end_ = earthcurvature::MAX_LENGTH_M;
+        farBand.scale_ = 0.5f;
+        farBand.stepBudget_ = 500;
+        farBand.updateInterval_ = 4;
+        farBand.maxTurnDeg_ = 2.0f;
+        farBand.history_ = false;
+
+        return { nearBand, farBand };
+    }
+
+    bool Due(const Cascade& cascade, uint32_t framesSinceUpdate, float turnedDeg) {
+        return framesSinceUpdate >= static_cast<uint32_t>((std::max)(cascade.updateInterval_, 1)) || turnedDeg > cascade.maxTurnDeg_;
+    }
+
+    CpuCloudRendererSettings BandSettings(const Cascade& cascade, const CpuCloudRendererSettings& near) {
+        CpuCloudRendererSettings settings = near;
+        settings.width_ = (std::max)(static_cast<int>(near.width_ * cascade.scale_), 1);
+        settings.height_ = (std::max)(static_cast<int>(near.height_ * cascade.scale_), 1);
+        settings.inStart_ = cascade.start_;
+        settings.inEnd_ = cascade.end_;
+        settings.stepBudget_ = cascade.stepBudget_;
+        settings.temporalJitter_ = near.temporalJitter_ && cascade.history_;
+        return settings;
+    }
+
+    void Composite(const std::vector<const CpuCloudFrame*>& bands, CpuCloudFrame& out) {
+        if (bands.empty()) { return; }
+        const CpuCloudFrame& first = *bands.front();
+        out.width_ = first.width_;
+        out.height_ = first.height_;
+        out.color_ = first.color_;
+        out.depth_ = first.depth_;
+        for (size_t b = 1; b < bands.size(); b++) {
+            const CpuCloudFrame& band = *bands[b];
+            for (int y = 0; y < out.height_; y++) {
+                for (int x = 0; x < out.width_; x++) {
+                    const size_t i = static_cast<size_t>(y) * out.width_ + x;
+                    const float u = (x + 0.5f) / out.width_, v = (y + 0.5f) / out.height_;
+                    const float4 farther = band.width_ == out.width_ && band.height_ == out.height_ ? band.color_[i] : SampleLinear(band, u, v);
+                    out.color_[i] = out.color_[i] + farther * (1.0f - out.color_[i].w);
+                    if (out.depth_[i] <= 0.0f) { out.depth_[i] = DepthLinear(band, u, v); }
+                }
+            }
+        }
+    }
+
+    std::string Report(DensityField& field, int width, int height, const std::string& resourceDir) {
+        std::ostringstream ss;
+        char line[256];
+        bool pass = true;
+        ss << "cloud cascades\n";
+
+        // the far band over 12 frames, turning 1 degree a frame from frame 6 on
+        const std::vector<Cascade> cascades = DefaultCascades();
+        {
+            std::string marched;
+            uint32_t since = (std::numeric_limits<uint32_t>::max)();
+            float turned = 0.0f;
+            for (int frame = 0; frame < 12; frame++) {
+                turned += frame >= 6 ? 1.0f : 0.0f;
+                const bool due = Due(cascades.back(), since, turned);
+                marched += due ? 'x' : '.';
+                if (due) { since = 0; turned = 0.0f; }
+                since++;
+            }
+            ss << "  far band updates over 12 frames, turning from frame 6: " << marched << "\n";
+            pass = pass && marched == "x...x...x..x";
+        }
+
+        if (field.NoiseLarge().texels_.empty()) {
+            ss << "  density field not initialized\n";
+            return ss.str();
+        }
+        const std::string path = resourceDir + "/40100.fmap";
+        if (!std::filesystem::exists(path)) {
+            ss << "  missing weather map " << path << "\n";
+            return ss.str();
+        }
+        field.SetWeather(Fmap(path));
+        field.SetTime(10.0);
+
+        OccupancyGrid grid;
+        CloudSdf sdf;
+        if (!grid.Build(field) || !sdf.Build(grid)) {
+            ss << "  occupancy grid or distance volume build failed\n";
+            return ss.str();
+        }
+        CpuCloudSources sources;
+        sources.occupancy_ = &grid;
+        sources.sdf_ = &sdf;
+
+        // cruise at 10 km over the layer tops, looking at the horizon
+        CpuCloudView view;
+        view.eye_ = float3(0.0f, -10000.0f, 0.0f);
+        view.lookAt_ = float3(0.0f, -10000.0f, 10000.0f);
+
+        CpuCloudRendererSettings settings;
+        settings.width_ = width;
+        settings.height_ = height;
+
+        CpuCloudRenderer renderer;
+        const auto render = [&](const CpuCloudRendererSettings& s, const CpuCloudView& v, CpuCloudFrame& frame) {
+            renderer.Initialize(s);
+            renderer.Render(field, v, frame, sources);
+        };
+
+        // one march over the whole ray, and at half size brought up by the merge's sampler
+        CpuCloudFrame reference, half, empty, halfUpsampled;
+        render(settings, view, reference);
+        CpuCloudRendererSettings halfSettings = settings;
+        halfSettings.width_ = width / 2;
+        halfSettings.height_ = height / 2;
+        render(halfSettings, view, half);
+        empty.width_ = width;
+        empty.height_ = height;
+        empty.color_.assign(static_cast<size_t>(width) * height, float4(0.0f));
+        empty.depth_.assign(static_cast<size_t>(width) * height, 0.0f);
+        Composite({ &empty, &half }, halfUpsampled);
+
+        // the same bands at the near size and budget: only the composite differs from the reference
+        std::vector<Cascade> even = cascades;
+        for (Cascade& c : even) { c.scale_ = 1.0f; c.stepBudget_ = settings.stepBudget_; }
+        CpuCloudFrame evenNear, evenFar, evenComposite;
+        render(BandSettings(even[0], settings), view, evenNear);
+        render(BandSettings(even[1], settings), view, evenFar);
+        Composite({ &evenNear, &evenFar }, evenComposite);
+
+        double farShare = 0.0;
+        for (size_t i = 0; i < evenNear.color_.size(); i++) { farShare += (1.0f - evenNear.color_[i].w) * evenFar.color_[i].w; }
+        farShare /= (std::max)(evenNear.color_.size(), size_t(1));
+
+        // the default table, and its far band 4 frames earlier: 250 m/s at 60 Hz, a 1.5 degree turn since
+        CpuCloudFrame nearBand, farBand, composite, staleFar, staleComposite;
+        render(BandSettings(cascades[0], settings), view, nearBand);
+        render(BandSettings(cascades[1], settings), view, farBand);
+        Composite({ &nearBand, &farBand }, composite);
+
+        CpuCloudView earlier = Turned(view, -1.5f);
+        const float3 cruise = normalize(view.lookAt_ - view.eye_) * (250.0f * 4.0f / 60.0f);
+        earlier.eye_ = earlier.eye_ - cruise;
+        earlier.lookAt_ = earlier.lookAt_ - cruise;
+        render(BandSettings(cascades[1], settings), earlier, staleFar);
+        Composite({ &nearBand, &staleFar }, staleComposite);
+
+        const double halfError = MeanError(halfUpsampled, reference);
+        const double evenError = MeanError(evenComposite, reference);
+        const double error = MeanError(composite, reference);
+        const double staleError = MeanError(staleComposite, reference);
+        const uint64_t evenSteps = evenNear.marchSteps_ + evenFar.marchSteps_;
+        const double frameSteps = nearBand.marchSteps_ + static_cast<double>(farBand.marchSteps_) / cascades[1].updateInterval_;
+
+        ss << "  cruise view " << width << "x" << height << " at 10 km over 40100.fmap, bands split at "
+           << static_cast<int>(cascades[0].end_) << " m, far band " << static_cast<int>(100.0f * farShare + 0.5f) << "% of the alpha\n";
+        snprintf(line, sizeof(line), "  %-26s %12s %12s %12s\n", "", "mean error", "steps", "per frame");
+        ss << line;
+        snprintf(line, sizeof(line), "  %-26s %12s %12llu %12llu\n", "one march", "-",
+            static_cast<unsigned long long>(reference.marchSteps_), static_cast<unsigned long long>(reference.marchSteps_));
+        ss << line;
+        snprintf(line, sizeof(line), "  %-26s %12.2e %12llu %12llu\n", "one march at 1/2", halfError,
+            static_cast<unsigned long long>(half.marchSteps_), static_cast<unsigned long long>(half.marchSteps_));
+        ss << line;
+        snprintf(line, sizeof(line), "  %-26s %12.2e %12llu %12llu\n", "bands at near settings", evenError,
+            static_cast<unsigned long long>(evenSteps), static_cast<unsigned long long>(evenSteps));
+        ss << line;
+        char label[64];
+        snprintf(label, sizeof(label), "cascades, far 1/%d every %d", static_cast<int>(1.0f / cascades[1].scale_ + 0.5f), cascades[1].updateInterval_);
+        snprintf(line, sizeof(line), "  %-26s %12.2e %12llu %12.0f\n", label, error,
+            static_cast<unsigned long long>(nearBand.marchSteps_ + farBand.marchSteps_), frameSteps);
+        ss << line;
+        snprintf(line, sizeof(line), "  %-26s %12.2e\n", "far band 4 frames old", staleError);
+        ss << line;
+
+        // splitting the ray loses nothing but the step positions, the half size far band less
+        // than a half size target, holding it for 4 frames little more, and the frame saves steps
+        pass = pass && evenError < 5e-3 && error < halfError && staleError < 1.25 * error
+            && frameSteps < 0.85 * reference.marchSteps_;
+        ss << (pass ? "  PASS\n" : "  FAIL\n");
+        return ss.str();
+    }
+
+} // namespace cloudcascade
@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <cmath>
+
+#include "../includes/CloudDensity.h"
+#include "../includes/HeightProfileLut.h"
+
+namespace clouddensity {
+
+CloudLayerDesc StratusLayer(float altitudeFt, bool inclement) {
+    CloudLayerDesc layer;
+    layer.altitude_ = float4(0.0f, altitudeFt, inclement ? 300.0f : 150.0f, 0.0f);
+    layer.coverage_ = inclement ? float4(0.6f, 0.0f, 0.5f, 0.0f) : float4(0.0f, 0.2f, 0.5f, 0.0f);
+    // no anvil, wide and smooth
+    layer.anvil_ = float4(0.0f, 0.2f, 0.8f, 0.0f);
+    layer.noise_ = float4(LARGE_NOISE_SCALE * 0.5f, inclement ? 0.75f : 0.25f, -kUnboundedSlab, kUnboundedSlab);
+    return layer;
+}
+
+std::vector<CloudLayerDesc> DefaultLayers() {
+    return { kCumulusLayer, kCirrusLayer };
+}
+
+void CloudLayerSlabs(std::span<CloudLayerDesc> layers, std::span<const float4> weather) {
+    if (weather.empty()) { return; }
+
+    float bLo = weather[0].z, bHi = weather[0].z, gLo = weather[0].y, gHi = weather[0].y;
+    for (const float4& w : weather) {
+        bLo = (std::min)(bLo, w.z);
+        bHi = (std::max)(bHi, w.z);
+        gLo = (std::min)(gLo, w.y);
+        gHi = (std::max)(gHi, w.y);
+    }
+
+    // bottom and thickness are linear in fmap.b and fmap.g, their extremes sit on the ends
+    for (CloudLayerDesc& layer : layers) {
+        const float bottom0 = (bLo * layer.altitude_.x + layer.altitude_.y) * FT_TO_M;
+        const float bottom1 = (bHi * layer.altitude_.x + layer.altitude_.y) * FT_TO_M;
+        const float thickness = (std::max)(layer.altitude_.z + layer.altitude_.w * gLo, layer.altitude_.z + layer.altitude_.w * gHi);
+        layer.noise_.z = (std::min)(bottom0, bottom1);
+        layer.noise_.w = (std::max)(bottom0, bottom1) + (std::max)(thickness, 0.0f);
+    }
+}
+
+float LayerDensity(const CloudLayerDesc& layer, float height, float poor, const float4& noise, bool lowFreq) {
+    return LayerDensity(layer, LayerProfile(layer, height), poor, noise, lowFreq);
+}
+
+float LayerDensity(const CloudLayerDesc& layer, const float2& profile, float poor, const float4& noise, bool lowFreq) {
+    float dense = RemapClamp((noise.x * 0.5f + 0.5f), 1.0f - (poor * layer.coverage_.x + layer.coverage_.y), 1.0f, 0.0f, 1.0f); // perlinWorley
+    if (!lowFreq && layer.anvil_.w > 0.0f) {
+        dense = RemapClamp(dense, 1.0f - (noise.y * 0.5f + 0.5f), 1.0f, 0.0f, 1.0f); // worley
+        dense = RemapClamp(dense, 1.0f - (noise.z * 0.5f + 0.5f), 1.0f, 0.0f, 1.0f); // worley
+        dense = RemapClamp(dense, 1.0f - (noise.w * 0.5f + 0.5f), 1.0f, 0.0f, 1.0f); // worley
+    }
+    dense = RemapClamp(dense, 1.0f - profile.x, 1.0f, 0.0f, 1.0f);
+    return std::pow(dense, profile.y);
+}
+
+float CloudDensityFromSamples(float rayHeightMeter, const DensitySamples& samples, std::span<const CloudLayerDesc> layers, float& distance, bool lowFreq, const HeightProfileLut* profiles) {
+    const float poor = RemapClamp(samples.fmap_.x, 0.0f, 1.0f, 0.0f, 1.0f);
+
+    float finaldense = 0.0f;
+    distance = 5.0f;
+    const size_t count = (std::min)(layers.size(), static_cast<size_t>(CLOUD_LAYER_MAX));
+    for (size_t l = 0; l < count; l++) {
+        const CloudLayerDesc& layer = layers[l];
+        const float thickness = LayerThickness(layer, samples.fmap_);
+        const float bottomAltMeter = LayerBottomMeter(layer, samples.fmap_);
+        const float layerDistance = DistanceCloud(rayHeightMeter, bottomAltMeter, thickness);
+        distance = l == 0 ? layerDistance : (std::min)(distance, layerDistance);
+
+        // outside the slab the layer shape is 0 for any weather
+        if (!LayerInSlab(layer, rayHeightMeter)) { continue; }
+        const float height = (rayHeightMeter - bottomAltMeter) / thickness;
+        const float2 profile = (profiles && static_cast<int>(l) < profiles->Rows()) ? profiles->Sample(static_cast<int>(l), height) : LayerProfile(layer, height);
+        finaldense = (std::max)(finaldense, LayerDensity(layer, profile, poor, samples.layerNoise_[l], lowFreq));
+    }
+
+    // apply noise detail
+    if (!lowFreq) {
+        const float4& small = samples.smallNoise_;
+        finaldense = RemapClamp(finaldense, 1.0f - (small.x * 0.5f + 0.5f), 1.0f, 0.0f, 1.0f); // worley
+        finaldense = RemapClamp(finaldense, 1.0f - (small.y * 0.5f + 0.5f), 1.0f, 0.0f, 1.0f); // worley
+        finaldense = RemapClamp(finaldense, 1.0f - (small.z * 0.5f + 0.5f), 1.0f, 0.0f, 1.0f); // worley
+    }
+    return finaldense / DENSITY_DIVISOR;
+}
+
+} // namespace clouddensity
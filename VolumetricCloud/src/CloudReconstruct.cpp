@@ -0,0 +1,462 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "../includes/CloudReconstruct.h"
+#include "../includes/CloudSdf.h"
+#include "../includes/DensityField.h"
+#include "../includes/Fmap.h"
+#include "../includes/OccupancyGrid.h"
+
+using namespace hlsl;
+
+namespace {
+
+    const float kPi = 3.14159265358979f;
+
+    // ReconstructViewDepth of CloudReconstruct.hlsl
+    float ViewDepth(float depth, const cloudreconstruct::CloudReconstructDesc& desc) {
+        return desc.up_.w * desc.previousEye_.w / (desc.up_.w - depth);
+    }
+
+    // ReconstructDepth of CloudReconstruct.hlsl
+    float ReversedDepth(float viewZ, const cloudreconstruct::CloudReconstructDesc& desc) {
+        return desc.up_.w * (viewZ - desc.previousEye_.w) / viewZ;
+    }
+
+    float4 Min(const float4& a, const float4& b) {
+        return float4((std::min)(a.x, b.x), (std::min)(a.y, b.y), (std::min)(a.z, b.z), (std::min)(a.w, b.w));
+    }
+
+    float4 Max(const float4& a, const float4& b) {
+        return float4((std::max)(a.x, b.x), (std::max)(a.y, b.y), (std::max)(a.z, b.z), (std::max)(a.w, b.w));
+    }
+
+    // HistoryBilinear of CloudReconstruct.hlsl
+    float4 Bilinear(const CpuCloudFrame& frame, float tx, float ty) {
+        const float bx = std::floor(tx), by = std::floor(ty);
+        const float fx = tx - bx, fy = ty - by;
+        const int x0 = std::clamp(static_cast<int>(bx), 0, frame.width_ - 1);
+        const int y0 = std::clamp(static_cast<int>(by), 0, frame.height_ - 1);
+        const int x1 = std::clamp(static_cast<int>(bx) + 1, 0, frame.width_ - 1);
+        const int y1 = std::clamp(static_cast<int>(by) + 1, 0, frame.height_ - 1);
+        const auto at = [&](int x, int y) { return frame.color_[static_cast<size_t>(y) * frame.width_ + x]; };
+        return lerp(lerp(at(x0, y0), at(x1, y0), fx), lerp(at(x0, y1), at(x1, y1), fx), fy);
+    }
+
+    // YCoCg of an rgb, alpha kept
+    float4 ToYCoCg(const float4& c) {
+        return float4(0.25f * c.x + 0.5f * c.y + 0.25f * c.z, 0.5f * c.x - 0.5f * c.z, -0.25f * c.x + 0.5f * c.y - 0.25f * c.z, c.w);
+    }
+
+    float4 FromYCoCg(const float4& c) {
+        return float4(c.x + c.y - c.z, c.x + c.z, c.x - c.y - c.z, c.w);
+    }
+
+    float MaxAbs(const float4& a, const float4& b) {
+        const float4 d = a - b;
+        return (std::max)((std::max)(std::fabs(d.x), std::fabs(d.y)), (std::max)(std::fabs(d.z), std::fabs(d.w)));
+    }
+
+} // namespace
+
+bool CloudReconstruct::Initialize(const Settings& settings, int width, int height) {
+    if ((settings.pattern_ != 2 && settings.pattern_ != 4) || width <= 0 || height <= 0
+        || width % settings.pattern_ != 0 || height % settings.pattern_ != 0) {
+        std::cerr << "CloudReconstruct: " << width << "x" << height << " is not a multiple of the pattern " << settings.pattern_
+            << ", which has to be 2 or 4" << std::endl;
+        return false;
+    }
+    settings_ = settings;
+    width_ = width;
+    height_ = height;
+    frame_ = 0;
+    historyValid_ = false;
+    cameraValid_ = false;
+    current_ = 0;
+    desc_ = {};
+    history_ = CpuCloudFrame();
+    stats_ = Stats();
+    return true;
+}
+
+void CloudReconstruct::Phase(uint32_t frame, int pattern, int& x, int& y) {
+    // ordered dither matrices, entry k is marched on frame k, consecutive frames far apart
+    static const int kBayer2[2][2] = { { 0, 2 }, { 3, 1 } };
+    static const int kBayer4[4][4] = { { 0, 8, 2, 10 }, { 12, 4, 14, 6 }, { 3, 11, 1, 9 }, { 15, 7, 13, 5 } };
+    const int k = static_cast<int>(frame % static_cast<uint32_t>(pattern * pattern));
+    for (y = 0; y < pattern; y++) {
+        for (x = 0; x < pattern; x++) {
+            if ((pattern == 2 ? kBayer2[y][x] : kBayer4[y][x]) == k) { return; }
+        }
+    }
+    x = y = 0;
+}
+
+void CloudReconstruct::BeginFrame(const float3& eye, const float3& lookAt, float vFovDeg, float nearZ, float farZ) {
+    CpuCloudView view;
+    view.eye_ = eye;
+    view.lookAt_ = lookAt;
+    float3 forward, right, up;
+    CpuCloudRenderer::CameraBasis(view, forward, right, up);
+
+    // the camera of the frame before is the one of the history
+    const Desc previous = desc_;
+    const float tanY = std::tan(vFovDeg * (kPi / 180.0f) * 0.5f);
+    const float tanX = tanY * width_ / height_;
+    desc_.eye_ = float4(eye, historyValid_ ? 1.0f : 0.0f);
+    desc_.forward_ = float4(forward, tanX);
+    desc_.right_ = float4(right, tanY);
+    desc_.up_ = float4(up, nearZ / (nearZ - farZ));
+    desc_.previousEye_ = float4(cameraValid_ ? previous.eye_.xyz() : eye, farZ);
+    desc_.previousForward_ = float4(cameraValid_ ? previous.forward_.xyz() : forward, settings_.depthTolerance_);
+    desc_.previousRight_ = float4(cameraValid_ ? previous.right_.xyz() : right, settings_.clamp_ ? settings_.clampGamma_ : 0.0f);
+    desc_.previousUp_ = float4(cameraValid_ ? previous.up_.xyz() : up, 0.0f);
+
+    int px, py;
+    Phase(frame_, settings_.pattern_, px, py);
+    desc_.size_ = int4(width_, height_, settings_.pattern_, static_cast<int32_t>(frame_));
+    desc_.phase_ = int4(px, py, 0, 0);
+    cameraValid_ = true;
+    frame_++;
+}
+
+float2 CloudReconstruct::PixelCenter() const {
+    const float n = static_cast<float>(settings_.pattern_);
+    return float2((desc_.phase_.x + 0.5f) / n, (desc_.phase_.y + 0.5f) / n);
+}
+
+void CloudReconstruct::Reconstruct(const CpuCloudFrame& sparse, CpuCloudFrame& out) {
+    const Desc& D = desc_;
+    const int N = settings_.pattern_;
+    const int sw = SparseWidth(), sh = SparseHeight();
+    out.width_ = width_;
+    out.height_ = height_;
+    out.color_.assign(static_cast<size_t>(width_) * height_, float4(0.0f));
+    out.depth_.assign(static_cast<size_t>(width_) * height_, 0.0f);
+    stats_ = Stats();
+    if (sparse.width_ != sw || sparse.height_ != sh) {
+        std::cerr << "CloudReconstruct: the sparse frame is " << sparse.width_ << "x" << sparse.height_ << ", not " << sw << "x" << sh << std::endl;
+        return;
+    }
+
+    const auto sparseColor = [&](int x, int y) { return sparse.color_[static_cast<size_t>(y) * sw + x]; };
+    for (int py = 0; py < height_; py++) {
+        for (int px = 0; px < width_; px++) {
+            const size_t i = static_cast<size_t>(py) * width_ + px;
+
+            // marched this frame
+            if (px % N == D.phase_.x && py % N == D.phase_.y) {
+                out.color_[i] = sparseColor(px / N, py / N);
+                out.depth_[i] = sparse.depth_[static_cast<size_t>(py / N) * sw + px / N];
+                stats_.fresh_++;
+                continue;
+            }
+
+            // the four fresh samples around, in sparse texels
+            const float ux = static_cast<float>(px - D.phase_.x) / N, uy = static_cast<float>(py - D.phase_.y) / N;
+            const float bx = std::floor(ux), by = std::floor(uy);
+            const float fx = ux - bx, fy = uy - by;
+            const int s0x = std::clamp(static_cast<int>(bx), 0, sw - 1), s0y = std::clamp(static_cast<int>(by), 0, sh - 1);
+            const int s1x = std::clamp(static_cast<int>(bx) + 1, 0, sw - 1), s1y = std::clamp(static_cast<int>(by) + 1, 0, sh - 1);
+            const float4 c00 = sparseColor(s0x, s0y), c10 = sparseColor(s1x, s0y), c01 = sparseColor(s0x, s1y), c11 = sparseColor(s1x, s1y);
+            const float4 spatial = lerp(lerp(c00, c10, fx), lerp(c01, c11, fx), fy);
+
+            // view depth range of the fresh samples around, sky is past every cloud
+            const float depths[4] = { sparse.depth_[static_cast<size_t>(s0y) * sw + s0x], sparse.depth_[static_cast<size_t>(s0y) * sw + s1x],
+                                      sparse.depth_[static_cast<size_t>(s1y) * sw + s0x], sparse.depth_[static_cast<size_t>(s1y) * sw + s1x] };
+            float minZ = 1e30f, maxZ = 0.0f;
+            bool anySky = false;
+            for (const float d : depths) {
+                if (d > 0.0f) {
+                    const float z = ViewDepth(d, D);
+                    minZ = (std::min)(minZ, z);
+                    maxZ = (std::max)(maxZ, z);
+                }
+                else {
+                    anySky = true;
+                }
+            }
+
+            // the nearest fresh sample gives the depth to reproject with
+            const int nx = std::clamp(static_cast<int>(std::floor(ux + 0.5f)), 0, sw - 1);
+            const int ny = std::clamp(static_cast<int>(std::floor(uy + 0.5f)), 0, sh - 1);
+            const float depth = sparse.depth_[static_cast<size_t>(ny) * sw + nx];
+            float historyOut = depth;
+
+            // world point of the pixel, a direction only when there is no cloud
+            const float ndcX = (px + 0.5f) / width_ * 2.0f - 1.0f;
+            const float ndcY = 1.0f - (py + 0.5f) / height_ * 2.0f;
+            const float3 dir = normalize(D.forward_.xyz() + D.right_.xyz() * (ndcX * D.forward_.w) + D.up_.xyz() * (ndcY * D.right_.w));
+            float3 rel = dir;
+            float viewZ = 0.0f;
+            if (depth > 0.0f) {
+                viewZ = ViewDepth(depth, D);
+                rel = D.eye_.xyz() + dir * (viewZ / dot(dir, D.forward_.xyz())) - D.previousEye_.xyz();
+            }
+
+            // into the history
+            const float pz = dot(rel, D.previousForward_.xyz());
+            bool valid = D.eye_.w > 0.0f && pz > 0.0f;
+            float tx = 0.0f, ty = 0.0f;
+            if (valid) {
+                const float prevX = dot(rel, D.previousRight_.xyz()) / (pz * D.forward_.w);
+                const float prevY = dot(rel, D.previousUp_.xyz()) / (pz * D.right_.w);
+                tx = (prevX + 1.0f) * 0.5f * width_ - 0.5f;
+                ty = (1.0f - prevY) * 0.5f * height_ - 0.5f;
+                valid = tx >= -0.5f && ty >= -0.5f && tx <= width_ - 0.5f && ty <= height_ - 0.5f;
+            }
+            const bool onScreen = valid;
+
+            // disocclusion: the history shows sky or cloud none of the fresh samples around shows, or a
+            // cloud outside their depth range moved into the history camera by the reprojected depth
+            if (valid) {
+                const int hx = std::clamp(static_cast<int>(std::floor(tx + 0.5f)), 0, width_ - 1);
+                const int hy = std::clamp(static_cast<int>(std::floor(ty + 0.5f)), 0, height_ - 1);
+                const float historyDepth = history_.depth_[static_cast<size_t>(hy) * width_ + hx];
+                if (historyDepth <= 0.0f) {
+                    valid = anySky;
+                    historyOut = 0.0f;
+                }
+                else if (maxZ <= 0.0f) {
+                    valid = false;
+                }
+                else {
+                    const float shift = depth > 0.0f ? pz - viewZ : 0.0f;
+                    const float historyZ = ViewDepth(historyDepth, D);
+                    const float tolerance = D.previousForward_.w * historyZ;
+                    valid = historyZ >= minZ + shift - tolerance && historyZ <= maxZ + shift + tolerance;
+                    // the history keeps the depth of its own march
+                    historyOut = ReversedDepth((std::max)(historyZ - shift, 1.0f), D);
+                }
+            }
+
+            if (!valid) {
+                // rejected history still on screen is clamped to the mean +- gamma sigma of the fresh
+                // samples in YCoCg, it keeps detail they do not resolve where the spatial blend has none
+                out.color_[i] = spatial;
+                if (onScreen && D.previousRight_.w > 0.0f) {
+                    const float4 y00 = ToYCoCg(c00), y10 = ToYCoCg(c10), y01 = ToYCoCg(c01), y11 = ToYCoCg(c11);
+                    const float4 mean = (y00 + y10 + y01 + y11) * 0.25f;
+                    const float4 square = (y00 * y00 + y10 * y10 + y01 * y01 + y11 * y11) * 0.25f;
+                    const float4 variance = Max(square - mean * mean, float4(0.0f));
+                    const float4 sigma = float4(std::sqrt(variance.x), std::sqrt(variance.y), std::sqrt(variance.z), std::sqrt(variance.w)) * D.previousRight_.w;
+                    out.color_[i] = FromYCoCg(Min(Max(ToYCoCg(Bilinear(history_, tx, ty)), mean - sigma), mean + sigma));
+                }
+                out.depth_[i] = depth;
+                stats_.spatial_++;
+                continue;
+            }
+            out.depth_[i] = historyOut;
+            out.color_[i] = Bilinear(history_, tx, ty);
+            stats_.history_++;
+        }
+    }
+
+    history_ = out;
+    historyValid_ = true;
+}
+
+std::string CloudReconstruct::Report(DensityField& field, int width, int height, int frames, const std::string& resourceDir) {
+    std::ostringstream ss;
+    if (field.NoiseLarge().texels_.empty()) {
+        ss << "cloud reconstruct: density field not initialized\n";
+        return ss.str();
+    }
+
+    const std::string path = resourceDir + "/40100.fmap";
+    if (!std::filesystem::exists(path)) {
+        ss << "cloud reconstruct: missing weather map " << path << "\n";
+        return ss.str();
+    }
+    field.SetWeather(Fmap(path));
+    field.SetTime(10.0);
+
+    OccupancyGrid grid;
+    CloudSdf sdf;
+    if (!grid.Build(field) || !sdf.Build(grid)) {
+        ss << "cloud reconstruct: occupancy grid or distance volume build failed\n";
+        return ss.str();
+    }
+    CpuCloudSources sources;
+    sources.occupancy_ = &grid;
+    sources.sdf_ = &sdf;
+
+    CpuCloudRendererSettings full;
+    full.width_ = width;
+    full.height_ = height;
+
+    // cruise at Mach 1.2 and 30 fps turning 10 degrees a second, and a hard turn at ten times the speed
+    struct Path {
+        const char* name_;
+        float metersPerFrame_;
+        float degreesPerFrame_;
+    };
+    const Path paths[] = { { "cruise", 343.0f * 1.2f / 30.0f, 10.0f / 30.0f }, { "hard turn", 137.0f, 1.5f } };
+
+    struct Config {
+        const char* name_;
+        int pattern_;
+        bool clamp_;
+        bool history_;
+    };
+    const Config configs[] = { { "1/4", 2, true, true }, { "1/16", 4, true, true }, { "1/4 unclamped", 2, false, true }, { "1/4 no history", 2, true, false } };
+    const int configCount = static_cast<int>(sizeof(configs) / sizeof(configs[0]));
+
+    ss << "interleaved marching at " << width << "x" << height << ", " << frames << " frames per path over 40100.fmap, "
+       << "rgba error against a full march of every frame, the first pattern^2 frames left out\n";
+    char line[200];
+    snprintf(line, sizeof(line), "  %-10s %-15s %10s %10s %9s %9s %12s\n", "path", "march", "mean err", "p99 err", "history", "spatial", "steps/full");
+    ss << line;
+
+    bool pass = true;
+    for (const Path& path : paths) {
+        // the full march of every frame
+        std::vector<CpuCloudView> views;
+        std::vector<CpuCloudFrame> truth(frames);
+        CpuCloudRenderer renderer;
+        renderer.Initialize(full);
+        CpuCloudView view;
+        for (int f = 0; f < frames; f++) {
+            views.push_back(view);
+            renderer.Render(field, view, truth[f], sources);
+
+            const float3 forward = normalize(view.lookAt_ - view.eye_);
+            const float yaw = path.degreesPerFrame_ * (kPi / 180.0f);
+            const float3 turned(forward.x * std::cos(yaw) - forward.z * std::sin(yaw), forward.y, forward.x * std::sin(yaw) + forward.z * std::cos(yaw));
+            view.eye_ = view.eye_ + forward * path.metersPerFrame_;
+            view.lookAt_ = view.eye_ + turned * 1000.0f;
+        }
+
+        std::vector<double> meanErrors(configCount);
+        for (int c = 0; c < configCount; c++) {
+            const Config& config = configs[c];
+            CloudReconstruct reconstruct;
+            Settings settings;
+            settings.pattern_ = config.pattern_;
+            settings.clamp_ = config.clamp_;
+            if (!reconstruct.Initialize(settings, width, height)) {
+                ss << "cloud reconstruct: " << width << "x" << height << " does not fit the patterns\n";
+                return ss.str();
+            }
+            CpuCloudRendererSettings sparseSettings = full;
+            sparseSettings.width_ = reconstruct.SparseWidth();
+            sparseSettings.height_ = reconstruct.SparseHeight();
+
+            std::vector<float> errors;
+            uint64_t sparseSteps = 0, fullSteps = 0;
+            int historyPixels = 0, spatialPixels = 0;
+            const int warmUp = config.pattern_ * config.pattern_;
+            for (int f = 0; f < frames; f++) {
+                if (!config.history_) { reconstruct.Reset(); }
+                reconstruct.BeginFrame(views[f].eye_, views[f].lookAt_, full.vFovDeg_, full.near_, full.far_);
+                sparseSettings.pixelCenter_ = reconstruct.PixelCenter();
+                renderer.Initialize(sparseSettings);
+                CpuCloudFrame sparse, out;
+                renderer.Render(field, views[f], sparse, sources);
+                reconstruct.Reconstruct(sparse, out);
+                if (f < warmUp) { continue; }
+
+                for (size_t i = 0; i < out.color_.size(); i++) { errors.push_back(MaxAbs(out.color_[i], truth[f].color_[i])); }
+                sparseSteps += sparse.marchSteps_;
+                fullSteps += truth[f].marchSteps_;
+                historyPixels += reconstruct.LastStats().history_;
+                spatialPixels += reconstruct.LastStats().spatial_;
+            }
+
+            double sum = 0.0;
+            for (const float e : errors) { sum += e; }
+            std::sort(errors.begin(), errors.end());
+            const double pixels = static_cast<double>(errors.size());
+            meanErrors[c] = errors.empty() ? 0.0 : sum / pixels;
+            const float p99 = errors.empty() ? 0.0f : errors[(errors.size() - 1) * 99 / 100];
+            const double stepRatio = fullSteps ? static_cast<double>(sparseSteps) / fullSteps : 0.0;
+            snprintf(line, sizeof(line), "  %-10s %-15s %10.2e %10.2e %8.1f%% %8.1f%% %12.3f\n", path.name_, config.name_, meanErrors[c], p99,
+                100.0 * historyPixels / (std::max)(pixels, 1.0), 100.0 * spatialPixels / (std::max)(pixels, 1.0), stepRatio);
+            ss << line;
+
+            // the march has to cost what the pattern promises
+            pass = pass && stepRatio <= 1.25 / (config.pattern_ * config.pattern_);
+        }
+        // the history has to beat the fresh samples alone, and the clamp the spatial blend
+        pass = pass && meanErrors[0] < meanErrors[configCount - 1] && meanErrors[0] < meanErrors[2];
+    }
+    ss << (pass ? "  PASS\n" : "  FAIL\n");
+    return ss.str();
+}
+
+#ifdef _WIN32
+bool CloudReconstruct::CreateResources() {
+    for (int i = 0; i < 2; i++) {
+        D3D11_TEXTURE2D_DESC desc = {};
+        desc.Width = width_;
+        desc.Height = height_;
+        desc.MipLevels = 1;
+        desc.ArraySize = 1;
+        desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+        desc.SampleDesc.Count = 1;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+
+        HRESULT hr = Renderer::device->CreateTexture2D(&desc, nullptr, &colorTEX_[i]);
+        if (FAILED(hr)) return false;
+        hr = Renderer::device->CreateShaderResourceView(colorTEX_[i].Get(), nullptr, &colorSRV_[i]);
+        if (FAILED(hr)) return false;
+        hr = Renderer::device->CreateUnorderedAccessView(colorTEX_[i].Get(), nullptr, &colorUAV_[i]);
+        if (FAILED(hr)) return false;
+
+        desc.Format = DXGI_FORMAT_R32_FLOAT;
+        hr = Renderer::device->CreateTexture2D(&desc, nullptr, &depthTEX_[i]);
+        if (FAILED(hr)) return false;
+        hr = Renderer::device->CreateShaderResourceView(depthTEX_[i].Get(), nullptr, &depthSRV_[i]);
+        if (FAILED(hr)) return false;
+        hr = Renderer::device->CreateUnorderedAccessView(depthTEX_[i].Get(), nullptr, &depthUAV_[i]);
+        if (FAILED(hr)) return false;
+    }
+
+    // cbuffer CloudReconstructBuffer
+    D3D11_BUFFER_DESC bufferDesc = {};
+    bufferDesc.ByteWidth = sizeof(Desc);
+    bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+    bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+    HRESULT hr = Renderer::device->CreateBuffer(&bufferDesc, nullptr, &descBuffer_);
+    if (FAILED(hr)) return false;
+
+    ComPtr<ID3DBlob> blob;
+    hr = Renderer::CompileShaderFromFile(L"shaders/CloudReconstruct.hlsl", "CSCloudReconstruct", "cs_5_0", blob);
+    if (FAILED(hr)) return false;
+
+    hr = Renderer::device->CreateComputeShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &computeShader_);
+    return SUCCEEDED(hr);
+}
+
+void CloudReconstruct::Dispatch(ID3D11ShaderResourceView* sparseColor, ID3D11ShaderResourceView* sparseDepth) {
+    if (!computeShader_) { return; }
+
+    // write the other texture, read the last one as the history
+    const int history = current_;
+    current_ = 1 - current_;
+
+    Renderer::context->UpdateSubresource(descBuffer_.Get(), 0, nullptr, &desc_, 0, 0);
+
+    ID3D11ShaderResourceView* const srvs[] = { sparseColor, sparseDepth, colorSRV_[history].Get(), depthSRV_[history].Get() };
+    ID3D11UnorderedAccessView* const uavs[] = { colorUAV_[current_].Get(), depthUAV_[current_].Get() };
+    Renderer::context->CSSetShader(computeShader_.Get(), nullptr, 0);
+    Renderer::context->CSSetShaderResources(0, _countof(srvs), srvs);
+    Renderer::context->CSSetConstantBuffers(0, 1, descBuffer_.GetAddressOf());
+    Renderer::context->CSSetUnorderedAccessViews(0, _countof(uavs), uavs, nullptr);
+    Renderer::context->Dispatch((width_ + 7) / 8, (height_ + 7) / 8, 1);
+
+    // the merge pass reads the result as a texture
+    ID3D11ShaderResourceView* const nullSRVs[] = { nullptr, nullptr, nullptr, nullptr };
+    ID3D11UnorderedAccessView* const nullUAVs[] = { nullptr, nullptr };
+    Renderer::context->CSSetShaderResources(0, _countof(nullSRVs), nullSRVs);
+    Renderer::context->CSSetUnorderedAccessViews(0, _countof(nullUAVs), nullUAVs, nullptr);
+    historyValid_ = true;
+}
+#endif
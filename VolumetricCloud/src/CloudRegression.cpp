@@ -0,0 +1,368 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#include "../includes/CloudRegression.h"
+#include "../includes/CloudSdf.h"
+#include "../includes/DensityField.h"
+#include "../includes/Fmap.h"
+#include "../includes/OccupancyGrid.h"
+
+using namespace hlsl;
+
+namespace {
+
+    const char kGoldenMagic[4] = { 'V', 'C', 'R', 'G' };
+
+    // environment::GetLightDir of VolumetricCloud.cpp
+    float3 LightDir(float azimuthDeg, float elevationDeg) {
+        const float az = azimuthDeg * (3.14159265f / 180.0f);
+        const float el = elevationDeg * (3.14159265f / 180.0f);
+        return float3(std::cos(el) * std::sin(az), std::sin(el), std::cos(el) * std::cos(az));
+    }
+
+    // weather of the case, its occupancy grid and distance volume, then the frame
+    bool RenderCase(DensityField& field, const CloudRegression::Settings& settings, const CloudRegression::Case& c,
+        const std::string& resourceDir, CpuCloudFrame& frame, std::string& error) {
+        const std::string path = resourceDir + "/" + c.fmap_;
+        if (!std::filesystem::exists(path)) {
+            error = "missing weather map " + path;
+            return false;
+        }
+        const Fmap fmap(path);
+        field.SetWeather(fmap);
+        field.SetTime(settings.seconds_);
+
+        OccupancyGrid grid;
+        CloudSdf sdf;
+        if (!grid.Build(field) || !sdf.Build(grid)) {
+            error = "occupancy grid or distance volume build failed";
+            return false;
+        }
+
+        CpuCloudRenderer renderer;
+        CpuCloudRendererSettings rendererSettings;
+        rendererSettings.width_ = settings.width_;
+        rendererSettings.height_ = settings.height_;
+        CpuCloudSources sources;
+        sources.occupancy_ = &grid;
+        sources.sdf_ = &sdf;
+        if (!renderer.Initialize(rendererSettings) || !renderer.Render(field, c.view_, frame, sources)) {
+            error = "render failed";
+            return false;
+        }
+        return true;
+    }
+
+    double PerPixel(uint64_t total, const CpuCloudFrame& frame) {
+        return static_cast<double>(total) / (static_cast<double>(frame.width_) * frame.height_);
+    }
+
+    std::string JsonEscape(const std::string& s) {
+        std::string out;
+        for (const char ch : s) {
+            if (ch == '"' || ch == '\\') { out += '\\'; }
+            out += ch;
+        }
+        return out;
+    }
+
+} // namespace
+
+std::vector<CloudRegression::Case> CloudRegression::Cases() {
+    // the start up camera of VolumetricCloud.cpp, a low sun under the cumulus deck and a
+    // high view down over the layers
+    CpuCloudView start;
+    start.lightDir_ = LightDir(90.0f, 45.0f);
+
+    CpuCloudView lowSun;
+    lowSun.eye_ = float3(0.0f, -1500.0f, 0.0f);
+    lowSun.lookAt_ = float3(0.5f, -1500.3f, 0.866f);
+    lowSun.lightDir_ = LightDir(200.0f, 8.0f);
+
+    CpuCloudView above;
+    above.eye_ = float3(20000.0f, -10000.0f, -20000.0f);
+    above.lookAt_ = float3(20000.866f, -9999.5f, -20000.0f);
+    above.lightDir_ = LightDir(30.0f, 60.0f);
+
+    std::vector<Case> cases;
+    for (const char* fmap : { "40100.fmap", "150800.fmap", "WeatherSample.fmap" }) {
+        const std::string stem = std::filesystem::path(fmap).stem().string();
+        cases.push_back({ stem + ".start", fmap, start });
+        cases.push_back({ stem + ".low_sun", fmap, lowSun });
+        cases.push_back({ stem + ".above", fmap, above });
+    }
+    return cases;
+}
+
+bool CloudRegression::SaveGolden(const std::string& path, const std::vector<GoldenImage>& golden) {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to write cloud regression golden " << path << std::endl;
+        return false;
+    }
+
+    const uint32_t header[2] = { kGoldenVersion, static_cast<uint32_t>(golden.size()) };
+    file.write(kGoldenMagic, 4);
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    for (const GoldenImage& image : golden) {
+        const uint32_t sizes[3] = { static_cast<uint32_t>(image.name_.size()), static_cast<uint32_t>(image.width_), static_cast<uint32_t>(image.height_) };
+        const double cost[2] = { image.stepsPerPixel_, image.samplesPerPixel_ };
+        file.write(reinterpret_cast<const char*>(sizes), sizeof(sizes));
+        file.write(image.name_.data(), image.name_.size());
+        file.write(reinterpret_cast<const char*>(cost), sizeof(cost));
+        file.write(reinterpret_cast<const char*>(image.color_.data()), image.color_.size() * sizeof(float4));
+        file.write(reinterpret_cast<const char*>(image.depth_.data()), image.depth_.size() * sizeof(float));
+    }
+    return static_cast<bool>(file);
+}
+
+bool CloudRegression::LoadGolden(const std::string& path, std::vector<GoldenImage>& golden) {
+    std::ifstream file(path, std::ios::binary);
+    char magic[4] = {};
+    uint32_t header[2] = {};
+    file.read(magic, 4);
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!file || !std::equal(kGoldenMagic, kGoldenMagic + 4, magic) || header[0] != kGoldenVersion) {
+        std::cerr << "Invalid cloud regression golden " << path << std::endl;
+        return false;
+    }
+
+    golden.assign(header[1], GoldenImage());
+    for (GoldenImage& image : golden) {
+        uint32_t sizes[3] = {};
+        double cost[2] = {};
+        file.read(reinterpret_cast<char*>(sizes), sizeof(sizes));
+        image.name_.assign(sizes[0], ' ');
+        file.read(image.name_.data(), sizes[0]);
+        file.read(reinterpret_cast<char*>(cost), sizeof(cost));
+        image.width_ = static_cast<int>(sizes[1]);
+        image.height_ = static_cast<int>(sizes[2]);
+        image.stepsPerPixel_ = cost[0];
+        image.samplesPerPixel_ = cost[1];
+        const size_t pixels = static_cast<size_t>(image.width_) * image.height_;
+        image.color_.assign(pixels, float4(0.0f));
+        image.depth_.assign(pixels, 0.0f);
+        file.read(reinterpret_cast<char*>(image.color_.data()), pixels * sizeof(float4));
+        file.read(reinterpret_cast<char*>(image.depth_.data()), pixels * sizeof(float));
+    }
+    if (!file) {
+        std::cerr << "Truncated cloud regression golden " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool CloudRegression::WriteGolden(DensityField& field, const Settings& settings, const std::string& resourceDir, const std::string& goldenPath) {
+    std::vector<GoldenImage> golden;
+    for (const Case& c : Cases()) {
+        CpuCloudFrame frame;
+        std::string error;
+        if (!RenderCase(field, settings, c, resourceDir, frame, error)) {
+            std::cerr << "CloudRegression: " << c.name_ << ": " << error << std::endl;
+            return false;
+        }
+        GoldenImage image;
+        image.name_ = c.name_;
+        image.width_ = frame.width_;
+        image.height_ = frame.height_;
+        image.stepsPerPixel_ = PerPixel(frame.marchSteps_, frame);
+        image.samplesPerPixel_ = PerPixel(frame.densitySamples_, frame);
+        image.color_ = std::move(frame.color_);
+        image.depth_ = std::move(frame.depth_);
+        golden.push_back(std::move(image));
+    }
+    return SaveGolden(goldenPath, golden);
+}
+
+CloudRegression::Report CloudRegression::Run(DensityField& field, const Settings& settings, const std::string& resourceDir,
+    const std::string& goldenPath, const std::string& baselinePath, const std::string& reportPath) {
+    Report report;
+    if (field.NoiseLarge().texels_.empty()) {
+        report.error_ = "density field not initialized";
+        return report;
+    }
+
+    std::vector<GoldenImage> golden;
+    if (!LoadGolden(goldenPath, golden)) {
+        report.error_ = "failed to load golden images " + goldenPath;
+        return report;
+    }
+
+    // per machine wall time baseline, "name ms" per line
+    std::map<std::string, double> baseline;
+    {
+        std::ifstream file(baselinePath);
+        std::string name;
+        double value;
+        while (file >> name >> value) {
+            baseline[name] = value;
+        }
+    }
+    const bool writeBaseline = baseline.empty();
+
+    for (const Case& c : Cases()) {
+        CaseResult result;
+        result.name_ = c.name_;
+
+        const auto image = std::find_if(golden.begin(), golden.end(), [&](const GoldenImage& g) { return g.name_ == c.name_; });
+        CpuCloudFrame frame;
+        if (image == golden.end()) {
+            result.error_ = "no golden image";
+        }
+        else if (image->width_ != settings.width_ || image->height_ != settings.height_) {
+            result.error_ = "golden is " + std::to_string(image->width_) + "x" + std::to_string(image->height_);
+        }
+        else if (RenderCase(field, settings, c, resourceDir, frame, result.error_)) {
+            // look
+            std::vector<float> errors(frame.color_.size());
+            double errorSum = 0.0;
+            int mismatched = 0;
+            for (size_t i = 0; i < frame.color_.size(); i++) {
+                const float4 d = frame.color_[i] - image->color_[i];
+                errors[i] = (std::max)((std::max)(std::fabs(d.x), std::fabs(d.y)), (std::max)(std::fabs(d.z), std::fabs(d.w)));
+                errorSum += errors[i];
+                mismatched += (frame.depth_[i] > 0.0f) != (image->depth_[i] > 0.0f);
+            }
+            std::sort(errors.begin(), errors.end());
+            result.meanAbs_ = static_cast<float>(errorSum / errors.size());
+            result.p99Abs_ = errors[(errors.size() - 1) * 99 / 100];
+            result.maxAbs_ = errors.back();
+            result.depthMismatch_ = static_cast<float>(mismatched) / errors.size();
+            result.ssim_ = Ssim(frame.color_, image->color_, frame.width_, frame.height_);
+            result.lookRegressed_ = result.ssim_ < settings.minSsim_ || result.meanAbs_ > settings.maxMeanAbs_
+                || result.p99Abs_ > settings.maxP99Abs_ || result.depthMismatch_ > settings.maxDepthMismatch_;
+
+            // cost
+            result.stepsPerPixel_ = PerPixel(frame.marchSteps_, frame);
+            result.samplesPerPixel_ = PerPixel(frame.densitySamples_, frame);
+            result.goldenStepsPerPixel_ = image->stepsPerPixel_;
+            result.costRegressed_ = result.stepsPerPixel_ > image->stepsPerPixel_ * settings.maxStepGrowth_;
+            result.ms_ = frame.totalMs_;
+            const auto it = baseline.find(c.name_);
+            if (it != baseline.end()) {
+                result.baselineMs_ = it->second;
+                result.speedRegressed_ = result.ms_ * settings.speedRegression_ > it->second;
+            }
+        }
+        report.cases_.push_back(result);
+    }
+
+    if (writeBaseline) {
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(baselinePath).parent_path(), ec);
+        std::ofstream file(baselinePath);
+        for (const CaseResult& r : report.cases_) {
+            if (r.error_.empty()) { file << r.name_ << " " << r.ms_ << "\n"; }
+        }
+    }
+
+    if (!reportPath.empty()) {
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(reportPath).parent_path(), ec);
+        std::ofstream file(reportPath);
+        file << report.ToJson();
+        if (!file) { std::cerr << "Failed to write cloud regression report " << reportPath << std::endl; }
+    }
+    return report;
+}
+
+float CloudRegression::Ssim(const std::vector<float4>& a, const std::vector<float4>& b, int width, int height) {
+    auto luminance = [](const float4& c) { return 1.0f - std::exp(-(0.2126f * c.x + 0.7152f * c.y + 0.0722f * c.z)); };
+    const int window = 8;
+    const int stride = 4;
+    const double c1 = 0.01 * 0.01;
+    const double c2 = 0.03 * 0.03;
+
+    double sum = 0.0;
+    int windows = 0;
+    for (int y0 = 0; y0 < height; y0 += stride) {
+        for (int x0 = 0; x0 < width; x0 += stride) {
+            // the last windows are pulled back inside the image
+            const int xs = (std::max)(0, (std::min)(x0, width - window));
+            const int ys = (std::max)(0, (std::min)(y0, height - window));
+            const int xe = (std::min)(xs + window, width);
+            const int ye = (std::min)(ys + window, height);
+
+            double ma = 0.0, mb = 0.0, va = 0.0, vb = 0.0, cov = 0.0;
+            const int n = (xe - xs) * (ye - ys);
+            for (int y = ys; y < ye; y++) {
+                for (int x = xs; x < xe; x++) {
+                    const size_t i = static_cast<size_t>(y) * width + x;
+                    ma += luminance(a[i]);
+                    mb += luminance(b[i]);
+                }
+            }
+            ma /= n;
+            mb /= n;
+            for (int y = ys; y < ye; y++) {
+                for (int x = xs; x < xe; x++) {
+                    const size_t i = static_cast<size_t>(y) * width + x;
+                    const double da = luminance(a[i]) - ma;
+                    const double db = luminance(b[i]) - mb;
+                    va += da * da;
+                    vb += db * db;
+                    cov += da * db;
+                }
+            }
+            va /= n;
+            vb /= n;
+            cov /= n;
+            sum += ((2.0 * ma * mb + c1) * (2.0 * cov + c2)) / ((ma * ma + mb * mb + c1) * (va + vb + c2));
+            windows++;
+        }
+    }
+    return windows > 0 ? static_cast<float>(sum / windows) : 1.0f;
+}
+
+bool CloudRegression::Report::Passed() const {
+    if (!error_.empty() || cases_.empty()) { return false; }
+    return std::all_of(cases_.begin(), cases_.end(), [](const CaseResult& r) { return r.Passed(); });
+}
+
+std::string CloudRegression::Report::ToString() const {
+    if (!error_.empty()) { return "cloud regression: " + error_ + "\n"; }
+
+    std::ostringstream out;
+    char line[320];
+    snprintf(line, sizeof(line), "%-22s %7s %9s %9s %8s %9s %9s %9s %9s\n", "case", "ssim", "meanAbs", "p99Abs", "depth", "spp", "steps", "golden", "ms");
+    out << line;
+    for (const CaseResult& r : cases_) {
+        if (!r.error_.empty()) {
+            out << r.name_ << ": " << r.error_ << "\n";
+            continue;
+        }
+        snprintf(line, sizeof(line), "%-22s %7.4f %9.2e %9.2e %7.2f%% %9.1f %9.1f %9.1f %9.1f%s%s%s\n",
+            r.name_.c_str(), r.ssim_, r.meanAbs_, r.p99Abs_, r.depthMismatch_ * 100.0f, r.samplesPerPixel_, r.stepsPerPixel_,
+            r.goldenStepsPerPixel_, r.ms_, r.lookRegressed_ ? "  LOOK" : "", r.costRegressed_ ? "  STEPS" : "", r.speedRegressed_ ? "  SLOWER" : "");
+        out << line;
+    }
+    out << (Passed() ? "PASSED" : "FAILED") << "\n";
+    return out.str();
+}
+
+std::string CloudRegression::Report::ToJson() const {
+    std::ostringstream out;
+    out << "{\n  \"version\": " << kGoldenVersion << ",\n  \"passed\": " << (Passed() ? "true" : "false")
+        << ",\n  \"error\": \"" << JsonEscape(error_) << "\",\n  \"cases\": [";
+    for (size_t i = 0; i < cases_.size(); i++) {
+        const CaseResult& r = cases_[i];
+        out << (i ? ",\n" : "\n") << "    { \"name\": \"" << JsonEscape(r.name_) << "\", \"passed\": " << (r.Passed() ? "true" : "false")
+            << ", \"error\": \"" << JsonEscape(r.error_) << "\""
+            << ", \"ssim\": " << r.ssim_ << ", \"meanAbs\": " << r.meanAbs_ << ", \"p99Abs\": " << r.p99Abs_ << ", \"maxAbs\": " << r.maxAbs_
+            << ", \"depthMismatch\": " << r.depthMismatch_
+            << ", \"samplesPerPixel\": " << r.samplesPerPixel_ << ", \"stepsPerPixel\": " << r.stepsPerPixel_
+            << ", \"goldenStepsPerPixel\": " << r.goldenStepsPerPixel_ << ", \"ms\": " << r.ms_ << ", \"baselineMs\": " << r.baselineMs_
+            << ", \"lookRegressed\": " << (r.lookRegressed_ ? "true" : "false") << ", \"costRegressed\": " << (r.costRegressed_ ? "true" : "false")
+            << ", \"speedRegressed\": " << (r.speedRegressed_ ? "true" : "false") << " }";
+    }
+    out << "\n  ]\n}\n";
+    return out.str();
+}
@@ -0,0 +1,39 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../includes/CloudRegression.h"
+#include "../includes/DensityField.h"
+
+// headless CloudRegression run for CI, built by CMakeLists.txt and not part of the
+// Windows project. exits with 1 when a case regressed or the noise bake failed.
+// usage: CloudRegression [--no-speed] [resource dir] [cache dir], from VolumetricCloud/ the
+// defaults fit. --no-speed still prints the wall times but only fails on look and cost,
+// for machines where other jobs share the cores
+int main(int argc, char** argv) {
+    CloudRegressionSettings settings;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--no-speed") {
+            settings.speedRegression_ = 0.0;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    const std::string resourceDir = paths.size() > 0 ? paths[0] : "resources";
+    const std::string cacheDir = paths.size() > 1 ? paths[1] : "cache";
+
+    DensityFieldSettings fieldSettings;
+    fieldSettings.cacheDir_ = cacheDir;
+    DensityField field;
+    if (!field.Initialize(fieldSettings)) {
+        std::cerr << "CloudRegression: density field initialization failed" << std::endl;
+        return 1;
+    }
+
+    const CloudRegression::Report report = CloudRegression::Run(field, settings, resourceDir,
+        resourceDir + "/CloudRegression.golden", cacheDir + "/CloudRegression.bench", cacheDir + "/CloudRegression.json");
+    std::cout << report.ToString();
+    return report.Passed() ? 0 : 1;
+}
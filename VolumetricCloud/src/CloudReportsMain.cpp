@@ -0,0 +1,144 @@
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../includes/AdaptiveStep.h"
+#include "../includes/BilateralUpsample.h"
+#include "../includes/BrickVolume.h"
+#include "../includes/CloudBvh.h"
+#include "../includes/CloudCascade.h"
+#include "../includes/CloudReconstruct.h"
+#include "../includes/CloudSdf.h"
+#include "../includes/CloudShadowMap.h"
+#include "../includes/DensityClipmap.h"
+#include "../includes/DensityField.h"
+#include "../includes/DepthPyramid.h"
+#include "../includes/EarthCurvature.h"
+#include "../includes/FarCloudCache.h"
+#include "../includes/Fmap.h"
+#include "../includes/HeightProfileLut.h"
+#include "../includes/NoisePrecision.h"
+#include "../includes/OccupancyGrid.h"
+#include "../includes/TemporalReprojection.h"
+
+namespace {
+
+    // what the buttons of the app's report panel run, with its settings
+    struct ReportEntry {
+        const char* name_;
+        bool needsField_; // the noise bake and the weather of 40100.fmap, like the app
+        std::function<std::string(DensityField& field, const std::string& resourceDir)> run_;
+    };
+
+    const std::vector<ReportEntry>& Reports() {
+        static const std::vector<ReportEntry> reports = {
+            { "CloudReconstruct", true, [](DensityField& field, const std::string& dir) { return CloudReconstruct::Report(field, 128, 72, 24, dir); } },
+            { "TemporalReprojection", true, [](DensityField& field, const std::string& dir) { return temporalreprojection::Report(field, 64, 36, 12, dir); } },
+            { "BilateralUpsample", true, [](DensityField& field, const std::string& dir) { return bilateralupsample::Report(field, 128, 72, dir); } },
+            { "DepthPyramid", true, [](DensityField& field, const std::string& dir) { return DepthPyramid::Report(field, 160, 90, dir); } },
+            { "CloudCascade", true, [](DensityField& field, const std::string& dir) { return cloudcascade::Report(field, 160, 90, dir); } },
+            { "FarCloudCache", true, [](DensityField& field, const std::string& dir) { return FarCloudCache::Report(field, 160, 90, dir); } },
+            { "AdaptiveStep", true, [](DensityField& field, const std::string& dir) { return adaptivestep::Report(field, 32, 18, dir); } },
+            { "OccupancyGrid", true, [](DensityField& field, const std::string&) {
+                OccupancyGrid grid;
+                grid.Build(field);
+                return grid.Validate(field) + grid.Report();
+            } },
+            { "CloudSdf", true, [](DensityField& field, const std::string&) {
+                CloudSdfSettings settings;
+                settings.grid_.layers_ = field.Layers();
+                const CloudSdf sdf = CloudSdf::BuildAsync(field.WeatherWidth(), field.WeatherHeight(), field.Weather(), NoiseBounds::FromField(field), settings).get();
+                return sdf.Report(field);
+            } },
+            { "DensityClipmap", true, [](DensityField& field, const std::string&) {
+                return DensityClipmap::TestUpdates() + DensityClipmap::Validate(field);
+            } },
+            { "CloudShadowMap", true, [](DensityField& field, const std::string&) {
+                CloudShadowMapSettings settings;
+                const hlsl::float2 band = DensityClipmap::AltitudeBand(field.Layers());
+                settings.altitudeMin_ = band.x;
+                settings.altitudeMax_ = band.y;
+                return CloudShadowMap::Validate(field, settings);
+            } },
+            { "HeightProfileLut", true, [](DensityField& field, const std::string&) {
+                HeightProfileLut lut;
+                lut.Build(field.Layers());
+                return lut.Validate();
+            } },
+            { "CloudBvh", false, [](DensityField&, const std::string&) {
+                const int counts[] = { 1000, 10000, 100000 };
+                return CloudBvh::Benchmark(counts);
+            } },
+            { "BrickVolume", false, [](DensityField&, const std::string&) {
+                BrickVolume::Settings settings;
+                std::string report = BrickVolume::Report(128, settings);
+                settings.brickSize_ = 16;
+                return report + BrickVolume::Report(128, settings);
+            } },
+            { "NoisePrecision", false, [](DensityField&, const std::string&) {
+                return NoisePrecision::Run(128, 32).ToString() + NoisePrecision::Run(128, 32, 64, true).ToString();
+            } },
+            { "EarthCurvature", false, [](DensityField&, const std::string&) { return earthcurvature::Report(); } },
+        };
+        return reports;
+    }
+
+    // the reports end their cases with a PASS or FAIL verdict, upper case words of their own
+    bool Passed(const std::string& report) {
+        std::istringstream words(report);
+        std::string word;
+        bool pass = false;
+        while (words >> word) {
+            while (!word.empty() && (word.back() == ':' || word.back() == ',')) { word.pop_back(); }
+            if (word == "FAIL") { return false; }
+            pass = pass || word == "PASS";
+        }
+        return pass;
+    }
+
+} // namespace
+
+// headless run of one report of the app's report panel for CI, built by CMakeLists.txt and not
+// part of the Windows project. exits with 1 when the report has a FAIL verdict or none at all.
+// usage: CloudReports <report> [resource dir] [cache dir], from VolumetricCloud/ the defaults
+// fit. CloudReports --list prints the reports
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        std::cerr << "usage: CloudReports <report> [resource dir] [cache dir]" << std::endl;
+        return 1;
+    }
+    const std::string name = argv[1];
+    const std::string resourceDir = argc > 2 ? argv[2] : "resources";
+    const std::string cacheDir = argc > 3 ? argv[3] : "cache";
+
+    if (name == "--list") {
+        for (const ReportEntry& entry : Reports()) { std::cout << entry.name_ << "\n"; }
+        return 0;
+    }
+
+    const ReportEntry* entry = nullptr;
+    for (const ReportEntry& e : Reports()) {
+        if (name == e.name_) { entry = &e; }
+    }
+    if (entry == nullptr) {
+        std::cerr << "CloudReports: no report " << name << std::endl;
+        return 1;
+    }
+
+    DensityField field;
+    if (entry->needsField_) {
+        DensityFieldSettings fieldSettings;
+        fieldSettings.cacheDir_ = cacheDir;
+        if (!field.Initialize(fieldSettings)) {
+            std::cerr << "CloudReports: density field initialization failed" << std::endl;
+            return 1;
+        }
+        field.SetWeather(Fmap(resourceDir + "/40100.fmap"));
+    }
+
+    const std::string report = entry->run_(field, resourceDir);
+    std::cout << report;
+    return Passed(report) ? 0 : 1;
+}
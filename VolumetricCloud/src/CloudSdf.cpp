@@ -0,0 +1,270 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+
+#include "../includes/CloudSdf.h"
+#include "../includes/ThreadPool.h"
+
+using namespace hlsl;
+
+namespace {
+
+    const float kFar = 1e20f;
+
+    // out[i] = min_j f[j] + w (i - j)^2 with the lower envelope of parabolas
+    // (Felzenszwalb and Huttenlocher), kFar entries hold no parabola
+    void Envelope(const std::vector<float>& f, float w, std::vector<float>& out, std::vector<int>& v, std::vector<double>& z) {
+        const int n = static_cast<int>(f.size());
+        v.resize(n);
+        z.resize(n + 1);
+        out.resize(n);
+
+        int k = -1;
+        for (int q = 0; q < n; q++) {
+            if (f[q] >= kFar) { continue; }
+            double s = -std::numeric_limits<double>::infinity();
+            while (k >= 0) {
+                const int p = v[k];
+                s = ((f[q] + static_cast<double>(w) * q * q) - (f[p] + static_cast<double>(w) * p * p)) / (2.0 * w * (q - p));
+                if (s > z[k]) { break; }
+                k--;
+            }
+            k++;
+            v[k] = q;
+            z[k] = k == 0 ? -std::numeric_limits<double>::infinity() : s;
+            z[k + 1] = std::numeric_limits<double>::infinity();
+        }
+
+        if (k < 0) {
+            std::fill(out.begin(), out.end(), kFar);
+            return;
+        }
+        k = 0;
+        for (int i = 0; i < n; i++) {
+            while (z[k + 1] < i) { k++; }
+            const double d = i - v[k];
+            out[i] = static_cast<float>(w * d * d + f[v[k]]);
+        }
+    }
+
+    // one axis of the box distance: the min over the neighbours turns (i - j)^2 into
+    // max(0, |i - j| - 1)^2, the gap between the voxel boxes
+    void BoxPass(std::vector<float>& line, float w, std::vector<float>& scratch, std::vector<float>& out, std::vector<int>& v, std::vector<double>& z) {
+        const int n = static_cast<int>(line.size());
+        scratch.resize(n);
+        for (int i = 0; i < n; i++) {
+            scratch[i] = (std::min)(line[i], (std::min)(line[(std::max)(i - 1, 0)], line[(std::min)(i + 1, n - 1)]));
+        }
+        Envelope(scratch, w, out, v, z);
+        line.swap(out);
+    }
+
+} // namespace
+
+bool CloudSdf::Build(const OccupancyGrid& grid, const Settings& settings) {
+    if (grid.mips_.empty()) {
+        std::cerr << "CloudSdf: occupancy grid is not built" << std::endl;
+        return false;
+    }
+    const auto start = std::chrono::steady_clock::now();
+
+    settings_ = settings;
+    settings_.grid_ = grid.settings_;
+    weatherWidth_ = grid.WeatherWidth();
+    weatherHeight_ = grid.WeatherHeight();
+
+    const OccupancyGrid::Mip& level0 = grid.mips_[0];
+    sizeX_ = level0.sizeX_;
+    sizeY_ = level0.sizeY_;
+    sizeZ_ = level0.sizeZ_;
+
+    // squared meters per voxel step
+    const float cellX = clouddensity::FMAP_EXTENT_M / sizeX_;
+    const float cellZ = clouddensity::FMAP_EXTENT_M / sizeZ_;
+    const float cellY = settings_.grid_.cellHeight_;
+
+    std::vector<float> squared(level0.maxDensity_.size());
+    for (size_t i = 0; i < squared.size(); i++) {
+        squared[i] = level0.maxDensity_[i] > settings_.threshold_ ? 0.0f : kFar;
+    }
+
+    struct Scratch {
+        std::vector<float> line, scratch, out;
+        std::vector<int> v;
+        std::vector<double> z;
+    };
+
+    // x and z wrap: the line is repeated three times and the middle copy kept
+    ThreadPool::Shared().ParallelFor(0, sizeY_, [&](int y) {
+        Scratch s;
+        for (int z = 0; z < sizeZ_; z++) {
+            s.line.resize(3 * sizeX_);
+            for (int i = 0; i < 3 * sizeX_; i++) { s.line[i] = squared[Index(i % sizeX_, y, z)]; }
+            BoxPass(s.line, cellX * cellX, s.scratch, s.out, s.v, s.z);
+            for (int x = 0; x < sizeX_; x++) { squared[Index(x, y, z)] = s.line[sizeX_ + x]; }
+        }
+        for (int x = 0; x < sizeX_; x++) {
+            s.line.resize(3 * sizeZ_);
+            for (int i = 0; i < 3 * sizeZ_; i++) { s.line[i] = squared[Index(x, y, i % sizeZ_)]; }
+            BoxPass(s.line, cellZ * cellZ, s.scratch, s.out, s.v, s.z);
+            for (int z = 0; z < sizeZ_; z++) { squared[Index(x, y, z)] = s.line[sizeZ_ + z]; }
+        }
+    });
+
+    // altitude: cloud the grid can not rule out above or below acts as a solid layer
+    // right outside the volume
+    const float below = grid.belowEmpty_ ? kFar : 0.0f;
+    const float above = grid.aboveEmpty_ ? kFar : 0.0f;
+    ThreadPool::Shared().ParallelFor(0, sizeZ_, [&](int z) {
+        Scratch s;
+        for (int x = 0; x < sizeX_; x++) {
+            s.line.resize(sizeY_ + 2);
+            s.line[0] = below;
+            s.line[sizeY_ + 1] = above;
+            for (int y = 0; y < sizeY_; y++) { s.line[y + 1] = squared[Index(x, y, z)]; }
+            BoxPass(s.line, cellY * cellY, s.scratch, s.out, s.v, s.z);
+            for (int y = 0; y < sizeY_; y++) { squared[Index(x, y, z)] = s.line[y + 1]; }
+        }
+    });
+
+    // round down so the stored step never overshoots, the half meter covers float error
+    distance_.resize(squared.size());
+    for (size_t i = 0; i < squared.size(); i++) {
+        const float d = squared[i] >= kFar ? settings_.maxDistance_ : (std::max)(0.0f, std::sqrt(squared[i]) - 0.5f);
+        distance_[i] = static_cast<uint16_t>(std::floor((std::min)(d, settings_.maxDistance_) / settings_.maxDistance_ * 65535.0f));
+    }
+
+    buildMs_ = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return true;
+}
+
+std::future<CloudSdf> CloudSdf::BuildAsync(int weatherWidth, int weatherHeight, std::vector<float4> weather, NoiseBounds noise, Settings settings) {
+    return std::async(std::launch::async, [=, weather = std::move(weather)]() {
+        CloudSdf sdf;
+        OccupancyGrid grid;
+        if (grid.Build(weatherWidth, weatherHeight, weather, noise, settings.grid_)) {
+            sdf.Build(grid, settings);
+        }
+        return sdf;
+    });
+}
+
+float CloudSdf::Distance(const float3& pos) const {
+    if (distance_.empty()) { return 0.0f; }
+
+    // the cells of OccupancyGrid::CellCoord
+    const float cpt = static_cast<float>(settings_.grid_.cellsPerTexel_);
+    const float2 uv = clouddensity::FmapUV(pos);
+    const float y = -pos.y / settings_.grid_.cellHeight_;
+    if (y < 0.0f || y >= sizeY_) { return 0.0f; }
+    float x = (uv.x * weatherWidth_ - 0.5f) * cpt;
+    float z = (uv.y * weatherHeight_ - 0.5f) * cpt;
+    x -= std::floor(x / sizeX_) * sizeX_;
+    z -= std::floor(z / sizeZ_) * sizeZ_;
+
+    const int ix = (std::min)(static_cast<int>(x), sizeX_ - 1);
+    const int iz = (std::min)(static_cast<int>(z), sizeZ_ - 1);
+    return distance_[Index(ix, static_cast<int>(y), iz)] * (settings_.maxDistance_ / 65535.0f);
+}
+
+int CloudSdf::MarchSteps(const DensityField& field, const float3& origin, const float3& dir, float tMax, bool useSdf, int* violations) const {
+    const float kPlainStep = 50.0f;
+    const float kCheckStep = 25.0f;
+
+    int steps = 0;
+    float t = 0.0f;
+    while (t < tMax) {
+        steps++;
+        const float3 pos = origin + dir * t;
+        float distance;
+        field.Evaluate(pos, distance);
+        float step = (std::max)(kPlainStep, distance);
+
+        if (useSdf) {
+            const float sdf = Distance(pos);
+            if (sdf > step) {
+                if (violations) {
+                    for (float s = step; s < sdf; s += kCheckStep) {
+                        *violations += field.Evaluate(origin + dir * (t + s)) > settings_.threshold_;
+                    }
+                }
+                step = sdf;
+            }
+        }
+        t += step;
+    }
+    return steps;
+}
+
+std::string CloudSdf::Report(const DensityField& field, int rays) const {
+    std::ostringstream ss;
+    if (distance_.empty() || !field.Ready()) {
+        ss << "cloud sdf: not built or density field not ready\n";
+        return ss.str();
+    }
+
+    // view rays of the near pass: low altitude, up to 45 degrees up, MAX_LENGTH * 0.1
+    std::mt19937 rng(34);
+    const float half = clouddensity::FMAP_EXTENT_M * 0.5f;
+    std::uniform_real_distribution<float> horizontal(-half, half);
+    std::uniform_real_distribution<float> altitude(500.0f, 3000.0f);
+    std::uniform_real_distribution<float> elevation(0.0f, 0.785f);
+    std::uniform_real_distribution<float> azimuth(0.0f, 6.2832f);
+    const float tMax = 42244.0f;
+
+    long long plain = 0, traced = 0;
+    int violations = 0;
+    for (int r = 0; r < rays; r++) {
+        const float3 origin(horizontal(rng), -altitude(rng), horizontal(rng));
+        const float e = elevation(rng), a = azimuth(rng);
+        const float3 dir(std::cos(e) * std::sin(a), -std::sin(e), std::cos(e) * std::cos(a));
+        plain += MarchSteps(field, origin, dir, tMax, false);
+        traced += MarchSteps(field, origin, dir, tMax, true, &violations);
+    }
+
+    size_t solid = std::count(distance_.begin(), distance_.end(), static_cast<uint16_t>(0));
+    ss << "cloud sdf " << sizeX_ << "x" << sizeZ_ << "x" << sizeY_ << " R16, built in " << buildMs_ << " ms, "
+       << 100.0 * solid / distance_.size() << "% at distance 0\n";
+    ss << "  steps per ray: plain " << static_cast<double>(plain) / rays << ", with sdf " << static_cast<double>(traced) / rays
+       << " (" << (plain ? 100.0 * (plain - traced) / plain : 0.0) << "% fewer)\n";
+    ss << "  cloud samples jumped over: " << violations << (violations == 0 ? "  PASS\n" : "  FAIL\n");
+    return ss.str();
+}
+
+#ifdef _WIN32
+bool CloudSdf::CreateTexture() {
+    if (distance_.empty()) { return false; }
+
+    D3D11_TEXTURE3D_DESC desc = {};
+    desc.Width = sizeX_;
+    desc.Height = sizeZ_;
+    desc.Depth = sizeY_;
+    desc.MipLevels = 1;
+    desc.Format = DXGI_FORMAT_R16_UNORM;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    D3D11_SUBRESOURCE_DATA initData = {};
+    initData.pSysMem = distance_.data();
+    initData.SysMemPitch = sizeX_ * sizeof(uint16_t);
+    initData.SysMemSlicePitch = sizeX_ * sizeZ_ * sizeof(uint16_t);
+
+    HRESULT hr = Renderer::device->CreateTexture3D(&desc, &initData, &sdfTEX_);
+    if (FAILED(hr)) return false;
+
+    hr = Renderer::device->CreateShaderResourceView(sdfTEX_.Get(), nullptr, &sdfSRV_);
+    if (FAILED(hr)) return false;
+
+    return true;
+}
+
+void CloudSdf::UpdateTexture() {
+    if (!sdfTEX_) { return; }
+    Renderer::context->UpdateSubresource(sdfTEX_.Get(), 0, nullptr, distance_.data(),
+        sizeX_ * sizeof(uint16_t), sizeX_ * sizeZ_ * sizeof(uint16_t));
+}
+#endif
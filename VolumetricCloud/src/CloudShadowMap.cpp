@@ -0,0 +1,413 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <thread>
+
+#include "../includes/CloudShadowMap.h"
+#include "../includes/DensityClipmap.h"
+#include "../includes/DensityField.h"
+#include "../includes/DensityPacket.h"
+
+using namespace hlsl;
+
+namespace {
+
+    const float kDegToRad = 3.14159265f / 180.0f;
+
+    // the sun at minElevationDeg at least, y down like the ray marcher
+    float3 ClampSun(const float3& toSun, float minElevationDeg) {
+        const float3 sun = normalize(toSun);
+        const float minUp = std::sin(minElevationDeg * kDegToRad);
+        if (-sun.y >= minUp) { return sun; }
+        const float horizontal = std::sqrt(sun.x * sun.x + sun.z * sun.z);
+        const float2 dir = horizontal > 0.0f ? float2(sun.x / horizontal, sun.z / horizontal) : float2(1.0f, 0.0f);
+        const float across = std::sqrt(1.0f - minUp * minUp);
+        return float3(dir.x * across, -minUp, dir.y * across);
+    }
+
+} // namespace
+
+bool CloudShadowMap::Initialize(const Settings& settings) {
+    if (settings.resolution_ < 4 || settings.texelSize_ <= 0.0f || settings.altitudeMax_ <= settings.altitudeMin_ || settings.knots_ < 4
+        || settings.knots_ % 4 != 0 || settings.knots_ > CLOUD_SHADOW_KNOTS_MAX || settings.samplesPerKnot_ < 1 || settings.rowsPerStep_ < 1
+        || settings.minElevationDeg_ <= 0.0f || settings.minElevationDeg_ >= 90.0f) {
+        std::cerr << "CloudShadowMap: " << settings.resolution_ << "x" << settings.resolution_ << " texels of " << settings.texelSize_ << " m, "
+            << settings.knots_ << " knots, band " << settings.altitudeMin_ << " to " << settings.altitudeMax_ << " m" << std::endl;
+        return false;
+    }
+
+    if (job_.valid()) { job_.wait(); job_ = {}; }
+    settings_ = settings;
+    const size_t texels = static_cast<size_t>(settings_.resolution_) * settings_.resolution_ * (settings_.knots_ / 4);
+    front_.assign(texels, float4(0.0f));
+    back_.assign(texels, float4(0.0f));
+    desc_ = {};
+    passDesc_ = {};
+    nextRow_ = settings_.resolution_;
+    return true;
+}
+
+void CloudShadowMap::Begin(const float3& center, const float3& toSun, double seconds) {
+    if (front_.empty() || job_.valid()) { return; }
+
+    const int res = settings_.resolution_;
+    const float ts = settings_.texelSize_;
+    const float3 sun = ClampSun(toSun, settings_.minElevationDeg_);
+    const float up = -sun.y;
+    const float2 shear(sun.x / up, sun.z / up);
+
+    // the window is centred on where the sun line through center crosses the band bottom,
+    // on the texel grid so a still camera bakes the same columns every pass
+    const float2 bottom = float2(center.x, center.z) - shear * (-center.y - settings_.altitudeMin_);
+    const float2 origin((std::floor(bottom.x / ts) - res / 2) * ts, (std::floor(bottom.y / ts) - res / 2) * ts);
+
+    passDesc_.origin_ = float4(origin.x, origin.y, ts, 1.0f / res);
+    passDesc_.shear_ = float4(shear.x, shear.y, static_cast<float>(settings_.knots_), 1.0f);
+    passDesc_.band_ = float4(settings_.altitudeMin_, (settings_.altitudeMax_ - settings_.altitudeMin_) / settings_.knots_, settings_.altitudeMax_, up);
+    passCenter_ = center;
+    passSun_ = normalize(toSun);
+    passSeconds_ = seconds;
+    nextRow_ = 0;
+}
+
+bool CloudShadowMap::NeedsRefresh(const float3& center, const float3& toSun, double seconds) const {
+    if (front_.empty() || Baking()) { return false; }
+    if (desc_.shear_.w <= 0.0f) { return true; }
+
+    const float2 moved(center.x - passCenter_.x, center.z - passCenter_.z);
+    const float window = settings_.resolution_ * settings_.texelSize_;
+    return std::sqrt(dot(moved, moved)) > settings_.recenterRatio_ * window
+        || std::fabs(center.y - passCenter_.y) > settings_.recenterRatio_ * window
+        || dot(normalize(toSun), passSun_) < std::cos(settings_.sunAngleDeg_ * kDegToRad)
+        || seconds - passSeconds_ > settings_.refreshSeconds_;
+}
+
+bool CloudShadowMap::Step(const DensityPacket& packet) {
+    if (job_.valid() || !Baking()) { return false; }
+
+    BakeRows(packet);
+    if (Baking()) { return false; }
+
+    front_.swap(back_);
+    desc_ = passDesc_;
+    return true;
+}
+
+void CloudShadowMap::BakeRows(const DensityPacket& packet) {
+    const int res = settings_.resolution_;
+    const int knots = settings_.knots_;
+    const int samples = settings_.samplesPerKnot_;
+    const int rows = (std::min)(settings_.rowsPerStep_, res - nextRow_);
+    const int perColumn = knots * samples;
+    const size_t count = static_cast<size_t>(rows) * res * perColumn;
+
+    // midpoints of samples intervals per knot along every column of the rows
+    const float2 origin(passDesc_.origin_.x, passDesc_.origin_.y);
+    const float2 shear(passDesc_.shear_.x, passDesc_.shear_.y);
+    const float knotHeight = passDesc_.band_.y;
+    std::vector<float> x(count), y(count), z(count), densities(count);
+    size_t i = 0;
+    for (int r = 0; r < rows; r++) {
+        const float cz = origin.y + (nextRow_ + r + 0.5f) * settings_.texelSize_;
+        for (int c = 0; c < res; c++) {
+            const float cx = origin.x + (c + 0.5f) * settings_.texelSize_;
+            for (int s = 0; s < perColumn; s++, i++) {
+                const float h = (s + 0.5f) * knotHeight / samples;
+                x[i] = cx + shear.x * h;
+                y[i] = -(settings_.altitudeMin_ + h);
+                z[i] = cz + shear.y * h;
+            }
+        }
+    }
+    packet.EvaluateParallel(x.data(), y.data(), z.data(), densities.data(), count);
+
+    // optical depth down from the band top, every sample covers knotHeight / samples of
+    // altitude and that over the altitude rate of the sun along the path
+    const float pathLength = knotHeight / samples / passDesc_.band_.w;
+    const size_t sliceTexels = static_cast<size_t>(res) * res;
+    i = 0;
+    for (int r = 0; r < rows; r++) {
+        for (int c = 0; c < res; c++, i += perColumn) {
+            const size_t texel = static_cast<size_t>(nextRow_ + r) * res + c;
+            float depth = 0.0f;
+            for (int k = knots - 1; k >= 0; k--) {
+                for (int s = samples - 1; s >= 0; s--) {
+                    depth += (std::max)(densities[i + k * samples + s], 0.0f) * pathLength;
+                }
+                float4& v = back_[(k / 4) * sliceTexels + texel];
+                (&v.x)[k % 4] = depth;
+            }
+        }
+    }
+
+    nextRow_ += rows;
+}
+
+void CloudShadowMap::Bake(const DensityPacket& packet, const float3& center, const float3& toSun) {
+    Begin(center, toSun);
+    while (Baking()) { Step(packet); }
+}
+
+void CloudShadowMap::BeginAsync(const DensityField& field, const float3& center, const float3& toSun, double seconds) {
+    if (front_.empty() || Baking() || !field.Ready()) { return; }
+
+    Begin(center, toSun, seconds);
+    // back_, passDesc_ and nextRow_ belong to the worker until PickUp got the future
+    job_ = std::async(std::launch::async, [this, snapshot = std::make_unique<DensityField>(field)]() {
+        DensityPacket packet;
+        if (!packet.Build(*snapshot)) {
+            nextRow_ = settings_.resolution_;
+            return false;
+        }
+        while (nextRow_ < settings_.resolution_) { BakeRows(packet); }
+        return true;
+    });
+}
+
+bool CloudShadowMap::PickUp() {
+    if (!job_.valid() || job_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) { return false; }
+    if (!job_.get()) { return false; }
+    front_.swap(back_);
+    desc_ = passDesc_;
+    return true;
+}
+
+float CloudShadowMap::ColumnDepth(int x, int z, float alt) const {
+    if (alt >= desc_.band_.z) { return 0.0f; }
+    const int res = settings_.resolution_;
+    const int knots = settings_.knots_;
+    const float k = (std::max)(alt - desc_.band_.x, 0.0f) / desc_.band_.y;
+    const int k0 = (std::min)(static_cast<int>(k), knots - 1);
+
+    const size_t sliceTexels = static_cast<size_t>(res) * res;
+    const size_t texel = static_cast<size_t>(z) * res + x;
+    auto knot = [&](int kk) { return kk >= knots ? 0.0f : (&front_[(kk / 4) * sliceTexels + texel].x)[kk % 4]; };
+    return lerp(knot(k0), knot(k0 + 1), saturate(k - k0));
+}
+
+float CloudShadowMap::OpticalDepth(const float3& pos) const {
+    return SegmentDepth(pos, -1.0f);
+}
+
+float CloudShadowMap::SegmentDepth(const float3& pos, float length) const {
+    if (desc_.shear_.w <= 0.0f || (length >= 0.0f && desc_.band_.w < CLOUD_SHADOW_SEGMENT_MIN_UP)) { return -1.0f; }
+
+    // CloudShadowColumn, the texel corners instead of a uv
+    const float alt = -pos.y;
+    const float2 bottom = float2(pos.x, pos.z) - float2(desc_.shear_.x, desc_.shear_.y) * (alt - desc_.band_.x);
+    const float fx = (bottom.x - desc_.origin_.x) / desc_.origin_.z - 0.5f;
+    const float fz = (bottom.y - desc_.origin_.y) / desc_.origin_.z - 0.5f;
+    const int res = settings_.resolution_;
+    if (fx < 0.0f || fz < 0.0f || fx > res - 1.0f || fz > res - 1.0f) { return -1.0f; }
+
+    const int x0 = (std::min)(static_cast<int>(fx), res - 2);
+    const int z0 = (std::min)(static_cast<int>(fz), res - 2);
+    const float tx = fx - x0, tz = fz - z0;
+    auto bilinear = [&](float a) {
+        return lerp(lerp(ColumnDepth(x0, z0, a), ColumnDepth(x0 + 1, z0, a), tx), lerp(ColumnDepth(x0, z0 + 1, a), ColumnDepth(x0 + 1, z0 + 1, a), tx), tz);
+    };
+    if (length < 0.0f) { return bilinear(alt); }
+    return (std::max)(bilinear(alt) - bilinear(alt + length * desc_.band_.w), 0.0f);
+}
+
+float CloudShadowMap::OpticalDepthReference(const DensityField& field, const float3& pos, const float3& toSun, float length, float altitudeMax, float step) {
+    const float3 sun = normalize(toSun);
+    double depth = 0.0;
+    for (float t = 0.5f * step; t < length; t += step) {
+        const float3 p = pos + sun * t;
+        if (-p.y > altitudeMax) { break; }
+        depth += (std::max)(field.Evaluate(p), 0.0f) * step;
+    }
+    return static_cast<float>(depth);
+}
+
+std::string CloudShadowMap::Validate(const DensityField& field, const Settings& requested, int samples) {
+    std::ostringstream ss;
+
+    // knots outside the layers only thin out the ones inside, the app bakes the band of the layers
+    Settings settings = requested;
+    const float2 layers = DensityClipmap::AltitudeBand(field.Layers());
+    if (layers.y > layers.x) {
+        settings.altitudeMin_ = (std::max)(settings.altitudeMin_, layers.x);
+        settings.altitudeMax_ = (std::min)(settings.altitudeMax_, layers.y);
+    }
+
+    DensityPacket packet;
+    CloudShadowMap map;
+    if (!field.Ready() || !packet.Build(field) || !map.Initialize(settings)) {
+        ss << "cloud shadow map: field not ready or invalid settings\n";
+        return ss.str();
+    }
+
+    using clock = std::chrono::steady_clock;
+    auto ms = [](clock::time_point a, clock::time_point b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+
+    const int res = settings.resolution_;
+    const float lightMarch = 400.0f; // LIGHT_MARCH_SIZE of RayMarch.hlsl
+    const int sunSteps = 8;
+    const float3 camera(1234.0f, -1500.0f, -5678.0f);
+
+    ss << "cloud shadow map " << res << "x" << res << " texels of " << settings.texelSize_ << " m, " << settings.knots_ << " knots over "
+        << settings.altitudeMin_ << " to " << settings.altitudeMax_ << " m, " << settings.samplesPerKnot_ << " samples per knot, "
+        << samples << " samples per sun\n";
+    ss << "  transmittance errors against a 10 m march, the light segment is " << lightMarch << " m like RayMarch\n";
+    ss << "  sun el  bake ms  step ms  ground mean  ground max  segment mean  segment max  8 step mean  8 step max  outside\n";
+
+    std::mt19937 rng(40);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    bool groundPass = true, segmentPass = true, asyncPass = true;
+    // the lowest sun is below CLOUD_SHADOW_SEGMENT_MIN_UP, its light is marched
+    for (const float elevation : { 70.0f, 30.0f, 12.0f }) {
+        const float el = elevation * kDegToRad;
+        const float3 toSun(std::cos(el) * 0.6f, -std::sin(el), std::cos(el) * 0.8f);
+
+        const clock::time_point start = clock::now();
+        map.Bake(packet, camera, toSun);
+        const double bakeMs = ms(start, clock::now());
+        const double stepMs = bakeMs * settings.rowsPerStep_ / res;
+
+        // the app's path, on a worker with a copy of the field
+        if (elevation == 70.0f) {
+            CloudShadowMap async;
+            async.Initialize(settings);
+            async.BeginAsync(field, camera, toSun);
+            while (!async.PickUp()) { std::this_thread::sleep_for(std::chrono::milliseconds(1)); }
+            const std::vector<float4>& a = async.Texels();
+            const std::vector<float4>& b = map.Texels();
+            asyncPass = a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(float4)) == 0;
+        }
+        const bool lit = map.GetDesc().band_.w >= CLOUD_SHADOW_SEGMENT_MIN_UP;
+
+        // positions over the inner half of the window, the sun line stays inside the map
+        const Desc& desc = map.GetDesc();
+        const float window = res * settings.texelSize_;
+        double groundSum = 0.0, segmentSum = 0.0, marchSum = 0.0;
+        float groundMax = 0.0f, segmentMax = 0.0f, marchMax = 0.0f;
+        int outside = 0, inCloud = 0;
+        for (int n = 0; n < samples; n++) {
+            const float alt = n % 4 == 0 ? 0.0f : lerp(settings.altitudeMin_, settings.altitudeMax_, unit(rng));
+            const float2 bottom(desc.origin_.x + window * lerp(0.25f, 0.75f, unit(rng)), desc.origin_.y + window * lerp(0.25f, 0.75f, unit(rng)));
+            const float3 pos(bottom.x + desc.shear_.x * (alt - desc.band_.x), -alt, bottom.y + desc.shear_.y * (alt - desc.band_.x));
+
+            if (n % 4 == 0) {
+                // ground, the monolith shadow: the whole band
+                const float cached = map.OpticalDepth(pos);
+                if (cached < 0.0f) { outside++; continue; }
+                const float reference = OpticalDepthReference(field, pos, toSun, 1e9f, settings.altitudeMax_);
+                const float err = std::fabs(std::exp(-cached) - std::exp(-reference));
+                groundSum += err;
+                groundMax = (std::max)(groundMax, err);
+                continue;
+            }
+
+            // in cloud samples only, the ones RayMarch lights
+            if (field.Evaluate(pos) <= 0.0f) { n--; continue; }
+            inCloud++;
+
+            const float cached = map.SegmentDepth(pos, lightMarch);
+            if (lit && cached < 0.0f) { outside++; continue; }
+            const float reference = OpticalDepthReference(field, pos, toSun, lightMarch, 1e9f);
+
+            // the trapezoid light march of RayMarch
+            const float3 sun = normalize(toSun);
+            const float stepLength = lightMarch / sunSteps;
+            float march = 0.0f;
+            float previous = (std::max)(field.Evaluate(pos), 0.0f);
+            for (int s = 1; s <= sunSteps; s++) {
+                const float dense = (std::max)(field.Evaluate(pos + sun * (stepLength * s)), 0.0f);
+                march += (previous + dense) * 0.5f * stepLength;
+                previous = dense;
+            }
+
+            const float err = lit ? std::fabs(std::exp(-cached) - std::exp(-reference)) : 0.0f;
+            const float marchErr = std::fabs(std::exp(-march) - std::exp(-reference));
+            segmentSum += err;
+            segmentMax = (std::max)(segmentMax, err);
+            marchSum += marchErr;
+            marchMax = (std::max)(marchMax, marchErr);
+        }
+        const int ground = (samples + 3) / 4;
+        // the ground shadow is what the map is for. the light segment replaces the 8 step march
+        // only if it comes close to it
+        groundPass = groundPass && outside == 0 && groundSum / ground < 0.1;
+        segmentPass = segmentPass && (!lit || segmentSum <= kSegmentErrorRatio * marchSum);
+
+        char line[200];
+        if (lit) {
+            std::snprintf(line, sizeof(line), "  %6.0f  %7.1f  %7.2f  %11.4f  %10.4f  %12.4f  %11.4f  %11.4f  %10.4f  %7d\n", elevation, bakeMs, stepMs,
+                groundSum / ground, groundMax, segmentSum / (std::max)(inCloud, 1), segmentMax, marchSum / (std::max)(inCloud, 1), marchMax, outside);
+        } else {
+            std::snprintf(line, sizeof(line), "  %6.0f  %7.1f  %7.2f  %11.4f  %10.4f  %12s  %11s  %11.4f  %10.4f  %7d\n", elevation, bakeMs, stepMs,
+                groundSum / ground, groundMax, "marched", "-", marchSum / (std::max)(inCloud, 1), marchMax, outside);
+        }
+        ss << line;
+    }
+
+    ss << "  per in cloud sample: " << sunSteps << " CloudDensity evaluations before, 1 to 4 texture fetches now; "
+        << settings.knots_ * settings.samplesPerKnot_ << " evaluations per column, " << settings.rowsPerStep_ * res << " columns per Step\n";
+    ss << "  ground shadow " << (groundPass ? "passes" : "fails") << ", light segment " << (segmentPass ? "passes" : "fails")
+        << " within " << kSegmentErrorRatio << "x the 8 step mean (USE_CLOUD_SHADOW_MAP of RayMarch.hlsl), BeginAsync "
+        << (asyncPass ? "bakes the same map" : "differs from Bake") << "\n";
+    ss << (groundPass && segmentPass && asyncPass ? "  PASS\n" : "  FAIL\n");
+    return ss.str();
+}
+
+#ifdef _WIN32
+bool CloudShadowMap::CreateResources() {
+    if (front_.empty()) { return false; }
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width = settings_.resolution_;
+    desc.Height = settings_.resolution_;
+    desc.MipLevels = 1;
+    desc.ArraySize = settings_.knots_ / 4;
+    desc.Format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    HRESULT hr = Renderer::device->CreateTexture2D(&desc, nullptr, &shadowTEX_);
+    if (FAILED(hr)) return false;
+
+    hr = Renderer::device->CreateShaderResourceView(shadowTEX_.Get(), nullptr, &shadowSRV_);
+    if (FAILED(hr)) return false;
+
+    D3D11_BUFFER_DESC descDesc = {};
+    descDesc.ByteWidth = sizeof(Desc);
+    descDesc.Usage = D3D11_USAGE_DEFAULT;
+    descDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    descDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+    descDesc.StructureByteStride = sizeof(Desc);
+
+    // not baked yet, the shaders march the sun
+    D3D11_SUBRESOURCE_DATA initData = {};
+    initData.pSysMem = &desc_;
+
+    hr = Renderer::device->CreateBuffer(&descDesc, &initData, &descBuffer_);
+    if (FAILED(hr)) return false;
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+    srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+    srvDesc.Buffer.NumElements = 1;
+
+    hr = Renderer::device->CreateShaderResourceView(descBuffer_.Get(), &srvDesc, &descSRV_);
+    return SUCCEEDED(hr);
+}
+
+void CloudShadowMap::UpdateTexture() {
+    if (!shadowTEX_) { return; }
+
+    const UINT res = settings_.resolution_;
+    for (int slice = 0; slice < settings_.knots_ / 4; slice++) {
+        Renderer::context->UpdateSubresource(shadowTEX_.Get(), D3D11CalcSubresource(0, slice, 1), nullptr,
+            &front_[static_cast<size_t>(slice) * res * res], res * sizeof(float4), res * res * sizeof(float4));
+    }
+    Renderer::context->UpdateSubresource(descBuffer_.Get(), 0, nullptr, &desc_, 0, 0);
+}
+#endif
@@ -0,0 +1,650 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+#include "../includes/CloudSdf.h"
+#include "../includes/CloudShadowMap.h"
+#include "../includes/CpuCloudRenderer.h"
+#include "../includes/DensityField.h"
+#include "../includes/DepthPyramid.h"
+#include "../includes/EarthCurvature.h"
+#include "../includes/OccupancyGrid.h"
+
+using namespace hlsl;
+
+namespace {
+
+    const float kPi = 3.14159265f;
+
+    // RayMarch.hlsl and CommonFunctions.hlsl
+    const float kAtmosRadius = 6471e3f;
+    const float kEarthRadius = 6371e3f;
+    const float kLightMarchSize = 400.0f;
+    const float kOccupancyMaxSkip = 24000.0f;
+    const float kOccupancyNudge = 1.0f;
+
+    float3 Exp(const float3& v) { return float3(std::exp(v.x), std::exp(v.y), std::exp(v.z)); }
+
+    // depthTexture through depthSampler: linear and wrapped
+    float SampleDepth(const CpuCloudFrame& depth, float u, float v) {
+        const float tx = u * depth.width_ - 0.5f, ty = v * depth.height_ - 0.5f;
+        const float bx = std::floor(tx), by = std::floor(ty);
+        const float fx = tx - bx, fy = ty - by;
+        const auto wrap = [](int i, int n) { return ((i % n) + n) % n; };
+        const int x0 = wrap(static_cast<int>(bx), depth.width_), x1 = wrap(static_cast<int>(bx) + 1, depth.width_);
+        const int y0 = wrap(static_cast<int>(by), depth.height_), y1 = wrap(static_cast<int>(by) + 1, depth.height_);
+        const auto at = [&](int x, int y) { return depth.depth_[static_cast<size_t>(y) * depth.width_ + x]; };
+        return (at(x0, y0) * (1.0f - fx) + at(x1, y0) * fx) * (1.0f - fy) + (at(x0, y1) * (1.0f - fx) + at(x1, y1) * fx) * fy;
+    }
+
+    // rsi / RaySphereIntersectForSunColor / ray_sphere_intersect
+    float2 RaySphere(const float3& start, const float3& dir, float radius) {
+        const float a = dot(dir, dir);
+        const float b = 2.0f * dot(dir, start);
+        const float c = dot(start, start) - radius * radius;
+        const float d = b * b - 4.0f * a * c;
+        if (d < 0.0f) { return float2(1e5f, -1e5f); }
+        return float2((-b - std::sqrt(d)) / (2.0f * a), (-b + std::sqrt(d)) / (2.0f * a));
+    }
+
+    float2 IntersectAtmo(const float3& r0, const float3& rayDir) {
+        const float3 start(0.0f, -r0.y + kEarthRadius, 0.0f);
+        const float3 dir = rayDir * float3(1.0f, -1.0f, 1.0f);
+        float2 p = RaySphere(start, dir, kAtmosRadius);
+        p.y = (std::min)(p.y, RaySphere(start, dir, kEarthRadius).x);
+        return p;
+    }
+
+    float3 CalculateSunlightColor(float3 sunDir) {
+        sunDir.y *= -1.0f;
+
+        const float3 rayleighCoeff(0.0058f, 0.0135f, 0.0331f);
+        const float3 mieCoeff(0.0030f, 0.0030f, 0.0030f);
+        const float rayleighScaleDepth = 0.25f;
+        const float mieScaleDepth = 0.1f;
+
+        const float sunZenithAngle = (std::max)(0.0f, 1.0f - sunDir.y);
+        const float safeSunDirY = (std::max)(std::fabs(sunDir.y), 0.01f);
+        const float horizon = 0.15f * std::pow(93.885f - sunZenithAngle * 180.0f / 3.14159f, -1.253f);
+        const float rayleighAirMass = std::exp(-safeSunDirY / rayleighScaleDepth) / (safeSunDirY + horizon);
+        const float mieAirMass = std::exp(-safeSunDirY / mieScaleDepth) / (safeSunDirY + horizon);
+        float3 color = Exp(-rayleighCoeff * rayleighAirMass) * Exp(-mieCoeff * mieAirMass);
+
+        // below the horizon of a sample 5 km up the shader shades a grey planet instead
+        const float3 pos(0.0f, 5000.0f + kEarthRadius, 0.0f);
+        const float2 planet = RaySphere(pos, sunDir, kEarthRadius);
+        if (0.0f < planet.y) {
+            const float3 normal = normalize(pos + sunDir * planet.x - kEarthRadius);
+            color = float3(0.5f) * (std::max)(1e-6f, dot(normal, sunDir));
+        }
+        return color;
+    }
+
+    // calculate_scattering of SkyRay.hlsl with its earth constants
+    float3 CalculateScattering(float3 start, const float3& dir, float maxDist, const float3& sceneColor, const float3& lightDir, int stepsI, int stepsL) {
+        const float3 betaRay(5.5e-6f, 13.0e-6f, 22.4e-6f);
+        const float betaMie = 21e-6f;
+        const float3 betaAbsorption(2.04e-5f, 4.97e-5f, 1.95e-6f);
+        const float g = 0.7f;
+        const float heightRay = 8e3f, heightMie = 1.2e3f, heightAbsorption = 30e3f, absorptionFalloff = 4e3f;
+        const float lightIntensity = 40.0f;
+
+        float a = dot(dir, dir);
+        float b = 2.0f * dot(dir, start);
+        float c = dot(start, start) - kAtmosRadius * kAtmosRadius;
+        float d = b * b - 4.0f * a * c;
+        if (d < 0.0f) { return sceneColor; }
+
+        float2 rayLength((std::max)((-b - std::sqrt(d)) / (2.0f * a), 0.0f), (std::min)((-b + std::sqrt(d)) / (2.0f * a), maxDist));
+        if (rayLength.x > rayLength.y) { return sceneColor; }
+        const bool allowMie = maxDist > rayLength.y;
+        rayLength.y = (std::min)(rayLength.y, maxDist);
+        rayLength.x = (std::max)(rayLength.x, 0.0f);
+        const float stepSizeI = (rayLength.y - rayLength.x) / stepsI;
+        float rayPosI = rayLength.x + stepSizeI * 0.5f;
+
+        float3 totalRay(0.0f), totalMie(0.0f), optI(0.0f);
+
+        const float mu = dot(dir, lightDir);
+        const float mumu = mu * mu;
+        const float gg = g * g;
+        const float phaseRay = 3.0f / 50.2654824574f * (1.0f + mumu);
+        const float phaseMie = allowMie ? 3.0f / 25.1327412287f * ((1.0f - gg) * (mumu + 1.0f)) / (std::pow(1.0f + gg - 2.0f * mu * g, 1.5f) * (2.0f + gg)) : 0.0f;
+
+        // ray, mie and absorption densities at a height, times the step
+        auto density = [&](float height, float step) {
+            const float denom = (heightAbsorption - height) / absorptionFalloff;
+            const float rayleigh = std::exp(-height / heightRay);
+            return float3(rayleigh, std::exp(-height / heightMie), rayleigh / (denom * denom + 1.0f)) * step;
+        };
+
+        for (int i = 0; i < stepsI; i++) {
+            const float3 posI = start + dir * rayPosI;
+            const float3 densityI = density(length(posI) - kEarthRadius, stepSizeI);
+            optI += densityI;
+
+            a = dot(lightDir, lightDir);
+            b = 2.0f * dot(lightDir, posI);
+            c = dot(posI, posI) - kAtmosRadius * kAtmosRadius;
+            d = b * b - 4.0f * a * c;
+            const float stepSizeL = (-b + std::sqrt(d)) / (2.0f * a * stepsL);
+            float rayPosL = stepSizeL * 0.5f;
+
+            float3 optL(0.0f);
+            for (int l = 0; l < stepsL; l++) {
+                optL += density(length(posI + lightDir * rayPosL) - kEarthRadius, stepSizeL);
+                rayPosL += stepSizeL;
+            }
+
+            const float3 attn = Exp(-betaRay * (optI.x + optL.x) - betaMie * (optI.y + optL.y) - betaAbsorption * (optI.z + optL.z));
+            totalRay += attn * densityI.x;
+            totalMie += attn * densityI.y;
+            rayPosI += stepSizeI;
+        }
+
+        const float3 opacity = Exp(-(betaRay * optI.x + betaMie * optI.y + betaAbsorption * optI.z));
+        return (betaRay * totalRay * phaseRay + totalMie * (phaseMie * betaMie)) * lightIntensity + sceneColor * opacity;
+    }
+
+    // render_scene of SkyRay.hlsl: the sun disc and the planet, depth in w
+    float4 RenderScene(const float3& pos, const float3& dir, const float3& lightDir) {
+        float4 color(0.0f, 0.0f, 0.0f, 1e12f);
+        const float sun = dot(dir, lightDir) > 0.9998f ? 3.0f : 0.0f;
+        color.x = color.y = color.z = sun;
+
+        const float2 planet = RaySphere(pos, dir, kEarthRadius);
+        if (0.0f < planet.y) {
+            color.w = (std::max)(planet.x, 0.0f);
+            const float3 samplePos = pos + dir * planet.x;
+            const float3 normal = normalize(samplePos);
+            const float dotNV = (std::max)(1e-6f, dot(normal, -dir));
+            const float dotNL = (std::max)(1e-6f, dot(normal, lightDir));
+            float3 shade = float3(0.1f, 0.2f, 0.4f) * (dotNL / (dotNL + dotNV));
+
+            // skylight, the normal bent toward the light
+            const float3 bent = normalize(lerp(normal, lightDir, 0.6f));
+            const float3 sky = CalculateScattering(samplePos, bent, 3.0f * kAtmosRadius, float3(0.0f), lightDir, 8, 8) * float3(0.0f, 0.25f, 0.05f);
+            shade += saturate(sky);
+            color.x = shade.x; color.y = shade.y; color.z = shade.z;
+        }
+        return color;
+    }
+
+    // randomDirection of RayMarch.hlsl
+    float3 RandomDirection(const float3& seed) {
+        const float phi = 2.0f * 3.14159f * frac(std::sin(seed.x * 12.9898f + seed.y * 78.233f) * 43758.5453f);
+        const float cosTheta = 2.0f * frac(std::cos(seed.x * 23.14069f + seed.y * 90.233f) * 12345.6789f) - 1.0f;
+        const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+        return float3(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+    }
+
+    // OccupancySkip of RayMarch.hlsl on the CPU grid, whose cell coordinates are (x, altitude, z)
+    float OccupancySkip(const OccupancyGrid& grid, const float3& pos, const float3& dir) {
+        if (grid.mips_.empty()) { return 0.0f; }
+        const OccupancyGrid::Mip& level0 = grid.mips_[0];
+        const float cellHeight = grid.settings_.cellHeight_;
+        const float alt = -pos.y;
+        if (alt < 0.0f || alt >= level0.sizeY_ * cellHeight) { return 0.0f; }
+
+        const float3 size(static_cast<float>(level0.sizeX_), static_cast<float>(level0.sizeY_), static_cast<float>(level0.sizeZ_));
+        const float3 coord = grid.CellCoord(pos);
+        const float3 speed(dir.x * size.x / clouddensity::FMAP_EXTENT_M, -dir.y / cellHeight, dir.z * size.z / clouddensity::FMAP_EXTENT_M);
+
+        for (int mip = grid.MipCount() - 1; mip >= 0; mip--) {
+            const OccupancyGrid::Mip& m = grid.mips_[mip];
+            const int cell[3] = {
+                (std::min)(static_cast<int>(coord.x) >> mip, m.sizeX_ - 1),
+                (std::min)(static_cast<int>(coord.y) >> mip, m.sizeY_ - 1),
+                (std::min)(static_cast<int>(coord.z) >> mip, m.sizeZ_ - 1) };
+            if (m.maxDensity_[m.Index(cell[0], cell[1], cell[2])] > 0.0f) { continue; }
+
+            const int mipSize[3] = { m.sizeX_, m.sizeY_, m.sizeZ_ };
+            float skip = kOccupancyMaxSkip;
+            for (int axis = 0; axis < 3; axis++) {
+                const float lo = static_cast<float>(cell[axis] << mip);
+                const float hi = cell[axis] == mipSize[axis] - 1 ? size[axis] : static_cast<float>((cell[axis] + 1) << mip);
+                if (speed[axis] > 0.0f) { skip = (std::min)(skip, (hi - coord[axis]) / speed[axis]); }
+                else if (speed[axis] < 0.0f) { skip = (std::min)(skip, (lo - coord[axis]) / speed[axis]); }
+            }
+            return clamp(skip, 0.0f, kOccupancyMaxSkip);
+        }
+        return 0.0f;
+    }
+
+    // per frame constants of the march: the camera basis of Camera::UpdateBuffer, the sun and the ambient
+    struct FrameSetup {
+        float3 right;
+        float3 up;
+        float3 forward;
+        float tanX = 1.0f;
+        float tanY = 1.0f;
+        float depthRange = 0.0f; // _33 of the reversed projection
+        float3 sunDir;
+        float3 sunColor;
+        float3 ambient;
+    };
+
+    FrameSetup MakeFrameSetup(const CpuCloudRendererSettings& settings, const CpuCloudView& view) {
+        FrameSetup setup;
+
+        CpuCloudRenderer::CameraBasis(view, setup.forward, setup.right, setup.up);
+
+        const float aspect = static_cast<float>(settings.width_) / settings.height_;
+        setup.tanY = std::tan(settings.vFovDeg_ * (kPi / 180.0f) * 0.5f);
+        setup.tanX = setup.tanY * aspect;
+        // XMMatrixPerspectiveFovLH(fov, aspect, far_, near_), near and far swapped on purpose
+        setup.depthRange = settings.near_ / (settings.near_ - settings.far_);
+
+        // SUNDIR and SUNCOLOR of RayMarch
+        setup.sunDir = float3(view.lightDir_.x, -view.lightDir_.y, view.lightDir_.z);
+        setup.sunColor = CalculateSunlightColor(setup.sunDir);
+
+        // monteCarloAmbient(float3(0, 1, 0)): the seed never changes, every sample reads the
+        // irradiance cube map in the same direction
+        setup.ambient = CpuCloudRenderer::SkyIrradiance(view.eye_, normalize(RandomDirection(float3(0.0f, 1.0f, 0.0f))), view.lightDir_);
+        return setup;
+    }
+
+    // RayMarch of RayMarch.hlsl for one pixel
+    float4 MarchPixel(const DensityField& field, const CpuCloudSources& sources, const CpuCloudRendererSettings& settings, const FrameSetup& setup,
+        const float3& rayStart, const float3& rayDir, float jitter, float primDepthMeter, float& cloudDepth, uint64_t& steps, uint64_t& samples) {
+        cloudDepth = 0.0f;
+        const bool useOccupancy = settings.useOccupancy_ && sources.occupancy_ && !sources.occupancy_->mips_.empty();
+        const bool useSdf = settings.useSdf_ && sources.sdf_;
+        const bool useLightCache = settings.useLightCache_ && sources.shadowMap_;
+
+        float3 scattering(0.0f);
+        float transmittance = 1.0f;
+        float rayDistance = settings.inStart_ + jitter;
+        bool hit = false;
+
+        const float2 atmo = IntersectAtmo(rayStart, rayDir);
+        float rayEnd = (std::min)(primDepthMeter, atmo.y - atmo.x);
+        if (settings.inEnd_ > 0.0f) { rayEnd = (std::min)(rayEnd, settings.inEnd_); }
+
+        // no layer within reach of the view ray before rayEnd
+        if (settings.layerCull_ && DepthPyramid::Culled(field.Layers(), rayStart, rayDir, rayDistance, rayEnd)) {
+            return float4(0.0f);
+        }
+
+        adaptivestep::State adaptive;
+
+        const bool reference = settings.referenceStep_ > 0.0f;
+        const int maxStep = reference ? INT_MAX : settings.stepBudget_;
+        for (int i = 0; i < maxStep; i++) {
+            steps++;
+            const float3 rayPos = earthcurvature::CurvedRayPosition(rayStart, rayDir, rayDistance);
+
+            if (useOccupancy) {
+                const float skip = OccupancySkip(*sources.occupancy_, rayPos, earthcurvature::CurvedRayTangent(rayDir, rayDistance));
+                if (skip > 0.0f) {
+                    rayDistance += skip + kOccupancyNudge + jitter;
+                    adaptive = adaptivestep::State();
+                    if (rayDistance > rayEnd) { break; }
+                    continue;
+                }
+            }
+
+            float distance;
+            const float dense = field.Evaluate(rayPos, distance);
+            samples++;
+
+            const float2 p = IntersectAtmo(rayPos, rayDir);
+            const float misStep = (rayDistance < 10000.0f ? 50.0f : (p.y - p.x) / (settings.stepBudget_ - i))
+                * (settings.temporalJitter_ ? settings.temporal_.stepScale_ : 1.0f);
+            float advance = (std::max)(misStep, distance);
+            if (useSdf) { advance = (std::max)(advance, sources.sdf_->Distance(rayPos)); }
+            if (reference) {
+                advance = settings.referenceStep_;
+            }
+            else if (settings.adaptiveStep_) {
+                advance = adaptivestep::NextStep(settings.adaptive_, adaptive, dense, transmittance, rayDistance, advance);
+                if (advance < 0.0f) {
+                    rayDistance += advance;
+                    continue;
+                }
+            }
+            rayDistance += advance;
+
+            if (rayDistance > rayEnd) { break; }
+            if (dense <= 0.0f) { continue; }
+
+            if (!hit) {
+                const float viewZ = dot(rayPos - rayStart, setup.forward);
+                cloudDepth = setup.depthRange * (viewZ - settings.far_) / viewZ;
+                hit = true;
+            }
+
+            const float stepTransmittance = std::exp(-(std::max)(dense, 0.0f) * advance);
+
+            float lightVisibility = 1.0f;
+            float shadowDepth = -1.0f;
+            if (useLightCache) {
+                shadowDepth = sources.shadowMap_->SegmentDepth(rayPos, kLightMarchSize);
+            }
+            if (shadowDepth >= 0.0f) {
+                lightVisibility = std::exp(-shadowDepth);
+            }
+            else {
+                // trapezoid light march
+                const float stepLength = kLightMarchSize / settings.sunSteps_;
+                float previousDensity = dense;
+                samples += settings.sunSteps_;
+                for (int s = 1; s <= settings.sunSteps_; s++) {
+                    const float dense2 = field.Evaluate(rayPos + setup.sunDir * (stepLength * s));
+                    const float averageDensity = (previousDensity + dense2) * 0.5f;
+                    lightVisibility *= std::exp(-(std::max)(averageDensity, 0.0f) * stepLength);
+                    previousDensity = dense2;
+                }
+            }
+
+            scattering += setup.sunColor * (lightVisibility * (1.0f - stepTransmittance) * transmittance);
+            transmittance *= stepTransmittance;
+            if (transmittance < 0.03f) {
+                transmittance = 0.0f;
+                break;
+            }
+        }
+
+        scattering += setup.ambient * (1.0f - transmittance);
+        return float4(scattering.x, scattering.y, scattering.z, 1.0f - transmittance);
+    }
+
+    bool WritePfm(const std::string& path, int width, int height, int channels, const std::vector<float>& rowsTopDown) {
+        std::ofstream file(path, std::ios::binary);
+        if (!file) {
+            std::cerr << "CpuCloudRenderer: cannot write " << path << std::endl;
+            return false;
+        }
+        // negative scale for little endian, rows bottom up
+        file << (channels == 3 ? "PF" : "Pf") << "\n" << width << " " << height << "\n-1.0\n";
+        const size_t rowFloats = static_cast<size_t>(width) * channels;
+        for (int y = height - 1; y >= 0; y--) {
+            file.write(reinterpret_cast<const char*>(rowsTopDown.data() + rowFloats * y), rowFloats * sizeof(float));
+        }
+        return static_cast<bool>(file);
+    }
+
+} // namespace
+
+bool CpuCloudRenderer::Initialize(const Settings& settings) {
+    if (settings.width_ <= 0 || settings.height_ <= 0 || settings.tileSize_ <= 0 || settings.sunSteps_ <= 0
+        || settings.near_ <= 0.0f || settings.far_ <= settings.near_ || settings.vFovDeg_ <= 0.0f || settings.vFovDeg_ >= 180.0f) {
+        std::cerr << "CpuCloudRenderer: " << settings.width_ << "x" << settings.height_ << " in tiles of " << settings.tileSize_
+            << ", fov " << settings.vFovDeg_ << ", depth " << settings.near_ << " to " << settings.far_ << std::endl;
+        return false;
+    }
+    settings_ = settings;
+    return true;
+}
+
+bool CpuCloudRenderer::Render(const DensityField& field, const View& view, CpuCloudFrame& frame, const Sources& sources, ThreadPool& pool) const {
+    if (!field.Ready()) {
+        std::cerr << "CpuCloudRenderer: Render before the density field is ready" << std::endl;
+        return false;
+    }
+
+    using clock = std::chrono::steady_clock;
+    const clock::time_point frameStart = clock::now();
+
+    const int width = settings_.width_;
+    const int height = settings_.height_;
+    const int tile = settings_.tileSize_;
+    frame.width_ = width;
+    frame.height_ = height;
+    frame.tilesX_ = (width + tile - 1) / tile;
+    frame.tilesY_ = (height + tile - 1) / tile;
+    frame.color_.assign(static_cast<size_t>(width) * height, float4(0.0f));
+    frame.depth_.assign(static_cast<size_t>(width) * height, 0.0f);
+    frame.tileMs_.assign(static_cast<size_t>(frame.tilesX_) * frame.tilesY_, 0.0f);
+    std::vector<uint64_t> tileSteps(frame.tileMs_.size(), 0);
+    std::vector<uint64_t> tileSamples(frame.tileMs_.size(), 0);
+    std::vector<uint64_t> tileCulled(frame.tileMs_.size(), 0);
+    frame.threads_ = pool.ThreadCount();
+
+    const FrameSetup setup = MakeFrameSetup(settings_, view);
+
+    // DepthToMeter, R = near / (near - far)
+    const float range = settings_.near_ / (settings_.near_ - settings_.far_);
+
+    // TemporalPixelJitter of StartRayMarch
+    const float2 pixelCenter = settings_.temporalJitter_ ? temporalreprojection::PixelJitter(settings_.jitterFrame_) : settings_.pixelCenter_;
+    pool.ParallelFor(0, frame.tilesX_ * frame.tilesY_, [&](int t) {
+        const clock::time_point tileStart = clock::now();
+        const int x0 = (t % frame.tilesX_) * tile;
+        const int y0 = (t / frame.tilesX_) * tile;
+        const int x1 = (std::min)(x0 + tile, width);
+        const int y1 = (std::min)(y0 + tile, height);
+        for (int y = y0; y < y1; y++) {
+            for (int x = x0; x < x1; x++) {
+                const size_t i = static_cast<size_t>(y) * width + x;
+                const float u = (x + pixelCenter.x) / width, v = (y + pixelCenter.y) / height;
+
+                // primDepth of StartRayMarch: the farthest primitive the pixel covers, the ray then
+                // crossing the centre of its texels, or the farthest of the pixel and its four
+                // neighbours. the far plane on the cleared depth target
+                float2 rayPos(u, v);
+                float primDepthMeter = settings_.far_;
+                if (sources.primitive_) {
+                    const float du = 1.0f / width, dv = 1.0f / height;
+                    const CpuCloudFrame& depth = *sources.primitive_;
+                    const float primDepth = !settings_.primitiveFootprint_ ? FootprintFarthest(depth, u, v, width, height, &rayPos)
+                        : (std::min)({ SampleDepth(depth, u, v), SampleDepth(depth, u + du, v), SampleDepth(depth, u - du, v),
+                            SampleDepth(depth, u, v + dv), SampleDepth(depth, u, v - dv) });
+                    primDepthMeter = -range * settings_.far_ / (primDepth - range);
+                }
+
+                // ray position in NDC, y up
+                const float ndcX = rayPos.x * 2.0f - 1.0f;
+                const float ndcY = 1.0f - rayPos.y * 2.0f;
+                const float3 rayDir = normalize(setup.forward + setup.right * (ndcX * setup.tanX) + setup.up * (ndcY * setup.tanY));
+
+                // TemporalJitter of StartRayMarch
+                const float jitter = settings_.temporalJitter_
+                    ? temporalreprojection::Jitter(x + 0.5f, y + 0.5f, settings_.jitterFrame_) * settings_.temporal_.jitterLength_ : 0.0f;
+
+                // DepthPyramidCulled of StartRayMarch: no layer within reach before the farthest
+                // primitive of the tile, the pixel stays empty
+                if (sources.depthPyramid_ && settings_.useDepthPyramid_ && !settings_.primitiveFootprint_) {
+                    const float farthest = sources.depthPyramid_->TileFarthest(u, v);
+                    if (farthest > 0.0f && DepthPyramid::Culled(field.Layers(), view.eye_, rayDir, settings_.inStart_,
+                            -range * settings_.far_ / (farthest - range) / dot(rayDir, setup.forward))) {
+                        tileCulled[t]++;
+                        continue;
+                    }
+                }
+
+                // a march takes one step at least, none when it returned at the layer check
+                const uint64_t steps = tileSteps[t];
+                frame.color_[i] = MarchPixel(field, sources, settings_, setup, view.eye_, rayDir, jitter, primDepthMeter, frame.depth_[i], tileSteps[t], tileSamples[t]);
+                if (tileSteps[t] == steps) { tileCulled[t]++; }
+            }
+        }
+        frame.tileMs_[t] = std::chrono::duration<float, std::milli>(clock::now() - tileStart).count();
+    });
+
+    frame.marchSteps_ = 0;
+    frame.densitySamples_ = 0;
+    frame.culledPixels_ = 0;
+    for (size_t t = 0; t < tileSteps.size(); t++) {
+        frame.marchSteps_ += tileSteps[t];
+        frame.densitySamples_ += tileSamples[t];
+        frame.culledPixels_ += tileCulled[t];
+    }
+    frame.totalMs_ = std::chrono::duration<float, std::milli>(clock::now() - frameStart).count();
+    return true;
+}
+
+uint64_t CpuCloudRenderer::March(const DensityField& field, const View& view, const std::vector<float3>& dirs,
+    std::vector<float4>& color, const Sources& sources, ThreadPool& pool) const {
+    color.assign(dirs.size(), float4(0.0f));
+    if (!field.Ready()) {
+        std::cerr << "CpuCloudRenderer: March before the density field is ready" << std::endl;
+        return 0;
+    }
+
+    const FrameSetup setup = MakeFrameSetup(settings_, view);
+
+    // tileSize_ x tileSize_ rays per item, like the tiles of Render
+    const int chunk = settings_.tileSize_ * settings_.tileSize_;
+    const int chunks = static_cast<int>((dirs.size() + chunk - 1) / chunk);
+    std::vector<uint64_t> chunkSteps(chunks, 0);
+    pool.ParallelFor(0, chunks, [&](int c) {
+        const size_t end = (std::min)(dirs.size(), static_cast<size_t>(c + 1) * chunk);
+        uint64_t samples = 0;
+        for (size_t i = static_cast<size_t>(c) * chunk; i < end; i++) {
+            float cloudDepth;
+            color[i] = MarchPixel(field, sources, settings_, setup, view.eye_, normalize(dirs[i]), 0.0f, settings_.far_, cloudDepth, chunkSteps[c], samples);
+        }
+    });
+
+    uint64_t steps = 0;
+    for (const uint64_t s : chunkSteps) { steps += s; }
+    return steps;
+}
+
+float CpuCloudRenderer::FootprintFarthest(const CpuCloudFrame& depth, float u, float v, int width, int height, float2* centroid) {
+    // depth texel centres inside [u - 0.5 / width, u + 0.5 / width) and the same along v
+    const int x0 = static_cast<int>(std::ceil((u - 0.5f / width) * depth.width_ - 0.5f));
+    const int x1 = static_cast<int>(std::ceil((u + 0.5f / width) * depth.width_ - 0.5f)) - 1;
+    const int y0 = static_cast<int>(std::ceil((v - 0.5f / height) * depth.height_ - 0.5f));
+    const int y1 = static_cast<int>(std::ceil((v + 0.5f / height) * depth.height_ - 0.5f)) - 1;
+    if (centroid) { *centroid = float2(u, v); }
+    if (x1 < x0 || y1 < y0) {
+        return SampleDepth(depth, u, v);
+    }
+    float farthest = FLT_MAX;
+    float2 sum(0.0f);
+    int count = 0;
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            // depthSampler wraps
+            const int wx = ((x % depth.width_) + depth.width_) % depth.width_;
+            const int wy = ((y % depth.height_) + depth.height_) % depth.height_;
+            const float d = depth.depth_[static_cast<size_t>(wy) * depth.width_ + wx];
+            if (d < farthest) { farthest = d; sum = float2(0.0f); count = 0; }
+            if (d == farthest) { sum += float2(x + 0.5f, y + 0.5f); count++; }
+        }
+    }
+    // the ray moves only where the footprint straddles a depth edge
+    if (centroid && count < (x1 - x0 + 1) * (y1 - y0 + 1)) {
+        *centroid = sum / static_cast<float>(count) / float2(static_cast<float>(depth.width_), static_cast<float>(depth.height_));
+    }
+    return farthest;
+}
+
+void CpuCloudRenderer::CameraBasis(const View& view, float3& forward, float3& right, float3& up) {
+    // Forward, Right and Up of Camera::UpdateBuffer, then the axes of XMMatrixLookAtLH
+    forward = normalize(view.lookAt_ - view.eye_);
+    float3 worldUp(0.0f, 1.0f, 0.0f);
+    if (forward.x == 0.0f && forward.z == 0.0f) { worldUp = float3(0.0f, 0.0f, 1.0f); }
+    const float3 cameraRight = normalize(cross(forward, worldUp));
+    const float3 cameraUp = cross(forward, cameraRight);
+    right = normalize(cross(cameraUp, forward));
+    up = cross(forward, right);
+}
+
+float3 CpuCloudRenderer::SkyColor(const float3& eye, const float3& dir, const float3& lightDir) {
+    // SkyRay flips the ray into its y up frame and puts the camera on the planet
+    const float3 rd(dir.x, -dir.y, dir.z);
+    const float3 ro(0.0f, kEarthRadius - eye.y, 0.0f);
+    const float4 scene = RenderScene(ro, rd, lightDir);
+    const float3 col = CalculateScattering(ro, rd, scene.w, float3(scene.x, scene.y, scene.z), lightDir, 32, 8);
+    return float3(1.0f) - Exp(-col);
+}
+
+float3 CpuCloudRenderer::SkyIrradiance(const float3& eye, const float3& normal, const float3& lightDir) {
+    const int sampleCount = 64;
+    const float3 up = std::fabs(normal.y) < 0.999f ? float3(0.0f, 1.0f, 0.0f) : float3(1.0f, 0.0f, 0.0f);
+    const float3 tangent = normalize(cross(up, normal));
+    const float3 bitangent = cross(normal, tangent);
+
+    float3 irradiance(0.0f);
+    for (int i = 0; i < sampleCount; i++) {
+        // ImportanceSampleHemisphere
+        const float phi = 2.0f * kPi * (static_cast<float>(i) / sampleCount);
+        const float cosTheta = std::sqrt(1.0f - static_cast<float>(i) / sampleCount);
+        const float sinTheta = std::sqrt(1.0f - cosTheta * cosTheta);
+        const float3 sampleDir = normalize(tangent * (std::cos(phi) * sinTheta) + bitangent * (std::sin(phi) * sinTheta) + normal * cosTheta);
+        irradiance += SkyColor(eye, sampleDir, lightDir) * dot(normal, sampleDir);
+    }
+    return irradiance / static_cast<float>(sampleCount);
+}
+
+bool CpuCloudRenderer::WriteColorPfm(const CpuCloudFrame& frame, const std::string& path) {
+    std::vector<float> rgb;
+    rgb.reserve(frame.color_.size() * 3);
+    for (const float4& c : frame.color_) {
+        rgb.push_back(c.x);
+        rgb.push_back(c.y);
+        rgb.push_back(c.z);
+    }
+    return WritePfm(path, frame.width_, frame.height_, 3, rgb);
+}
+
+bool CpuCloudRenderer::WriteDepthPfm(const CpuCloudFrame& frame, const std::string& path) {
+    return WritePfm(path, frame.width_, frame.height_, 1, frame.depth_);
+}
+
+std::string CpuCloudRenderer::Benchmark(const DensityField& field, const Settings& settings, const View& view, const Sources& sources, unsigned maxThreads) {
+    std::ostringstream ss;
+    CpuCloudRenderer renderer;
+    if (!field.Ready() || !renderer.Initialize(settings)) {
+        ss << "cpu cloud renderer: field not ready or invalid settings\n";
+        return ss.str();
+    }
+    if (maxThreads == 0) { maxThreads = (std::max)(1u, std::thread::hardware_concurrency()); }
+
+    std::vector<unsigned> counts;
+    for (unsigned n = 1; n < maxThreads; n *= 2) { counts.push_back(n); }
+    counts.push_back(maxThreads);
+
+    ss << "cpu cloud renderer " << settings.width_ << "x" << settings.height_ << " in " << settings.tileSize_ << " px tiles, "
+       << settings.sunSteps_ << " sun steps, occupancy " << (sources.occupancy_ ? "on" : "off") << ", sdf " << (sources.sdf_ ? "on" : "off")
+       << ", shadow map " << (sources.shadowMap_ ? "on" : "off") << "\n";
+    ss << "  threads  frame ms  tile min  tile mean  tile max  speedup  efficiency  image\n";
+
+    CpuCloudFrame reference;
+    bool pass = true;
+    for (const unsigned n : counts) {
+        ThreadPool pool(n - 1);
+        CpuCloudFrame frame;
+        renderer.Render(field, view, frame, sources, pool);
+        if (n == counts.front()) {
+            reference = frame;
+
+            size_t covered = 0;
+            for (const float4& c : frame.color_) { covered += c.w > 0.0f; }
+            ss << "  (" << 100.0 * covered / frame.color_.size() << "% of the pixels hold cloud)\n";
+        }
+
+        float tileMin = frame.tileMs_.front(), tileMax = 0.0f;
+        double tileSum = 0.0;
+        for (const float ms : frame.tileMs_) {
+            tileMin = (std::min)(tileMin, ms);
+            tileMax = (std::max)(tileMax, ms);
+            tileSum += ms;
+        }
+
+        // bit exact, the pixels do not depend on which thread drew them
+        const bool same = std::equal(frame.color_.begin(), frame.color_.end(), reference.color_.begin(),
+            [](const float4& a, const float4& b) { return a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w; })
+            && frame.depth_ == reference.depth_;
+        pass = pass && same;
+
+        const double speedup = reference.totalMs_ / frame.totalMs_;
+        ss << std::fixed << std::setprecision(2)
+           << "  " << std::setw(7) << n << std::setw(10) << frame.totalMs_ << std::setw(10) << tileMin
+           << std::setw(11) << tileSum / frame.tileMs_.size() << std::setw(10) << tileMax
+           << std::setw(9) << speedup << std::setw(11) << 100.0 * speedup / n << "%"
+           << (same ? "  same\n" : "  DIFFERS\n");
+    }
+    ss << (pass ? "  PASS\n" : "  FAIL\n");
+    return ss.str();
+}
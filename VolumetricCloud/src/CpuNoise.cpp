@@ -0,0 +1,484 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "../includes/CpuNoise.h"
+
+namespace cpunoise {
+
+uint32_t hash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+namespace {
+
+    // floor(p) of a periodic noise less whole periods, the shaders take them off before the %
+    int WrapCell(float fl, int frequency) {
+        return toint(fl) - frequency * toint(std::floor(fl / (float)frequency));
+    }
+
+} // namespace
+
+float hashToFloat(uint32_t x) {
+    return (x & 0x00FFFFFF) / 16777216.0f;
+}
+
+uint32_t hash3(uint3 p) {
+    return hash(p.x ^ hash(p.y ^ hash(p.z)));
+}
+
+uint32_t hash4(uint4 p) {
+    return hash(p.x ^ hash(p.y ^ hash(p.z ^ hash(p.w))));
+}
+
+float hash01(uint32_t x) {
+    return (x & 0x00FFFFFF) / 16777216.0f;
+}
+
+float fade(float t) {
+    return t * t * t * (t * (t * 6 - 15) + 10);
+}
+
+float4 grad4(uint4 p) {
+    const float h1 = hash01(hash4(p));
+    const float h2 = hash01(hash4(uint4(p.x + 11, p.y + 11, p.z + 11, p.w + 11)));
+
+    const float a = h1 * TWO_PI;
+    const float b = h2 * TWO_PI;
+
+    // the third hash in the shader (h3) only feeds an unused variable
+    float4 g;
+    g.x = std::cos(a);
+    g.y = std::sin(a);
+    g.z = std::cos(b);
+    g.w = std::sin(b);
+
+    return normalize(g);
+}
+
+float Perlin4D(float4 p) {
+    const float4 fl = floor(p);
+    const int4 i0(toint(fl.x), toint(fl.y), toint(fl.z), toint(fl.w));
+    const int4 i1(i0.x + 1, i0.y + 1, i0.z + 1, i0.w + 1);
+
+    const float4 f = frac(p);
+    const float4 u = fade(f);
+
+    auto corner = [&](int cx, int cy, int cz, int cw) {
+        const uint4 c(
+            touint(cx ? i1.x : i0.x),
+            touint(cy ? i1.y : i0.y),
+            touint(cz ? i1.z : i0.z),
+            touint(cw ? i1.w : i0.w));
+        return dot(grad4(c), f - float4((float)cx, (float)cy, (float)cz, (float)cw));
+    };
+
+    const float n0000 = corner(0, 0, 0, 0);
+    const float n1000 = corner(1, 0, 0, 0);
+    const float n0100 = corner(0, 1, 0, 0);
+    const float n1100 = corner(1, 1, 0, 0);
+
+    const float n0010 = corner(0, 0, 1, 0);
+    const float n1010 = corner(1, 0, 1, 0);
+    const float n0110 = corner(0, 1, 1, 0);
+    const float n1110 = corner(1, 1, 1, 0);
+
+    const float n0001 = corner(0, 0, 0, 1);
+    const float n1001 = corner(1, 0, 0, 1);
+    const float n0101 = corner(0, 1, 0, 1);
+    const float n1101 = corner(1, 1, 0, 1);
+
+    const float n0011 = corner(0, 0, 1, 1);
+    const float n1011 = corner(1, 0, 1, 1);
+    const float n0111 = corner(0, 1, 1, 1);
+    const float n1111 = corner(1, 1, 1, 1);
+
+    const float nx000 = lerp(n0000, n1000, u.x);
+    const float nx100 = lerp(n0100, n1100, u.x);
+    const float nx010 = lerp(n0010, n1010, u.x);
+    const float nx110 = lerp(n0110, n1110, u.x);
+
+    const float nx001 = lerp(n0001, n1001, u.x);
+    const float nx101 = lerp(n0101, n1101, u.x);
+    const float nx011 = lerp(n0011, n1011, u.x);
+    const float nx111 = lerp(n0111, n1111, u.x);
+
+    const float nxy00 = lerp(nx000, nx100, u.y);
+    const float nxy10 = lerp(nx010, nx110, u.y);
+    const float nxy01 = lerp(nx001, nx101, u.y);
+    const float nxy11 = lerp(nx011, nx111, u.y);
+
+    const float nxyz0 = lerp(nxy00, nxy10, u.z);
+    const float nxyz1 = lerp(nxy01, nxy11, u.z);
+
+    return lerp(nxyz0, nxyz1, u.w) * 0.5f + 0.5f;
+}
+
+float PerlinPeriodic(float3 p, int frequency) {
+    const float3 a = p * (float)frequency * TWO_PI;
+
+    float4 p4;
+    p4.x = std::cos(a.x);
+    p4.y = std::sin(a.x);
+    p4.z = std::cos(a.y);
+    p4.w = std::sin(a.y);
+
+    const float n1 = Perlin4D(p4 + float4(0, 0, std::cos(a.z), std::sin(a.z)));
+    const float n2 = Perlin4D(p4 + float4(0, 0, std::cos(a.z + 1.7f), std::sin(a.z + 1.7f)));
+
+    return 1.0f - (n1 + n2) * 0.5f;
+}
+
+float PerlinPeriodicLoop(float3 p, int frequency, float loopTime) {
+    const float3 a = p * (float)frequency * TWO_PI;
+    const float t = loopTime * TWO_PI;
+
+    // same torus embedding as PerlinPeriodic, then walk a circle in the x/y plane of
+    // the 4D domain so loopTime = 0 and loopTime = 1 land on the same point.
+    const float4 loop = float4(std::cos(t), std::sin(t), 0, 0) * 0.75f;
+
+    float4 p4;
+    p4.x = std::cos(a.x);
+    p4.y = std::sin(a.x);
+    p4.z = std::cos(a.y);
+    p4.w = std::sin(a.y);
+    p4 = p4 + loop;
+
+    const float n1 = Perlin4D(p4 + float4(0, 0, std::cos(a.z), std::sin(a.z)));
+    const float n2 = Perlin4D(p4 + float4(0, 0, std::cos(a.z + 1.7f), std::sin(a.z + 1.7f)));
+
+    return 1.0f - (n1 + n2) * 0.5f;
+}
+
+float WorleyPeriodic(float3 p, int frequency) {
+    p = p * (float)frequency;
+
+    const float3 fl = floor(p);
+    const int3 cell(WrapCell(fl.x, frequency), WrapCell(fl.y, frequency), WrapCell(fl.z, frequency));
+    const float3 f = frac(p);
+
+    float minDist = 1e6f;
+
+    for (int z = -1; z <= 1; z++)
+    for (int y = -1; y <= 1; y++)
+    for (int x = -1; x <= 1; x++) {
+        const uint3 cu(
+            touint((cell.x + x + frequency) % frequency),
+            touint((cell.y + y + frequency) % frequency),
+            touint((cell.z + z + frequency) % frequency));
+
+        const float3 rand(
+            hashToFloat(hash3(uint3(cu.x + 1, cu.y + 1, cu.z + 1))),
+            hashToFloat(hash3(uint3(cu.x + 2, cu.y + 2, cu.z + 2))),
+            hashToFloat(hash3(uint3(cu.x + 3, cu.y + 3, cu.z + 3))));
+
+        const float3 d = float3((float)x, (float)y, (float)z) + rand - f;
+        minDist = std::min(minDist, dot(d, d));
+    }
+
+    return 1.0f - std::sqrt(minDist);
+}
+
+// Hash functions by Dave_Hoskins
+#define UI0 1597334673U
+#define UI1 3812015801U
+#define UI2 2798796415U
+#define UIF (1.0f / 4294967296.0f)
+
+float3 hash33(float3 p) {
+    uint32_t qx = touint(toint(p.x)) * UI0;
+    uint32_t qy = touint(toint(p.y)) * UI1;
+    uint32_t qz = touint(toint(p.z)) * UI2;
+    const uint32_t n = qx ^ qy ^ qz;
+    qx = n * UI0;
+    qy = n * UI1;
+    qz = n * UI2;
+    return float3(-1.0f + 2.0f * (float)qx * UIF, -1.0f + 2.0f * (float)qy * UIF, -1.0f + 2.0f * (float)qz * UIF);
+}
+
+float hash13(float3 p) {
+    uint32_t qx = touint(toint(p.x)) * UI0;
+    uint32_t qy = touint(toint(p.y)) * UI1;
+    uint32_t qz = touint(toint(p.z)) * UI2;
+    qx *= UI0;
+    qy *= UI1;
+    qz *= UI2;
+    const uint32_t n = (qx ^ qy ^ qz) * UI0;
+    return (float)n * UIF;
+}
+
+float valueNoise(float3 x, float freq) {
+    const float3 i = floor(x);
+    float3 f = frac(x);
+    f = f * f * (3.0f - 2.0f * f);
+
+    auto h = [&](float ox, float oy, float oz) {
+        return hash13(fmod(i + float3(ox, oy, oz), float3(freq)));
+    };
+
+    return lerp(lerp(lerp(h(0, 0, 0), h(1, 0, 0), f.x),
+                     lerp(h(0, 1, 0), h(1, 1, 0), f.x), f.y),
+                lerp(lerp(h(0, 0, 1), h(1, 0, 1), f.x),
+                     lerp(h(0, 1, 1), h(1, 1, 1), f.x), f.y), f.z);
+}
+
+// Fbm for Perlin noise based on iq's blog
+float perlinFbm(float3 p, float freq, int octaves) {
+    const float G = 0.5f;
+    float amp = 1.0f;
+    float noise = 0.0f;
+    for (int i = 0; i < octaves; ++i) {
+        noise += amp * valueNoise(p * freq, freq);
+        freq *= 2.0f;
+        amp *= G;
+    }
+    return noise;
+}
+
+// Tileable Worley fbm inspired by Andrew Schneider's Real-Time Volumetric Cloudscapes
+// chapter in GPU Pro 7.
+float worleyFbm(float3 p, float freq, bool /*tileable*/) {
+    // always tileable like the shader, the shader passes the float frequency into an int parameter
+    const int f = static_cast<int>(freq);
+    const float fbm = WorleyPeriodic(p, f) * 0.75f +
+                      WorleyPeriodic(p * 2.0f, f) * 0.25f +
+                      WorleyPeriodic(p * 4.0f, f) * 0.125f;
+    return std::max(0.0f, fbm) * 1.5f;
+}
+
+// Blue noise generation using a simplified void-and-cluster approach
+float blueNoise(float3 p, float freq) {
+    const float3 ip = floor(p * freq);
+    const float3 fp = frac(p * freq);
+
+    // Random offset based on position
+    const float3 offset = hash33(ip);
+
+    // Void and cluster distribution
+    float noise = 0.0f;
+    float w = 1.0f;
+
+    for (int i = -1; i <= 1; i++) {
+        for (int j = -1; j <= 1; j++) {
+            for (int k = -1; k <= 1; k++) {
+                const float3 pos = float3((float)i, (float)j, (float)k) - fp;
+                const float3 cellOffset = hash33(ip + float3((float)i, (float)j, (float)k));
+
+                // Distance-based weighting
+                const float dist = length(pos + (cellOffset - offset));
+                const float weight = std::exp(-4.0f * dist * dist);
+
+                noise += weight;
+                w += weight;
+            }
+        }
+    }
+
+    // Normalize and invert for blue noise characteristic
+    return 1.0f - (noise / w);
+}
+
+#undef UI0
+#undef UI1
+#undef UI2
+#undef UIF
+
+// ------------------------------------------------------------
+// Alligator Noise, ported from Alligator.hlsl
+// ------------------------------------------------------------
+
+// 0-1 smoothstep
+float SmoothValue(float x) {
+    x = saturate(x);
+    return x * x * (3.0f - 2.0f * x);
+}
+
+// Simple deterministic hash: float3 -> float
+float Hash13(float3 p) {
+    p = frac(p * 0.1031f);
+    p += dot(p, float3(p.y, p.z, p.x) + 33.33f);
+    return frac((p.x + p.y) * p.z);
+}
+
+// Simple deterministic hash: float3 -> float3
+float3 Hash33(float3 p) {
+    p = frac(p * float3(0.1031f, 0.1030f, 0.0973f));
+    p += dot(p, float3(p.y, p.x, p.z) + 33.33f);
+    return frac((float3(p.x, p.x, p.y) + float3(p.y, p.x, p.x)) * float3(p.z, p.y, p.x));
+}
+
+// Single octave Alligator Noise
+float AlligatorNoiseSingle(float3 position, uint32_t gridsize, uint3 seed, bool tiling) {
+    const float fGridSize = (float)gridsize;
+
+    // Scale into grid space
+    position = position * fGridSize;
+
+    const float3 id = floor(position);
+    const float3 grid = position - id;
+
+    float densest = 0.0f;
+    float secondDensest = 0.0f;
+
+    // Compare with 3x3x3 neighbor cells
+    for (int ix = -1; ix <= 1; ++ix) {
+        for (int iy = -1; iy <= 1; ++iy) {
+            for (int iz = -1; iz <= 1; ++iz) {
+                const float3 offset((float)ix, (float)iy, (float)iz);
+                float3 cell = id + offset;
+
+                if (tiling) {
+                    // Repeat in 0-1 domain, fmod keeps the sign of the dividend
+                    cell = fmod(cell, float3(fGridSize));
+                    for (int c = 0; c < 3; c++) {
+                        if (cell[c] < 0.0f) { cell[c] += fGridSize; }
+                    }
+                }
+
+                // Hash dislikes zero-ish coordinates, so add seed
+                cell += float3((float)seed.x, (float)seed.y, (float)seed.z);
+
+                // Random feature point inside neighbor cell
+                const float3 center = Hash33(cell) + offset;
+
+                const float dist = distance(grid, center);
+
+                const float density = Hash13(cell) * SmoothValue(1.0f - dist);
+
+                if (density > densest) {
+                    secondDensest = densest;
+                    densest = density;
+                }
+                else if (density > secondDensest) {
+                    secondDensest = density;
+                }
+            }
+        }
+    }
+
+    return densest - secondDensest;
+}
+
+// Fractal/octaved Alligator Noise
+float AlligatorNoise(float3 position, float gridsize, int octaves, float lacunarity, float persistence, bool tiling, uint3 seed) {
+    float amplitude = 1.0f;
+    float amplitudeSum = 0.0f;
+    float result = 0.0f;
+
+    for (int i = 0; i < octaves; ++i) {
+        const uint32_t gridU = std::max(1u, (uint32_t)gridsize);
+
+        result += AlligatorNoiseSingle(position, gridU, seed, tiling) * amplitude;
+
+        amplitudeSum += amplitude;
+
+        gridsize *= lacunarity;
+        amplitude *= persistence;
+
+        seed = uint3(seed.x + (uint32_t)gridsize, seed.y + (uint32_t)gridsize, seed.z + (uint32_t)gridsize);
+    }
+
+    return result / std::max(amplitudeSum, 1e-5f);
+}
+
+// Convenience version
+float AlligatorNoiseDefault(float3 position) {
+    return AlligatorNoise(position, 8.0f, 5, ALLIGATOR_LACUNARITY, ALLIGATOR_PERSISTENCE, true);
+}
+
+// ------------------------------------------------------------
+// ported from FBM2.hlsl
+// ------------------------------------------------------------
+
+float PerlinWorleyPeriodic(float3 p, int frequency) {
+    // the shader samples the perlin part at frequency 1
+    const float pNoise = PerlinPeriodic(p) * 1.5f;
+    const float wNoise = WorleyPeriodic(p, frequency);
+
+    return Remap(pNoise, 1.0f - wNoise, 1.0f, 0.0f, 1.0f);
+}
+
+float WorleyF2MinusF1(float3 p, int frequency) {
+    p = p * (float)frequency;
+
+    const float3 fl = floor(p);
+    const int3 cell(WrapCell(fl.x, frequency), WrapCell(fl.y, frequency), WrapCell(fl.z, frequency));
+    const float3 f = frac(p);
+
+    float d1 = 1e6f;
+    float d2 = 1e6f;
+
+    for (int z = -1; z <= 1; z++)
+    for (int y = -1; y <= 1; y++)
+    for (int x = -1; x <= 1; x++) {
+        const uint3 cu(
+            touint((cell.x + x + frequency) % frequency),
+            touint((cell.y + y + frequency) % frequency),
+            touint((cell.z + z + frequency) % frequency));
+
+        const float3 rand(
+            hashToFloat(hash3(uint3(cu.x + 1, cu.y + 1, cu.z + 1))),
+            hashToFloat(hash3(uint3(cu.x + 2, cu.y + 2, cu.z + 2))),
+            hashToFloat(hash3(uint3(cu.x + 3, cu.y + 3, cu.z + 3))));
+
+        const float3 d = float3((float)x, (float)y, (float)z) + rand - f;
+        const float dist = dot(d, d);
+
+        if (dist < d1) {
+            d2 = d1;
+            d1 = dist;
+        }
+        else if (dist < d2) {
+            d2 = dist;
+        }
+    }
+
+    return std::sqrt(d2) - std::sqrt(d1);
+}
+
+float AlligatorPeriodic(float3 p, int frequency) {
+    // 1. Domain Warp (Perlin)
+    const float warpAmp = 0.35f;
+
+    float3 warp;
+    warp.x = PerlinPeriodic(p + float3(12.3f, 45.1f, 78.9f), frequency);
+    warp.y = PerlinPeriodic(p + float3(98.2f, 11.7f, 3.4f), frequency);
+    warp.z = PerlinPeriodic(p + float3(7.1f, 63.5f, 29.8f), frequency);
+
+    warp = warp * 2.0f - 1.0f;   // [-1,1]
+    const float3 pw = p + warp * warpAmp;
+
+    // 2. Low Frequency Cells
+    const float f1 = WorleyPeriodic(pw, frequency);
+    float edge = WorleyF2MinusF1(pw, frequency);
+
+    // cell body
+    float cells = saturate(f1);
+    cells = smoothstep(0.25f, 0.85f, cells);
+
+    // cell seams (edges)
+    edge = saturate(edge * 2.0f);
+    edge = std::pow(edge, 1.4f);
+
+    const float base = lerp(cells, edge, 0.65f);
+
+    // 3. High Frequency Detail, the shader passes the float into an int parameter
+    const int detailFreq = frequency * 3;
+    const float d1 = WorleyPeriodic(pw, detailFreq);
+    const float d2 = WorleyF2MinusF1(pw, detailFreq);
+
+    float detail = saturate(lerp(d1, d2, 0.5f));
+    detail = smoothstep(0.3f, 0.7f, detail);
+
+    // 4. Final Composition
+    const float result = base * (0.7f + 0.3f * detail);
+
+    return saturate(result);
+}
+
+} // namespace cpunoise
@@ -0,0 +1,572 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+
+#include "../includes/DensityClipmap.h"
+#include "../includes/DensityField.h"
+#include "../includes/DensityPacket.h"
+
+using namespace hlsl;
+
+namespace {
+
+    DensityClipmap::Rect Intersect(const DensityClipmap::Rect& a, const DensityClipmap::Rect& b) {
+        return { (std::max)(a.x0_, b.x0_), (std::max)(a.z0_, b.z0_), (std::min)(a.x1_, b.x1_), (std::min)(a.z1_, b.z1_) };
+    }
+
+    bool Contains(const DensityClipmap::Rect& outer, const DensityClipmap::Rect& inner) {
+        return inner.Empty() || (inner.x0_ >= outer.x0_ && inner.z0_ >= outer.z0_ && inner.x1_ <= outer.x1_ && inner.z1_ <= outer.z1_);
+    }
+
+    constexpr int kSkipLattice = DENSITY_CLIPMAP_SKIP_LATTICE;
+
+    // UNORM16 round trip
+    float QuantizeUnorm16(float v) {
+        return std::floor(saturate(v) * 65535.0f + 0.5f) / 65535.0f;
+    }
+
+} // namespace
+
+bool DensityClipmap::Initialize(const Settings& settings) {
+    if (settings.levels_ < 1 || settings.levels_ > DENSITY_CLIPMAP_LEVELS_MAX || settings.resolution_ < 4 || settings.resolution_ % 2 != 0
+        || settings.rows_ < 2 || settings.texelSize_ <= 0.0f || settings.altitudeMax_ <= settings.altitudeMin_ || settings.budgetTexels_ < 1) {
+        std::cerr << "DensityClipmap: " << settings.levels_ << " levels of " << settings.resolution_ << "x" << settings.resolution_ << "x" << settings.rows_
+            << ", texel " << settings.texelSize_ << " m, band " << settings.altitudeMin_ << " to " << settings.altitudeMax_ << " m" << std::endl;
+        return false;
+    }
+
+    settings_ = settings;
+    window_.assign(settings_.levels_, Rect());
+    valid_.assign(settings_.levels_, Rect());
+    regions_.clear();
+    sweepLevel_ = 0;
+    sweepColumn_ = 0;
+    texels_.assign(static_cast<size_t>(settings_.levels_) * settings_.rows_ * settings_.resolution_ * settings_.resolution_, 0.0f);
+    maxTexels_.assign(texels_.size(), 0.0f);
+    return true;
+}
+
+float2 DensityClipmap::AltitudeBand(std::span<const clouddensity::CloudLayerDesc> layers) {
+    if (layers.empty()) { return float2(0.0f, 0.0f); }
+    float2 band(layers[0].noise_.z, layers[0].noise_.w);
+    for (const clouddensity::CloudLayerDesc& layer : layers) {
+        band.x = (std::min)(band.x, layer.noise_.z);
+        band.y = (std::max)(band.y, layer.noise_.w);
+    }
+    return float2((std::max)(band.x, 0.0f), band.y);
+}
+
+const std::vector<DensityClipmap::Region>& DensityClipmap::Update(const float3& cameraPos) {
+    regions_.clear();
+    if (!Ready()) { return regions_; }
+
+    const int res = settings_.resolution_;
+    const int rows = settings_.rows_;
+
+    // slide the windows, the fresh rect keeps what is still inside
+    for (int l = 0; l < settings_.levels_; l++) {
+        const float ts = TexelSize(l);
+        const int x0 = static_cast<int>(std::floor(cameraPos.x / ts)) - res / 2;
+        const int z0 = static_cast<int>(std::floor(cameraPos.z / ts)) - res / 2;
+        window_[l] = { x0, z0, x0 + res, z0 + res };
+
+        Rect& valid = valid_[l];
+        valid = Intersect(valid, window_[l]);
+        // nothing left, grow a zero width rect along x over the whole window
+        if (valid.Empty()) { valid = { x0, z0, x0, z0 + res }; }
+    }
+
+    // stale strips next to the fresh rects, finest level first. x strips span the fresh z
+    // extent and z strips the whole window, so the fresh texels always form a rect
+    int budget = settings_.budgetTexels_;
+    bool spent = false;
+    for (int l = 0; l < settings_.levels_ && !spent; l++) {
+        Rect& valid = valid_[l];
+        const Rect& window = window_[l];
+        while (!(valid == window)) {
+            const bool alongX = valid.x0_ > window.x0_ || valid.x1_ < window.x1_;
+            const int length = alongX ? valid.z1_ - valid.z0_ : valid.x1_ - valid.x0_;
+            const int gap = alongX ? (valid.x0_ > window.x0_ ? valid.x0_ - window.x0_ : window.x1_ - valid.x1_)
+                : (valid.z0_ > window.z0_ ? valid.z0_ - window.z0_ : window.z1_ - valid.z1_);
+            int lines = budget > 0 ? (std::min)(gap, budget / (length * rows)) : 0;
+            if (lines == 0) {
+                // a budget below one strip still moves one strip per frame
+                if (!regions_.empty()) { spent = true; break; }
+                lines = 1;
+            }
+
+            Region region;
+            region.level_ = l;
+            if (alongX) {
+                region.z_ = valid.z0_;
+                region.sizeX_ = lines;
+                region.sizeZ_ = length;
+                if (valid.x0_ > window.x0_) {
+                    valid.x0_ -= lines;
+                    region.x_ = valid.x0_;
+                } else {
+                    region.x_ = valid.x1_;
+                    valid.x1_ += lines;
+                }
+            } else {
+                region.x_ = valid.x0_;
+                region.sizeX_ = length;
+                region.sizeZ_ = lines;
+                if (valid.z0_ > window.z0_) {
+                    valid.z0_ -= lines;
+                    region.z_ = valid.z0_;
+                } else {
+                    region.z_ = valid.z1_;
+                    valid.z1_ += lines;
+                }
+            }
+            regions_.push_back(region);
+            budget -= lines * length * rows;
+        }
+    }
+
+    // every window is fresh, re-evaluate whole columns round robin. the noise sequence
+    // moves the density, this bounds the age of a texel by the clipmap size over the budget
+    if (!spent && settings_.sweep_ && StaleTexels() == 0) {
+        const int columnTexels = res * rows;
+        int swept = 0;
+        while (budget >= columnTexels && swept < settings_.levels_ * res) {
+            const int lines = (std::min)(res - sweepColumn_, budget / columnTexels);
+            const Rect& window = window_[sweepLevel_];
+            regions_.push_back({ sweepLevel_, window.x0_ + sweepColumn_, window.z0_, lines, res });
+            budget -= lines * columnTexels;
+            swept += lines;
+            sweepColumn_ += lines;
+            if (sweepColumn_ >= res) {
+                sweepColumn_ = 0;
+                sweepLevel_ = (sweepLevel_ + 1) % settings_.levels_;
+            }
+        }
+    }
+    return regions_;
+}
+
+void DensityClipmap::Invalidate() {
+    for (Rect& valid : valid_) { valid = Rect(); }
+}
+
+int DensityClipmap::StaleTexels() const {
+    int stale = 0;
+    for (int l = 0; l < static_cast<int>(valid_.size()); l++) {
+        stale += (window_[l].Area() - valid_[l].Area()) * settings_.rows_;
+    }
+    return stale;
+}
+
+std::vector<DensityClipmap::Level> DensityClipmap::Levels() const {
+    std::vector<Level> levels(valid_.size());
+    for (size_t l = 0; l < valid_.size(); l++) {
+        const float ts = TexelSize(static_cast<int>(l));
+        const Rect& valid = valid_[l];
+        // half a texel in, the filter footprint of a position stays on fresh texels
+        levels[l].window_ = valid.Empty() ? float4(0.0f)
+            : float4((valid.x0_ + 0.5f) * ts, (valid.z0_ + 0.5f) * ts, (valid.x1_ - 0.5f) * ts, (valid.z1_ - 0.5f) * ts);
+        levels[l].texel_ = float4(ts, 1.0f / (ts * settings_.resolution_), settings_.altitudeMin_, 1.0f / (settings_.altitudeMax_ - settings_.altitudeMin_));
+    }
+    return levels;
+}
+
+size_t DensityClipmap::TexelIndex(int level, int x, int z, int row) const {
+    const size_t res = settings_.resolution_;
+    return ((static_cast<size_t>(level) * settings_.rows_ + row) * res + Wrap(z)) * res + Wrap(x);
+}
+
+void DensityClipmap::Fill(const DensityPacket& packet) {
+    size_t count = 0;
+    for (const Region& region : regions_) {
+        count += static_cast<size_t>(region.sizeX_) * region.sizeZ_ * settings_.rows_;
+    }
+    if (count == 0) { return; }
+
+    // the texel centre, then the skip lattice over the texel box
+    const int points = 1 + kSkipLattice * kSkipLattice * kSkipLattice;
+    const size_t evaluations = count * points;
+    std::vector<float> x(evaluations), y(evaluations), z(evaluations), densities(evaluations);
+    std::vector<uint8_t> lowFreq(evaluations, 1);
+    std::vector<size_t> target(count);
+
+    const float rowHeight = (settings_.altitudeMax_ - settings_.altitudeMin_) / settings_.rows_;
+    const float lattice = 1.0f / (kSkipLattice - 1);
+    size_t i = 0, e = 0;
+    for (const Region& region : regions_) {
+        const float ts = TexelSize(region.level_);
+        for (int row = 0; row < settings_.rows_; row++) {
+            for (int tz = region.z_; tz < region.z_ + region.sizeZ_; tz++) {
+                for (int tx = region.x_; tx < region.x_ + region.sizeX_; tx++, i++) {
+                    target[i] = TexelIndex(region.level_, tx, tz, row);
+                    x[e] = (tx + 0.5f) * ts;
+                    y[e] = -(settings_.altitudeMin_ + (row + 0.5f) * rowHeight);
+                    z[e] = (tz + 0.5f) * ts;
+                    e++;
+                    for (int lr = 0; lr < kSkipLattice; lr++) {
+                        for (int lz = 0; lz < kSkipLattice; lz++) {
+                            for (int lx = 0; lx < kSkipLattice; lx++, e++) {
+                                x[e] = (tx + lx * lattice) * ts;
+                                y[e] = -(settings_.altitudeMin_ + (row + lr * lattice) * rowHeight);
+                                z[e] = (tz + lz * lattice) * ts;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    packet.EvaluateParallel(x.data(), y.data(), z.data(), densities.data(), evaluations, lowFreq.data());
+    for (i = 0; i < count; i++) {
+        const float* texel = densities.data() + i * points;
+        texels_[target[i]] = QuantizeUnorm16(texel[0] * clouddensity::DENSITY_DIVISOR);
+        // rounded up, a texel with any cloud on its lattice never reads 0
+        const float densest = *std::max_element(texel + 1, texel + points) * clouddensity::DENSITY_DIVISOR;
+        maxTexels_[target[i]] = densest > 0.0f ? (std::max)(QuantizeUnorm16(densest), 1.0f / 65535.0f) : 0.0f;
+    }
+}
+
+float DensityClipmap::Sample(const float3& pos) const {
+    if (!Ready()) { return -1.0f; }
+    const int rows = settings_.rows_;
+
+    for (int l = 0; l < settings_.levels_; l++) {
+        const float ts = TexelSize(l);
+        const Rect& valid = valid_[l];
+        if (valid.Empty() || pos.x < (valid.x0_ + 0.5f) * ts || pos.x >= (valid.x1_ - 0.5f) * ts
+            || pos.z < (valid.z0_ + 0.5f) * ts || pos.z >= (valid.z1_ - 0.5f) * ts) {
+            continue;
+        }
+
+        // no layer reaches outside the band
+        const float alt = -pos.y;
+        if (alt < settings_.altitudeMin_ || alt > settings_.altitudeMax_) { return 0.0f; }
+
+        const float fx = pos.x / ts - 0.5f;
+        const float fz = pos.z / ts - 0.5f;
+        const float fr = clamp((alt - settings_.altitudeMin_) / (settings_.altitudeMax_ - settings_.altitudeMin_) * rows, 0.5f, rows - 0.5f) - 0.5f;
+        const int x0 = static_cast<int>(std::floor(fx));
+        const int z0 = static_cast<int>(std::floor(fz));
+        const int r0 = (std::min)(static_cast<int>(fr), rows - 1);
+        const int r1 = (std::min)(r0 + 1, rows - 1);
+        const float tx = fx - x0, tz = fz - z0, tr = fr - r0;
+
+        auto texel = [&](int x, int z, int r) { return texels_[TexelIndex(l, x, z, r)]; };
+        auto bilinear = [&](int r) {
+            return lerp(lerp(texel(x0, z0, r), texel(x0 + 1, z0, r), tx), lerp(texel(x0, z0 + 1, r), texel(x0 + 1, z0 + 1, r), tx), tz);
+        };
+        return lerp(bilinear(r0), bilinear(r1), tr);
+    }
+    return -1.0f;
+}
+
+float DensityClipmap::SampleMax(const float3& pos) const {
+    if (!Ready()) { return -1.0f; }
+    const int rows = settings_.rows_;
+
+    for (int l = 0; l < settings_.levels_; l++) {
+        const float ts = TexelSize(l);
+        const Rect& valid = valid_[l];
+        if (valid.Empty() || pos.x < (valid.x0_ + 0.5f) * ts || pos.x >= (valid.x1_ - 0.5f) * ts
+            || pos.z < (valid.z0_ + 0.5f) * ts || pos.z >= (valid.z1_ - 0.5f) * ts) {
+            continue;
+        }
+
+        const float alt = -pos.y;
+        if (alt < settings_.altitudeMin_ || alt > settings_.altitudeMax_) { return 0.0f; }
+
+        const int row = (std::min)(static_cast<int>((alt - settings_.altitudeMin_) / (settings_.altitudeMax_ - settings_.altitudeMin_) * rows), rows - 1);
+        return maxTexels_[TexelIndex(l, static_cast<int>(std::floor(pos.x / ts)), static_cast<int>(std::floor(pos.z / ts)), row)];
+    }
+    return -1.0f;
+}
+
+std::string DensityClipmap::TestUpdates(const Settings& settings, int frames) {
+    std::ostringstream ss;
+    DensityClipmap clipmap;
+    if (!clipmap.Initialize(settings)) {
+        ss << "density clipmap: invalid settings\n";
+        return ss.str();
+    }
+
+    const int res = settings.resolution_;
+    const int levels = settings.levels_;
+    const int64_t kNever = std::numeric_limits<int64_t>::min();
+    auto key = [](int x, int z) { return (static_cast<int64_t>(x) << 32) ^ static_cast<uint32_t>(z); };
+
+    std::mt19937 rng(39);
+    std::uniform_real_distribution<float> teleport(-400000.0f, 400000.0f);
+    float3 jump(0.0f, -3000.0f, 0.0f);
+
+    struct Path {
+        const char* name_;
+        std::function<float3(int)> pos_;
+    };
+    const Path paths[] = {
+        { "still", [](int) { return float3(1000.0f, -3000.0f, -2000.0f); } },
+        { "glider 60 m/frame", [](int f) { return float3(f * 55.0f, -3000.0f, f * 24.0f); } },
+        { "jet 2 km/frame", [](int f) { return float3(f * 1900.0f, -9000.0f, -f * 620.0f); } },
+        { "circle r 30 km", [](int f) { return float3(30000.0f * std::cos(f * 0.01f), -3000.0f, 30000.0f * std::sin(f * 0.01f)); } },
+        { "teleport every 256", [&](int f) { if (f % 256 == 0) { jump = float3(teleport(rng), -3000.0f, teleport(rng)); } return jump; } },
+    };
+
+    const int totalTexels = levels * res * res * settings.rows_;
+    const int lineTexels = res * settings.rows_;
+    // a cold start refreshes whole window lines: all but less than one line of the budget
+    // per frame, and one line when the budget is smaller
+    const int progress = (std::max)(settings.budgetTexels_ - lineTexels + 1, lineTexels);
+    const int convergeBound = (totalTexels + progress - 1) / progress + 1;
+
+    bool pass = true;
+    ss << "density clipmap updates, " << levels << " levels " << res << "x" << res << "x" << settings.rows_ << ", budget " << settings.budgetTexels_
+        << " texels, " << frames << " frames per path\n";
+    ss << "  path                 stale max (warm)  texels/frame  over budget  stale reads  outside window  frames to converge (bound " << convergeBound << ")\n";
+    for (const Path& path : paths) {
+        clipmap.Initialize(settings);
+        std::vector<int64_t> stored(static_cast<size_t>(levels) * res * res, kNever);
+
+        int staleMax = 0, overBudget = 0, staleReads = 0, outside = 0;
+        bool warm = false;
+        double texelSum = 0.0;
+        for (int f = 0; f < frames; f++) {
+            const std::vector<Region>& regions = clipmap.Update(path.pos_(f));
+
+            int texels = 0;
+            for (const Region& region : regions) {
+                texels += region.sizeX_ * region.sizeZ_ * settings.rows_;
+                for (int z = region.z_; z < region.z_ + region.sizeZ_; z++) {
+                    for (int x = region.x_; x < region.x_ + region.sizeX_; x++) {
+                        stored[(static_cast<size_t>(region.level_) * res + clipmap.Wrap(z)) * res + clipmap.Wrap(x)] = key(x, z);
+                    }
+                }
+            }
+            texelSum += texels;
+            overBudget += texels > settings.budgetTexels_ && regions.size() > 1;
+            // the cold start counts towards the convergence below
+            warm = warm || clipmap.StaleTexels() == 0;
+            if (warm) { staleMax = (std::max)(staleMax, clipmap.StaleTexels()); }
+
+            for (int l = 0; l < levels; l++) {
+                const Rect valid = clipmap.Valid(l);
+                outside += !Contains(clipmap.Window(l), valid);
+                for (int z = valid.z0_; z < valid.z1_; z++) {
+                    for (int x = valid.x0_; x < valid.x1_; x++) {
+                        staleReads += stored[(static_cast<size_t>(l) * res + clipmap.Wrap(z)) * res + clipmap.Wrap(x)] != key(x, z);
+                    }
+                }
+            }
+        }
+
+        // hold the camera where the path ended, after a cold start
+        const float3 last = path.pos_(frames - 1);
+        clipmap.Invalidate();
+        int converge = 0;
+        do {
+            clipmap.Update(last);
+            converge++;
+        } while (clipmap.StaleTexels() > 0 && converge <= 4 * convergeBound);
+
+        const bool ok = overBudget == 0 && staleReads == 0 && outside == 0 && converge <= convergeBound;
+        pass = pass && ok;
+        char line[256];
+        std::snprintf(line, sizeof(line), "  %-20s %16d  %12.0f  %11d  %11d  %14d  %d\n", path.name_, staleMax, texelSum / frames, overBudget, staleReads, outside, converge);
+        ss << line;
+    }
+    ss << (pass ? "  PASS\n" : "  FAIL\n");
+    return ss.str();
+}
+
+std::string DensityClipmap::Validate(const DensityField& field, const Settings& settings, int samples) {
+    std::ostringstream ss;
+    DensityPacket packet;
+    DensityClipmap clipmap;
+    if (!field.Ready() || !packet.Build(field) || !clipmap.Initialize(settings)) {
+        ss << "density clipmap: field not ready or invalid settings\n";
+        return ss.str();
+    }
+
+    using clock = std::chrono::steady_clock;
+    auto ms = [](clock::time_point a, clock::time_point b) { return std::chrono::duration<double, std::milli>(b - a).count(); };
+
+    // cold start at a fixed camera
+    float3 camera(1234.0f, -2000.0f, -5678.0f);
+    int frames = 0;
+    size_t evaluated = 0;
+    const clock::time_point start = clock::now();
+    do {
+        for (const Region& region : clipmap.Update(camera)) {
+            evaluated += static_cast<size_t>(region.sizeX_) * region.sizeZ_ * settings.rows_;
+        }
+        clipmap.Fill(packet);
+        frames++;
+    } while (clipmap.StaleTexels() > 0);
+    const double fillMs = ms(start, clock::now());
+
+    // a few texels of level 0 further on, until every level caught up
+    camera += float3(settings.texelSize_ * 3.3f, 0.0f, -settings.texelSize_ * 1.7f);
+    int moveFrames = 0;
+    const clock::time_point moveStart = clock::now();
+    do {
+        clipmap.Update(camera);
+        clipmap.Fill(packet);
+        moveFrames++;
+    } while (clipmap.StaleTexels() > 0);
+    const double moveMs = ms(moveStart, clock::now());
+
+    std::mt19937 rng(39);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    ss << "density clipmap vs low frequency CloudDensity * " << clouddensity::DENSITY_DIVISOR << ", " << samples << " samples per level\n";
+    ss << "  cold fill " << frames << " frames, " << evaluated << " texels, " << fillMs << " ms (" << fillMs * 1e6 / (std::max)(size_t(1), evaluated)
+        << " ns/texel), " << moveFrames << " frames after a move " << moveMs << " ms\n";
+    ss << "  level  texel m  mean error  p99 error  max error  missed cloud  false cloud  skipped  skipped cloud  unread\n";
+
+    bool pass = clipmap.StaleTexels() == 0;
+    for (int l = 0; l < settings.levels_; l++) {
+        const std::vector<Level> levels = clipmap.Levels();
+        const float4 window = levels[l].window_;
+        const float4 inner = l > 0 ? levels[l - 1].window_ : float4(0.0f);
+
+        std::vector<float> errors;
+        errors.reserve(samples);
+        int missed = 0, falseCloud = 0, skipped = 0, skippedCloud = 0, unread = 0, n = 0;
+        while (n < samples) {
+            const float3 pos(lerp(window.x, window.z, unit(rng)), -lerp(settings.altitudeMin_, settings.altitudeMax_, unit(rng)), lerp(window.y, window.w, unit(rng)));
+            // positions a finer level holds test that level instead
+            if (l > 0 && pos.x >= inner.x && pos.x < inner.z && pos.z >= inner.y && pos.z < inner.w) { continue; }
+            n++;
+
+            const float cached = clipmap.Sample(pos);
+            if (cached < 0.0f) { unread++; continue; }
+
+            const uint8_t lowFreq = 1;
+            float reference;
+            packet.Evaluate(&pos.x, &pos.y, &pos.z, &reference, 1, &lowFreq);
+            reference *= clouddensity::DENSITY_DIVISOR;
+
+            errors.push_back(std::fabs(cached - reference));
+            missed += cached <= 0.0f && reference > 0.05f;
+            falseCloud += reference <= 0.0f && cached > 0.05f;
+            // the noise fetches CloudDensity leaves out, any cloud there is lost
+            const bool skip = clipmap.SampleMax(pos) == 0.0f;
+            skipped += skip;
+            skippedCloud += skip && reference > 0.0f;
+        }
+
+        std::sort(errors.begin(), errors.end());
+        double errSum = 0.0;
+        for (const float err : errors) { errSum += err; }
+        const float errMean = errors.empty() ? 0.0f : static_cast<float>(errSum / errors.size());
+        const float errP99 = errors.empty() ? 0.0f : errors[errors.size() * 99 / 100];
+        const float errMax = errors.empty() ? 0.0f : errors.back();
+        pass = pass && unread == 0 && errMean <= kMaxMeanError && errP99 <= kMaxP99Error
+            && falseCloud <= samples * kMaxFalseCloud && skippedCloud <= skipped * kMaxSkippedCloud;
+
+        char line[192];
+        std::snprintf(line, sizeof(line), "  %5d  %7.0f  %10.4f  %9.4f  %9.4f  %12d  %11d  %7d  %13d  %6d\n", l, clipmap.TexelSize(l), errMean, errP99, errMax,
+            missed, falseCloud, skipped, skippedCloud, unread);
+        ss << line;
+    }
+    ss << (pass ? "  PASS\n" : "  FAIL\n");
+    return ss.str();
+}
+
+#ifdef _WIN32
+bool DensityClipmap::CreateResources() {
+    if (!Ready()) { return false; }
+
+    D3D11_TEXTURE3D_DESC desc = {};
+    desc.Width = settings_.resolution_;
+    desc.Height = settings_.resolution_;
+    desc.Depth = settings_.rows_ * settings_.levels_;
+    desc.MipLevels = 1;
+    desc.Format = DXGI_FORMAT_R16G16_UNORM;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+
+    HRESULT hr = Renderer::device->CreateTexture3D(&desc, nullptr, &clipmapTEX_);
+    if (FAILED(hr)) return false;
+
+    hr = Renderer::device->CreateShaderResourceView(clipmapTEX_.Get(), nullptr, &clipmapSRV_);
+    if (FAILED(hr)) return false;
+
+    hr = Renderer::device->CreateUnorderedAccessView(clipmapTEX_.Get(), nullptr, &clipmapUAV_);
+    if (FAILED(hr)) return false;
+
+    D3D11_BUFFER_DESC levelDesc = {};
+    levelDesc.ByteWidth = sizeof(Level) * settings_.levels_;
+    levelDesc.Usage = D3D11_USAGE_DEFAULT;
+    levelDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    levelDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+    levelDesc.StructureByteStride = sizeof(Level);
+
+    // every window starts empty
+    const std::vector<Level> levels = Levels();
+    D3D11_SUBRESOURCE_DATA initData = {};
+    initData.pSysMem = levels.data();
+
+    hr = Renderer::device->CreateBuffer(&levelDesc, &initData, &levelBuffer_);
+    if (FAILED(hr)) return false;
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+    srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+    srvDesc.Buffer.NumElements = settings_.levels_;
+
+    hr = Renderer::device->CreateShaderResourceView(levelBuffer_.Get(), &srvDesc, &levelSRV_);
+    if (FAILED(hr)) return false;
+
+    // cbuffer DensityClipmapRegion of CSDensityClipmap
+    D3D11_BUFFER_DESC regionDesc = {};
+    regionDesc.ByteWidth = sizeof(int) * 8;
+    regionDesc.Usage = D3D11_USAGE_DEFAULT;
+    regionDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+    hr = Renderer::device->CreateBuffer(&regionDesc, nullptr, &regionBuffer_);
+    if (FAILED(hr)) return false;
+
+    ComPtr<ID3DBlob> blob;
+    hr = Renderer::CompileShaderFromFile(L"shaders/RayMarch.hlsl", "CSDensityClipmap", "cs_5_0", blob);
+    if (FAILED(hr)) return false;
+
+    hr = Renderer::device->CreateComputeShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &computeShader_);
+    return SUCCEEDED(hr);
+}
+
+void DensityClipmap::UpdateTexture(UINT numViews, ID3D11ShaderResourceView* const* srvs, UINT bufferCount, ID3D11Buffer** buffers,
+    UINT numSamplers, ID3D11SamplerState* const* samplers) {
+    if (!computeShader_) { return; }
+
+    // the windows changed even when nothing has to be evaluated
+    const std::vector<Level> levels = Levels();
+    Renderer::context->UpdateSubresource(levelBuffer_.Get(), 0, nullptr, levels.data(), 0, 0);
+    if (regions_.empty()) { return; }
+
+    // t14 is the texture the dispatch writes
+    ID3D11ShaderResourceView* const clipmapSRVs[] = { nullptr, levelSRV_.Get() };
+    Renderer::context->CSSetShader(computeShader_.Get(), nullptr, 0);
+    Renderer::context->CSSetShaderResources(0, numViews, srvs);
+    Renderer::context->CSSetShaderResources(14, 2, clipmapSRVs);
+    Renderer::context->CSSetSamplers(0, numSamplers, samplers);
+    Renderer::context->CSSetConstantBuffers(0, bufferCount, buffers);
+    Renderer::context->CSSetUnorderedAccessViews(1, 1, clipmapUAV_.GetAddressOf(), nullptr);
+
+    for (const Region& region : regions_) {
+        const int data[8] = { region.x_, region.z_, region.level_, settings_.rows_, region.sizeX_, region.sizeZ_, settings_.resolution_, 0 };
+        Renderer::context->UpdateSubresource(regionBuffer_.Get(), 0, nullptr, data, 0, 0);
+        Renderer::context->CSSetConstantBuffers(5, 1, regionBuffer_.GetAddressOf());
+        Renderer::context->Dispatch((region.sizeX_ + 3) / 4, (region.sizeZ_ + 3) / 4, (settings_.rows_ + 3) / 4);
+    }
+
+    // the pixel shader reads the texture as t14
+    ID3D11UnorderedAccessView* const nullUAV[] = { nullptr };
+    Renderer::context->CSSetUnorderedAccessViews(1, 1, nullUAV, nullptr);
+}
+#endif
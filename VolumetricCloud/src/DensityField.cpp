@@ -0,0 +1,163 @@
+#include <cmath>
+#include <iostream>
+
+#include "../includes/DensityField.h"
+#include "../includes/ThreadPool.h"
+
+using namespace hlsl;
+
+bool DensityField::Initialize(const Settings& settings) {
+    settings_ = settings;
+
+    noise_ = NoiseBaker::BakeCached(settings.noiseRecipe_,
+        settings.noiseResolution_, settings.noiseResolution_, settings.noiseResolution_, settings.cacheDir_);
+    noiseSmall_ = NoiseBaker::BakeCached(NoiseBaker::RecipeFbmSmall(),
+        settings.noiseSmallResolution_, settings.noiseSmallResolution_, settings.noiseSmallResolution_, settings.cacheDir_);
+    if (settings.useNoiseSequence_) {
+        noiseSequence_ = NoiseBaker::BakeCached(NoiseBaker::RecipeNoiseSequence(),
+            settings.noiseSequenceResolution_, settings.noiseSequenceResolution_, settings.noiseSequenceResolution_, settings.cacheDir_);
+    }
+
+    if (noise_.texels_.empty() || noiseSmall_.texels_.empty() || (settings.useNoiseSequence_ && noiseSequence_.texels_.empty())) {
+        std::cerr << "DensityField: noise bake failed" << std::endl;
+        return false;
+    }
+    profiles_.Build(layers_);
+    SetTime(0.0);
+    return true;
+}
+
+bool DensityField::SetNoiseRecipe(const NoiseBaker::VolumeRecipe& recipe) {
+    return SetNoiseRecipe(recipe, NoiseBaker::BakeCached(recipe,
+        settings_.noiseResolution_, settings_.noiseResolution_, settings_.noiseResolution_, settings_.cacheDir_));
+}
+
+bool DensityField::SetNoiseRecipe(const NoiseBaker::VolumeRecipe& recipe, NoiseVolume noise) {
+    if (noise.texels_.empty() || noise.width_ != settings_.noiseResolution_ || noise.height_ != settings_.noiseResolution_
+        || noise.depth_ != settings_.noiseResolution_) {
+        std::cerr << "DensityField: no " << settings_.noiseResolution_ << "^3 noise of " << recipe.name_ << std::endl;
+        return false;
+    }
+    settings_.noiseRecipe_ = recipe;
+    noise_ = std::move(noise);
+    return true;
+}
+
+void DensityField::SetWeather(const Fmap& fmap) {
+    SetWeather(fmap.X_, fmap.Y_, fmap.ColorTexels());
+    SetLayers(fmap.CloudLayers());
+}
+
+void DensityField::SetLayers(std::vector<clouddensity::CloudLayerDesc> layers) {
+    if (layers.size() > CLOUD_LAYER_MAX) {
+        std::cerr << "DensityField: " << layers.size() << " layers, at most " << CLOUD_LAYER_MAX << std::endl;
+        layers.resize(CLOUD_LAYER_MAX);
+    }
+    layers_ = std::move(layers);
+    profiles_.Build(layers_);
+}
+
+void DensityField::SetWeather(int width, int height, std::vector<float4> texels) {
+    if (width <= 0 || height <= 0 || texels.size() != static_cast<size_t>(width) * height) {
+        std::cerr << "DensityField: weather map of " << width << "x" << height << " with " << texels.size() << " texels" << std::endl;
+        return;
+    }
+    weatherWidth_ = width;
+    weatherHeight_ = height;
+    weather_ = std::move(texels);
+}
+
+void DensityField::SetTime(double seconds) {
+    const int frames = (std::max)(noiseSequence_.frames_, 1);
+
+    // same as NoiseSequenceTex
+    const double t = (seconds / kSequencePeriodSec - std::floor(seconds / kSequencePeriodSec)) * frames;
+    frame0_ = static_cast<int>(std::floor(t)) % frames;
+    frame1_ = (frame0_ + 1) % frames;
+    frameBlend_ = static_cast<float>(t - std::floor(t));
+}
+
+float4 DensityField::SampleWeather(const float2& uv) const {
+    // bilinear with wrap addressing like fmapSampler_, texel centers at (i + 0.5) / size
+    const float px = uv.x * weatherWidth_ - 0.5f;
+    const float py = uv.y * weatherHeight_ - 0.5f;
+    const float fx = std::floor(px);
+    const float fy = std::floor(py);
+    const float tx = px - fx;
+    const float ty = py - fy;
+
+    auto wrap = [](int v, int size) { const int m = v % size; return m < 0 ? m + size : m; };
+    const int x0 = wrap(static_cast<int>(fx), weatherWidth_), x1 = wrap(static_cast<int>(fx) + 1, weatherWidth_);
+    const int y0 = wrap(static_cast<int>(fy), weatherHeight_), y1 = wrap(static_cast<int>(fy) + 1, weatherHeight_);
+    auto texel = [&](int x, int y) { return weather_[static_cast<size_t>(y) * weatherWidth_ + x]; };
+
+    return lerp(lerp(texel(x0, y0), texel(x1, y0), tx), lerp(texel(x0, y1), texel(x1, y1), tx), ty);
+}
+
+float4 DensityField::SampleNoiseSequence(const float3& uvw) const {
+    // w stays half a texel inside the frame, see NoiseSequenceTex
+    const float frameSlices = static_cast<float>(noiseSequence_.depth_);
+    const float w = clamp(frac(uvw.z), 0.5f / frameSlices, 1.0f - 0.5f / frameSlices);
+    const float4 a = noiseSequence_.Sample(float3(uvw.x, uvw.y, w), frame0_);
+    const float4 b = noiseSequence_.Sample(float3(uvw.x, uvw.y, w), frame1_);
+    return lerp(a, b, frameBlend_);
+}
+
+clouddensity::DensitySamples DensityField::Samples(const float3& pos) const {
+    using namespace clouddensity;
+
+    DensitySamples samples = {};
+    samples.fmap_ = SampleWeather(FmapUV(pos));
+    for (size_t l = 0; l < layers_.size(); l++) {
+        const CloudLayerDesc& layer = layers_[l];
+        if (!LayerInSlab(layer, -pos.y)) { continue; }
+        const float3 uvw = LayerNoiseUVW(layer, pos);
+        samples.layerNoise_[l] = noise_.Sample(uvw);
+        if (settings_.useNoiseSequence_ && layer.coverage_.w > 0.0f) {
+            // let the base shape evolve over time
+            samples.layerNoise_[l].x = lerp(samples.layerNoise_[l].x, SampleNoiseSequence(uvw).y, layer.coverage_.w);
+        }
+    }
+    if (!settings_.lowFreq_) {
+        samples.smallNoise_ = noiseSmall_.Sample(SmallNoiseUVW(pos));
+    }
+    return samples;
+}
+
+float DensityField::Evaluate(const float3& pos, float& distance) const {
+    const HeightProfileLut* profiles = (settings_.useHeightProfileLut_ && profiles_.Ready()) ? &profiles_ : nullptr;
+    return clouddensity::CloudDensityFromSamples(-pos.y, Samples(pos), layers_, distance, settings_.lowFreq_, profiles);
+}
+
+float DensityField::Evaluate(const float3& pos) const {
+    float distance;
+    return Evaluate(pos, distance);
+}
+
+void DensityField::Evaluate(std::span<const float3> positions, std::span<float> densities) const {
+    if (positions.size() != densities.size()) {
+        std::cerr << "DensityField: " << positions.size() << " positions for " << densities.size() << " densities" << std::endl;
+        return;
+    }
+    if (!Ready()) {
+        std::cerr << "DensityField: Evaluate before Initialize/SetWeather" << std::endl;
+        return;
+    }
+
+    if (positions.size() < kParallelBatch) {
+        for (size_t i = 0; i < positions.size(); i++) {
+            densities[i] = Evaluate(positions[i]);
+        }
+        return;
+    }
+
+    // chunks keep the per item overhead of the pool small
+    const size_t chunk = kParallelBatch / 4;
+    const int chunks = static_cast<int>((positions.size() + chunk - 1) / chunk);
+    ThreadPool::Shared().ParallelFor(0, chunks, [&](int c) {
+        const size_t end = (std::min)(positions.size(), (c + 1) * chunk);
+        for (size_t i = c * chunk; i < end; i++) {
+            densities[i] = Evaluate(positions[i]);
+        }
+    });
+}
@@ -0,0 +1,350 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#elif defined(__GNUC__)
+#include <cpuid.h>
+#endif
+
+#include "../includes/DensityPacket.h"
+#include "../includes/DensityPacketKernel.h"
+#include "../includes/ThreadPool.h"
+
+using namespace hlsl;
+
+namespace {
+
+    // the packet kernel one lane wide
+    struct Scalar {
+        static constexpr int kWidth = 1;
+
+        using F = float;
+        using I = int32_t;
+        using M = bool;
+
+        static F Load(const float* p) { return *p; }
+        static void Store(float* p, F a) { *p = a; }
+        static M LoadFlags(const uint8_t* p) { return *p != 0; }
+        static M SetMask(bool b) { return b; }
+
+        static F Min(F a, F b) { return a < b ? a : b; }
+        static F Max(F a, F b) { return a > b ? a : b; }
+        static F Floor(F a) { return std::floor(a); }
+        static F Select(M m, F a, F b) { return m ? a : b; }
+        static I SelectI(M m, I a, I b) { return m ? a : b; }
+        static I MinI(I a, I b) { return a < b ? a : b; }
+        static bool Any(M m) { return m; }
+        static bool All(M m) { return m; }
+        static M AndNot(M a, M b) { return !a && b; }
+
+        static I ToInt(F a) { return static_cast<I>(a); }
+        static F ToFloat(I a) { return static_cast<F>(a); }
+        static I AsInt(F a) { I i; std::memcpy(&i, &a, sizeof(i)); return i; }
+        static F AsFloat(I a) { F f; std::memcpy(&f, &a, sizeof(f)); return f; }
+        static I AndI(I a, int32_t b) { return a & b; }
+        static I OrI(I a, int32_t b) { return a | b; }
+        static I Srl(I a, int n) { return static_cast<I>(static_cast<uint32_t>(a) >> n); }
+        static I Sll(I a, int n) { return static_cast<I>(static_cast<uint32_t>(a) << n); }
+
+        static I Gather(const uint32_t* base, I index) { return static_cast<I>(base[index]); }
+        static F GatherF(const float* base, I index) { return base[index]; }
+    };
+
+    void PackVolume(const NoiseVolume& volume, std::vector<uint32_t>& packed) {
+        const std::vector<uint8_t> bytes = volume.ToUnorm8();
+        packed.resize(volume.TexelCount());
+        for (size_t i = 0; i < packed.size(); i++) {
+            packed[i] = bytes[i * 4] | (bytes[i * 4 + 1] << 8) | (bytes[i * 4 + 2] << 16) | (static_cast<uint32_t>(bytes[i * 4 + 3]) << 24);
+        }
+    }
+
+    PackedVolume View(const NoiseVolume& volume, const std::vector<uint32_t>& packed) {
+        PackedVolume view;
+        view.texels_ = packed.data();
+        view.width_ = volume.width_;
+        view.height_ = volume.height_;
+        view.depth_ = volume.depth_;
+        return view;
+    }
+
+    using PacketFunc = void (*)(const DensityPacketData&, const float*, const float*, const float*, const uint8_t*, float*, size_t);
+
+    PacketFunc Entry(DensityPacket::Isa isa) {
+        switch (isa) {
+        case DensityPacket::kAvx2: return EvaluateDensityPacketsAvx2;
+        case DensityPacket::kAvx512: return EvaluateDensityPacketsAvx512;
+        default: return EvaluateDensityPacketsScalar;
+        }
+    }
+
+    void Cpuid(int leaf, int subleaf, uint32_t regs[4]) {
+#if defined(_MSC_VER)
+        int r[4];
+        __cpuidex(r, leaf, subleaf);
+        for (int i = 0; i < 4; i++) { regs[i] = static_cast<uint32_t>(r[i]); }
+#elif defined(__GNUC__)
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#else
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+#endif
+    }
+
+    uint64_t Xgetbv() {
+#if defined(_MSC_VER)
+        return _xgetbv(0);
+#elif defined(__GNUC__)
+        uint32_t eax, edx;
+        __asm__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+        return (static_cast<uint64_t>(edx) << 32) | eax;
+#else
+        return 0;
+#endif
+    }
+
+    DensityPacket::Isa DetectIsa() {
+        uint32_t regs[4];
+        Cpuid(0, 0, regs);
+        if (regs[0] < 7) { return DensityPacket::kScalar; }
+
+        Cpuid(1, 0, regs);
+        const bool osxsave = (regs[2] >> 27) & 1;
+        const bool fma = (regs[2] >> 12) & 1;
+        if (!osxsave) { return DensityPacket::kScalar; }
+
+        // the OS has to save the ymm (and zmm) state
+        const uint64_t xcr0 = Xgetbv();
+        Cpuid(7, 0, regs);
+        const bool avx2 = fma && ((regs[1] >> 5) & 1) && (xcr0 & 0x6) == 0x6;
+        const bool avx512 = avx2 && ((regs[1] >> 16) & 1) && (xcr0 & 0xe6) == 0xe6;
+        return avx512 ? DensityPacket::kAvx512 : (avx2 ? DensityPacket::kAvx2 : DensityPacket::kScalar);
+    }
+
+    double Seconds(std::chrono::steady_clock::time_point begin) {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    }
+
+} // namespace
+
+void EvaluateDensityPacketsScalar(const DensityPacketData& data, const float* x, const float* y, const float* z,
+    const uint8_t* lowFreq, float* densities, size_t count) {
+    densitypacket::EvaluatePackets<Scalar>(data, x, y, z, lowFreq, densities, count);
+}
+
+DensityPacket::Isa DensityPacket::BestIsa() {
+    static const Isa isa = DetectIsa();
+    return isa;
+}
+
+bool DensityPacket::Supported(Isa isa) {
+    return isa >= 0 && isa <= BestIsa();
+}
+
+int DensityPacket::Width(Isa isa) {
+    switch (isa) {
+    case kAvx2: return 8;
+    case kAvx512: return 16;
+    default: return 1;
+    }
+}
+
+const char* DensityPacket::IsaName(Isa isa) {
+    switch (isa) {
+    case kScalar: return "scalar";
+    case kAvx2: return "AVX2";
+    case kAvx512: return "AVX-512";
+    default: return "?";
+    }
+}
+
+float DensityPacket::PowApprox(float x, float e) {
+    return densitypacket::Pow<Scalar>(x, e);
+}
+
+bool DensityPacket::Build(const DensityField& field) {
+    if (!field.Ready()) {
+        std::cerr << "DensityPacket: the density field has no noise or weather" << std::endl;
+        return false;
+    }
+    field_ = &field;
+    PackVolume(field.NoiseLarge(), noise_);
+    PackVolume(field.NoiseSmall(), noiseSmall_);
+    if (field.GetSettings().useNoiseSequence_) {
+        PackVolume(field.NoiseSequence(), noiseSequence_);
+    }
+    return true;
+}
+
+DensityPacketData DensityPacket::Data() const {
+    DensityPacketData data;
+    data.noise_ = View(field_->NoiseLarge(), noise_);
+    data.noiseSmall_ = View(field_->NoiseSmall(), noiseSmall_);
+    data.useNoiseSequence_ = field_->GetSettings().useNoiseSequence_;
+    if (data.useNoiseSequence_) {
+        data.noiseSequence_ = View(field_->NoiseSequence(), noiseSequence_);
+        field_->SequenceFrames(data.sequenceFrame0_, data.sequenceFrame1_, data.sequenceBlend_);
+    }
+    data.weather_ = &field_->Weather()[0].x;
+    data.weatherWidth_ = field_->WeatherWidth();
+    data.weatherHeight_ = field_->WeatherHeight();
+    data.lowFreq_ = field_->GetSettings().lowFreq_;
+    data.layers_ = field_->Layers().data();
+    data.layerCount_ = static_cast<int>(field_->Layers().size());
+    return data;
+}
+
+void DensityPacket::Evaluate(const float* x, const float* y, const float* z, float* densities, size_t count,
+    const uint8_t* lowFreq, Isa isa) const {
+    if (field_ == nullptr) {
+        std::cerr << "DensityPacket: Evaluate before Build" << std::endl;
+        return;
+    }
+    if (!Supported(isa)) {
+        isa = BestIsa();
+    }
+
+    const DensityPacketData data = Data();
+    const int width = Width(isa);
+    const size_t full = count - count % width;
+    Entry(isa)(data, x, y, z, lowFreq, densities, full);
+    if (full == count) {
+        return;
+    }
+
+    // tail padded with its last position
+    float px[16], py[16], pz[16], out[16];
+    uint8_t flags[16];
+    for (int i = 0; i < width; i++) {
+        const size_t src = (std::min)(full + i, count - 1);
+        px[i] = x[src];
+        py[i] = y[src];
+        pz[i] = z[src];
+        flags[i] = lowFreq ? lowFreq[src] : 0;
+    }
+    Entry(isa)(data, px, py, pz, lowFreq ? flags : nullptr, out, width);
+    std::copy(out, out + (count - full), densities + full);
+}
+
+void DensityPacket::Evaluate(std::span<const float3> positions, std::span<float> densities, Isa isa) const {
+    if (positions.size() != densities.size()) {
+        std::cerr << "DensityPacket: " << positions.size() << " positions for " << densities.size() << " densities" << std::endl;
+        return;
+    }
+
+    const size_t run = 256;
+    float x[run], y[run], z[run];
+    for (size_t begin = 0; begin < positions.size(); begin += run) {
+        const size_t count = (std::min)(run, positions.size() - begin);
+        for (size_t i = 0; i < count; i++) {
+            x[i] = positions[begin + i].x;
+            y[i] = positions[begin + i].y;
+            z[i] = positions[begin + i].z;
+        }
+        Evaluate(x, y, z, densities.data() + begin, count, nullptr, isa);
+    }
+}
+
+void DensityPacket::EvaluateParallel(const float* x, const float* y, const float* z, float* densities, size_t count,
+    const uint8_t* lowFreq, Isa isa) const {
+    const int chunks = static_cast<int>((count + kParallelChunk - 1) / kParallelChunk);
+    ThreadPool::Shared().ParallelFor(0, chunks, [&](int c) {
+        const size_t begin = c * kParallelChunk;
+        const size_t n = (std::min)(kParallelChunk, count - begin);
+        Evaluate(x + begin, y + begin, z + begin, densities + begin, n, lowFreq ? lowFreq + begin : nullptr, isa);
+    });
+}
+
+std::string DensityPacket::Benchmark(const DensityField& field, size_t samples) {
+    DensityPacket packet;
+    if (!packet.Build(field)) {
+        return "density field not ready\n";
+    }
+
+    // positions along rays through the layers, 50 m apart like the near steps of RayMarch
+    const size_t steps = 256;
+    const size_t rays = (std::max)(static_cast<size_t>(1), samples / steps);
+    samples = rays * steps;
+    std::vector<float> x(samples), y(samples), z(samples);
+    std::vector<float3> positions(samples);
+    uint32_t state = 0x2545F491u;
+    auto next = [&]() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    };
+    for (size_t r = 0; r < rays; r++) {
+        const float azimuth = next() * 6.2831853f;
+        const float elevation = (next() * 2.0f - 1.0f) * 0.2f;
+        const float3 origin((next() - 0.5f) * 400000.0f, -next() * 8000.0f, (next() - 0.5f) * 400000.0f);
+        const float3 dir(std::cos(elevation) * std::sin(azimuth), -std::sin(elevation), std::cos(elevation) * std::cos(azimuth));
+        for (size_t s = 0; s < steps; s++) {
+            const size_t i = r * steps + s;
+            positions[i] = origin + dir * (s * 50.0f);
+            x[i] = positions[i].x;
+            y[i] = positions[i].y;
+            z[i] = positions[i].z;
+        }
+    }
+
+    std::ostringstream out;
+    char line[256];
+    snprintf(line, sizeof(line), "%zu samples, %u threads, best isa %s\n", samples, ThreadPool::Shared().ThreadCount(), IsaName(BestIsa()));
+    out << line;
+    snprintf(line, sizeof(line), "%-22s %12s %8s %10s\n", "path", "Msamples/s", "speedup", "max error");
+    out << line;
+
+    // reference: DensityField::Evaluate
+    std::vector<float> reference(samples);
+    auto begin = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < samples; i++) {
+        reference[i] = field.Evaluate(positions[i]);
+    }
+    const double scalarRate = samples / Seconds(begin);
+    snprintf(line, sizeof(line), "%-22s %12.2f %8.2f %10s\n", "DensityField 1 thread", scalarRate * 1e-6, 1.0, "-");
+    out << line;
+
+    std::vector<float> densities(samples);
+    begin = std::chrono::steady_clock::now();
+    field.Evaluate(positions, densities);
+    const double scalarParallelRate = samples / Seconds(begin);
+    snprintf(line, sizeof(line), "%-22s %12.2f %8.2f %10s\n", "DensityField pool", scalarParallelRate * 1e-6, scalarParallelRate / scalarRate, "-");
+    out << line;
+
+    // error in CloudDensity * DENSITY_DIVISOR, 0-1
+    auto maxError = [&]() {
+        float e = 0.0f;
+        for (size_t i = 0; i < samples; i++) {
+            e = (std::max)(e, std::fabs(densities[i] - reference[i]) * clouddensity::DENSITY_DIVISOR);
+        }
+        return e;
+    };
+
+    for (int i = 0; i < kIsaCount; i++) {
+        const Isa isa = static_cast<Isa>(i);
+        if (!Supported(isa)) {
+            continue;
+        }
+        char name[64];
+
+        begin = std::chrono::steady_clock::now();
+        packet.Evaluate(x.data(), y.data(), z.data(), densities.data(), samples, nullptr, isa);
+        const double rate = samples / Seconds(begin);
+        snprintf(name, sizeof(name), "packet %s 1 thread", IsaName(isa));
+        snprintf(line, sizeof(line), "%-22s %12.2f %8.2f %10.2e\n", name, rate * 1e-6, rate / scalarRate, maxError());
+        out << line;
+
+        begin = std::chrono::steady_clock::now();
+        packet.EvaluateParallel(x.data(), y.data(), z.data(), densities.data(), samples, nullptr, isa);
+        const double parallelRate = samples / Seconds(begin);
+        snprintf(name, sizeof(name), "packet %s pool", IsaName(isa));
+        snprintf(line, sizeof(line), "%-22s %12.2f %8.2f %10.2e\n", name, parallelRate * 1e-6, parallelRate / scalarRate, maxError());
+        out << line;
+    }
+    return out.str();
+}
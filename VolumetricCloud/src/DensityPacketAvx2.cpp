@@ -0,0 +1,93 @@
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+
+#include "../includes/DensityPacket.h"
+
+// everything below is compiled for AVX2 + FMA, DensityPacket::BestIsa checks the CPU.
+// MSVC takes the intrinsics without /arch, gcc and clang need the target set.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+#endif
+
+#include "../includes/DensityPacketKernel.h"
+
+namespace {
+
+    struct Avx2 {
+        static constexpr int kWidth = 8;
+
+        struct F {
+            __m256 v;
+            F() = default;
+            F(__m256 v) : v(v) {}
+            F(float s) : v(_mm256_set1_ps(s)) {}
+        };
+        struct I {
+            __m256i v;
+            I() = default;
+            I(__m256i v) : v(v) {}
+            I(int32_t s) : v(_mm256_set1_epi32(s)) {}
+        };
+        struct M {
+            __m256 v;
+        };
+
+        static F Load(const float* p) { return _mm256_loadu_ps(p); }
+        static void Store(float* p, F a) { _mm256_storeu_ps(p, a.v); }
+        static M LoadFlags(const uint8_t* p) {
+            const __m256i flags = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)));
+            return { _mm256_castsi256_ps(_mm256_cmpgt_epi32(flags, _mm256_setzero_si256())) };
+        }
+        static M SetMask(bool b) { return { _mm256_castsi256_ps(_mm256_set1_epi32(b ? -1 : 0)) }; }
+
+        static F Min(F a, F b) { return _mm256_min_ps(a.v, b.v); }
+        static F Max(F a, F b) { return _mm256_max_ps(a.v, b.v); }
+        static F Floor(F a) { return _mm256_floor_ps(a.v); }
+        static F Select(M m, F a, F b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+        static I SelectI(M m, I a, I b) { return _mm256_blendv_epi8(b.v, a.v, _mm256_castps_si256(m.v)); }
+        static I MinI(I a, I b) { return _mm256_min_epi32(a.v, b.v); }
+        static bool Any(M m) { return _mm256_movemask_ps(m.v) != 0; }
+        static bool All(M m) { return _mm256_movemask_ps(m.v) == 0xff; }
+        static M AndNot(M a, M b) { return { _mm256_andnot_ps(a.v, b.v) }; }
+
+        static I ToInt(F a) { return _mm256_cvttps_epi32(a.v); }
+        static F ToFloat(I a) { return _mm256_cvtepi32_ps(a.v); }
+        static I AsInt(F a) { return _mm256_castps_si256(a.v); }
+        static F AsFloat(I a) { return _mm256_castsi256_ps(a.v); }
+        static I AndI(I a, int32_t b) { return _mm256_and_si256(a.v, _mm256_set1_epi32(b)); }
+        static I OrI(I a, int32_t b) { return _mm256_or_si256(a.v, _mm256_set1_epi32(b)); }
+        static I Srl(I a, int n) { return _mm256_srl_epi32(a.v, _mm_cvtsi32_si128(n)); }
+        static I Sll(I a, int n) { return _mm256_sll_epi32(a.v, _mm_cvtsi32_si128(n)); }
+
+        static I Gather(const uint32_t* base, I index) { return _mm256_i32gather_epi32(reinterpret_cast<const int*>(base), index.v, 4); }
+        static F GatherF(const float* base, I index) { return _mm256_i32gather_ps(base, index.v, 4); }
+    };
+
+    inline Avx2::F operator+(Avx2::F a, Avx2::F b) { return _mm256_add_ps(a.v, b.v); }
+    inline Avx2::F operator-(Avx2::F a, Avx2::F b) { return _mm256_sub_ps(a.v, b.v); }
+    inline Avx2::F operator*(Avx2::F a, Avx2::F b) { return _mm256_mul_ps(a.v, b.v); }
+    inline Avx2::F operator/(Avx2::F a, Avx2::F b) { return _mm256_div_ps(a.v, b.v); }
+    inline Avx2::M operator<(Avx2::F a, Avx2::F b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ) }; }
+    inline Avx2::M operator>(Avx2::F a, Avx2::F b) { return { _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ) }; }
+    inline Avx2::I operator+(Avx2::I a, Avx2::I b) { return _mm256_add_epi32(a.v, b.v); }
+    inline Avx2::I operator*(Avx2::I a, Avx2::I b) { return _mm256_mullo_epi32(a.v, b.v); }
+    inline Avx2::M operator==(Avx2::I a, Avx2::I b) { return { _mm256_castsi256_ps(_mm256_cmpeq_epi32(a.v, b.v)) }; }
+    inline Avx2::M operator&(Avx2::M a, Avx2::M b) { return { _mm256_and_ps(a.v, b.v) }; }
+    inline Avx2::M operator|(Avx2::M a, Avx2::M b) { return { _mm256_or_ps(a.v, b.v) }; }
+
+} // namespace
+
+void EvaluateDensityPacketsAvx2(const DensityPacketData& data, const float* x, const float* y, const float* z,
+    const uint8_t* lowFreq, float* densities, size_t count) {
+    densitypacket::EvaluatePackets<Avx2>(data, x, y, z, lowFreq, densities, count);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
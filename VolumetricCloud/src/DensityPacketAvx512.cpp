@@ -0,0 +1,93 @@
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+
+#include "../includes/DensityPacket.h"
+
+// everything below is compiled for AVX-512F, DensityPacket::BestIsa checks the CPU.
+// MSVC takes the intrinsics without /arch, gcc and clang need the target set.
+#if defined(__clang__)
+#pragma clang attribute push(__attribute__((target("avx512f,avx2,fma"))), apply_to = function)
+#elif defined(__GNUC__)
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma")
+#endif
+
+#include "../includes/DensityPacketKernel.h"
+
+namespace {
+
+    struct Avx512 {
+        static constexpr int kWidth = 16;
+
+        struct F {
+            __m512 v;
+            F() = default;
+            F(__m512 v) : v(v) {}
+            F(float s) : v(_mm512_set1_ps(s)) {}
+        };
+        struct I {
+            __m512i v;
+            I() = default;
+            I(__m512i v) : v(v) {}
+            I(int32_t s) : v(_mm512_set1_epi32(s)) {}
+        };
+        struct M {
+            __mmask16 v;
+        };
+
+        static F Load(const float* p) { return _mm512_loadu_ps(p); }
+        static void Store(float* p, F a) { _mm512_storeu_ps(p, a.v); }
+        static M LoadFlags(const uint8_t* p) {
+            const __m512i flags = _mm512_cvtepu8_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+            return { _mm512_test_epi32_mask(flags, flags) };
+        }
+        static M SetMask(bool b) { return { static_cast<__mmask16>(b ? 0xffff : 0) }; }
+
+        static F Min(F a, F b) { return _mm512_min_ps(a.v, b.v); }
+        static F Max(F a, F b) { return _mm512_max_ps(a.v, b.v); }
+        static F Floor(F a) { return _mm512_roundscale_ps(a.v, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+        static F Select(M m, F a, F b) { return _mm512_mask_blend_ps(m.v, b.v, a.v); }
+        static I SelectI(M m, I a, I b) { return _mm512_mask_blend_epi32(m.v, b.v, a.v); }
+        static I MinI(I a, I b) { return _mm512_min_epi32(a.v, b.v); }
+        static bool Any(M m) { return m.v != 0; }
+        static bool All(M m) { return m.v == 0xffff; }
+        static M AndNot(M a, M b) { return { static_cast<__mmask16>(~a.v & b.v) }; }
+
+        static I ToInt(F a) { return _mm512_cvttps_epi32(a.v); }
+        static F ToFloat(I a) { return _mm512_cvtepi32_ps(a.v); }
+        static I AsInt(F a) { return _mm512_castps_si512(a.v); }
+        static F AsFloat(I a) { return _mm512_castsi512_ps(a.v); }
+        static I AndI(I a, int32_t b) { return _mm512_and_si512(a.v, _mm512_set1_epi32(b)); }
+        static I OrI(I a, int32_t b) { return _mm512_or_si512(a.v, _mm512_set1_epi32(b)); }
+        static I Srl(I a, int n) { return _mm512_srl_epi32(a.v, _mm_cvtsi32_si128(n)); }
+        static I Sll(I a, int n) { return _mm512_sll_epi32(a.v, _mm_cvtsi32_si128(n)); }
+
+        static I Gather(const uint32_t* base, I index) { return _mm512_i32gather_epi32(index.v, base, 4); }
+        static F GatherF(const float* base, I index) { return _mm512_i32gather_ps(index.v, base, 4); }
+    };
+
+    inline Avx512::F operator+(Avx512::F a, Avx512::F b) { return _mm512_add_ps(a.v, b.v); }
+    inline Avx512::F operator-(Avx512::F a, Avx512::F b) { return _mm512_sub_ps(a.v, b.v); }
+    inline Avx512::F operator*(Avx512::F a, Avx512::F b) { return _mm512_mul_ps(a.v, b.v); }
+    inline Avx512::F operator/(Avx512::F a, Avx512::F b) { return _mm512_div_ps(a.v, b.v); }
+    inline Avx512::M operator<(Avx512::F a, Avx512::F b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ) }; }
+    inline Avx512::M operator>(Avx512::F a, Avx512::F b) { return { _mm512_cmp_ps_mask(a.v, b.v, _CMP_GT_OQ) }; }
+    inline Avx512::I operator+(Avx512::I a, Avx512::I b) { return _mm512_add_epi32(a.v, b.v); }
+    inline Avx512::I operator*(Avx512::I a, Avx512::I b) { return _mm512_mullo_epi32(a.v, b.v); }
+    inline Avx512::M operator==(Avx512::I a, Avx512::I b) { return { _mm512_cmpeq_epi32_mask(a.v, b.v) }; }
+    inline Avx512::M operator&(Avx512::M a, Avx512::M b) { return { static_cast<__mmask16>(a.v & b.v) }; }
+    inline Avx512::M operator|(Avx512::M a, Avx512::M b) { return { static_cast<__mmask16>(a.v | b.v) }; }
+
+} // namespace
+
+void EvaluateDensityPacketsAvx512(const DensityPacketData& data, const float* x, const float* y, const float* z,
+    const uint8_t* lowFreq, float* densities, size_t count) {
+    densitypacket::EvaluatePackets<Avx512>(data, x, y, z, lowFreq, densities, count);
+}
+
+#if defined(__clang__)
+#pragma clang attribute pop
+#elif defined(__GNUC__)
+#pragma GCC pop_options
+#endif
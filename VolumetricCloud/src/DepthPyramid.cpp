@@ -0,0 +1,417 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "../includes/CloudSdf.h"
+#include "../includes/CpuCloudRenderer.h"
+#include "../includes/DensityField.h"
+#include "../includes/DepthPyramid.h"
+#include "../includes/EarthCurvature.h"
+#include "../includes/Fmap.h"
+#include "../includes/OccupancyGrid.h"
+
+using namespace hlsl;
+
+namespace {
+
+    // CLOUD_LAYER_SLAB_PAD of RayMarch.hlsl. only the view ray decides whether a pixel gets
+    // cloud, the light march starts from cloud samples and needs no pad here
+    const float kLayerReach = 16.0f;
+
+    int Wrap(int i, int n) { return ((i % n) + n) % n; }
+
+    // the reduction of every texel of level straight from level 0
+    float2 BruteForce(const DepthPyramid::Level& base, int level, int x, int y) {
+        float2 r(1e30f, -1e30f);
+        for (int py = y << level; py < (std::min)((y + 1) << level, base.height_); py++) {
+            for (int px = x << level; px < (std::min)((x + 1) << level, base.width_); px++) {
+                const float2& v = base.minMax_[static_cast<size_t>(py) * base.width_ + px];
+                r.x = (std::min)(r.x, v.x);
+                r.y = (std::max)(r.y, v.y);
+            }
+        }
+        return r;
+    }
+
+    // straight ray hit of the Report terrain: ground at altitude 0, a ridge across z = 2.5 km up
+    // to 450 m and a tower up to 2.5 km, y down. negative for sky
+    float TerrainHit(const float3& eye, const float3& dir) {
+        float hit = -1.0f;
+        const auto take = [&](float t) { if (t > 0.0f && (hit < 0.0f || t < hit)) { hit = t; } };
+        if (dir.y > 0.0f) { take(-eye.y / dir.y); }
+        if (dir.z > 0.0f) {
+            const float t = (2500.0f - eye.z) / dir.z;
+            if (-(eye.y + dir.y * t) <= 450.0f) { take(t); }
+        }
+        // slabs of the tower box
+        const float3 lo(-700.0f, -2500.0f, 1500.0f), hi(-400.0f, 0.0f, 1800.0f);
+        float tNear = 0.0f, tFar = 1e30f;
+        for (int a = 0; a < 3; a++) {
+            if (std::fabs(dir[a]) < 1e-9f) {
+                if (eye[a] < lo[a] || eye[a] > hi[a]) { tNear = 1e30f; }
+                continue;
+            }
+            const float t0 = (lo[a] - eye[a]) / dir[a], t1 = (hi[a] - eye[a]) / dir[a];
+            tNear = (std::max)(tNear, (std::min)(t0, t1));
+            tFar = (std::min)(tFar, (std::max)(t0, t1));
+        }
+        if (tNear <= tFar) { take(tNear); }
+        return hit;
+    }
+
+} // namespace
+
+bool DepthPyramid::Build(const std::vector<float>& depth, int width, int height, const Settings& settings) {
+    if (width <= 0 || height <= 0 || depth.size() != static_cast<size_t>(width) * height) {
+        std::cerr << "DepthPyramid: depth of " << depth.size() << " texels does not match " << width << "x" << height << std::endl;
+        return false;
+    }
+    settings_ = settings;
+    width_ = width;
+    height_ = height;
+
+    levels_.clear();
+    Level base;
+    base.width_ = width;
+    base.height_ = height;
+    base.minMax_.resize(depth.size());
+    for (size_t i = 0; i < depth.size(); i++) { base.minMax_[i] = float2(depth[i], depth[i]); }
+    levels_.push_back(std::move(base));
+
+    // CSDepthPyramidReduce: halved rounding up, children past the edge repeat the last one
+    while (levels_.back().width_ > 1 || levels_.back().height_ > 1) {
+        const Level& source = levels_.back();
+        Level next;
+        next.width_ = (source.width_ + 1) / 2;
+        next.height_ = (source.height_ + 1) / 2;
+        next.minMax_.resize(static_cast<size_t>(next.width_) * next.height_);
+        for (int y = 0; y < next.height_; y++) {
+            for (int x = 0; x < next.width_; x++) {
+                const int x0 = x * 2, y0 = y * 2;
+                const int x1 = (std::min)(x0 + 1, source.width_ - 1), y1 = (std::min)(y0 + 1, source.height_ - 1);
+                const auto at = [&](int cx, int cy) { return source.minMax_[static_cast<size_t>(cy) * source.width_ + cx]; };
+                const float2 a = at(x0, y0), b = at(x1, y0), c = at(x0, y1), d = at(x1, y1);
+                next.minMax_[static_cast<size_t>(y) * next.width_ + x] = float2(
+                    (std::min)({ a.x, b.x, c.x, d.x }), (std::max)({ a.y, b.y, c.y, d.y }));
+            }
+        }
+        levels_.push_back(std::move(next));
+    }
+    return true;
+}
+
+int DepthPyramid::TileLevel() const {
+    return std::clamp(settings_.tileLevel_, 0, (std::max)(static_cast<int>(levels_.size()) - 1, 0));
+}
+
+float DepthPyramid::TileFarthest(float u, float v) const {
+    if (levels_.empty()) { return 0.0f; }
+    const int level = TileLevel();
+    const Level& tiles = levels_[level];
+
+    // the texels of a linear, wrapped sample, then the tiles that hold them
+    const int bx = static_cast<int>(std::floor(u * width_ - 0.5f));
+    const int by = static_cast<int>(std::floor(v * height_ - 0.5f));
+    const int x0 = Wrap(bx, width_) >> level, x1 = Wrap(bx + 1, width_) >> level;
+    const int y0 = Wrap(by, height_) >> level, y1 = Wrap(by + 1, height_) >> level;
+    const auto at = [&](int x, int y) { return tiles.minMax_[static_cast<size_t>(y) * tiles.width_ + x].x; };
+    return (std::min)({ at(x0, y0), at(x1, y0), at(x0, y1), at(x1, y1) });
+}
+
+bool DepthPyramid::Culled(const std::vector<clouddensity::CloudLayerDesc>& layers, const float3& rayStart, const float3& rayDir,
+    float inStart, float rayEnd) {
+    const float2 alt = earthcurvature::CurvedRayAltitudeRange(rayStart, rayDir, inStart, (std::max)(inStart, rayEnd));
+    const size_t count = (std::min)(layers.size(), static_cast<size_t>(CLOUD_LAYER_MAX));
+    for (size_t l = 0; l < count; l++) {
+        if (alt.y + kLayerReach >= layers[l].noise_.z && alt.x - kLayerReach <= layers[l].noise_.w) { return false; }
+    }
+    return true;
+}
+
+std::string DepthPyramid::Report(DensityField& field, int width, int height, const std::string& resourceDir) {
+    std::ostringstream ss;
+    char line[256];
+    bool pass = true;
+    ss << "depth pyramid\n";
+
+    // the reduction on an odd size against brute force, sky holes included
+    {
+        const int w = 1000, h = 563;
+        std::mt19937 rng(48);
+        std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+        std::vector<float> depth(static_cast<size_t>(w) * h);
+        for (float& d : depth) { d = uniform(rng) < 0.1f ? 0.0f : uniform(rng); }
+
+        DepthPyramid pyramid;
+        pyramid.Build(depth, w, h);
+        int mismatches = 0;
+        size_t texels = 0;
+        for (int level = 0; level < static_cast<int>(pyramid.levels_.size()); level++) {
+            const Level& l = pyramid.levels_[level];
+            for (int y = 0; y < l.height_; y++) {
+                for (int x = 0; x < l.width_; x++) {
+                    const float2 expected = BruteForce(pyramid.levels_[0], level, x, y);
+                    const float2& got = l.minMax_[static_cast<size_t>(y) * l.width_ + x];
+                    if (got.x != expected.x || got.y != expected.y) { mismatches++; }
+                    texels++;
+                }
+            }
+        }
+        const Level& top = pyramid.levels_.back();
+        snprintf(line, sizeof(line), "  reduction %dx%d: %zu levels, top %dx%d, %d of %zu texels differ from brute force\n",
+            w, h, pyramid.levels_.size(), top.width_, top.height_, mismatches, texels);
+        ss << line;
+        pass = pass && mismatches == 0 && top.width_ == 1 && top.height_ == 1;
+
+        // the tiles under a bilinear footprint never hold a nearer farthest than its texels
+        int above = 0;
+        double slack = 0.0;
+        const int samples = 4096;
+        for (int s = 0; s < samples; s++) {
+            const float u = uniform(rng), v = uniform(rng);
+            const int bx = static_cast<int>(std::floor(u * w - 0.5f)), by = static_cast<int>(std::floor(v * h - 0.5f));
+            const auto at = [&](int x, int y) { return depth[static_cast<size_t>(Wrap(y, h)) * w + Wrap(x, w)]; };
+            const float footprint = (std::min)({ at(bx, by), at(bx + 1, by), at(bx, by + 1), at(bx + 1, by + 1) });
+            const float farthest = pyramid.TileFarthest(u, v);
+            if (farthest > footprint) { above++; }
+            slack += footprint - farthest;
+        }
+        snprintf(line, sizeof(line), "  tile farthest, level %d: %d of %d footprints nearer than their tile, mean slack %.3f\n",
+            pyramid.TileLevel(), above, samples, slack / samples);
+        ss << line;
+        pass = pass && above == 0;
+    }
+
+    if (field.NoiseLarge().texels_.empty()) {
+        ss << "  density field not initialized\n";
+        return ss.str();
+    }
+    const std::string path = resourceDir + "/40100.fmap";
+    if (!std::filesystem::exists(path)) {
+        ss << "  missing weather map " << path << "\n";
+        return ss.str();
+    }
+    field.SetWeather(Fmap(path));
+    field.SetTime(10.0);
+
+    OccupancyGrid grid;
+    CloudSdf sdf;
+    if (!grid.Build(field) || !sdf.Build(grid)) {
+        ss << "  occupancy grid or distance volume build failed\n";
+        return ss.str();
+    }
+
+    // 150 m up, looking just over the ridge at the layer base of 40100.fmap
+    CpuCloudView view;
+    view.eye_ = float3(0.0f, -150.0f, 0.0f);
+    view.lookAt_ = float3(0.0f, -350.0f, 4000.0f);
+    float3 forward, right, up;
+    CpuCloudRenderer::CameraBasis(view, forward, right, up);
+
+    CpuCloudRendererSettings settings;
+    settings.width_ = width;
+    settings.height_ = height;
+    const float range = settings.near_ / (settings.near_ - settings.far_);
+    const float tanY = std::tan(settings.vFovDeg_ * 0.5f * 3.14159265f / 180.0f);
+    const float tanX = tanY * width / height;
+    const auto rayThrough = [&](float u, float v) {
+        return normalize(forward + right * ((u * 2.0f - 1.0f) * tanX) + up * ((1.0f - v * 2.0f) * tanY));
+    };
+
+    // the primitive depth of the terrain at screen size
+    CpuCloudFrame primitive;
+    primitive.width_ = width;
+    primitive.height_ = height;
+    primitive.depth_.assign(static_cast<size_t>(width) * height, 0.0f);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            const float3 dir = rayThrough((x + 0.5f) / width, (y + 0.5f) / height);
+            const float hit = TerrainHit(view.eye_, dir);
+            if (hit < 0.0f) { continue; }
+            const float viewZ = (std::min)(hit * dot(dir, forward), settings.far_);
+            primitive.depth_[static_cast<size_t>(y) * width + x] = range * (1.0f - settings.far_ / viewZ);
+        }
+    }
+    DepthPyramid pyramid;
+    pyramid.Build(primitive.depth_, width, height);
+
+    CpuCloudSources sources;
+    sources.occupancy_ = &grid;
+    sources.sdf_ = &sdf;
+    sources.primitive_ = &primitive;
+
+    ss << "  terrain " << width << "x" << height << " over 40100.fmap, layer base " << static_cast<int>(field.Layers()[0].noise_.z)
+       << " m, camera 150 m up, ridge 450 m, tower 2.5 km\n";
+    snprintf(line, sizeof(line), "  %-6s %9s %9s %9s %10s %12s %12s %12s %10s\n", "scale", "by pixel", "by tile", "tile only", "tiles",
+        "pixel steps", "tile steps", "tile samples", "max diff");
+    ss << line;
+    CpuCloudRenderer renderer;
+    uint64_t tileOnlyTotal = 0;
+    for (const int scale : { 1, 2 }) {
+        CpuCloudRendererSettings low = settings;
+        low.width_ = width / scale;
+        low.height_ = height / scale;
+
+        // the march without any cull, with the layer check of RayMarch on the depth of the
+        // pixel, and with the pyramid tile in front of it
+        CpuCloudFrame frames[3];
+        for (int m = 0; m < 3; m++) {
+            low.layerCull_ = m >= 1;
+            low.useDepthPyramid_ = m == 2;
+            CpuCloudSources s = sources;
+            s.depthPyramid_ = &pyramid;
+            renderer.Initialize(low);
+            renderer.Render(field, view, frames[m], s);
+        }
+
+        // pixels the tile bound culls and the cloud pixel tiles of the pyramid tile size that
+        // were emptied whole. tile only: culled with the pyramid, marched without
+        const int tile = 1 << pyramid.TileLevel();
+        const int tilesX = (low.width_ + tile - 1) / tile, tilesY = (low.height_ + tile - 1) / tile;
+        std::vector<int> tileKept(static_cast<size_t>(tilesX) * tilesY, 0);
+        int byTile = 0;
+        float maxDiff = 0.0f;
+        for (int y = 0; y < low.height_; y++) {
+            for (int x = 0; x < low.width_; x++) {
+                const size_t i = static_cast<size_t>(y) * low.width_ + x;
+                const float3 dir = rayThrough((x + 0.5f) / low.width_, (y + 0.5f) / low.height_);
+                for (int m = 1; m < 3; m++) {
+                    const float4 d = frames[m].color_[i] - frames[0].color_[i];
+                    maxDiff = (std::max)({ maxDiff, std::fabs(d.x), std::fabs(d.y), std::fabs(d.z), std::fabs(d.w),
+                        std::fabs(frames[m].depth_[i] - frames[0].depth_[i]) });
+                }
+                const float u = (x + 0.5f) / low.width_, v = (y + 0.5f) / low.height_;
+                const float farthest = pyramid.TileFarthest(u, v);
+                const bool culled = farthest > 0.0f
+                    && Culled(field.Layers(), view.eye_, dir, low.inStart_, -range * low.far_ / (farthest - range) / dot(dir, forward));
+                if (culled) { byTile++; } else { tileKept[static_cast<size_t>(y / tile) * tilesX + x / tile] = 1; }
+            }
+        }
+        const uint64_t tileOnly = frames[2].culledPixels_ - frames[1].culledPixels_;
+        tileOnlyTotal += tileOnly;
+        const int tilesCulled = static_cast<int>(std::count(tileKept.begin(), tileKept.end(), 0));
+        const double pixels = static_cast<double>(low.width_) * low.height_;
+        char tiles[32], pixelSteps[32], tileSteps[32], tileSamples[32];
+        snprintf(tiles, sizeof(tiles), "%d/%d", tilesCulled, tilesX * tilesY);
+        snprintf(pixelSteps, sizeof(pixelSteps), "%.3fx", static_cast<double>(frames[1].marchSteps_) / (std::max)(frames[0].marchSteps_, uint64_t(1)));
+        snprintf(tileSteps, sizeof(tileSteps), "%.3fx", static_cast<double>(frames[2].marchSteps_) / (std::max)(frames[1].marchSteps_, uint64_t(1)));
+        snprintf(tileSamples, sizeof(tileSamples), "%.3fx", static_cast<double>(frames[2].densitySamples_) / (std::max)(frames[1].densitySamples_, uint64_t(1)));
+        snprintf(line, sizeof(line), "  1/%-4d %8.1f%% %8.1f%% %9llu %10s %12s %12s %12s %10.3g\n", scale,
+            100.0 * frames[1].culledPixels_ / pixels, 100.0 * byTile / pixels, static_cast<unsigned long long>(tileOnly), tiles, pixelSteps, tileSteps, tileSamples, maxDiff);
+        ss << line;
+
+        // the culled pixels hold no cloud and the layer check saves steps
+        pass = pass && maxDiff == 0.0f && frames[1].culledPixels_ > 0 && frames[1].marchSteps_ < frames[0].marchSteps_;
+    }
+    ss << "  pixel steps: the layer check of RayMarch against no cull, tile steps: the pyramid on top of it\n";
+    ss << "  the tile bound culls " << (tileOnlyTotal == 0 ? "no pixel" : "pixels") << " the layer check of the pixel keeps ("
+        << tileOnlyTotal << "), one more fetch per pixel for " << (tileOnlyTotal == 0 ? "nothing, USE_DEPTH_PYRAMID stays off" : "those") << "\n";
+    ss << (pass ? "  PASS\n" : "  FAIL\n");
+    return ss.str();
+}
+
+#ifdef _WIN32
+bool DepthPyramid::CreateResources(int width, int height) {
+    width_ = width;
+    height_ = height;
+    levelSRVs_.clear();
+    levelUAVs_.clear();
+
+    int levels = 1;
+    for (int w = width, h = height; w > 1 || h > 1; w = (w + 1) / 2, h = (h + 1) / 2) { levels++; }
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width = width;
+    desc.Height = height;
+    desc.MipLevels = levels;
+    desc.ArraySize = 1;
+    desc.Format = DXGI_FORMAT_R32G32_FLOAT;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+
+    HRESULT hr = Renderer::device->CreateTexture2D(&desc, nullptr, &pyramidTEX_);
+    if (FAILED(hr)) return false;
+    hr = Renderer::device->CreateShaderResourceView(pyramidTEX_.Get(), nullptr, &pyramidSRV_);
+    if (FAILED(hr)) return false;
+
+    for (int level = 0; level < levels; level++) {
+        D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+        srvDesc.Format = desc.Format;
+        srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
+        srvDesc.Texture2D.MostDetailedMip = level;
+        srvDesc.Texture2D.MipLevels = 1;
+        ComPtr<ID3D11ShaderResourceView> srv;
+        hr = Renderer::device->CreateShaderResourceView(pyramidTEX_.Get(), &srvDesc, &srv);
+        if (FAILED(hr)) return false;
+        levelSRVs_.push_back(srv);
+
+        D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+        uavDesc.Format = desc.Format;
+        uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
+        uavDesc.Texture2D.MipSlice = level;
+        ComPtr<ID3D11UnorderedAccessView> uav;
+        hr = Renderer::device->CreateUnorderedAccessView(pyramidTEX_.Get(), &uavDesc, &uav);
+        if (FAILED(hr)) return false;
+        levelUAVs_.push_back(uav);
+    }
+
+    // cbuffer DepthPyramidBuffer
+    D3D11_BUFFER_DESC bufferDesc = {};
+    bufferDesc.ByteWidth = sizeof(int) * 4;
+    bufferDesc.Usage = D3D11_USAGE_DEFAULT;
+    bufferDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    hr = Renderer::device->CreateBuffer(&bufferDesc, nullptr, &sizeBuffer_);
+    if (FAILED(hr)) return false;
+
+    if (!copyShader_) {
+        ComPtr<ID3DBlob> blob;
+        hr = Renderer::CompileShaderFromFile(L"shaders/DepthPyramid.hlsl", "CSDepthPyramidCopy", "cs_5_0", blob);
+        if (FAILED(hr)) return false;
+        hr = Renderer::device->CreateComputeShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &copyShader_);
+        if (FAILED(hr)) return false;
+        hr = Renderer::CompileShaderFromFile(L"shaders/DepthPyramid.hlsl", "CSDepthPyramidReduce", "cs_5_0", blob);
+        if (FAILED(hr)) return false;
+        hr = Renderer::device->CreateComputeShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &reduceShader_);
+        if (FAILED(hr)) return false;
+    }
+    return true;
+}
+
+void DepthPyramid::Dispatch(ID3D11ShaderResourceView* depth) {
+    if (!copyShader_ || !reduceShader_ || levelUAVs_.empty()) { return; }
+
+    // the depth target is still bound for writing after the primitive pass
+    Renderer::context->OMSetRenderTargets(0, nullptr, nullptr);
+    Renderer::context->CSSetConstantBuffers(0, 1, sizeBuffer_.GetAddressOf());
+
+    int w = width_, h = height_;
+    for (size_t level = 0; level < levelUAVs_.size(); level++) {
+        const int sourceW = w, sourceH = h;
+        if (level > 0) {
+            w = (w + 1) / 2;
+            h = (h + 1) / 2;
+        }
+        const int size[4] = { w, h, sourceW, sourceH };
+        Renderer::context->UpdateSubresource(sizeBuffer_.Get(), 0, nullptr, size, 0, 0);
+
+        ID3D11ShaderResourceView* const srvs[] = { level == 0 ? depth : nullptr, level == 0 ? nullptr : levelSRVs_[level - 1].Get() };
+        Renderer::context->CSSetShader(level == 0 ? copyShader_.Get() : reduceShader_.Get(), nullptr, 0);
+        // the level read is unbound as a target before it is bound as a texture
+        Renderer::context->CSSetUnorderedAccessViews(0, 1, levelUAVs_[level].GetAddressOf(), nullptr);
+        Renderer::context->CSSetShaderResources(0, _countof(srvs), srvs);
+        Renderer::context->Dispatch((w + 7) / 8, (h + 7) / 8, 1);
+    }
+
+    // RayMarch reads the whole chain as a texture
+    ID3D11ShaderResourceView* const nullSRVs[] = { nullptr, nullptr };
+    ID3D11UnorderedAccessView* const nullUAV = nullptr;
+    Renderer::context->CSSetShaderResources(0, _countof(nullSRVs), nullSRVs);
+    Renderer::context->CSSetUnorderedAccessViews(0, 1, &nullUAV, nullptr);
+}
+#endif
@@ -0,0 +1,85 @@
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <sstream>
+
+#include "../includes/EarthCurvature.h"
+
+namespace earthcurvature {
+
+    namespace {
+
+        struct Double3 {
+            double x, y, z;
+        };
+
+        double Distance(const float3& a, const Double3& b) {
+            const double dx = a.x - b.x, dy = a.y - b.y, dz = a.z - b.z;
+            return std::sqrt(dx * dx + dy * dy + dz * dz);
+        }
+
+        // the arc in double, the reference for both float paths
+        Double3 ExactPosition(const float3& start, const float3& dir, double d) {
+            const double r = EARTH_RADIUS_M;
+            const double a = d / r;
+            const double along = r * std::sin(a);
+            const double drop = 2.0 * r * std::sin(a * 0.5) * std::sin(a * 0.5);
+            return { start.x + dir.x * along, start.y + dir.y * along - drop, start.z + dir.z * along };
+        }
+
+        Double3 ExactTangent(const float3& dir, double d) {
+            const double a = d / EARTH_RADIUS_M;
+            return { dir.x * std::cos(a), dir.y * std::cos(a) - std::sin(a), dir.z * std::cos(a) };
+        }
+
+    } // namespace
+
+    float3 AdjustForEarthCurvature(const float3& rayPos, const float3& rayStart) {
+        const float3 dir = normalize(rayPos - rayStart);
+        const float distance = length(rayPos - rayStart);
+        const float angle = distance / EARTH_RADIUS_M;
+        return rayStart + EARTH_RADIUS_M * std::sin(angle) * dir - float3(0.0f, EARTH_RADIUS_M * (1.0f - std::cos(angle)), 0.0f);
+    }
+
+    std::string Report(int rays, int steps) {
+        std::mt19937 rng(38);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::uniform_real_distribution<float> horizontal(-0.5f * MAX_LENGTH_M, 0.5f * MAX_LENGTH_M);
+        std::uniform_real_distribution<float> altitude(0.0f, 12000.0f);
+
+        double polyErr = 0.0, polyErrD = 0.0, oldErr = 0.0, oldErrD = 0.0, tangentErr = 0.0, altErr = 0.0;
+        for (int r = 0; r < rays; r++) {
+            const float3 start(horizontal(rng), -altitude(rng), horizontal(rng));
+            // uniform on the sphere, the grazing rays near the horizon are the long ones
+            const float z = unit(rng) * 2.0f - 1.0f;
+            const float phi = unit(rng) * 6.2831853f;
+            const float s = std::sqrt(1.0f - z * z);
+            const float3 dir = normalize(float3(s * std::cos(phi), z, s * std::sin(phi)));
+
+            for (int i = 0; i <= steps; i++) {
+                const float d = MAX_LENGTH_M * static_cast<float>(i) / steps;
+                const Double3 exact = ExactPosition(start, dir, d);
+
+                const float3 poly = CurvedRayPosition(start, dir, d);
+                const double err = Distance(poly, exact);
+                if (err > polyErr) { polyErr = err; polyErrD = d; }
+                altErr = (std::max)(altErr, std::fabs(static_cast<double>(poly.y) - exact.y));
+
+                const float3 old = AdjustForEarthCurvature(start + dir * d, start);
+                const double errOld = Distance(old, exact);
+                if (errOld > oldErr) { oldErr = errOld; oldErrD = d; }
+
+                tangentErr = (std::max)(tangentErr, Distance(CurvedRayTangent(dir, d), ExactTangent(dir, d)));
+            }
+        }
+
+        std::ostringstream ss;
+        ss << "earth curvature, " << rays << " rays x " << steps + 1 << " steps out to " << MAX_LENGTH_M << " m, max error vs double arc\n";
+        ss << "  polynomial position " << polyErr << " m at " << polyErrD << " m, altitude " << altErr << " m\n";
+        ss << "  polynomial tangent " << tangentErr << "\n";
+        ss << "  AdjustForEarthCurvature " << oldErr << " m at " << oldErrD << " m\n";
+        ss << ((polyErr < MAX_ERROR_M) ? "  PASS\n" : "  FAIL\n");
+        return ss.str();
+    }
+
+} // namespace earthcurvature
@@ -0,0 +1,577 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <vector>
+
+#include "../includes/CloudSdf.h"
+#include "../includes/CpuCloudRenderer.h"
+#include "../includes/DensityClipmap.h"
+#include "../includes/DensityField.h"
+#include "../includes/EarthCurvature.h"
+#include "../includes/FarCloudCache.h"
+#include "../includes/Fmap.h"
+#include "../includes/OccupancyGrid.h"
+
+using namespace hlsl;
+
+namespace {
+
+    const float kPi = 3.14159265f;
+    const float kRadToDeg = 180.0f / kPi;
+
+    // CLOUD_LAYER_SLAB_PAD of RayMarch.hlsl
+    const float kLayerReach = 16.0f;
+
+    float AngleDeg(const float3& a, const float3& b) {
+        return std::acos(std::clamp(dot(normalize(a), normalize(b)), -1.0f, 1.0f)) * kRadToDeg;
+    }
+
+    // above the horizon is positive, y points down
+    float ElevationDeg(const float3& dir) {
+        return std::asin(std::clamp(-dir.y / length(dir), -1.0f, 1.0f)) * kRadToDeg;
+    }
+
+    // mean absolute rgba difference per pixel, over the 4 channels
+    double MeanError(const CpuCloudFrame& a, const CpuCloudFrame& b) {
+        double sum = 0.0;
+        for (size_t i = 0; i < a.color_.size(); i++) {
+            const float4 d = a.color_[i] - b.color_[i];
+            sum += (std::fabs(d.x) + std::fabs(d.y) + std::fabs(d.z) + std::fabs(d.w)) * 0.25;
+        }
+        return sum / (std::max)(a.color_.size(), size_t(1));
+    }
+
+} // namespace
+
+bool FarCloudCache::Initialize(const cloudcascade::Cascade& band, const Settings& settings) {
+    if (settings.faceSize_ <= 0 || settings.tileSize_ <= 0 || settings.faceSize_ % settings.tileSize_ != 0
+        || settings.tilesPerFrame_ <= 0 || band.end_ <= band.start_) {
+        std::cerr << "FarCloudCache: faces of " << settings.faceSize_ << " in tiles of " << settings.tileSize_
+            << ", band " << band.start_ << " to " << band.end_ << std::endl;
+        return false;
+    }
+    settings_ = settings;
+    band_ = band;
+    texels_.assign(static_cast<size_t>(settings.faceSize_) * settings.faceSize_ * 6, float4(0.0f));
+
+    // the directions of a tile do not depend on the camera, only the march does
+    const int n = TilesPerFace();
+    const float size = static_cast<float>(settings.faceSize_);
+    const int grid = 8;
+    tiles_.clear();
+    for (int face = 0; face < 6; face++) {
+        for (int ty = 0; ty < n; ty++) {
+            for (int tx = 0; tx < n; tx++) {
+                Tile tile;
+                tile.face_ = face;
+                tile.x_ = tx * settings.tileSize_;
+                tile.y_ = ty * settings.tileSize_;
+                const float u0 = tile.x_ / size, v0 = tile.y_ / size;
+                const float span = settings.tileSize_ / size;
+                tile.center_ = normalize(FaceDirection(face, u0 + span * 0.5f, v0 + span * 0.5f));
+
+                // elevation on a grid over the tile, padded by the angle between grid points
+                float low = 90.0f, high = -90.0f;
+                for (int j = 0; j <= grid; j++) {
+                    for (int i = 0; i <= grid; i++) {
+                        const float3 dir = FaceDirection(face, u0 + span * i / grid, v0 + span * j / grid);
+                        const float elevation = ElevationDeg(dir);
+                        low = (std::min)(low, elevation);
+                        high = (std::max)(high, elevation);
+                        if ((i == 0 || i == grid) && (j == 0 || j == grid)) {
+                            tile.radiusDeg_ = (std::max)(tile.radiusDeg_, AngleDeg(tile.center_, dir));
+                        }
+                    }
+                }
+                const float pad = tile.radiusDeg_ * 2.0f / grid;
+                tile.elevationDeg_ = float2((std::max)(low - pad, -90.0f), (std::min)(high + pad, 90.0f));
+                tiles_.push_back(tile);
+            }
+        }
+    }
+    regions_.clear();
+    return true;
+}
+
+float3 FarCloudCache::FaceDirection(int face, float u, float v) {
+    const float s = u * 2.0f - 1.0f, t = v * 2.0f - 1.0f;
+    switch (face) {
+    case 0: return float3(1.0f, -t, -s);
+    case 1: return float3(-1.0f, -t, s);
+    case 2: return float3(s, 1.0f, t);
+    case 3: return float3(s, -1.0f, -t);
+    case 4: return float3(s, -t, 1.0f);
+    default: return float3(-s, -t, -1.0f);
+    }
+}
+
+void FarCloudCache::DirectionToFace(const float3& dir, int& face, float& u, float& v) {
+    const float ax = std::fabs(dir.x), ay = std::fabs(dir.y), az = std::fabs(dir.z);
+    float sc, tc, ma;
+    if (ax >= ay && ax >= az) {
+        face = dir.x >= 0.0f ? 0 : 1;
+        sc = dir.x >= 0.0f ? -dir.z : dir.z;
+        tc = -dir.y;
+        ma = ax;
+    }
+    else if (ay >= az) {
+        face = dir.y >= 0.0f ? 2 : 3;
+        sc = dir.x;
+        tc = dir.y >= 0.0f ? dir.z : -dir.z;
+        ma = ay;
+    }
+    else {
+        face = dir.z >= 0.0f ? 4 : 5;
+        sc = dir.z >= 0.0f ? dir.x : -dir.x;
+        tc = -dir.y;
+        ma = az;
+    }
+    u = (sc / ma + 1.0f) * 0.5f;
+    v = (tc / ma + 1.0f) * 0.5f;
+}
+
+bool FarCloudCache::Visible(const Tile& tile, const View& view) const {
+    return AngleDeg(tile.center_, view.forward_) <= view.viewHalfAngleDeg_ + tile.radiusDeg_;
+}
+
+bool FarCloudCache::Reachable(const Tile& tile, const View& view) const {
+    // the altitude along a bent ray grows with its elevation at every distance, so the lowest
+    // and the highest ray of the tile bound the altitudes of all of them
+    const auto direction = [](float deg) {
+        const float r = deg / kRadToDeg;
+        return float3(std::cos(r), -std::sin(r), 0.0f);
+    };
+    const float2 low = earthcurvature::CurvedRayAltitudeRange(view.eye_, direction(tile.elevationDeg_.x), band_.start_, band_.end_);
+    const float2 high = earthcurvature::CurvedRayAltitudeRange(view.eye_, direction(tile.elevationDeg_.y), band_.start_, band_.end_);
+    const float lowest = (std::min)(low.x, high.x), highest = (std::max)(low.y, high.y);
+    return highest >= view.cloudAltitude_.x - kLayerReach && lowest <= view.cloudAltitude_.y + kLayerReach;
+}
+
+float FarCloudCache::Staleness(const Tile& tile, const View& view) const {
+    if (!tile.marched_) { return std::numeric_limits<float>::infinity(); }
+
+    // sideways move of the camera against the texel angle at the band start
+    const float texelAngle = kPi * 0.5f / settings_.faceSize_;
+    const float sideways = length(cross(view.eye_ - tile.eye_, tile.center_));
+    const float parallax = sideways / (std::max)(band_.start_, 1.0f) / texelAngle / settings_.maxParallaxTexels_;
+
+    const float sun = AngleDeg(view.sunDir_, tile.sunDir_) / settings_.maxSunTurnDeg_;
+    const float age = static_cast<float>(view.frame_ - tile.frame_) / (std::max)(settings_.maxAgeFrames_, 1);
+    return (std::max)({ parallax, sun, age }) * (Visible(tile, view) ? 1.0f : settings_.offscreenWeight_);
+}
+
+const std::vector<FarCloudCache::Region>& FarCloudCache::Update(const View& view) {
+    regions_.clear();
+    if (!Ready()) { return regions_; }
+
+    struct Candidate {
+        int tile_;
+        float staleness_;
+        bool visible_;
+        float angle_;
+    };
+    std::vector<Candidate> candidates;
+    for (int i = 0; i < static_cast<int>(tiles_.size()); i++) {
+        Tile& tile = tiles_[i];
+        if (!Reachable(tile, view)) {
+            if (tile.marched_) {
+                regions_.push_back({ i, true });
+                tile.marched_ = false;
+            }
+            continue;
+        }
+        const float staleness = Staleness(tile, view);
+        if (staleness < 1.0f) { continue; }
+        candidates.push_back({ i, staleness, Visible(tile, view), AngleDeg(tile.center_, view.forward_) });
+    }
+
+    // never marched first, in view first, then the stalest, nearest the view direction on ties
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        if (a.staleness_ != b.staleness_) { return a.staleness_ > b.staleness_; }
+        if (a.visible_ != b.visible_) { return a.visible_; }
+        return a.angle_ < b.angle_;
+    });
+    const int count = (std::min)(static_cast<int>(candidates.size()), settings_.tilesPerFrame_);
+    for (int c = 0; c < count; c++) {
+        Tile& tile = tiles_[candidates[c].tile_];
+        tile.marched_ = true;
+        tile.eye_ = view.eye_;
+        tile.sunDir_ = view.sunDir_;
+        tile.frame_ = view.frame_;
+        regions_.push_back({ candidates[c].tile_, false });
+    }
+    return regions_;
+}
+
+void FarCloudCache::Invalidate() {
+    for (Tile& tile : tiles_) {
+        if (tile.marched_) { tile.frame_ -= static_cast<uint32_t>((std::max)(settings_.maxAgeFrames_, 1)); }
+    }
+}
+
+int FarCloudCache::MarchedTiles() const {
+    return static_cast<int>(std::count_if(tiles_.begin(), tiles_.end(), [](const Tile& tile) { return tile.marched_; }));
+}
+
+uint64_t FarCloudCache::Fill(const DensityField& field, const CpuCloudView& view, const CpuCloudSources& sources) {
+    const int size = settings_.faceSize_;
+    const int ts = settings_.tileSize_;
+    std::vector<float3> dirs;
+    std::vector<size_t> targets;
+    for (const Region& region : regions_) {
+        const Tile& tile = tiles_[region.tile_];
+        for (int y = tile.y_; y < tile.y_ + ts; y++) {
+            for (int x = tile.x_; x < tile.x_ + ts; x++) {
+                const size_t i = (static_cast<size_t>(tile.face_) * size + y) * size + x;
+                if (region.clear_) {
+                    texels_[i] = float4(0.0f);
+                    continue;
+                }
+                dirs.push_back(normalize(FaceDirection(tile.face_, (x + 0.5f) / size, (y + 0.5f) / size)));
+                targets.push_back(i);
+            }
+        }
+    }
+    if (dirs.empty()) { return 0; }
+
+    // the far band of CSFarCloudCache: no jitter, no primitive
+    CpuCloudRenderer renderer;
+    renderer.Initialize(cloudcascade::BandSettings(band_, CpuCloudRendererSettings()));
+    std::vector<float4> color;
+    const uint64_t steps = renderer.March(field, view, dirs, color, sources);
+    for (size_t i = 0; i < targets.size(); i++) { texels_[targets[i]] = color[i]; }
+    return steps;
+}
+
+float4 FarCloudCache::Sample(const float3& dir) const {
+    int face;
+    float u, v;
+    DirectionToFace(dir, face, u, v);
+    const int size = settings_.faceSize_;
+    const float tx = std::clamp(u * size - 0.5f, 0.0f, size - 1.0f);
+    const float ty = std::clamp(v * size - 0.5f, 0.0f, size - 1.0f);
+    const int x0 = static_cast<int>(tx), y0 = static_cast<int>(ty);
+    const int x1 = (std::min)(x0 + 1, size - 1), y1 = (std::min)(y0 + 1, size - 1);
+    const float fx = tx - x0, fy = ty - y0;
+    const auto at = [&](int x, int y) { return texels_[(static_cast<size_t>(face) * size + y) * size + x]; };
+    return (at(x0, y0) * (1.0f - fx) + at(x1, y0) * fx) * (1.0f - fy) + (at(x0, y1) * (1.0f - fx) + at(x1, y1) * fx) * fy;
+}
+
+void FarCloudCache::Resolve(const CpuCloudRendererSettings& settings, const CpuCloudView& view, CpuCloudFrame& frame) const {
+    float3 forward, right, up;
+    CpuCloudRenderer::CameraBasis(view, forward, right, up);
+    const float tanY = std::tan(settings.vFovDeg_ * (kPi / 180.0f) * 0.5f);
+    const float tanX = tanY * settings.width_ / settings.height_;
+
+    frame.width_ = settings.width_;
+    frame.height_ = settings.height_;
+    frame.color_.assign(static_cast<size_t>(settings.width_) * settings.height_, float4(0.0f));
+    frame.depth_.assign(frame.color_.size(), 0.0f);
+    for (int y = 0; y < settings.height_; y++) {
+        for (int x = 0; x < settings.width_; x++) {
+            const float ndcX = (x + 0.5f) / settings.width_ * 2.0f - 1.0f;
+            const float ndcY = 1.0f - (y + 0.5f) / settings.height_ * 2.0f;
+            const float3 dir = normalize(forward + right * (ndcX * tanX) + up * (ndcY * tanY));
+            frame.color_[static_cast<size_t>(y) * settings.width_ + x] = Sample(dir);
+        }
+    }
+}
+
+std::string FarCloudCache::Report(DensityField& field, int width, int height, const std::string& resourceDir) {
+    std::ostringstream ss;
+    char line[256];
+    bool pass = true;
+    ss << "far cloud cache\n";
+
+    // the cube directions against the lookup
+    {
+        int wrong = 0;
+        const int size = 16;
+        for (int face = 0; face < 6; face++) {
+            for (int y = 0; y < size; y++) {
+                for (int x = 0; x < size; x++) {
+                    int f;
+                    float u, v;
+                    DirectionToFace(normalize(FaceDirection(face, (x + 0.5f) / size, (y + 0.5f) / size)), f, u, v);
+                    if (f != face || std::fabs(u * size - (x + 0.5f)) > 1e-3f || std::fabs(v * size - (y + 0.5f)) > 1e-3f) { wrong++; }
+                }
+            }
+        }
+        ss << "  cube addressing: " << wrong << " of " << 6 * size * size << " texel directions map elsewhere\n";
+        pass = pass && wrong == 0;
+    }
+
+    if (field.NoiseLarge().texels_.empty()) {
+        ss << "  density field not initialized\n";
+        return ss.str();
+    }
+    const std::string path = resourceDir + "/40100.fmap";
+    if (!std::filesystem::exists(path)) {
+        ss << "  missing weather map " << path << "\n";
+        return ss.str();
+    }
+    field.SetWeather(Fmap(path));
+    field.SetTime(10.0);
+
+    const cloudcascade::Cascade farBand = cloudcascade::DefaultCascades().back();
+
+    // cruise at 10 km over the layer tops looking at the horizon, 250 m/s at 60 Hz
+    CpuCloudView cruise;
+    cruise.eye_ = float3(0.0f, -10000.0f, 0.0f);
+    cruise.lookAt_ = float3(0.0f, -10000.0f, 10000.0f);
+    CpuCloudRendererSettings settings;
+    settings.width_ = width;
+    settings.height_ = height;
+    const float3 velocity = float3(0.0f, 0.0f, 250.0f / 60.0f);
+
+    View plan;
+    plan.eye_ = cruise.eye_;
+    plan.forward_ = normalize(cruise.lookAt_ - cruise.eye_);
+    plan.sunDir_ = normalize(cruise.lightDir_);
+    plan.cloudAltitude_ = DensityClipmap::AltitudeBand(field.Layers());
+    const float tanY = std::tan(settings.vFovDeg_ * 0.5f / kRadToDeg);
+    plan.viewHalfAngleDeg_ = std::atan(tanY * std::sqrt(1.0f + static_cast<float>(width * width) / (height * height))) * kRadToDeg;
+
+    // the planner alone with the default layout
+    {
+        FarCloudCache cache;
+        cache.Initialize(farBand);
+        View view = plan;
+
+        // first fill of a still camera: everything in view before anything behind
+        int reachable = 0, visible = 0;
+        for (const Tile& tile : cache.Tiles()) {
+            if (cache.Reachable(tile, view)) {
+                reachable++;
+                if (cache.Visible(tile, view)) { visible++; }
+            }
+        }
+        int frames = 0, marchedInView = 0;
+        bool viewFirst = true;
+        for (; frames < 1000; frames++) {
+            view.frame_ = frames;
+            const std::vector<Region>& regions = cache.Update(view);
+            if (regions.empty()) { break; }
+            for (const Region& region : regions) {
+                const bool inView = cache.Visible(cache.Tiles()[region.tile_], view);
+                if (!inView && marchedInView < visible) { viewFirst = false; }
+                if (inView) { marchedInView++; }
+            }
+        }
+        int restless = 0;
+        for (int f = 0; f < 60; f++) {
+            view.frame_ = frames + f;
+            restless += static_cast<int>(cache.Update(view).size());
+        }
+        snprintf(line, sizeof(line), "  first fill: %d of %zu tiles reachable, %d in view, at rest after %d frames, %d tiles over the next second\n",
+            reachable, cache.Tiles().size(), visible, frames, restless);
+        ss << line;
+        pass = pass && viewFirst && cache.MarchedTiles() == reachable && restless == 0 && reachable < static_cast<int>(cache.Tiles().size());
+
+        // cruise with the sun turning 1 degree a second, 20 seconds
+        View moving = view;
+        const uint32_t start = view.frame_ + 1;
+        float worstInView = 0.0f;
+        uint64_t tiles = 0;
+        int busiest = 0;
+        const int cruiseFrames = 1200;
+        for (int f = 0; f < cruiseFrames; f++) {
+            moving.frame_ = start + f;
+            moving.eye_ = view.eye_ + velocity * static_cast<float>(f);
+            const float sunDeg = 45.0f + f / 60.0f;
+            moving.sunDir_ = float3(std::cos(sunDeg / kRadToDeg), std::sin(sunDeg / kRadToDeg), 0.0f);
+            const size_t count = cache.Update(moving).size();
+            tiles += count;
+            busiest = (std::max)(busiest, static_cast<int>(count));
+            for (const Tile& tile : cache.Tiles()) {
+                if (tile.marched_ && cache.Visible(tile, moving)) { worstInView = (std::max)(worstInView, cache.Staleness(tile, moving)); }
+            }
+        }
+        snprintf(line, sizeof(line), "  cruise 20 s, sun 1 deg/s: %.2f tiles a frame, at most %d, stalest tile in view %.2f of its limit\n",
+            static_cast<double>(tiles) / cruiseFrames, busiest, worstInView);
+        ss << line;
+        pass = pass && busiest <= cache.settings_.tilesPerFrame_ && worstInView < 1.5f;
+
+        // climbing from inside the layers to over them: tiles that lose the clouds are cleared
+        View climb = plan;
+        FarCloudCache climbing;
+        climbing.Initialize(farBand);
+        int clears = 0;
+        for (int f = 0; f < 2400; f++) {
+            climb.frame_ = f;
+            climb.eye_ = float3(0.0f, -(3000.0f + 9000.0f * f / 2399.0f), 0.0f);
+            for (const Region& region : climbing.Update(climb)) { clears += region.clear_ ? 1 : 0; }
+        }
+        int unreachableMarched = 0;
+        for (const Tile& tile : climbing.Tiles()) {
+            if (tile.marched_ && !climbing.Reachable(tile, climb)) { unreachableMarched++; }
+        }
+        snprintf(line, sizeof(line), "  climb 3 to 12 km: %d tiles cleared, %d marched tiles out of reach at the top\n", clears, unreachableMarched);
+        ss << line;
+        pass = pass && clears > 0 && unreachableMarched == 0;
+    }
+
+    OccupancyGrid grid;
+    CloudSdf sdf;
+    if (!grid.Build(field) || !sdf.Build(grid)) {
+        ss << "  occupancy grid or distance volume build failed\n";
+        return ss.str();
+    }
+    CpuCloudSources sources;
+    sources.occupancy_ = &grid;
+    sources.sdf_ = &sdf;
+
+    // a cube of the angular size of the half size far cascade, filled at the start, then 10 s
+    // of cruise refreshing what Update hands out
+    FarCloudCacheSettings small;
+    small.faceSize_ = 64;
+    small.tileSize_ = 16;
+    small.tilesPerFrame_ = 2;
+    FarCloudCache cache;
+    cache.Initialize(farBand, small);
+
+    View view = plan;
+    uint64_t fillSteps = 0;
+    for (view.frame_ = 0; !cache.Update(view).empty(); view.frame_++) {
+        fillSteps += cache.Fill(field, cruise, sources);
+    }
+    const int cruiseFrames = 600;
+    uint64_t cruiseSteps = 0;
+    CpuCloudView end = cruise;
+    for (int f = 1; f <= cruiseFrames; f++) {
+        view.frame_++;
+        end.eye_ = cruise.eye_ + velocity * static_cast<float>(f);
+        end.lookAt_ = cruise.lookAt_ + velocity * static_cast<float>(f);
+        view.eye_ = end.eye_;
+        cache.Update(view);
+        cruiseSteps += cache.Fill(field, end, sources);
+    }
+
+    // the frame at the end of the cruise: one march, the cascades, the near band over the cube
+    CpuCloudRenderer renderer;
+    const auto render = [&](const CpuCloudRendererSettings& s, CpuCloudFrame& frame) {
+        renderer.Initialize(s);
+        renderer.Render(field, end, frame, sources);
+    };
+    const std::vector<cloudcascade::Cascade> cascades = cloudcascade::DefaultCascades();
+    CpuCloudFrame reference, nearBand, farFrame, cascaded, cubeFrame, cached;
+    render(settings, reference);
+    render(cloudcascade::BandSettings(cascades.front(), settings), nearBand);
+    render(cloudcascade::BandSettings(farBand, settings), farFrame);
+    cloudcascade::Composite({ &nearBand, &farFrame }, cascaded);
+    cache.Resolve(settings, end, cubeFrame);
+    cloudcascade::Composite({ &nearBand, &cubeFrame }, cached);
+
+    const double cascadeFarSteps = static_cast<double>(farFrame.marchSteps_) / (std::max)(farBand.updateInterval_, 1);
+    const double cacheFarSteps = static_cast<double>(cruiseSteps) / cruiseFrames;
+    const double cascadeError = MeanError(cascaded, reference);
+    const double cacheError = MeanError(cached, reference);
+
+    snprintf(line, sizeof(line), "  cruise view %dx%d at 10 km over 40100.fmap, cube %d x %d in tiles of %d, %d a frame\n",
+        width, height, small.faceSize_, small.faceSize_, small.tileSize_, small.tilesPerFrame_);
+    ss << line;
+    snprintf(line, sizeof(line), "  %-30s %12s %16s\n", "far band", "mean error", "steps a frame");
+    ss << line;
+    snprintf(line, sizeof(line), "  %-30s %12.2e %16.0f\n", "cascade 1/2 every 4 frames", cascadeError, cascadeFarSteps);
+    ss << line;
+    snprintf(line, sizeof(line), "  %-30s %12.2e %16.0f\n", "cube after 10 s of cruise", cacheError, cacheFarSteps);
+    ss << line;
+    snprintf(line, sizeof(line), "  first fill of %d tiles: %llu steps, the cascade pays that every %.0f frames\n",
+        cache.MarchedTiles(), static_cast<unsigned long long>(fillSteps), fillSteps / (std::max)(cascadeFarSteps, 1.0));
+    ss << line;
+
+    // the cube holds the image of a fresh far band and costs a fraction of its steps
+    pass = pass && cacheError < 1.25 * cascadeError && cacheFarSteps < 0.5 * cascadeFarSteps;
+    ss << (pass ? "  PASS\n" : "  FAIL\n");
+    return ss.str();
+}
+
+#ifdef _WIN32
+bool FarCloudCache::CreateResources() {
+    if (!Ready()) { return false; }
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width = settings_.faceSize_;
+    desc.Height = settings_.faceSize_;
+    desc.MipLevels = 1;
+    desc.ArraySize = 6;
+    desc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_UNORDERED_ACCESS;
+    desc.MiscFlags = D3D11_RESOURCE_MISC_TEXTURECUBE;
+
+    HRESULT hr = Renderer::device->CreateTexture2D(&desc, nullptr, &cacheTEX_);
+    if (FAILED(hr)) return false;
+
+    D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+    srvDesc.Format = desc.Format;
+    srvDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURECUBE;
+    srvDesc.TextureCube.MipLevels = 1;
+
+    hr = Renderer::device->CreateShaderResourceView(cacheTEX_.Get(), &srvDesc, &cacheSRV_);
+    if (FAILED(hr)) return false;
+
+    // the compute pass writes the faces as array slices
+    D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+    uavDesc.Format = desc.Format;
+    uavDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2DARRAY;
+    uavDesc.Texture2DArray.ArraySize = 6;
+
+    hr = Renderer::device->CreateUnorderedAccessView(cacheTEX_.Get(), &uavDesc, &cacheUAV_);
+    if (FAILED(hr)) return false;
+
+    // no tile is marched yet, the cube starts clear
+    const float clear[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    Renderer::context->ClearUnorderedAccessViewFloat(cacheUAV_.Get(), clear);
+
+    // cbuffer FarCloudCacheTile of CSFarCloudCache
+    D3D11_BUFFER_DESC tileDesc = {};
+    tileDesc.ByteWidth = sizeof(int) * 4 + sizeof(float) * 4;
+    tileDesc.Usage = D3D11_USAGE_DEFAULT;
+    tileDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+
+    hr = Renderer::device->CreateBuffer(&tileDesc, nullptr, &tileBuffer_);
+    if (FAILED(hr)) return false;
+
+    ComPtr<ID3DBlob> blob;
+    hr = Renderer::CompileShaderFromFile(L"shaders/RayMarch.hlsl", "CSFarCloudCache", "cs_5_0", blob);
+    if (FAILED(hr)) return false;
+
+    hr = Renderer::device->CreateComputeShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &computeShader_);
+    return SUCCEEDED(hr);
+}
+
+void FarCloudCache::UpdateTexture(UINT numViews, ID3D11ShaderResourceView* const* srvs, UINT bufferCount, ID3D11Buffer** buffers,
+    UINT numSamplers, ID3D11SamplerState* const* samplers) {
+    if (!computeShader_ || regions_.empty()) { return; }
+
+    Renderer::context->CSSetShader(computeShader_.Get(), nullptr, 0);
+    Renderer::context->CSSetShaderResources(0, numViews, srvs);
+    Renderer::context->CSSetSamplers(0, numSamplers, samplers);
+    Renderer::context->CSSetConstantBuffers(0, bufferCount, buffers);
+    Renderer::context->CSSetUnorderedAccessViews(2, 1, cacheUAV_.GetAddressOf(), nullptr);
+
+    for (const Region& region : regions_) {
+        const Tile& tile = tiles_[region.tile_];
+        struct {
+            int tile[4];
+            float band[4];
+        } data = {
+            { tile.face_, tile.x_, tile.y_, settings_.faceSize_ },
+            { band_.start_, region.clear_ ? 0.0f : band_.end_, static_cast<float>(band_.stepBudget_), 0.0f },
+        };
+        Renderer::context->UpdateSubresource(tileBuffer_.Get(), 0, nullptr, &data, 0, 0);
+        Renderer::context->CSSetConstantBuffers(6, 1, tileBuffer_.GetAddressOf());
+        Renderer::context->Dispatch((settings_.tileSize_ + 7) / 8, (settings_.tileSize_ + 7) / 8, 1);
+    }
+
+    // the far target reads the cube as t22
+    ID3D11UnorderedAccessView* const nullUAV[] = { nullptr };
+    Renderer::context->CSSetUnorderedAccessViews(2, 1, nullUAV, nullptr);
+}
+#endif
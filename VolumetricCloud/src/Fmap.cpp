@@ -3,17 +3,26 @@
 #include <string>
 #include <vector>
 
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+
 #include "../includes/Fmap.h"
+#ifdef _WIN32
 #include <wtypes.h>
-#include <functional>
 #include <d3d11.h>
 #include <wrl/client.h>
 #include "../includes/Renderer.h"
+#endif
 
 Fmap::Fmap(std::string fname) {
 
 	FILE* pFile = nullptr;
+#ifdef _WIN32
 	errno_t err = fopen_s(&pFile, fname.c_str(), "rb");
+#else
+	pFile = fopen(fname.c_str(), "rb");
+#endif
 
 	X_ = 59;
 	Y_ = 59;
@@ -30,7 +39,7 @@ Fmap::Fmap(std::string fname) {
 
 	if (pFile == nullptr) { return; }
 
-	DWORD ver = 0;
+	uint32_t ver = 0;
 	fread(&ver, sizeof(ver), 1, pFile);
 
 	fread(&X_, sizeof(X_), 1, pFile);
@@ -130,16 +139,47 @@ Fmap::Fmap(std::string fname) {
 	fclose(pFile);
 };
 
+hlsl::float4 Fmap::ColorTexel(int x, int y) const {
+	return hlsl::float4(
+		(cells_[y][x].cumulusDensity_ - 1) / 12.0f, // R
+		cells_[y][x].cumulusSize_ / 5.0f,           // G
+		-cells_[y][x].cumulusAlt_,                  // B
+		1.0f);                                      // A
+}
+
+std::vector<hlsl::float4> Fmap::ColorTexels() const {
+	std::vector<hlsl::float4> texels(static_cast<size_t>(X_) * Y_);
+	for (int y = 0; y < Y_; y++) {
+		for (int x = 0; x < X_; x++) {
+			texels[static_cast<size_t>(y) * X_ + x] = ColorTexel(x, y);
+		}
+	}
+	return texels;
+}
+
+std::vector<clouddensity::CloudLayerDesc> Fmap::CloudLayers() const {
+	std::vector<clouddensity::CloudLayerDesc> layers = clouddensity::DefaultLayers();
+	// 0 means the map has no such layer
+	if (stratusAltFair_ > 0) { layers.push_back(clouddensity::StratusLayer(static_cast<float>(stratusAltFair_), false)); }
+	if (stratusAltIncl_ > 0) { layers.push_back(clouddensity::StratusLayer(static_cast<float>(stratusAltIncl_), true)); }
+
+	const std::vector<hlsl::float4> texels = ColorTexels();
+	clouddensity::CloudLayerSlabs(layers, texels);
+	return layers;
+}
+
+#ifdef _WIN32
 bool Fmap::CreateTexture2DFromData() {
 	// Convert to float RGBA format
 	std::vector<float> pixelData(X_ * Y_ * 4);
 	for (int y = 0; y < Y_; y++) {
 		for (int x = 0; x < X_; x++) {
 			int idx = (y * X_ + x) * 4;
-			pixelData[idx + 0] = (cells_[y][x].cumulusDensity_ - 1) / 12.0f; // R
-			pixelData[idx + 1] = cells_[y][x].cumulusSize_ / 5.0f;           // G
-			pixelData[idx + 2] = -cells_[y][x].cumulusAlt_;                  // B
-			pixelData[idx + 3] = 1.0f;                                       // A
+			const hlsl::float4 texel = ColorTexel(x, y);
+			pixelData[idx + 0] = texel.x;
+			pixelData[idx + 1] = texel.y;
+			pixelData[idx + 2] = texel.z;
+			pixelData[idx + 3] = texel.w;
 		}
 	}
 
@@ -179,13 +219,42 @@ void Fmap::UpdateTextureData() {
 	for (int y = 0; y < Y_; y++) {
 		for (int x = 0; x < X_; x++) {
 			int idx = x * 4;
-			texPtr[idx + 0] = (cells_[y][x].cumulusDensity_ - 1) / 12.0f;  // R
-			texPtr[idx + 1] = cells_[y][x].cumulusSize_ / 5.0f;            // G
-			texPtr[idx + 2] = -cells_[y][x].cumulusAlt_;                   // B
-			texPtr[idx + 3] = 1.0f;                                        // A
+			const hlsl::float4 texel = ColorTexel(x, y);
+			texPtr[idx + 0] = texel.x;
+			texPtr[idx + 1] = texel.y;
+			texPtr[idx + 2] = texel.z;
+			texPtr[idx + 3] = texel.w;
 		}
 		texPtr = (float*)((uint8_t*)texPtr + mappedResource.RowPitch);
 	}
 
 	Renderer::context->Unmap(colorTEX_.Get(), 0);
-}
\ No newline at end of file
+}
+
+bool Fmap::CreateLayerBuffer() {
+	const std::vector<clouddensity::CloudLayerDesc> layers = CloudLayers();
+
+	D3D11_BUFFER_DESC desc = {};
+	desc.ByteWidth = static_cast<UINT>(layers.size() * sizeof(clouddensity::CloudLayerDesc));
+	desc.Usage = D3D11_USAGE_IMMUTABLE;
+	desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+	desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+	desc.StructureByteStride = sizeof(clouddensity::CloudLayerDesc);
+
+	D3D11_SUBRESOURCE_DATA initData = {};
+	initData.pSysMem = layers.data();
+
+	HRESULT hr = Renderer::device->CreateBuffer(&desc, &initData, &layerBuffer_);
+	if (FAILED(hr)) return false;
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+	srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	srvDesc.Buffer.NumElements = static_cast<UINT>(layers.size());
+
+	hr = Renderer::device->CreateShaderResourceView(layerBuffer_.Get(), &srvDesc, &layerSRV_);
+	if (FAILED(hr)) return false;
+
+	return true;
+}
+#endif
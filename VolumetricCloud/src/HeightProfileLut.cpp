@@ -0,0 +1,130 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+#include "../includes/HeightProfileLut.h"
+
+using namespace hlsl;
+
+bool HeightProfileLut::Build(std::span<const clouddensity::CloudLayerDesc> layers, const Settings& settings) {
+    if (settings.heightSamples_ < 2 || layers.empty() || layers.size() > CLOUD_LAYER_MAX) {
+        std::cerr << "HeightProfileLut: " << layers.size() << " layers, " << settings.heightSamples_ << " height samples" << std::endl;
+        return false;
+    }
+
+    settings_ = settings;
+    layers_.assign(layers.begin(), layers.end());
+
+    const int n = settings_.heightSamples_;
+    texels_.resize(static_cast<size_t>(n) * layers_.size());
+    for (size_t l = 0; l < layers_.size(); l++) {
+        for (int i = 0; i < n; i++) {
+            texels_[l * n + i] = clouddensity::LayerProfile(layers_[l], static_cast<float>(i) / (n - 1));
+        }
+    }
+    return true;
+}
+
+float2 HeightProfileLut::Sample(int layer, float height, int filterBits) const {
+    const int n = settings_.heightSamples_;
+    const float x = saturate(height) * (n - 1);
+    const int i = (std::min)(static_cast<int>(x), n - 2);
+    float t = x - i;
+    if (filterBits > 0) {
+        const float steps = static_cast<float>(1 << filterBits);
+        t = std::floor(t * steps + 0.5f) / steps;
+    }
+
+    const float2* row = &texels_[static_cast<size_t>(layer) * n];
+    return float2(lerp(row[i].x, row[i + 1].x, t), lerp(row[i].y, row[i + 1].y, t));
+}
+
+std::string HeightProfileLut::Validate(int samples) const {
+    std::ostringstream ss;
+    if (!Ready()) {
+        ss << "height profile lut: not built\n";
+        return ss.str();
+    }
+
+    std::mt19937 rng(36);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::uniform_real_distribution<float> height(-0.1f, 1.1f);
+
+    // profiles and the layer density, exact filter and 8 bit filter weights
+    float shapeErr = 0.0f, exponentErr = 0.0f, layerErr = 0.0f, layerErr8 = 0.0f;
+    for (int l = 0; l < Rows(); l++) {
+        const clouddensity::CloudLayerDesc& layer = layers_[l];
+        for (int s = 0; s < samples; s++) {
+            const float h = height(rng);
+            const float2 exact = clouddensity::LayerProfile(layer, h);
+            const float2 lut = Sample(l, h);
+            const float2 lut8 = Sample(l, h, 8);
+            shapeErr = (std::max)(shapeErr, std::fabs(lut.x - exact.x));
+            exponentErr = (std::max)(exponentErr, std::fabs(lut.y - exact.y));
+
+            const float4 noise(unit(rng), unit(rng), unit(rng), unit(rng));
+            const float poor = unit(rng);
+            const float reference = clouddensity::LayerDensity(layer, exact, poor, noise, false);
+            layerErr = (std::max)(layerErr, std::fabs(clouddensity::LayerDensity(layer, lut, poor, noise, false) - reference));
+            layerErr8 = (std::max)(layerErr8, std::fabs(clouddensity::LayerDensity(layer, lut8, poor, noise, false) - reference));
+        }
+    }
+
+    // CloudDensity on random weather, noise and altitudes
+    float densityErr = 0.0f;
+    int nonZero = 0;
+    std::uniform_real_distribution<float> altitude(0.0f, 12000.0f);
+    std::uniform_real_distribution<float> bottomFt(1200.0f, 22000.0f);
+    for (int s = 0; s < samples; s++) {
+        clouddensity::DensitySamples sample = {};
+        sample.fmap_ = float4(unit(rng), unit(rng), bottomFt(rng), 0.0f);
+        for (int l = 0; l < Rows(); l++) { sample.layerNoise_[l] = float4(unit(rng), unit(rng), unit(rng), unit(rng)); }
+        sample.smallNoise_ = float4(unit(rng), unit(rng), unit(rng), unit(rng));
+        const float alt = altitude(rng);
+
+        float distance;
+        const float reference = clouddensity::CloudDensityFromSamples(alt, sample, layers_, distance);
+        const float lut = clouddensity::CloudDensityFromSamples(alt, sample, layers_, distance, false, this);
+        densityErr = (std::max)(densityErr, std::fabs(lut - reference));
+        nonZero += reference > 0.0f;
+    }
+
+    // a layer density off by less than one 8 bit step of the output
+    const float kPassError = 1.0f / 255.0f;
+    ss << "height profile lut " << settings_.heightSamples_ << "x" << Rows() << " R32G32, max error vs analytic\n";
+    ss << "  layerShape " << shapeErr << ", anvil exponent " << exponentErr << "\n";
+    ss << "  layer density " << layerErr << ", with 8 bit filter weights " << layerErr8 << "\n";
+    ss << "  CloudDensity " << densityErr << " (" << nonZero << " of " << samples << " samples with cloud)\n";
+    ss << ((layerErr8 < kPassError) ? "  PASS\n" : "  FAIL\n");
+    return ss.str();
+}
+
+#ifdef _WIN32
+bool HeightProfileLut::CreateTexture() {
+    if (!Ready()) { return false; }
+
+    D3D11_TEXTURE2D_DESC desc = {};
+    desc.Width = settings_.heightSamples_;
+    desc.Height = Rows();
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.Format = DXGI_FORMAT_R32G32_FLOAT;
+    desc.SampleDesc.Count = 1;
+    desc.Usage = D3D11_USAGE_IMMUTABLE;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    D3D11_SUBRESOURCE_DATA initData = {};
+    initData.pSysMem = texels_.data();
+    initData.SysMemPitch = settings_.heightSamples_ * sizeof(float2);
+
+    HRESULT hr = Renderer::device->CreateTexture2D(&desc, &initData, &profileTEX_);
+    if (FAILED(hr)) return false;
+
+    hr = Renderer::device->CreateShaderResourceView(profileTEX_.Get(), nullptr, &profileSRV_);
+    if (FAILED(hr)) return false;
+
+    return true;
+}
+#endif
@@ -208,4 +208,98 @@ void Noise::RenderNoiseTexture3D() {
     // Restore original render target and other states
     Renderer::context->OMSetRenderTargets(1, oldRTV.GetAddressOf(), oldDSV.Get());
     Renderer::context->RSSetViewports(1, &oldViewport);
-}
\ No newline at end of file
+}
+
+void Noise::CreateNoiseTexture3DFromVolume(const NoiseVolume& volume) {
+
+    widthPx_ = volume.width_;
+    heightPx_ = volume.height_;
+    slicePx_ = volume.depth_ * volume.frames_;
+
+    // no mips, they would blend neighbouring frames of a sequence
+    D3D11_TEXTURE3D_DESC texDesc = {};
+    texDesc.Width = widthPx_;
+    texDesc.Height = heightPx_;
+    texDesc.Depth = slicePx_;
+    texDesc.MipLevels = 1;
+    texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+    texDesc.Usage = D3D11_USAGE_IMMUTABLE;
+    texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    texDesc.CPUAccessFlags = 0;
+    texDesc.MiscFlags = 0;
+
+    const std::vector<uint8_t> texels = volume.ToUnorm8();
+
+    D3D11_SUBRESOURCE_DATA initData = {};
+    initData.pSysMem = texels.data();
+    initData.SysMemPitch = widthPx_ * 4; // RGBA8
+    initData.SysMemSlicePitch = widthPx_ * heightPx_ * 4;
+
+    colorTEX_.Reset();
+    colorSRV_.Reset();
+
+    HRESULT hr = Renderer::device->CreateTexture3D(&texDesc, &initData, &colorTEX_);
+    if (FAILED(hr)) {
+        std::cerr << "Failed to create 3D texture from baked volume." << std::endl;
+        return;
+    }
+
+    hr = Renderer::device->CreateShaderResourceView(colorTEX_.Get(), nullptr, &colorSRV_);
+    if (FAILED(hr)) {
+        std::cerr << "Failed to create Shader Resource View for baked volume." << std::endl;
+        return;
+    }
+}
+
+void Noise::CreateBrickTextures(const BrickVolume& bricks) {
+
+    brickIndirectionTEX_.Reset();
+    brickIndirectionSRV_.Reset();
+    brickAtlasTEX_.Reset();
+    brickAtlasSRV_.Reset();
+
+    // indirection: one texel per brick
+    std::vector<uint32_t> pages;
+    bricks.ExportIndirection(pages);
+
+    D3D11_TEXTURE3D_DESC texDesc = {};
+    texDesc.Width = bricks.pagesX_;
+    texDesc.Height = bricks.pagesY_;
+    texDesc.Depth = bricks.pagesZ_;
+    texDesc.MipLevels = 1;
+    texDesc.Format = DXGI_FORMAT_R32G32_UINT;
+    texDesc.Usage = D3D11_USAGE_IMMUTABLE;
+    texDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    D3D11_SUBRESOURCE_DATA initData = {};
+    initData.pSysMem = pages.data();
+    initData.SysMemPitch = bricks.pagesX_ * 8;
+    initData.SysMemSlicePitch = bricks.pagesX_ * bricks.pagesY_ * 8;
+
+    HRESULT hr = Renderer::device->CreateTexture3D(&texDesc, &initData, &brickIndirectionTEX_);
+    if (FAILED(hr) || FAILED(Renderer::device->CreateShaderResourceView(brickIndirectionTEX_.Get(), nullptr, &brickIndirectionSRV_))) {
+        std::cerr << "Failed to create brick indirection texture." << std::endl;
+        return;
+    }
+
+    // atlas
+    std::vector<uint8_t> atlas;
+    int bricksX, bricksY, bricksZ;
+    bricks.ExportAtlas(atlas, bricksX, bricksY, bricksZ);
+    const int stored = bricks.StoredBrickSize();
+
+    texDesc.Width = bricksX * stored;
+    texDesc.Height = bricksY * stored;
+    texDesc.Depth = bricksZ * stored;
+    texDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
+
+    initData.pSysMem = atlas.data();
+    initData.SysMemPitch = texDesc.Width * 4;
+    initData.SysMemSlicePitch = texDesc.Width * texDesc.Height * 4;
+
+    hr = Renderer::device->CreateTexture3D(&texDesc, &initData, &brickAtlasTEX_);
+    if (FAILED(hr) || FAILED(Renderer::device->CreateShaderResourceView(brickAtlasTEX_.Get(), nullptr, &brickAtlasSRV_))) {
+        std::cerr << "Failed to create brick atlas texture." << std::endl;
+        return;
+    }
+}
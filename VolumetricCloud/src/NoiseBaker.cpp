@@ -0,0 +1,260 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../includes/CpuNoise.h"
+#include "../includes/NoiseBaker.h"
+
+using namespace hlsl;
+
+std::vector<uint8_t> NoiseVolume::ToUnorm8() const {
+    std::vector<uint8_t> bytes(texels_.size());
+    for (size_t i = 0; i < texels_.size(); i++) {
+        bytes[i] = static_cast<uint8_t>(saturate(texels_[i]) * 255.0f + 0.5f);
+    }
+    return bytes;
+}
+
+float4 NoiseVolume::Sample(const float3& uvw, int frame) const {
+    // texel centers at (i + 0.5) / size
+    const float3 p = uvw * float3((float)width_, (float)height_, (float)depth_) - 0.5f;
+    const float3 fl = floor(p);
+    const float3 f = p - fl;
+
+    auto wrap = [](int v, int size) { const int m = v % size; return m < 0 ? m + size : m; };
+    const int x0 = wrap((int)fl.x, width_), x1 = wrap((int)fl.x + 1, width_);
+    const int y0 = wrap((int)fl.y, height_), y1 = wrap((int)fl.y + 1, height_);
+    const int z0 = wrap((int)fl.z, depth_), z1 = wrap((int)fl.z + 1, depth_);
+
+    return lerp(
+        lerp(lerp(Load(x0, y0, z0, frame), Load(x1, y0, z0, frame), f.x), lerp(Load(x0, y1, z0, frame), Load(x1, y1, z0, frame), f.x), f.y),
+        lerp(lerp(Load(x0, y0, z1, frame), Load(x1, y0, z1, frame), f.x), lerp(Load(x0, y1, z1, frame), Load(x1, y1, z1, frame), f.x), f.y),
+        f.z);
+}
+
+float3 NoiseBaker::TexelUVW(int x, int y, int z, int width, int height, int depth) {
+    // x/y are interpolated at pixel centers,
+    // the slice coordinate is slice / (slicePx_ - 1) in Noise::RenderNoiseTexture3D
+    return float3(
+        (x + 0.5f) / width,
+        (y + 0.5f) / height,
+        depth > 1 ? static_cast<float>(z) / (depth - 1) : 0.0f);
+}
+
+NoiseVolume NoiseBaker::Bake(const VolumeRecipe& recipe, int width, int height, int depth, ThreadPool& pool) {
+    NoiseVolume volume;
+    volume.Allocate(width, height, depth, recipe.frames_);
+
+    // one work item per slice of every frame
+    pool.ParallelFor(0, depth * recipe.frames_, [&](int item) {
+        const int frame = item / depth;
+        const int z = item % depth;
+        const float loopTime = static_cast<float>(frame) / recipe.frames_;
+
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                const float3 uvw = TexelUVW(x, y, z, width, height, depth);
+                float* texel = &volume.texels_[volume.Index(x, y, z, frame)];
+                for (int c = 0; c < 4; c++) {
+                    const ChannelFunc& func = recipe.channels_[c].func_;
+                    texel[c] = func ? func(uvw, loopTime) : 0.0f;
+                }
+            }
+        }
+    });
+
+    return volume;
+}
+
+std::string NoiseBaker::CachePath(const VolumeRecipe& recipe, int width, int height, int depth, const std::string& cacheDir) {
+    char name[256];
+    snprintf(name, sizeof(name), "%s_%dx%dx%dx%d.vol", recipe.name_.c_str(), width, height, depth, recipe.frames_);
+    return (std::filesystem::path(cacheDir) / name).string();
+}
+
+namespace {
+
+    const char kVolumeMagic[4] = { 'V', 'C', 'N', 'B' };
+
+    struct VolumeFileHeader {
+        char magic[4];
+        uint32_t version;
+        int32_t width;
+        int32_t height;
+        int32_t depth;
+        int32_t frames;
+    };
+
+} // namespace
+
+bool NoiseBaker::SaveVolume(const std::string& path, const NoiseVolume& volume) {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to write noise cache " << path << std::endl;
+        return false;
+    }
+
+    VolumeFileHeader header = {};
+    std::copy(kVolumeMagic, kVolumeMagic + 4, header.magic);
+    header.version = kCacheVersion;
+    header.width = volume.width_;
+    header.height = volume.height_;
+    header.depth = volume.depth_;
+    header.frames = volume.frames_;
+
+    const std::vector<uint8_t> bytes = volume.ToUnorm8();
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    return file.good();
+}
+
+bool NoiseBaker::LoadVolume(const std::string& path, NoiseVolume& volume) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) { return false; }
+
+    VolumeFileHeader header = {};
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!file || !std::equal(kVolumeMagic, kVolumeMagic + 4, header.magic) || header.version != kCacheVersion) {
+        return false;
+    }
+
+    volume.Allocate(header.width, header.height, header.depth, header.frames);
+    std::vector<uint8_t> bytes(volume.texels_.size());
+    file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+    if (!file) { return false; }
+
+    for (size_t i = 0; i < bytes.size(); i++) {
+        volume.texels_[i] = bytes[i] / 255.0f;
+    }
+    return true;
+}
+
+NoiseVolume NoiseBaker::BakeCached(const VolumeRecipe& recipe, int width, int height, int depth, const std::string& cacheDir) {
+    const std::string path = CachePath(recipe, width, height, depth, cacheDir);
+
+    NoiseVolume volume;
+    if (LoadVolume(path, volume) &&
+        volume.width_ == width && volume.height_ == height && volume.depth_ == depth && volume.frames_ == recipe.frames_) {
+        return volume;
+    }
+
+    volume = Bake(recipe, width, height, depth);
+    SaveVolume(path, volume);
+
+    // hand out exactly what the cache would give next time
+    for (float& v : volume.texels_) {
+        v = static_cast<uint8_t>(saturate(v) * 255.0f + 0.5f) / 255.0f;
+    }
+    return volume;
+}
+
+NoiseBaker::VolumeRecipe NoiseBaker::RecipeFbm() {
+    VolumeRecipe recipe;
+    recipe.name_ = "fbm";
+    recipe.channels_[0] = { "perlinWorley8", [](const float3& uvw, float) {
+        const float worley = cpunoise::worleyFbm(uvw, 8, true);
+        const float perlin = cpunoise::perlinFbm(uvw, 8, 4);
+        return Remap(perlin * 0.25f + 0.5f, 1.0f - worley, 1.0f, 0.0f, 1.0f);
+    } };
+    recipe.channels_[1] = { "worleyFbm6", [](const float3& uvw, float) { return cpunoise::worleyFbm(uvw, 6, true); } };
+    recipe.channels_[2] = { "worleyFbm12", [](const float3& uvw, float) { return cpunoise::worleyFbm(uvw, 12, true); } };
+    recipe.channels_[3] = { "worleyFbm24", [](const float3& uvw, float) { return cpunoise::worleyFbm(uvw, 24, true); } };
+    return recipe;
+}
+
+NoiseBaker::VolumeRecipe NoiseBaker::RecipeFbmSmall() {
+    VolumeRecipe recipe;
+    recipe.name_ = "fbmSmall";
+    recipe.channels_[0] = { "worleyFbm3", [](const float3& uvw, float) { return cpunoise::worleyFbm(uvw, 3, true); } };
+    recipe.channels_[1] = { "worleyFbm6", [](const float3& uvw, float) { return cpunoise::worleyFbm(uvw, 6, true); } };
+    recipe.channels_[2] = { "worleyFbm9", [](const float3& uvw, float) { return cpunoise::worleyFbm(uvw, 9, true); } };
+    recipe.channels_[3] = { "blueNoise32", [](const float3& uvw, float) { return cpunoise::blueNoise(uvw + uvw.z, 32); } };
+    return recipe;
+}
+
+NoiseBaker::VolumeRecipe NoiseBaker::RecipeNoiseSequence(int frames) {
+    VolumeRecipe recipe;
+    recipe.name_ = "noiseSequence";
+    recipe.frames_ = frames;
+    recipe.channels_[0] = { "perlinLoop2", [](const float3& uvw, float t) { return cpunoise::PerlinPeriodicLoop(uvw, 2, t); } };
+    recipe.channels_[1] = { "perlinLoop4", [](const float3& uvw, float t) { return cpunoise::PerlinPeriodicLoop(uvw, 4, t); } };
+    recipe.channels_[2] = { "perlinLoop8", [](const float3& uvw, float t) { return cpunoise::PerlinPeriodicLoop(uvw, 8, t); } };
+    recipe.channels_[3] = { "perlinLoop16", [](const float3& uvw, float t) { return cpunoise::PerlinPeriodicLoop(uvw, 16, t); } };
+    return recipe;
+}
+
+NoiseBaker::ChannelRecipe NoiseBaker::ChannelAlligatorNoise(float gridsize, int octaves, bool tiling, uint3 seed) {
+    char name[128];
+    snprintf(name, sizeof(name), "alligator%gx%d%s_%u_%u_%u", gridsize, octaves, tiling ? "" : "NoTile", seed.x, seed.y, seed.z);
+    return { name, [=](const float3& uvw, float) {
+        return cpunoise::AlligatorNoise(uvw, gridsize, octaves, cpunoise::ALLIGATOR_LACUNARITY, cpunoise::ALLIGATOR_PERSISTENCE, tiling, seed);
+    } };
+}
+
+NoiseBaker::ChannelRecipe NoiseBaker::ChannelAlligatorPeriodic(int frequency) {
+    return { "alligatorPeriodic" + std::to_string(frequency),
+        [=](const float3& uvw, float) { return cpunoise::AlligatorPeriodic(uvw, frequency); } };
+}
+
+NoiseBaker::ChannelRecipe NoiseBaker::ChannelWorleyF2MinusF1(int frequency) {
+    return { "worleyF2F1_" + std::to_string(frequency),
+        [=](const float3& uvw, float) { return cpunoise::WorleyF2MinusF1(uvw, frequency); } };
+}
+
+NoiseBaker::ChannelRecipe NoiseBaker::ChannelPerlinWorleyPeriodic(int frequency) {
+    return { "perlinWorleyPeriodic" + std::to_string(frequency),
+        [=](const float3& uvw, float) { return cpunoise::PerlinWorleyPeriodic(uvw, frequency); } };
+}
+
+const std::vector<NoiseBaker::ChannelRecipe>& NoiseBaker::ChannelPresets() {
+    static const std::vector<ChannelRecipe> presets = [] {
+        std::vector<ChannelRecipe> list;
+        list.push_back(RecipeFbm().channels_[0]);
+        for (int freq : { 3, 6, 9, 12, 24 }) {
+            list.push_back({ "worleyFbm" + std::to_string(freq),
+                [=](const float3& uvw, float) { return cpunoise::worleyFbm(uvw, (float)freq, true); } });
+        }
+        for (int freq : { 2, 4, 8 }) {
+            list.push_back(ChannelPerlinWorleyPeriodic(freq));
+        }
+        for (int freq : { 4, 8, 16 }) {
+            list.push_back(ChannelWorleyF2MinusF1(freq));
+        }
+        for (int freq : { 2, 4, 8 }) {
+            list.push_back(ChannelAlligatorPeriodic(freq));
+        }
+        list.push_back(ChannelAlligatorNoise(4.0f, 4));
+        list.push_back(ChannelAlligatorNoise(8.0f, 5));
+        list.push_back(ChannelAlligatorNoise(16.0f, 3));
+        return list;
+    }();
+    return presets;
+}
+
+NoiseBaker::VolumeRecipe NoiseBaker::RecipeFromChannels(const ChannelRecipe& r, const ChannelRecipe& g, const ChannelRecipe& b, const ChannelRecipe& a) {
+    VolumeRecipe recipe;
+    recipe.name_ = r.name_ + "-" + g.name_ + "-" + b.name_ + "-" + a.name_;
+    recipe.channels_[0] = r;
+    recipe.channels_[1] = g;
+    recipe.channels_[2] = b;
+    recipe.channels_[3] = a;
+    return recipe;
+}
+
+NoiseBaker::VolumeRecipe NoiseBaker::RecipeAlligator() {
+    VolumeRecipe recipe = RecipeFromChannels(
+        ChannelAlligatorPeriodic(4),
+        ChannelWorleyF2MinusF1(8),
+        ChannelPerlinWorleyPeriodic(4),
+        ChannelAlligatorNoise(8.0f, 5));
+    recipe.name_ = "alligator";
+    return recipe;
+}
@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../includes/CpuNoise.h"
+#include "../includes/NoiseParity.h"
+
+using namespace hlsl;
+
+namespace {
+
+    // tolerances: hashes are integer math and have to be bit exact,
+    // the trig in PerlinPeriodic and the frac of large products in the Alligator
+    // hashes follow the GPU transcendental / mad precision.
+    const NoiseParity::FunctionSpec kSpecs[NoiseParity::kFunctionCount] = {
+        { "hash",           1, true,  0,  0.0f },
+        { "hash3",          1, true,  0,  0.0f },
+        { "hash33",         3, false, 2,  1e-6f },
+        { "PerlinPeriodic", 1, false, 16, 2e-4f },
+        { "WorleyPeriodic", 1, false, 16, 1e-5f },
+        { "AlligatorNoise", 1, false, 64, 2e-3f },
+    };
+
+    const char kGoldenMagic[4] = { 'V', 'C', 'N', 'P' };
+
+    // octaves used for the AlligatorNoise inputs, gridsize comes from the input
+    const int kAlligatorOctaves = 3;
+
+    uint32_t Random(uint32_t seed, uint32_t function, uint32_t index, uint32_t word) {
+        return cpunoise::hash(seed ^ cpunoise::hash(function * 0x9E3779B9u ^ cpunoise::hash(index * 4 + word)));
+    }
+
+    // [lo, hi) with 24 bits of randomness
+    float RandomFloat(uint32_t bits, float lo, float hi) {
+        return lo + (hi - lo) * ((bits >> 8) * (1.0f / 16777216.0f));
+    }
+
+    uint32_t Bits(float v) { return std::bit_cast<uint32_t>(v); }
+    float Float(uint32_t v) { return std::bit_cast<float>(v); }
+
+    float3 InputPosition(const uint4& in) { return float3(Float(in.x), Float(in.y), Float(in.z)); }
+
+    uint32_t Word(const uint4& v, int i) { return i == 0 ? v.x : i == 1 ? v.y : i == 2 ? v.z : v.w; }
+
+} // namespace
+
+const NoiseParity::FunctionSpec& NoiseParity::Spec(Function function) {
+    return kSpecs[function];
+}
+
+uint32_t NoiseParity::UlpDistance(float a, float b) {
+    if (std::isnan(a) || std::isnan(b)) {
+        return std::isnan(a) && std::isnan(b) ? 0 : UINT32_MAX;
+    }
+    // map the sign-magnitude floats onto a monotonic integer line
+    auto ordered = [](float v) {
+        const int32_t i = std::bit_cast<int32_t>(v);
+        return i < 0 ? static_cast<int64_t>(INT32_MIN) - i : static_cast<int64_t>(i);
+    };
+    const int64_t d = ordered(a) - ordered(b);
+    return static_cast<uint32_t>((std::min)(static_cast<int64_t>(UINT32_MAX), d < 0 ? -d : d));
+}
+
+std::vector<uint4> NoiseParity::MakeInputs(Function function, int count, uint32_t seed) {
+    std::vector<uint4> inputs(count);
+    for (int i = 0; i < count; i++) {
+        const uint32_t r0 = Random(seed, function, i, 0);
+        const uint32_t r1 = Random(seed, function, i, 1);
+        const uint32_t r2 = Random(seed, function, i, 2);
+        const uint32_t r3 = Random(seed, function, i, 3);
+
+        switch (function) {
+        case kHash:
+            inputs[i] = uint4(r0, 0, 0, 0);
+            break;
+        case kHash3:
+            inputs[i] = uint4(r0, r1, r2, 0);
+            break;
+        case kHash33:
+            // the hash truncates to int, spread the inputs over a few thousand cells
+            inputs[i] = uint4(Bits(RandomFloat(r0, -4096, 4096)), Bits(RandomFloat(r1, -4096, 4096)), Bits(RandomFloat(r2, -4096, 4096)), 0);
+            break;
+        case kPerlinPeriodic:
+        case kWorleyPeriodic:
+            // outside of [0, 1) as well to cover the wrap around, w is the integer frequency
+            inputs[i] = uint4(Bits(RandomFloat(r0, -1, 2)), Bits(RandomFloat(r1, -1, 2)), Bits(RandomFloat(r2, -1, 2)), 1 + r3 % 16);
+            break;
+        case kAlligatorNoise:
+            // w is the float grid size
+            inputs[i] = uint4(Bits(RandomFloat(r0, -1, 2)), Bits(RandomFloat(r1, -1, 2)), Bits(RandomFloat(r2, -1, 2)), Bits(RandomFloat(r3, 2, 16)));
+            break;
+        default:
+            break;
+        }
+    }
+    return inputs;
+}
+
+uint4 NoiseParity::EvaluateCpu(Function function, const uint4& in) {
+    switch (function) {
+    case kHash:
+        return uint4(cpunoise::hash(in.x), 0, 0, 0);
+    case kHash3:
+        return uint4(cpunoise::hash3(uint3(in.x, in.y, in.z)), 0, 0, 0);
+    case kHash33: {
+        const float3 h = cpunoise::hash33(InputPosition(in));
+        return uint4(Bits(h.x), Bits(h.y), Bits(h.z), 0);
+    }
+    case kPerlinPeriodic:
+        return uint4(Bits(cpunoise::PerlinPeriodic(InputPosition(in), static_cast<int>(in.w))), 0, 0, 0);
+    case kWorleyPeriodic:
+        return uint4(Bits(cpunoise::WorleyPeriodic(InputPosition(in), static_cast<int>(in.w))), 0, 0, 0);
+    case kAlligatorNoise:
+        return uint4(Bits(cpunoise::AlligatorNoise(InputPosition(in), Float(in.w), kAlligatorOctaves,
+            cpunoise::ALLIGATOR_LACUNARITY, cpunoise::ALLIGATOR_PERSISTENCE, true)), 0, 0, 0);
+    default:
+        return uint4();
+    }
+}
+
+std::vector<uint4> NoiseParity::EvaluateCpu(Function function, const std::vector<uint4>& inputs) {
+    std::vector<uint4> outputs(inputs.size());
+    for (size_t i = 0; i < inputs.size(); i++) {
+        outputs[i] = EvaluateCpu(function, inputs[i]);
+    }
+    return outputs;
+}
+
+NoiseParity::Golden NoiseParity::MakeGolden(uint32_t seed, int samples) {
+    Golden golden;
+    golden.seed_ = seed;
+    golden.samples_ = samples;
+    for (uint32_t f = 0; f < kFunctionCount; f++) {
+        golden.outputs_[f] = EvaluateCpu(static_cast<Function>(f), MakeInputs(static_cast<Function>(f), samples, seed));
+    }
+    return golden;
+}
+
+// layout: magic, version, seed, samples, function count, source,
+// then per function its name (32 bytes) and the used output words of every sample
+bool NoiseParity::SaveGolden(const std::string& path, const Golden& golden) {
+    std::error_code ec;
+    std::filesystem::create_directories(std::filesystem::path(path).parent_path(), ec);
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Failed to write noise parity golden " << path << std::endl;
+        return false;
+    }
+
+    const uint32_t header[5] = { kGoldenVersion, golden.seed_, static_cast<uint32_t>(golden.samples_), kFunctionCount, golden.source_ };
+    file.write(kGoldenMagic, 4);
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    for (uint32_t f = 0; f < kFunctionCount; f++) {
+        char name[32] = {};
+        snprintf(name, sizeof(name), "%s", kSpecs[f].name_);
+        file.write(name, sizeof(name));
+
+        std::vector<uint32_t> words;
+        words.reserve(golden.outputs_[f].size() * kSpecs[f].components_);
+        for (const uint4& v : golden.outputs_[f]) {
+            for (int c = 0; c < kSpecs[f].components_; c++) {
+                words.push_back(Word(v, c));
+            }
+        }
+        file.write(reinterpret_cast<const char*>(words.data()), words.size() * sizeof(uint32_t));
+    }
+    return file.good();
+}
+
+bool NoiseParity::LoadGolden(const std::string& path, Golden& golden) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) { return false; }
+
+    char magic[4] = {};
+    uint32_t header[5] = {};
+    file.read(magic, 4);
+    file.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!file || !std::equal(kGoldenMagic, kGoldenMagic + 4, magic) || header[0] != kGoldenVersion || header[3] != kFunctionCount
+        || header[4] > kSourceGpu) {
+        return false;
+    }
+
+    golden.source_ = static_cast<Source>(header[4]);
+    golden.seed_ = header[1];
+    golden.samples_ = static_cast<int>(header[2]);
+
+    for (uint32_t f = 0; f < kFunctionCount; f++) {
+        char name[32] = {};
+        file.read(name, sizeof(name));
+        if (!file || std::string(name) != kSpecs[f].name_) { return false; }
+
+        std::vector<uint32_t> words(static_cast<size_t>(golden.samples_) * kSpecs[f].components_);
+        file.read(reinterpret_cast<char*>(words.data()), words.size() * sizeof(uint32_t));
+        if (!file) { return false; }
+
+        golden.outputs_[f].assign(golden.samples_, uint4());
+        for (int i = 0; i < golden.samples_; i++) {
+            uint32_t w[4] = {};
+            for (int c = 0; c < kSpecs[f].components_; c++) {
+                w[c] = words[static_cast<size_t>(i) * kSpecs[f].components_ + c];
+            }
+            golden.outputs_[f][i] = uint4(w[0], w[1], w[2], w[3]);
+        }
+    }
+    return true;
+}
+
+NoiseParity::FunctionResult NoiseParity::Compare(Function function, const std::vector<uint4>& reference, const std::vector<uint4>& candidate) {
+    const FunctionSpec& spec = kSpecs[function];
+
+    FunctionResult result;
+    result.name_ = spec.name_;
+    result.samples_ = static_cast<int>((std::min)(reference.size(), candidate.size()));
+    result.failures_ = static_cast<int>((std::max)(reference.size(), candidate.size())) - result.samples_;
+
+    for (int i = 0; i < result.samples_; i++) {
+        bool failed = false;
+        for (int c = 0; c < spec.components_; c++) {
+            const uint32_t a = Word(reference[i], c);
+            const uint32_t b = Word(candidate[i], c);
+            if (spec.integer_) {
+                failed |= a != b;
+                continue;
+            }
+
+            const uint32_t ulp = UlpDistance(Float(a), Float(b));
+            const float absError = std::fabs(Float(a) - Float(b));
+            result.maxUlp_ = (std::max)(result.maxUlp_, ulp);
+            if (!std::isnan(absError)) {
+                result.maxAbs_ = (std::max)(result.maxAbs_, absError);
+            }
+            failed |= ulp > spec.ulpTolerance_ && !(absError <= spec.absTolerance_);
+        }
+
+        if (failed) {
+            if (result.firstFailure_ < 0) { result.firstFailure_ = i; }
+            result.failures_++;
+        }
+    }
+    return result;
+}
+
+double NoiseParity::Benchmark(Function function, int evaluations) {
+    const std::vector<uint4> inputs = MakeInputs(function, 4096, kDefaultSeed + 1);
+
+    // fold the outputs so the calls can not be optimized away
+    volatile uint32_t sink = 0;
+    uint32_t fold = 0;
+
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < evaluations; i++) {
+        const uint4 v = EvaluateCpu(function, inputs[i & 4095]);
+        fold ^= v.x ^ v.y ^ v.z;
+    }
+    const auto end = std::chrono::steady_clock::now();
+    sink = fold;
+    (void)sink;
+
+    const double seconds = std::chrono::duration<double>(end - start).count();
+    return seconds > 0.0 ? evaluations / seconds : 0.0;
+}
+
+NoiseParity::Report NoiseParity::Run(const std::string& goldenPath, const std::string& baselinePath, int benchmarkEvaluations) {
+    Report report;
+
+    Golden golden;
+    if (!LoadGolden(goldenPath, golden)) {
+        report.error_ = "failed to load golden outputs " + goldenPath;
+        return report;
+    }
+    report.source_ = golden.source_;
+
+    // per machine throughput baseline, "name evalsPerSec" per line
+    std::map<std::string, double> baseline;
+    {
+        std::ifstream file(baselinePath);
+        std::string name;
+        double value;
+        while (file >> name >> value) {
+            baseline[name] = value;
+        }
+    }
+    const bool writeBaseline = baseline.empty();
+
+    for (uint32_t f = 0; f < kFunctionCount; f++) {
+        const Function function = static_cast<Function>(f);
+        const std::vector<uint4> outputs = EvaluateCpu(function, MakeInputs(function, golden.samples_, golden.seed_));
+
+        FunctionResult result = Compare(function, golden.outputs_[f], outputs);
+        if (benchmarkEvaluations > 0) {
+            result.evalsPerSec_ = Benchmark(function, benchmarkEvaluations);
+            const auto it = baseline.find(result.name_);
+            if (it != baseline.end()) {
+                result.baselineEvalsPerSec_ = it->second;
+                result.speedRegressed_ = result.evalsPerSec_ < it->second * kSpeedRegression;
+            }
+        }
+        report.functions_.push_back(result);
+    }
+
+    if (writeBaseline && benchmarkEvaluations > 0) {
+        std::error_code ec;
+        std::filesystem::create_directories(std::filesystem::path(baselinePath).parent_path(), ec);
+        std::ofstream file(baselinePath);
+        for (const FunctionResult& result : report.functions_) {
+            file << result.name_ << " " << result.evalsPerSec_ << "\n";
+        }
+    }
+
+    return report;
+}
+
+bool NoiseParity::Report::Passed() const {
+    // a golden of the port itself proves nothing about the shader
+    if (!error_.empty() || functions_.empty() || source_ != kSourceGpu) { return false; }
+    return std::all_of(functions_.begin(), functions_.end(), [](const FunctionResult& r) { return r.Passed(); });
+}
+
+std::string NoiseParity::Report::ToString() const {
+    if (!error_.empty()) { return "noise parity: " + error_ + "\n"; }
+
+    std::ostringstream out;
+    char line[256];
+    out << (source_ == kSourceGpu ? "C++ port against the shader outputs\n"
+        : "C++ port against its own golden outputs, no shader parity: write the golden from the GPU\n");
+    snprintf(line, sizeof(line), "%-16s %8s %8s %10s %12s %12s %12s\n", "function", "samples", "fail", "maxUlp", "maxAbs", "Meval/s", "baseline");
+    out << line;
+    for (const FunctionResult& r : functions_) {
+        snprintf(line, sizeof(line), "%-16s %8d %8d %10u %12.3e %12.2f %12.2f%s\n",
+            r.name_.c_str(), r.samples_, r.failures_, r.maxUlp_, r.maxAbs_,
+            r.evalsPerSec_ * 1e-6, r.baselineEvalsPerSec_ * 1e-6, r.speedRegressed_ ? "  SLOWER" : "");
+        out << line;
+    }
+    out << (Passed() ? "PASSED" : "FAILED") << "\n";
+    return out.str();
+}
@@ -0,0 +1,510 @@
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/glcorearb.h>
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <regex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../includes/NoiseParityGl.h"
+
+using hlsl::uint4;
+
+namespace {
+
+    // GL entry points through eglGetProcAddress, no loader library
+    struct GlFunctions {
+        PFNGLGETSTRINGPROC GetString = nullptr;
+        PFNGLCREATESHADERPROC CreateShader = nullptr;
+        PFNGLSHADERSOURCEPROC ShaderSource = nullptr;
+        PFNGLCOMPILESHADERPROC CompileShader = nullptr;
+        PFNGLGETSHADERIVPROC GetShaderiv = nullptr;
+        PFNGLGETSHADERINFOLOGPROC GetShaderInfoLog = nullptr;
+        PFNGLDELETESHADERPROC DeleteShader = nullptr;
+        PFNGLCREATEPROGRAMPROC CreateProgram = nullptr;
+        PFNGLATTACHSHADERPROC AttachShader = nullptr;
+        PFNGLLINKPROGRAMPROC LinkProgram = nullptr;
+        PFNGLGETPROGRAMIVPROC GetProgramiv = nullptr;
+        PFNGLGETPROGRAMINFOLOGPROC GetProgramInfoLog = nullptr;
+        PFNGLDELETEPROGRAMPROC DeleteProgram = nullptr;
+        PFNGLUSEPROGRAMPROC UseProgram = nullptr;
+        PFNGLGETUNIFORMLOCATIONPROC GetUniformLocation = nullptr;
+        PFNGLUNIFORM1UIPROC Uniform1ui = nullptr;
+        PFNGLGENBUFFERSPROC GenBuffers = nullptr;
+        PFNGLDELETEBUFFERSPROC DeleteBuffers = nullptr;
+        PFNGLBINDBUFFERPROC BindBuffer = nullptr;
+        PFNGLBINDBUFFERBASEPROC BindBufferBase = nullptr;
+        PFNGLBUFFERDATAPROC BufferData = nullptr;
+        PFNGLGETBUFFERSUBDATAPROC GetBufferSubData = nullptr;
+        PFNGLDISPATCHCOMPUTEPROC DispatchCompute = nullptr;
+        PFNGLMEMORYBARRIERPROC MemoryBarrier = nullptr;
+
+        bool Load() {
+            bool ok = true;
+            auto load = [&](auto& function, const char* name) {
+                function = reinterpret_cast<std::remove_reference_t<decltype(function)>>(eglGetProcAddress(name));
+                ok &= function != nullptr;
+            };
+            load(GetString, "glGetString");
+            load(CreateShader, "glCreateShader");
+            load(ShaderSource, "glShaderSource");
+            load(CompileShader, "glCompileShader");
+            load(GetShaderiv, "glGetShaderiv");
+            load(GetShaderInfoLog, "glGetShaderInfoLog");
+            load(DeleteShader, "glDeleteShader");
+            load(CreateProgram, "glCreateProgram");
+            load(AttachShader, "glAttachShader");
+            load(LinkProgram, "glLinkProgram");
+            load(GetProgramiv, "glGetProgramiv");
+            load(GetProgramInfoLog, "glGetProgramInfoLog");
+            load(DeleteProgram, "glDeleteProgram");
+            load(UseProgram, "glUseProgram");
+            load(GetUniformLocation, "glGetUniformLocation");
+            load(Uniform1ui, "glUniform1ui");
+            load(GenBuffers, "glGenBuffers");
+            load(DeleteBuffers, "glDeleteBuffers");
+            load(BindBuffer, "glBindBuffer");
+            load(BindBufferBase, "glBindBufferBase");
+            load(BufferData, "glBufferData");
+            load(GetBufferSubData, "glGetBufferSubData");
+            load(DispatchCompute, "glDispatchCompute");
+            load(MemoryBarrier, "glMemoryBarrier");
+            return ok;
+        }
+    };
+
+    GlFunctions gl;
+
+    // HLSL names GLSL spells differently, and the HLSL intrinsics it lacks
+    const char kPrelude[] = R"(#version 450
+#define float2 vec2
+#define float3 vec3
+#define float4 vec4
+#define int2 ivec2
+#define int3 ivec3
+#define int4 ivec4
+#define uint2 uvec2
+#define uint3 uvec3
+#define uint4 uvec4
+#define bool2 bvec2
+#define bool3 bvec3
+#define bool4 bvec4
+#define frac fract
+#define lerp mix
+#define rsqrt inversesqrt
+#define atan2 atan
+#define asfloat uintBitsToFloat
+#define asuint floatBitsToUint
+#define asint floatBitsToInt
+float saturate(float v) { return clamp(v, 0.0, 1.0); }
+vec2 saturate(vec2 v) { return clamp(v, 0.0, 1.0); }
+vec3 saturate(vec3 v) { return clamp(v, 0.0, 1.0); }
+vec4 saturate(vec4 v) { return clamp(v, 0.0, 1.0); }
+float fmod(float a, float b) { return a - b * trunc(a / b); }
+vec2 fmod(vec2 a, vec2 b) { return a - b * trunc(a / b); }
+vec3 fmod(vec3 a, vec3 b) { return a - b * trunc(a / b); }
+vec4 fmod(vec4 a, vec4 b) { return a - b * trunc(a / b); }
+vec2 fmod(vec2 a, float b) { return a - b * trunc(a / b); }
+vec3 fmod(vec3 a, float b) { return a - b * trunc(a / b); }
+vec4 fmod(vec4 a, float b) { return a - b * trunc(a / b); }
+)";
+
+    // the dispatch of NoiseParity.hlsl CSMain, std430 uvec4 is the uint4 of the structured buffers
+    const char kParityMain[] = R"(
+layout(local_size_x = 64) in;
+layout(std430, binding = 0) readonly buffer ParityInputs { uvec4 parityInputs[]; };
+layout(std430, binding = 1) writeonly buffer ParityOutputs { uvec4 parityOutputs[]; };
+uniform uint cParityFunction_;
+uniform uint cParityCount_;
+void main() {
+    uint id = gl_GlobalInvocationID.x;
+    if (id >= cParityCount_) {
+        return;
+    }
+    parityOutputs[id] = ParityEvaluate(cParityFunction_, parityInputs[id]);
+}
+)";
+
+    std::string Lower(std::string s) {
+        std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return s;
+    }
+
+    // the shaders include "commonFunctions.hlsl" for CommonFunctions.hlsl, fine on Windows only
+    std::filesystem::path FindInclude(const std::filesystem::path& dir, const std::string& name) {
+        std::error_code ec;
+        for (const auto& entry : std::filesystem::directory_iterator(dir, ec)) {
+            if (Lower(entry.path().filename().string()) == Lower(name)) {
+                return entry.path();
+            }
+        }
+        return {};
+    }
+
+    // the file with its includes inlined once each, comments removed
+    bool LoadSource(const std::filesystem::path& path, std::set<std::string>& loaded, std::string& out, std::string& error) {
+        if (!loaded.insert(Lower(path.filename().string())).second) {
+            return true;
+        }
+        std::ifstream file(path);
+        if (!file) {
+            error = "failed to open " + path.string();
+            return false;
+        }
+        std::stringstream text;
+        text << file.rdbuf();
+        const std::string source = text.str();
+
+        std::string stripped;
+        for (size_t i = 0; i < source.size(); i++) {
+            if (source.compare(i, 2, "//") == 0) {
+                while (i < source.size() && source[i] != '\n') { i++; }
+                stripped += '\n';
+            } else if (source.compare(i, 2, "/*") == 0) {
+                const size_t end = source.find("*/", i + 2);
+                i = end == std::string::npos ? source.size() : end + 1;
+                stripped += ' ';
+            } else {
+                stripped += source[i];
+            }
+        }
+
+        static const std::regex includeLine(R"(^\s*#\s*include\s*"([^"]+)\")");
+        std::istringstream lines(stripped);
+        std::string line;
+        while (std::getline(lines, line)) {
+            std::smatch match;
+            if (std::regex_search(line, match, includeLine)) {
+                const std::filesystem::path include = FindInclude(path.parent_path(), match[1].str());
+                if (include.empty()) {
+                    error = "include " + match[1].str() + " of " + path.string() + " not found";
+                    return false;
+                }
+                if (!LoadSource(include, loaded, out, error)) {
+                    return false;
+                }
+                continue;
+            }
+            out += line + "\n";
+        }
+        return true;
+    }
+
+    // a top level piece of the source: a function, a global, a #define or something unused
+    struct Item {
+        std::string name_;
+        std::string text_;
+        bool function_ = false;
+    };
+
+    std::string LastIdentifier(const std::string& s) {
+        static const std::regex identifier(R"([A-Za-z_]\w*)");
+        std::string last;
+        for (std::sregex_iterator it(s.begin(), s.end(), identifier), end; it != end; ++it) {
+            last = it->str();
+        }
+        return last;
+    }
+
+    std::vector<Item> SplitItems(const std::string& source) {
+        std::vector<Item> items;
+        static const std::regex define(R"(^\s*#\s*define\s+([A-Za-z_]\w*)(\(|\s+\S))");
+
+        std::string code;
+        std::istringstream lines(source);
+        std::string line;
+        while (std::getline(lines, line)) {
+            std::smatch match;
+            if (std::regex_search(line, match, define)) {
+                items.push_back({ match[1].str(), line + "\n", false });
+            } else if (line.find_first_not_of(" \t\r") != std::string::npos && line[line.find_first_not_of(" \t\r")] == '#') {
+                // guards, pragmas: the GLSL gets only what the entry reaches
+            } else {
+                code += line + "\n";
+            }
+        }
+
+        // bodies end with the brace that closes them, declarations with a ; at depth 0
+        std::string current;
+        int depth = 0;
+        for (size_t i = 0; i < code.size(); i++) {
+            const char c = code[i];
+            current += c;
+            if (c == '{') { depth++; }
+            if ((c == '}' && --depth == 0) || (c == ';' && depth == 0)) {
+                Item item;
+                const size_t brace = current.find('{');
+                const size_t paren = current.find('(');
+                const std::string head = current.substr(0, (std::min)(brace, current.find('=')));
+                if (c == '}' && paren != std::string::npos && paren < brace) {
+                    item.function_ = true;
+                    item.name_ = LastIdentifier(current.substr(0, paren));
+                } else if (c == ';' && head.find('(') == std::string::npos) {
+                    item.name_ = LastIdentifier(head.substr(0, (std::min)(head.find(':'), head.find('['))));
+                }
+                item.text_ = current;
+                if (current.find_first_not_of(" \t\r\n;") != std::string::npos) {
+                    items.push_back(item);
+                }
+                current.clear();
+            }
+        }
+        return items;
+    }
+
+    // balanced (...) or [...] starting at pos, end is one past the close
+    size_t SkipGroup(const std::string& s, size_t pos) {
+        const char open = s[pos];
+        const char close = open == '(' ? ')' : ']';
+        int depth = 0;
+        for (size_t i = pos; i < s.size(); i++) {
+            if (s[i] == open) { depth++; }
+            if (s[i] == close && --depth == 0) { return i + 1; }
+        }
+        return s.size();
+    }
+
+    // (int3)floor(p) -> int3(floor(p)), GLSL only has constructor casts
+    std::string RewriteCasts(std::string s) {
+        static const std::regex cast(R"(\(\s*(bool|int|uint|float)([1-4]?)\s*\)\s*)");
+        std::smatch match;
+        std::string out;
+        while (std::regex_search(s, match, cast)) {
+            out += match.prefix().str();
+            const std::string rest = match.suffix().str();
+            size_t end = 0;
+            if (!rest.empty() && rest[0] == '(') {
+                end = SkipGroup(rest, 0);
+            } else {
+                while (end < rest.size() && (std::isalnum(static_cast<unsigned char>(rest[end])) || rest[end] == '_' || rest[end] == '.')) { end++; }
+                while (end < rest.size() && (rest[end] == '(' || rest[end] == '[')) { end = SkipGroup(rest, end); }
+            }
+            out += match[1].str() + match[2].str() + "(" + rest.substr(0, end) + ")";
+            s = rest.substr(end);
+        }
+        return out + s;
+    }
+
+    std::string Rewrite(const Item& item) {
+        std::string text = item.text_;
+        if (item.function_) {
+            // default arguments of the signature, the callers here pass every argument
+            const size_t brace = text.find('{');
+            static const std::regex defaultArgument(R"(\s*=\s*[^,)]+)");
+            text = std::regex_replace(text.substr(0, brace), defaultArgument, "") + text.substr(brace);
+        }
+        static const std::regex staticQualifier(R"(\bstatic\s+)");
+        static const std::regex attribute(R"(\[\s*(unroll|loop|fastopt|flatten|branch|allow_uav_condition)\s*(\(\s*\d*\s*\))?\s*\])");
+        // the per component select of a vector compare (AlligatorNoiseSingle), GLSL ?: takes a bool only
+        static const std::regex vectorSelect(R"(\((\w+)\s*<\s*([0-9.]+)\)\s*\?\s*([^:;]+?)\s*:\s*(\w+)\s*;)");
+        text = std::regex_replace(text, staticQualifier, "");
+        text = std::regex_replace(text, attribute, "");
+        text = std::regex_replace(text, vectorSelect, "mix($4, $3, lessThan($1, $1 * 0.0 + $2));");
+        return RewriteCasts(text);
+    }
+
+} // namespace
+
+bool NoiseParityGl::Translate(const std::string& path, const std::string& entry, std::string& glsl, std::string& error) {
+    std::string source;
+    std::set<std::string> loaded;
+    if (!LoadSource(path, loaded, source, error)) {
+        return false;
+    }
+    const std::vector<Item> items = SplitItems(source);
+
+    // the entry and everything its text names, overloads included
+    std::multimap<std::string, size_t> byName;
+    for (size_t i = 0; i < items.size(); i++) {
+        if (!items[i].name_.empty()) {
+            byName.insert({ items[i].name_, i });
+        }
+    }
+    std::vector<bool> used(items.size(), false);
+    std::vector<size_t> pending;
+    auto use = [&](const std::string& name) {
+        const auto range = byName.equal_range(name);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (!used[it->second]) {
+                used[it->second] = true;
+                pending.push_back(it->second);
+            }
+        }
+    };
+    use(entry);
+    if (pending.empty()) {
+        error = entry + " not found in " + path;
+        return false;
+    }
+    static const std::regex identifier(R"([A-Za-z_]\w*)");
+    while (!pending.empty()) {
+        const std::string text = items[pending.back()].text_;
+        pending.pop_back();
+        for (std::sregex_iterator it(text.begin(), text.end(), identifier), end; it != end; ++it) {
+            use(it->str());
+        }
+    }
+
+    // defines first, the rest in source order like HLSL needs it as well
+    glsl = kPrelude;
+    for (size_t i = 0; i < items.size(); i++) {
+        if (used[i] && !items[i].function_ && items[i].text_[items[i].text_.find_first_not_of(" \t")] == '#') {
+            glsl += items[i].text_;
+        }
+    }
+    for (size_t i = 0; i < items.size(); i++) {
+        if (used[i] && (items[i].function_ || items[i].text_[items[i].text_.find_first_not_of(" \t")] != '#')) {
+            glsl += Rewrite(items[i]) + "\n";
+        }
+    }
+    return true;
+}
+
+NoiseParityGl::~NoiseParityGl() {
+    if (program_ != 0 && gl.DeleteProgram) {
+        gl.DeleteProgram(program_);
+    }
+    if (display_) {
+        eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context_) {
+            eglDestroyContext(display_, context_);
+        }
+        eglTerminate(display_);
+    }
+}
+
+bool NoiseParityGl::Initialize(const std::string& shaderDir, std::string& error) {
+    if (program_ != 0) {
+        return true;
+    }
+
+    // surfaceless, no window system needed
+    const auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+    display_ = getPlatformDisplay ? getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr) : eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLint major = 0, minor = 0;
+    if (!display_ || !eglInitialize(display_, &major, &minor)) {
+        display_ = nullptr;
+        error = "no EGL display";
+        return false;
+    }
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 5,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    if (!eglBindAPI(EGL_OPENGL_API) || !(context_ = eglCreateContext(display_, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, contextAttributes))
+        || !eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, context_)) {
+        error = "no OpenGL 4.5 context";
+        return false;
+    }
+    if (!gl.Load()) {
+        error = "missing OpenGL entry points";
+        return false;
+    }
+    renderer_ = reinterpret_cast<const char*>(gl.GetString(GL_RENDERER));
+
+    std::string glsl;
+    if (!Translate(shaderDir + "/NoiseParity.hlsl", "ParityEvaluate", glsl, error)) {
+        return false;
+    }
+    glsl += kParityMain;
+
+    const GLuint shader = gl.CreateShader(GL_COMPUTE_SHADER);
+    const char* text = glsl.c_str();
+    gl.ShaderSource(shader, 1, &text, nullptr);
+    gl.CompileShader(shader);
+    GLint status = 0;
+    gl.GetShaderiv(shader, GL_COMPILE_STATUS, &status);
+    if (!status) {
+        char log[4096] = {};
+        gl.GetShaderInfoLog(shader, sizeof(log), nullptr, log);
+        error = std::string("NoiseParity.hlsl as GLSL does not compile:\n") + log;
+        gl.DeleteShader(shader);
+        return false;
+    }
+
+    program_ = gl.CreateProgram();
+    gl.AttachShader(program_, shader);
+    gl.LinkProgram(program_);
+    gl.DeleteShader(shader);
+    gl.GetProgramiv(program_, GL_LINK_STATUS, &status);
+    if (!status) {
+        char log[4096] = {};
+        gl.GetProgramInfoLog(program_, sizeof(log), nullptr, log);
+        error = std::string("NoiseParity.hlsl as GLSL does not link:\n") + log;
+        gl.DeleteProgram(program_);
+        program_ = 0;
+        return false;
+    }
+    return true;
+}
+
+bool NoiseParityGl::Evaluate(NoiseParity::Function function, const std::vector<uint4>& inputs, std::vector<uint4>& outputs) {
+    if (program_ == 0 || inputs.empty()) {
+        return false;
+    }
+    const GLuint count = static_cast<GLuint>(inputs.size());
+    const GLsizeiptr bytes = sizeof(uint4) * count;
+
+    GLuint buffers[2] = {};
+    gl.GenBuffers(2, buffers);
+    gl.BindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[0]);
+    gl.BufferData(GL_SHADER_STORAGE_BUFFER, bytes, inputs.data(), GL_STATIC_DRAW);
+    gl.BindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[1]);
+    gl.BufferData(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, GL_STREAM_READ);
+    gl.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, buffers[0]);
+    gl.BindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, buffers[1]);
+
+    gl.UseProgram(program_);
+    gl.Uniform1ui(gl.GetUniformLocation(program_, "cParityFunction_"), static_cast<GLuint>(function));
+    gl.Uniform1ui(gl.GetUniformLocation(program_, "cParityCount_"), count);
+    gl.DispatchCompute((count + 63) / 64, 1, 1);
+    gl.MemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    outputs.assign(count, uint4());
+    gl.BindBuffer(GL_SHADER_STORAGE_BUFFER, buffers[1]);
+    gl.GetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, outputs.data());
+    gl.DeleteBuffers(2, buffers);
+    return true;
+}
+
+NoiseParity::Report NoiseParityGl::CompareWithCpu(int samples, uint32_t seed) {
+    NoiseParity::Report report;
+    report.source_ = NoiseParity::kSourceGpu;
+    for (uint32_t f = 0; f < NoiseParity::kFunctionCount; f++) {
+        const NoiseParity::Function function = static_cast<NoiseParity::Function>(f);
+        const std::vector<uint4> inputs = NoiseParity::MakeInputs(function, samples, seed);
+
+        std::vector<uint4> gpu;
+        if (!Evaluate(function, inputs, gpu)) {
+            report.error_ = "GL evaluation failed";
+            return report;
+        }
+        report.functions_.push_back(NoiseParity::Compare(function, gpu, NoiseParity::EvaluateCpu(function, inputs)));
+    }
+    return report;
+}
+
+bool NoiseParityGl::WriteGolden(const std::string& path) {
+    NoiseParity::Golden golden;
+    golden.source_ = NoiseParity::kSourceGpu;
+    golden.seed_ = NoiseParity::kDefaultSeed;
+    golden.samples_ = NoiseParity::kGoldenSamples;
+
+    for (uint32_t f = 0; f < NoiseParity::kFunctionCount; f++) {
+        const NoiseParity::Function function = static_cast<NoiseParity::Function>(f);
+        if (!Evaluate(function, NoiseParity::MakeInputs(function, golden.samples_, golden.seed_), golden.outputs_[f])) {
+            return false;
+        }
+    }
+    return NoiseParity::SaveGolden(path, golden);
+}
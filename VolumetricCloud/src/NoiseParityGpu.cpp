@@ -0,0 +1,155 @@
+#include <d3d11.h>
+#include <d3dcompiler.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <windows.h>
+#include <wrl/client.h>
+
+#include "../includes/NoiseParityGpu.h"
+#include "../includes/Renderer.h"
+
+using hlsl::uint4;
+
+namespace {
+
+    struct ParityParams {
+        UINT function;
+        UINT count;
+        UINT padding[2];
+    };
+
+} // namespace
+
+void NoiseParityGpu::CreateShader() {
+    ComPtr<ID3DBlob> csBlob;
+    HRESULT hr = Renderer::CompileShaderFromFile(L"shaders/NoiseParity.hlsl", "CSMain", "cs_5_0", csBlob);
+    if (FAILED(hr)) {
+        return;
+    }
+    Renderer::device->CreateComputeShader(csBlob->GetBufferPointer(), csBlob->GetBufferSize(), nullptr, &computeShader_);
+
+    D3D11_BUFFER_DESC cbDesc = {};
+    cbDesc.Usage = D3D11_USAGE_DYNAMIC;
+    cbDesc.ByteWidth = sizeof(ParityParams);
+    cbDesc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+    cbDesc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+    Renderer::device->CreateBuffer(&cbDesc, nullptr, &paramsCB_);
+}
+
+bool NoiseParityGpu::Evaluate(NoiseParity::Function function, const std::vector<uint4>& inputs, std::vector<uint4>& outputs) {
+    if (!computeShader_) {
+        CreateShader();
+    }
+    if (!computeShader_ || inputs.empty()) {
+        return false;
+    }
+
+    const UINT count = static_cast<UINT>(inputs.size());
+
+    // structured input buffer
+    D3D11_BUFFER_DESC inputDesc = {};
+    inputDesc.Usage = D3D11_USAGE_IMMUTABLE;
+    inputDesc.ByteWidth = sizeof(uint4) * count;
+    inputDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+    inputDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+    inputDesc.StructureByteStride = sizeof(uint4);
+
+    D3D11_SUBRESOURCE_DATA inputData = {};
+    inputData.pSysMem = inputs.data();
+
+    ComPtr<ID3D11Buffer> inputBuffer;
+    ComPtr<ID3D11ShaderResourceView> inputSRV;
+    if (FAILED(Renderer::device->CreateBuffer(&inputDesc, &inputData, &inputBuffer)) ||
+        FAILED(Renderer::device->CreateShaderResourceView(inputBuffer.Get(), nullptr, &inputSRV))) {
+        std::cerr << "Failed to create noise parity input buffer" << std::endl;
+        return false;
+    }
+
+    // structured output buffer + staging copy
+    D3D11_BUFFER_DESC outputDesc = inputDesc;
+    outputDesc.Usage = D3D11_USAGE_DEFAULT;
+    outputDesc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+
+    ComPtr<ID3D11Buffer> outputBuffer;
+    ComPtr<ID3D11UnorderedAccessView> outputUAV;
+    if (FAILED(Renderer::device->CreateBuffer(&outputDesc, nullptr, &outputBuffer)) ||
+        FAILED(Renderer::device->CreateUnorderedAccessView(outputBuffer.Get(), nullptr, &outputUAV))) {
+        std::cerr << "Failed to create noise parity output buffer" << std::endl;
+        return false;
+    }
+
+    D3D11_BUFFER_DESC readbackDesc = {};
+    readbackDesc.Usage = D3D11_USAGE_STAGING;
+    readbackDesc.ByteWidth = outputDesc.ByteWidth;
+    readbackDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    readbackDesc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+    readbackDesc.StructureByteStride = sizeof(uint4);
+
+    ComPtr<ID3D11Buffer> readbackBuffer;
+    Renderer::device->CreateBuffer(&readbackDesc, nullptr, &readbackBuffer);
+
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    if (SUCCEEDED(Renderer::context->Map(paramsCB_.Get(), 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped))) {
+        ParityParams* params = static_cast<ParityParams*>(mapped.pData);
+        params->function = static_cast<UINT>(function);
+        params->count = count;
+        Renderer::context->Unmap(paramsCB_.Get(), 0);
+    }
+
+    Renderer::context->CSSetShader(computeShader_.Get(), nullptr, 0);
+    Renderer::context->CSSetConstantBuffers(5, 1, paramsCB_.GetAddressOf());
+    Renderer::context->CSSetShaderResources(0, 1, inputSRV.GetAddressOf());
+    Renderer::context->CSSetUnorderedAccessViews(0, 1, outputUAV.GetAddressOf(), nullptr);
+
+    Renderer::context->Dispatch((count + 63) / 64, 1, 1);
+
+    // unbind so the buffers can be released / reused
+    ID3D11ShaderResourceView* nullSRV = nullptr;
+    ID3D11UnorderedAccessView* nullUAV = nullptr;
+    Renderer::context->CSSetShaderResources(0, 1, &nullSRV);
+    Renderer::context->CSSetUnorderedAccessViews(0, 1, &nullUAV, nullptr);
+
+    Renderer::context->CopyResource(readbackBuffer.Get(), outputBuffer.Get());
+
+    if (FAILED(Renderer::context->Map(readbackBuffer.Get(), 0, D3D11_MAP_READ, 0, &mapped))) {
+        return false;
+    }
+    const uint4* data = static_cast<const uint4*>(mapped.pData);
+    outputs.assign(data, data + count);
+    Renderer::context->Unmap(readbackBuffer.Get(), 0);
+
+    return true;
+}
+
+NoiseParity::Report NoiseParityGpu::CompareWithCpu(int samples, uint32_t seed) {
+    NoiseParity::Report report;
+    report.source_ = NoiseParity::kSourceGpu;
+    for (uint32_t f = 0; f < NoiseParity::kFunctionCount; f++) {
+        const NoiseParity::Function function = static_cast<NoiseParity::Function>(f);
+        const std::vector<uint4> inputs = NoiseParity::MakeInputs(function, samples, seed);
+
+        std::vector<uint4> gpu;
+        if (!Evaluate(function, inputs, gpu)) {
+            report.error_ = "GPU evaluation failed";
+            return report;
+        }
+        report.functions_.push_back(NoiseParity::Compare(function, gpu, NoiseParity::EvaluateCpu(function, inputs)));
+    }
+    return report;
+}
+
+bool NoiseParityGpu::WriteGolden(const std::string& path) {
+    NoiseParity::Golden golden;
+    golden.source_ = NoiseParity::kSourceGpu;
+    golden.seed_ = NoiseParity::kDefaultSeed;
+    golden.samples_ = NoiseParity::kGoldenSamples;
+
+    for (uint32_t f = 0; f < NoiseParity::kFunctionCount; f++) {
+        const NoiseParity::Function function = static_cast<NoiseParity::Function>(f);
+        if (!Evaluate(function, NoiseParity::MakeInputs(function, golden.samples_, golden.seed_), golden.outputs_[f])) {
+            return false;
+        }
+    }
+    return NoiseParity::SaveGolden(path, golden);
+}
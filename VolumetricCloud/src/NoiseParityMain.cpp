@@ -0,0 +1,75 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../includes/NoiseParity.h"
+#if NOISE_PARITY_GL
+#include "../includes/NoiseParityGl.h"
+#endif
+
+// headless NoiseParity run for CI, built by CMakeLists.txt and not part of the Windows project.
+// usage: NoiseParity [--no-speed] [--gl] [--write-golden] [resource dir] [cache dir] [shader dir],
+// from VolumetricCloud/ the defaults fit.
+//   default          the C++ port against resources/NoiseParity.golden, written from the shader
+//   --gl             the C++ port against the shader dispatched now through NoiseParityGl
+//   --write-golden   the shader outputs through NoiseParityGl become the golden
+// the last two need the EGL build (NOISE_PARITY_GL). exits with 1 when a function is out of
+// tolerance or the golden is not from the shader, --no-speed skips the throughput check
+int main(int argc, char** argv) {
+    bool speed = true;
+    bool live = false;
+    bool writeGolden = false;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++) {
+        const std::string arg = argv[i];
+        if (arg == "--no-speed") {
+            speed = false;
+        } else if (arg == "--gl") {
+            live = true;
+        } else if (arg == "--write-golden") {
+            writeGolden = true;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    const std::string resourceDir = paths.size() > 0 ? paths[0] : "resources";
+    const std::string cacheDir = paths.size() > 1 ? paths[1] : "cache";
+    const std::string shaderDir = paths.size() > 2 ? paths[2] : "shaders";
+    const std::string goldenPath = resourceDir + "/NoiseParity.golden";
+
+    if (live || writeGolden) {
+#if NOISE_PARITY_GL
+        NoiseParityGl parityGl;
+        std::string error;
+        if (!parityGl.Initialize(shaderDir, error)) {
+            std::cerr << "NoiseParity: " << error << std::endl;
+            return 1;
+        }
+        std::cout << "shader on " << parityGl.renderer_ << "\n";
+        if (writeGolden) {
+            if (!parityGl.WriteGolden(goldenPath)) {
+                std::cerr << "NoiseParity: failed to write " << goldenPath << std::endl;
+                return 1;
+            }
+            std::cout << "golden written to " << goldenPath << "\n";
+        }
+        if (live) {
+            const NoiseParity::Report report = parityGl.CompareWithCpu(1 << 16);
+            std::cout << report.ToString();
+            if (!report.Passed()) {
+                return 1;
+            }
+        }
+        if (!writeGolden) {
+            return 0;
+        }
+#else
+        std::cerr << "NoiseParity: built without EGL, no shader to run" << std::endl;
+        return 1;
+#endif
+    }
+
+    const NoiseParity::Report report = NoiseParity::Run(goldenPath, cacheDir + "/NoiseParity.bench", speed ? 1 << 18 : 0);
+    std::cout << report.ToString();
+    return report.Passed() ? 0 : 1;
+}
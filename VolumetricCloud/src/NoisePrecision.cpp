@@ -0,0 +1,296 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../includes/CloudDensity.h"
+#include "../includes/NoisePrecision.h"
+#include "../includes/ThreadPool.h"
+
+using namespace hlsl;
+
+namespace {
+
+    // weather states the rays are traced through: fmap r (coverage), g (size), b (altitude ft)
+    const float4 kWeathers[] = {
+        float4(0.35f, 0.3f, 2000.0f, 0.0f),
+        float4(0.6f, 0.5f, 4000.0f, 0.0f),
+        float4(0.9f, 0.8f, 6000.0f, 0.0f),
+    };
+
+    const int kRaySteps = 400;
+    const float kRayStepMeter = 50.0f; // the near step of RayMarch
+
+    struct Ray {
+        float3 origin;
+        float3 dir;
+        float4 fmap;
+    };
+
+    float QuantizeUnorm(float v, float levels) {
+        return std::floor(saturate(v) * levels + 0.5f) / levels;
+    }
+
+    // BC4_UNORM of one 4x4 block in the 8 value mode (red0 > red1)
+    void EncodeDecodeBC4(float block[16]) {
+        float lo = 1.0f, hi = 0.0f;
+        for (int i = 0; i < 16; i++) {
+            block[i] = saturate(block[i]);
+            lo = (std::min)(lo, block[i]);
+            hi = (std::max)(hi, block[i]);
+        }
+        const int r0 = static_cast<int>(hi * 255.0f + 0.5f);
+        const int r1 = static_cast<int>(lo * 255.0f + 0.5f);
+        if (r0 == r1) {
+            for (int i = 0; i < 16; i++) { block[i] = r0 / 255.0f; }
+            return;
+        }
+
+        float palette[8];
+        palette[0] = r0 / 255.0f;
+        palette[1] = r1 / 255.0f;
+        for (int i = 1; i < 7; i++) {
+            palette[i + 1] = ((7 - i) * r0 + i * r1) / (7.0f * 255.0f);
+        }
+
+        for (int i = 0; i < 16; i++) {
+            float best = palette[0];
+            for (int p = 1; p < 8; p++) {
+                if (std::fabs(palette[p] - block[i]) < std::fabs(best - block[i])) { best = palette[p]; }
+            }
+            block[i] = best;
+        }
+    }
+
+    float MarchTransmittance(const Ray& ray, const NoiseVolume& large, const NoiseVolume& small, std::vector<float>& densities) {
+        using namespace clouddensity;
+
+        densities.resize(kRaySteps);
+        float transmittance = 1.0f;
+        for (int s = 0; s < kRaySteps; s++) {
+            const float3 pos = ray.origin + ray.dir * (s * kRayStepMeter);
+
+            DensitySamples samples = {};
+            samples.fmap_ = ray.fmap;
+            samples.layerNoise_[0] = large.Sample(LayerNoiseUVW(kCumulusLayer, pos));
+            samples.layerNoise_[1] = large.Sample(LayerNoiseUVW(kCirrusLayer, pos));
+            samples.smallNoise_ = small.Sample(SmallNoiseUVW(pos));
+
+            // the two default layers, the same noise volume as the ray marcher
+            const CloudLayerDesc layers[] = { kCumulusLayer, kCirrusLayer };
+            float distance;
+            const float dense = CloudDensityFromSamples(-pos.y, samples, layers, distance);
+            densities[s] = dense;
+            transmittance *= std::exp(-(std::max)(dense, 0.0f) * kRayStepMeter);
+        }
+        return transmittance;
+    }
+
+} // namespace
+
+const char* NoisePrecision::FormatName(Format format) {
+    switch (format) {
+    case kFloat: return "R32_FLOAT";
+    case kR16F: return "R16_FLOAT";
+    case kR16: return "R16_UNORM";
+    case kR8: return "R8_UNORM";
+    case kBC4: return "BC4_UNORM";
+    default: return "?";
+    }
+}
+
+float NoisePrecision::BitsPerChannel(Format format) {
+    switch (format) {
+    case kFloat: return 32.0f;
+    case kR16F: return 16.0f;
+    case kR16: return 16.0f;
+    case kR8: return 8.0f;
+    case kBC4: return 4.0f;
+    default: return 0.0f;
+    }
+}
+
+bool NoisePrecision::FormatResult::VisuallySafe() const {
+    return maxTransmittanceError_ <= kVisualTransmittanceError;
+}
+
+float NoisePrecision::QuantizeHalf(float value) {
+    if (!std::isfinite(value) || value == 0.0f) { return value; }
+
+    const float magnitude = std::fabs(value);
+    if (magnitude > 65504.0f) { return std::copysign(INFINITY, value); }
+
+    // 11 significant bits for normals, a fixed 2^-24 step for subnormals
+    int exponent;
+    std::frexp(magnitude, &exponent);
+    const float step = magnitude < 6.103515625e-05f ? 5.9604644775390625e-08f : std::ldexp(1.0f, exponent - 11);
+    return std::copysign(std::nearbyint(magnitude / step) * step, value);
+}
+
+NoiseVolume NoisePrecision::Quantize(const NoiseVolume& volume, Format format) {
+    NoiseVolume out = volume;
+
+    switch (format) {
+    case kFloat:
+        break;
+    case kR16F:
+        for (float& v : out.texels_) { v = QuantizeHalf(v); }
+        break;
+    case kR16:
+        for (float& v : out.texels_) { v = QuantizeUnorm(v, 65535.0f); }
+        break;
+    case kR8:
+        for (float& v : out.texels_) { v = QuantizeUnorm(v, 255.0f); }
+        break;
+    case kBC4:
+        // one BC4 texture per channel, blocks are 4x4 texels of a slice
+        for (int f = 0; f < volume.frames_; f++)
+        for (int z = 0; z < volume.depth_; z++)
+        for (int by = 0; by < volume.height_; by += 4)
+        for (int bx = 0; bx < volume.width_; bx += 4)
+        for (int c = 0; c < 4; c++) {
+            float block[16];
+            for (int i = 0; i < 16; i++) {
+                const int x = (std::min)(bx + i % 4, volume.width_ - 1);
+                const int y = (std::min)(by + i / 4, volume.height_ - 1);
+                block[i] = volume.texels_[volume.Index(x, y, z, f) + c];
+            }
+            EncodeDecodeBC4(block);
+            for (int i = 0; i < 16; i++) {
+                const int x = bx + i % 4;
+                const int y = by + i / 4;
+                if (x < volume.width_ && y < volume.height_) {
+                    out.texels_[volume.Index(x, y, z, f) + c] = block[i];
+                }
+            }
+        }
+        break;
+    default:
+        break;
+    }
+    return out;
+}
+
+NoisePrecision::Report NoisePrecision::Run(int largeResolution, int smallResolution, int raysPerWeather, bool saturateReference) {
+    Report report;
+    report.largeResolution_ = largeResolution;
+    report.smallResolution_ = smallResolution;
+    report.saturatedReference_ = saturateReference;
+
+    // float bakes of the recipes RenderNoiseTexture3D produces on the GPU
+    NoiseVolume large = NoiseBaker::Bake(NoiseBaker::RecipeFbm(), largeResolution, largeResolution, largeResolution);
+    NoiseVolume small = NoiseBaker::Bake(NoiseBaker::RecipeFbmSmall(), smallResolution, smallResolution, smallResolution);
+
+    // the worley fbm channels reach above 1, UNORM formats clip them.
+    // a saturated reference leaves only the precision loss in the numbers.
+    if (saturateReference) {
+        for (float& v : large.texels_) { v = saturate(v); }
+        for (float& v : small.texels_) { v = saturate(v); }
+    }
+
+    // rays through and along the layers of every weather state, deterministic
+    std::vector<Ray> rays;
+    uint32_t state = 0x9E3779B9u;
+    auto next = [&]() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return (state >> 8) * (1.0f / 16777216.0f);
+    };
+    for (const float4& weather : kWeathers) {
+        const float bottom = weather.z * clouddensity::FT_TO_M;
+        const float top = bottom + 500.0f + 2000.0f * weather.y;
+        for (int i = 0; i < raysPerWeather; i++) {
+            const float azimuth = next() * 6.2831853f;
+            const float elevation = (next() * 2.0f - 1.0f) * 0.35f;
+            const float altitude = next() * (top + 500.0f);
+
+            Ray ray;
+            ray.origin = float3((next() - 0.5f) * 80000.0f, -altitude, (next() - 0.5f) * 80000.0f);
+            ray.dir = float3(std::cos(elevation) * std::sin(azimuth), -std::sin(elevation), std::cos(elevation) * std::cos(azimuth));
+            ray.fmap = weather;
+            rays.push_back(ray);
+        }
+    }
+    report.rays_ = static_cast<int>(rays.size());
+
+    // reference march
+    std::vector<float> referenceT(rays.size());
+    std::vector<std::vector<float>> referenceD(rays.size());
+    ThreadPool::Shared().ParallelFor(0, static_cast<int>(rays.size()), [&](int r) {
+        referenceT[r] = MarchTransmittance(rays[r], large, small, referenceD[r]);
+    });
+
+    for (int f = 0; f < kFormatCount; f++) {
+        const Format format = static_cast<Format>(f);
+        const NoiseVolume largeQ = Quantize(large, format);
+        const NoiseVolume smallQ = Quantize(small, format);
+
+        FormatResult result;
+        result.format_ = format;
+        result.bytes_ = static_cast<size_t>((large.TexelCount() + small.TexelCount()) * 4 * BitsPerChannel(format) / 8);
+        for (size_t i = 0; i < large.texels_.size(); i++) {
+            result.maxTexelError_ = (std::max)(result.maxTexelError_, std::fabs(largeQ.texels_[i] - large.texels_[i]));
+        }
+        for (size_t i = 0; i < small.texels_.size(); i++) {
+            result.maxTexelError_ = (std::max)(result.maxTexelError_, std::fabs(smallQ.texels_[i] - small.texels_[i]));
+        }
+
+        std::vector<float> transmittance(rays.size());
+        std::vector<float> maxDensity(rays.size(), 0.0f);
+        std::vector<double> sumSquares(rays.size(), 0.0);
+        ThreadPool::Shared().ParallelFor(0, static_cast<int>(rays.size()), [&](int r) {
+            std::vector<float> densities;
+            transmittance[r] = MarchTransmittance(rays[r], largeQ, smallQ, densities);
+            for (int s = 0; s < kRaySteps; s++) {
+                const float e = std::fabs(densities[s] - referenceD[r][s]) * clouddensity::DENSITY_DIVISOR;
+                maxDensity[r] = (std::max)(maxDensity[r], e);
+                sumSquares[r] += static_cast<double>(e) * e;
+            }
+        });
+
+        double squares = 0.0;
+        double transmittanceSum = 0.0;
+        for (size_t r = 0; r < rays.size(); r++) {
+            const float e = std::fabs(transmittance[r] - referenceT[r]);
+            result.maxTransmittanceError_ = (std::max)(result.maxTransmittanceError_, e);
+            result.maxDensityError_ = (std::max)(result.maxDensityError_, maxDensity[r]);
+            transmittanceSum += e;
+            squares += sumSquares[r];
+        }
+        result.meanTransmittanceError_ = static_cast<float>(transmittanceSum / rays.size());
+        result.rmsDensityError_ = static_cast<float>(std::sqrt(squares / (static_cast<double>(rays.size()) * kRaySteps)));
+        report.formats_.push_back(result);
+    }
+    return report;
+}
+
+std::string NoisePrecision::Report::ToString() const {
+    std::ostringstream out;
+    char line[256];
+    snprintf(line, sizeof(line), "noise %d^3 + small %d^3, %d rays x %d steps, reference: %s\n",
+        largeResolution_, smallResolution_, rays_, kRaySteps, saturatedReference_ ? "float saturated to 0-1" : "float");
+    out << line;
+    snprintf(line, sizeof(line), "%-10s %8s %10s %10s %10s %10s %10s %5s\n",
+        "format", "MB", "texel", "dens max", "dens rms", "trans max", "trans avg", "safe");
+    out << line;
+
+    const FormatResult* smallest = nullptr;
+    size_t smallestBytes = SIZE_MAX;
+    for (const FormatResult& r : formats_) {
+        snprintf(line, sizeof(line), "%-10s %8.2f %10.2e %10.2e %10.2e %10.2e %10.2e %5s\n",
+            FormatName(r.format_), r.bytes_ / 1048576.0, r.maxTexelError_, r.maxDensityError_, r.rmsDensityError_,
+            r.maxTransmittanceError_, r.meanTransmittanceError_, r.VisuallySafe() ? "yes" : "no");
+        out << line;
+        if (r.VisuallySafe() && r.bytes_ < smallestBytes) {
+            smallest = &r;
+            smallestBytes = r.bytes_;
+        }
+    }
+    // the study fails when no quantized format holds the float bake
+    const bool pass = smallest != nullptr && smallest->format_ != kFloat;
+    out << "smallest visually safe format: " << (smallest ? FormatName(smallest->format_) : "none") << (pass ? "  PASS\n" : "  FAIL\n");
+    return out.str();
+}
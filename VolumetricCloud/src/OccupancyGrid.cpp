@@ -0,0 +1,574 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+
+#include "../includes/OccupancyGrid.h"
+#include "../includes/ThreadPool.h"
+
+using namespace hlsl;
+
+namespace {
+
+    int Wrap(int v, int size) {
+        const int m = v % size;
+        return m < 0 ? m + size : m;
+    }
+
+    float MaxChannel(const NoiseVolume& volume, int channel) {
+        float value = 0.0f;
+        for (size_t i = channel; i < volume.texels_.size(); i += 4) {
+            value = (std::max)(value, volume.texels_[i]);
+        }
+        return value;
+    }
+
+    // the layerShape term of CloudDensity
+    float LayerShape(const clouddensity::CloudLayerDesc& layer, float height) {
+        const float peak = layer.coverage_.z;
+        return RemapClamp(height, 0.00f, peak, 0.0f, 1.0f) * RemapClamp(height, peak, 1.00f, 1.0f, 0.0f);
+    }
+
+    // the exponent of the cumulus anvil, monotone in height
+    float AnvilExponent(const clouddensity::CloudLayerDesc& layer, float height) {
+        return RemapClamp(1.0f - height, layer.anvil_.y, layer.anvil_.z, 1.0f, lerp(1.0f, 0.5f, layer.anvil_.x));
+    }
+
+} // namespace
+
+NoiseBounds NoiseBounds::FromField(const DensityField& field) {
+    NoiseBounds bounds;
+    for (int c = 0; c < 4; c++) {
+        bounds.large_[c] = MaxChannel(field.NoiseLarge(), c);
+        bounds.small_[c] = MaxChannel(field.NoiseSmall(), c);
+    }
+    bounds.useNoiseSequence_ = field.GetSettings().useNoiseSequence_;
+    bounds.sequence_ = bounds.useNoiseSequence_ ? MaxChannel(field.NoiseSequence(), 1) : 0.0f;
+    bounds.lowFreq_ = field.GetSettings().lowFreq_;
+    return bounds;
+}
+
+bool OccupancyGrid::Build(const DensityField& field, const Settings& settings) {
+    Settings fieldSettings = settings;
+    fieldSettings.layers_ = field.Layers();
+    return Build(field.WeatherWidth(), field.WeatherHeight(), field.Weather(), NoiseBounds::FromField(field), fieldSettings);
+}
+
+bool OccupancyGrid::Build(int weatherWidth, int weatherHeight, const std::vector<float4>& weather, const NoiseBounds& noise, const Settings& settings) {
+    if (weatherWidth <= 0 || weatherHeight <= 0 || weather.size() != static_cast<size_t>(weatherWidth) * weatherHeight) {
+        std::cerr << "OccupancyGrid: weather map of " << weatherWidth << "x" << weatherHeight << " with " << weather.size() << " texels" << std::endl;
+        return false;
+    }
+    if (settings.cellsPerTexel_ <= 0 || settings.levels_ <= 0 || settings.cellHeight_ <= 0.0f || settings.curvatureMargin_ < 0.0f) {
+        std::cerr << "OccupancyGrid: invalid settings" << std::endl;
+        return false;
+    }
+
+    settings_ = settings;
+    noise_ = noise;
+    weatherWidth_ = weatherWidth;
+    weatherHeight_ = weatherHeight;
+    weather_ = weather;
+
+    // mip sizes of a D3D Texture3D (x, z, altitude)
+    mips_.clear();
+    Mip mip;
+    mip.sizeX_ = weatherWidth * settings.cellsPerTexel_;
+    mip.sizeZ_ = weatherHeight * settings.cellsPerTexel_;
+    mip.sizeY_ = settings.levels_;
+    while (true) {
+        mip.maxDensity_.assign(static_cast<size_t>(mip.sizeX_) * mip.sizeY_ * mip.sizeZ_, 0.0f);
+        mips_.push_back(mip);
+        if (mip.sizeX_ == 1 && mip.sizeY_ == 1 && mip.sizeZ_ == 1) { break; }
+        mip.sizeX_ = (std::max)(1, mip.sizeX_ / 2);
+        mip.sizeY_ = (std::max)(1, mip.sizeY_ / 2);
+        mip.sizeZ_ = (std::max)(1, mip.sizeZ_ / 2);
+    }
+
+    UpdateOutsideBounds();
+
+    const std::vector<char> all(static_cast<size_t>(mips_[0].sizeX_) * mips_[0].sizeZ_, 1);
+    BuildColumns(all);
+    BuildMips(all);
+    return true;
+}
+
+int OccupancyGrid::Update(const std::vector<float4>& weather) {
+    if (mips_.empty() || weather.size() != weather_.size()) {
+        std::cerr << "OccupancyGrid: Update with " << weather.size() << " texels, expected " << weather_.size() << std::endl;
+        return 0;
+    }
+
+    // a cell reads the texels around its corners, widened by the curvature margin
+    const Mip& level0 = mips_[0];
+    const int cpt = settings_.cellsPerTexel_;
+    const float margin = settings_.curvatureMargin_ * (std::max)(weatherWidth_, weatherHeight_) / clouddensity::FMAP_EXTENT_M;
+    const int reach = 1 + static_cast<int>(margin * cpt);
+    std::vector<char> dirty(static_cast<size_t>(level0.sizeX_) * level0.sizeZ_, 0);
+    bool changed = false;
+    for (int ty = 0; ty < weatherHeight_; ty++) {
+        for (int tx = 0; tx < weatherWidth_; tx++) {
+            const size_t i = static_cast<size_t>(ty) * weatherWidth_ + tx;
+            const float4& a = weather_[i];
+            const float4& b = weather[i];
+            if (a.x == b.x && a.y == b.y && a.z == b.z && a.w == b.w) { continue; }
+            changed = true;
+            for (int z = (ty - 1) * cpt - reach; z < (ty + 1) * cpt + reach; z++) {
+                for (int x = (tx - 1) * cpt - reach; x < (tx + 1) * cpt + reach; x++) {
+                    dirty[static_cast<size_t>(Wrap(z, level0.sizeZ_)) * level0.sizeX_ + Wrap(x, level0.sizeX_)] = 1;
+                }
+            }
+        }
+    }
+    if (!changed) { return 0; }
+
+    weather_ = weather;
+    UpdateOutsideBounds();
+    BuildColumns(dirty);
+    BuildMips(dirty);
+    return static_cast<int>(std::count(dirty.begin(), dirty.end(), 1));
+}
+
+void OccupancyGrid::UpdateOutsideBounds() {
+    // above and below the grid nothing is skipped unless no layer can reach there
+    float4 lo = weather_[0], hi = weather_[0];
+    for (const float4& w : weather_) {
+        lo = float4((std::min)(lo.x, w.x), (std::min)(lo.y, w.y), (std::min)(lo.z, w.z), (std::min)(lo.w, w.w));
+        hi = float4((std::max)(hi.x, w.x), (std::max)(hi.y, w.y), (std::max)(hi.z, w.z), (std::max)(hi.w, w.w));
+    }
+    float top = 0.0f, bottom = 0.0f;
+    for (const clouddensity::CloudLayerDesc& layer : settings_.layers_) {
+        const float bottom0 = clouddensity::LayerBottomMeter(layer, lo);
+        const float bottom1 = clouddensity::LayerBottomMeter(layer, hi);
+        const float thickness = (std::max)(clouddensity::LayerThickness(layer, lo), clouddensity::LayerThickness(layer, hi));
+        top = (std::max)(top, (std::max)(bottom0, bottom1) + (std::max)(thickness, 0.0f));
+        bottom = (std::min)(bottom, (std::min)(bottom0, bottom1));
+    }
+    aboveEmpty_ = top <= Top();
+    belowEmpty_ = bottom >= 0.0f;
+}
+
+float4 OccupancyGrid::WeatherTexel(int x, int y) const {
+    return weather_[static_cast<size_t>(Wrap(y, weatherHeight_)) * weatherWidth_ + Wrap(x, weatherWidth_)];
+}
+
+void OccupancyGrid::WeatherRange(int cellX, int cellZ, float4& lo, float4& hi) const {
+    // cell extent in texel space (texel centers at integers), widened by the margin and by
+    // the 8 bit filter weights of the GPU sampler, which shift the lookup by up to 1/256 texel
+    const float cpt = static_cast<float>(settings_.cellsPerTexel_);
+    const float marginX = settings_.curvatureMargin_ * weatherWidth_ / clouddensity::FMAP_EXTENT_M + 1.0f / 256.0f;
+    const float marginZ = settings_.curvatureMargin_ * weatherHeight_ / clouddensity::FMAP_EXTENT_M + 1.0f / 256.0f;
+    const float x0 = cellX / cpt - marginX, x1 = (cellX + 1) / cpt + marginX;
+    const float z0 = cellZ / cpt - marginZ, z1 = (cellZ + 1) / cpt + marginZ;
+
+    // the bilinear filter is bilinear between texel centers, its extremes lie on the corners
+    // of the pieces the rectangle is split into
+    auto breaks = [](float a, float b) {
+        std::vector<float> v = { a };
+        for (float t = std::floor(a) + 1.0f; t < b; t += 1.0f) { v.push_back(t); }
+        v.push_back(b);
+        return v;
+    };
+
+    bool first = true;
+    for (float z : breaks(z0, z1)) {
+        for (float x : breaks(x0, x1)) {
+            const float fx = std::floor(x), fz = std::floor(z);
+            const int ix = static_cast<int>(fx), iz = static_cast<int>(fz);
+            const float4 w = lerp(lerp(WeatherTexel(ix, iz), WeatherTexel(ix + 1, iz), x - fx),
+                lerp(WeatherTexel(ix, iz + 1), WeatherTexel(ix + 1, iz + 1), x - fx), z - fz);
+            if (first) {
+                lo = hi = w;
+                first = false;
+                continue;
+            }
+            lo = float4((std::min)(lo.x, w.x), (std::min)(lo.y, w.y), (std::min)(lo.z, w.z), (std::min)(lo.w, w.w));
+            hi = float4((std::max)(hi.x, w.x), (std::max)(hi.y, w.y), (std::max)(hi.z, w.z), (std::max)(hi.w, w.w));
+        }
+    }
+}
+
+float OccupancyGrid::CellMax(const float4& weatherLo, const float4& weatherHi, float altLo, float altHi) const {
+    // every step of the remap chain grows with its inputs (the noise, the coverage, the layer
+    // shape) and the anvil exponent shrinks the density as it grows, so the upper ends give
+    // the bound. weather terms are linear, their extremes sit on the ends of the range.
+    const float poorLo = RemapClamp(weatherLo.x, 0.0f, 1.0f, 0.0f, 1.0f);
+    const float poorHi = RemapClamp(weatherHi.x, 0.0f, 1.0f, 0.0f, 1.0f);
+    const bool lowFreq = noise_.lowFreq_;
+
+    auto layerMax = [&](const clouddensity::CloudLayerDesc& layer) {
+        // outside the slab CloudDensity skips the layer
+        if (altHi < layer.noise_.z || altLo > layer.noise_.w) { return 0.0f; }
+
+        const float noiseX = (noise_.useNoiseSequence_ && layer.coverage_.w > 0.0f)
+            ? lerp(noise_.large_[0], noise_.sequence_, layer.coverage_.w) : noise_.large_[0];
+        const float coverage = (std::max)(poorLo * layer.coverage_.x, poorHi * layer.coverage_.x) + layer.coverage_.y;
+        float dense = RemapClamp(noiseX * 0.5f + 0.5f, 1.0f - coverage, 1.0f, 0.0f, 1.0f);
+        if (!lowFreq && layer.anvil_.w > 0.0f) {
+            for (int c = 1; c < 4; c++) {
+                dense = RemapClamp(dense, 1.0f - (noise_.large_[c] * 0.5f + 0.5f), 1.0f, 0.0f, 1.0f);
+            }
+        }
+        if (dense <= 0.0f) { return 0.0f; }
+
+        const float thickness0 = clouddensity::LayerThickness(layer, weatherLo);
+        const float thickness1 = clouddensity::LayerThickness(layer, weatherHi);
+        const float thicknessLo = (std::min)(thickness0, thickness1);
+        const float thicknessHi = (std::max)(thickness0, thickness1);
+        if (thicknessLo <= 0.0f) { return dense; }
+        const float bottom0 = clouddensity::LayerBottomMeter(layer, weatherLo);
+        const float bottom1 = clouddensity::LayerBottomMeter(layer, weatherHi);
+        const float bottomLo = (std::min)(bottom0, bottom1);
+        const float bottomHi = (std::max)(bottom0, bottom1);
+
+        // height = (altitude - bottom) / thickness over the cell
+        const float nLo = altLo - bottomHi;
+        const float nHi = altHi - bottomLo;
+        const float heightLo = nLo / (nLo >= 0.0f ? thicknessHi : thicknessLo);
+        const float heightHi = nHi / (nHi >= 0.0f ? thicknessLo : thicknessHi);
+
+        // the shape peaks at coverage_.z
+        const float peak = layer.coverage_.z;
+        const float shape = (heightLo <= peak && heightHi >= peak) ? 1.0f
+            : (std::max)(LayerShape(layer, heightLo), LayerShape(layer, heightHi));
+        dense = RemapClamp(dense, 1.0f - shape, 1.0f, 0.0f, 1.0f);
+        return std::pow(dense, (std::min)(AnvilExponent(layer, heightLo), AnvilExponent(layer, heightHi)));
+    };
+
+    float dense = 0.0f;
+    for (const clouddensity::CloudLayerDesc& layer : settings_.layers_) {
+        dense = (std::max)(dense, layerMax(layer));
+    }
+
+    if (!lowFreq) {
+        for (int c = 0; c < 3; c++) {
+            dense = RemapClamp(dense, 1.0f - (noise_.small_[c] * 0.5f + 0.5f), 1.0f, 0.0f, 1.0f);
+        }
+    }
+    return dense / clouddensity::DENSITY_DIVISOR;
+}
+
+void OccupancyGrid::BuildColumns(const std::vector<char>& dirty) {
+    Mip& level0 = mips_[0];
+    const float margin = settings_.curvatureMargin_;
+
+    ThreadPool::Shared().ParallelFor(0, level0.sizeZ_, [&](int z) {
+        for (int x = 0; x < level0.sizeX_; x++) {
+            if (!dirty[static_cast<size_t>(z) * level0.sizeX_ + x]) { continue; }
+            float4 lo, hi;
+            WeatherRange(x, z, lo, hi);
+            for (int y = 0; y < level0.sizeY_; y++) {
+                const float altLo = y * settings_.cellHeight_ - margin;
+                const float altHi = (y + 1) * settings_.cellHeight_ + margin;
+                level0.maxDensity_[level0.Index(x, y, z)] = CellMax(lo, hi, altLo, altHi);
+            }
+        }
+    });
+}
+
+void OccupancyGrid::BuildMips(const std::vector<char>& dirty) {
+    std::vector<char> childDirty = dirty;
+    for (size_t m = 1; m < mips_.size(); m++) {
+        const Mip& child = mips_[m - 1];
+        Mip& mip = mips_[m];
+
+        // children of the last cell include the leftover of an odd size
+        auto children = [](int p, int size, int childSize, int& begin, int& end) {
+            begin = 2 * p;
+            end = (p == size - 1) ? childSize : 2 * p + 2;
+        };
+
+        std::vector<char> mipDirty(static_cast<size_t>(mip.sizeX_) * mip.sizeZ_, 0);
+        for (int z = 0; z < mip.sizeZ_; z++) {
+            int z0, z1;
+            children(z, mip.sizeZ_, child.sizeZ_, z0, z1);
+            for (int x = 0; x < mip.sizeX_; x++) {
+                int x0, x1;
+                children(x, mip.sizeX_, child.sizeX_, x0, x1);
+                bool any = false;
+                for (int cz = z0; cz < z1 && !any; cz++) {
+                    for (int cx = x0; cx < x1 && !any; cx++) {
+                        any = childDirty[static_cast<size_t>(cz) * child.sizeX_ + cx] != 0;
+                    }
+                }
+                if (!any) { continue; }
+                mipDirty[static_cast<size_t>(z) * mip.sizeX_ + x] = 1;
+
+                for (int y = 0; y < mip.sizeY_; y++) {
+                    int y0, y1;
+                    children(y, mip.sizeY_, child.sizeY_, y0, y1);
+                    float value = 0.0f;
+                    for (int cy = y0; cy < y1; cy++) {
+                        for (int cz = z0; cz < z1; cz++) {
+                            for (int cx = x0; cx < x1; cx++) {
+                                value = (std::max)(value, child.maxDensity_[child.Index(cx, cy, cz)]);
+                            }
+                        }
+                    }
+                    mip.maxDensity_[mip.Index(x, y, z)] = value;
+                }
+            }
+        }
+        childDirty.swap(mipDirty);
+    }
+}
+
+float3 OccupancyGrid::CellCoord(const float3& pos) const {
+    const Mip& level0 = mips_[0];
+    const float cpt = static_cast<float>(settings_.cellsPerTexel_);
+    const float2 uv = clouddensity::FmapUV(pos);
+    float x = (uv.x * weatherWidth_ - 0.5f) * cpt;
+    float z = (uv.y * weatherHeight_ - 0.5f) * cpt;
+    x -= std::floor(x / level0.sizeX_) * level0.sizeX_;
+    z -= std::floor(z / level0.sizeZ_) * level0.sizeZ_;
+    return float3(x, -pos.y / settings_.cellHeight_, z);
+}
+
+float OccupancyGrid::MaxDensity(const float3& pos, int mip) const {
+    if (mips_.empty() || mip < 0 || mip >= MipCount()) { return -1.0f; }
+    const float3 c = CellCoord(pos);
+    if (c.y < 0.0f || c.y >= settings_.levels_) { return -1.0f; }
+
+    const Mip& m = mips_[mip];
+    const int x = (std::min)(static_cast<int>(c.x) >> mip, m.sizeX_ - 1);
+    const int y = (std::min)(static_cast<int>(c.y) >> mip, m.sizeY_ - 1);
+    const int z = (std::min)(static_cast<int>(c.z) >> mip, m.sizeZ_ - 1);
+    return m.maxDensity_[m.Index(x, y, z)];
+}
+
+std::vector<OccupancyGrid::Segment> OccupancyGrid::OccupiedSegments(const float3& origin, const float3& dir, float tMin, float tMax, int* cellVisits) const {
+    std::vector<Segment> segments;
+    int visits = 0;
+    if (mips_.empty()) {
+        segments.push_back({ tMin, tMax });
+        return segments;
+    }
+
+    const Mip& level0 = mips_[0];
+    const float levels = static_cast<float>(settings_.levels_);
+
+    // cell units per meter along the ray
+    const float cpt = static_cast<float>(settings_.cellsPerTexel_);
+    const float3 speed(dir.x * weatherWidth_ * cpt / clouddensity::FMAP_EXTENT_M,
+        -dir.y / settings_.cellHeight_,
+        dir.z * weatherHeight_ * cpt / clouddensity::FMAP_EXTENT_M);
+    const float3 size0(static_cast<float>(level0.sizeX_), levels, static_cast<float>(level0.sizeZ_));
+
+    // distance from coord to the face of [lo, hi) the ray leaves through
+    auto exitDistance = [&](const float3& coord, const float3& lo, const float3& hi) {
+        float t = std::numeric_limits<float>::infinity();
+        const float c[3] = { coord.x, coord.y, coord.z };
+        const float l[3] = { lo.x, lo.y, lo.z };
+        const float h[3] = { hi.x, hi.y, hi.z };
+        const float s[3] = { speed.x, speed.y, speed.z };
+        for (int a = 0; a < 3; a++) {
+            if (s[a] > 0.0f) { t = (std::min)(t, (h[a] - c[a]) / s[a]); }
+            else if (s[a] < 0.0f) { t = (std::min)(t, (l[a] - c[a]) / s[a]); }
+        }
+        return (std::max)(t, 0.0f);
+    };
+
+    auto addOccupied = [&](float begin, float end) {
+        // the cell bounds reach past the cells, so touching the neighbours is safe
+        if (!segments.empty() && segments.back().end_ >= begin) {
+            segments.back().end_ = (std::max)(segments.back().end_, end);
+        } else {
+            segments.push_back({ begin, end });
+        }
+    };
+
+    // probing a little past t picks the cell the ray is heading into
+    const float kProbe = 0.01f;
+    float t = tMin;
+    while (t < tMax) {
+        visits++;
+        const float3 coord = CellCoord(origin + dir * (t + kProbe));
+
+        if (coord.y < 0.0f || coord.y >= levels) {
+            // outside the grid, skip to where the ray enters it
+            const bool empty = coord.y < 0.0f ? belowEmpty_ : aboveEmpty_;
+            const float plane = coord.y < 0.0f ? 0.0f : levels;
+            const float enter = ((coord.y < 0.0f && speed.y > 0.0f) || (coord.y >= levels && speed.y < 0.0f))
+                ? t + kProbe + (plane - coord.y) / speed.y : tMax;
+            if (!empty) { addOccupied(t, (std::min)(enter, tMax)); }
+            t = enter;
+            continue;
+        }
+
+        // coarsest empty cell around the position
+        float skip = -1.0f;
+        for (int m = MipCount() - 1; m >= 0 && skip < 0.0f; m--) {
+            const Mip& mip = mips_[m];
+            const int cx = (std::min)(static_cast<int>(coord.x) >> m, mip.sizeX_ - 1);
+            const int cy = (std::min)(static_cast<int>(coord.y) >> m, mip.sizeY_ - 1);
+            const int cz = (std::min)(static_cast<int>(coord.z) >> m, mip.sizeZ_ - 1);
+            if (mip.maxDensity_[mip.Index(cx, cy, cz)] > 0.0f && m > 0) { continue; }
+
+            const float3 lo(static_cast<float>(cx << m), static_cast<float>(cy << m), static_cast<float>(cz << m));
+            const float3 hi(cx == mip.sizeX_ - 1 ? size0.x : static_cast<float>((cx + 1) << m),
+                cy == mip.sizeY_ - 1 ? size0.y : static_cast<float>((cy + 1) << m),
+                cz == mip.sizeZ_ - 1 ? size0.z : static_cast<float>((cz + 1) << m));
+            const float exit = t + kProbe + exitDistance(coord, lo, hi);
+            if (mip.maxDensity_[mip.Index(cx, cy, cz)] > 0.0f) {
+                addOccupied(t, (std::min)(exit, tMax));
+            }
+            skip = exit;
+        }
+        t = skip;
+    }
+
+    if (cellVisits) { *cellVisits = visits; }
+    return segments;
+}
+
+float OccupancyGrid::TransmittanceReference(const DensityField& field, const float3& from, const float3& to, float step, int* samples) {
+    const float length = hlsl::length(to - from);
+    const float3 dir = (to - from) / (std::max)(length, 1e-6f);
+    double opticalDepth = 0.0;
+    int count = 0;
+    for (int k = 0; (k + 0.5f) * step < length; k++) {
+        opticalDepth += field.Evaluate(from + dir * ((k + 0.5f) * step)) * step;
+        count++;
+    }
+    if (samples) { *samples = count; }
+    return static_cast<float>(std::exp(-opticalDepth));
+}
+
+float OccupancyGrid::Transmittance(const DensityField& field, const float3& from, const float3& to, float step, int* samples) const {
+    const float length = hlsl::length(to - from);
+    const float3 dir = (to - from) / (std::max)(length, 1e-6f);
+
+    // same sample positions as TransmittanceReference, the skipped ones add nothing there
+    double opticalDepth = 0.0;
+    int count = 0;
+    for (const Segment& s : OccupiedSegments(from, dir, 0.0f, length)) {
+        const int k0 = (std::max)(0, static_cast<int>(std::ceil(s.begin_ / step - 0.5f)));
+        for (int k = k0; (k + 0.5f) * step < length && (k + 0.5f) * step <= s.end_; k++) {
+            opticalDepth += field.Evaluate(from + dir * ((k + 0.5f) * step)) * step;
+            count++;
+        }
+    }
+    if (samples) { *samples = count; }
+    return static_cast<float>(std::exp(-opticalDepth));
+}
+
+std::string OccupancyGrid::Validate(const DensityField& field, int rays) const {
+    std::ostringstream ss;
+    if (mips_.empty() || !field.Ready()) {
+        ss << "occupancy grid: not built or density field not ready\n";
+        return ss.str();
+    }
+
+    std::mt19937 rng(33);
+    const float half = clouddensity::FMAP_EXTENT_M * 0.5f;
+    std::uniform_real_distribution<float> horizontal(-half, half);
+    std::uniform_real_distribution<float> altitude(0.0f, Top());
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+    // 1. the bound holds on every mip
+    int violations = 0, positive = 0;
+    const int points = 1 << 16;
+    for (int i = 0; i < points; i++) {
+        const float3 pos(horizontal(rng), -altitude(rng), horizontal(rng));
+        const float density = field.Evaluate(pos);
+        positive += density > 0.0f;
+        for (int m = 0; m < MipCount(); m++) {
+            if (density > MaxDensity(pos, m)) {
+                violations++;
+                break;
+            }
+        }
+    }
+
+    // 2. rays: no cloud outside the segments, same transmittance as plain marching
+    const float step = 50.0f;
+    const float rayLength = 60000.0f;
+    int missed = 0, mismatches = 0, visits = 0;
+    long long samplesNaive = 0, samplesGrid = 0;
+    double maxError = 0.0;
+    for (int r = 0; r < rays; r++) {
+        const float3 origin(horizontal(rng), -altitude(rng), horizontal(rng));
+        float3 dir(unit(rng), unit(rng) * (r % 2 ? 0.1f : 1.0f), unit(rng));
+        dir = dir / (std::max)(hlsl::length(dir), 1e-6f);
+        const float3 end = origin + dir * rayLength;
+
+        int v = 0;
+        const std::vector<Segment> segments = OccupiedSegments(origin, dir, 0.0f, rayLength, &v);
+        visits += v;
+        for (int k = 0; (k + 0.5f) * step < rayLength; k++) {
+            const float t = (k + 0.5f) * step;
+            if (field.Evaluate(origin + dir * t) <= 0.0f) { continue; }
+            const bool inside = std::any_of(segments.begin(), segments.end(), [t](const Segment& s) { return s.begin_ <= t && t <= s.end_; });
+            missed += !inside;
+        }
+
+        int naive = 0, grid = 0;
+        const float reference = TransmittanceReference(field, origin, end, step, &naive);
+        const float skipped = Transmittance(field, origin, end, step, &grid);
+        samplesNaive += naive;
+        samplesGrid += grid;
+        maxError = (std::max)(maxError, static_cast<double>(std::fabs(reference - skipped)));
+        mismatches += reference != skipped;
+    }
+
+    ss << "occupancy grid " << mips_[0].sizeX_ << "x" << mips_[0].sizeZ_ << "x" << mips_[0].sizeY_ << ", " << MipCount() << " mips\n";
+    ss << "  bound: " << violations << " violations in " << points << " points (" << positive << " with cloud)\n";
+    ss << "  rays: " << rays << ", cloud samples outside segments " << missed << "\n";
+    ss << "  LOS: " << mismatches << " mismatches, max error " << maxError << "\n";
+    ss << "  samples: naive " << samplesNaive << ", grid " << samplesGrid << " ("
+       << (samplesNaive ? 100.0 * (samplesNaive - samplesGrid) / samplesNaive : 0.0) << "% skipped), "
+       << static_cast<double>(visits) / (std::max)(rays, 1) << " cell visits per ray\n";
+    ss << ((violations == 0 && missed == 0 && mismatches == 0) ? "  PASS\n" : "  FAIL\n");
+    return ss.str();
+}
+
+std::string OccupancyGrid::Report() const {
+    std::ostringstream ss;
+    for (int m = 0; m < MipCount(); m++) {
+        const Mip& mip = mips_[m];
+        const size_t occupied = std::count_if(mip.maxDensity_.begin(), mip.maxDensity_.end(), [](float v) { return v > 0.0f; });
+        ss << "  mip " << m << " " << mip.sizeX_ << "x" << mip.sizeZ_ << "x" << mip.sizeY_ << ": "
+           << 100.0 * occupied / (std::max)(mip.maxDensity_.size(), static_cast<size_t>(1)) << "% occupied\n";
+    }
+    return ss.str();
+}
+
+#ifdef _WIN32
+bool OccupancyGrid::CreateTexture() {
+    if (mips_.empty()) { return false; }
+
+    D3D11_TEXTURE3D_DESC desc = {};
+    desc.Width = mips_[0].sizeX_;
+    desc.Height = mips_[0].sizeZ_;
+    desc.Depth = mips_[0].sizeY_;
+    desc.MipLevels = MipCount();
+    desc.Format = DXGI_FORMAT_R32_FLOAT;
+    desc.Usage = D3D11_USAGE_DEFAULT;
+    desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+    std::vector<D3D11_SUBRESOURCE_DATA> initData(mips_.size());
+    for (size_t m = 0; m < mips_.size(); m++) {
+        initData[m].pSysMem = mips_[m].maxDensity_.data();
+        initData[m].SysMemPitch = mips_[m].sizeX_ * sizeof(float);
+        initData[m].SysMemSlicePitch = mips_[m].sizeX_ * mips_[m].sizeZ_ * sizeof(float);
+    }
+
+    HRESULT hr = Renderer::device->CreateTexture3D(&desc, initData.data(), &occupancyTEX_);
+    if (FAILED(hr)) return false;
+
+    hr = Renderer::device->CreateShaderResourceView(occupancyTEX_.Get(), nullptr, &occupancySRV_);
+    if (FAILED(hr)) return false;
+
+    return true;
+}
+
+void OccupancyGrid::UpdateTexture() {
+    if (!occupancyTEX_) { return; }
+    for (size_t m = 0; m < mips_.size(); m++) {
+        Renderer::context->UpdateSubresource(occupancyTEX_.Get(), static_cast<UINT>(m), nullptr, mips_[m].maxDensity_.data(),
+            mips_[m].sizeX_ * sizeof(float), mips_[m].sizeX_ * mips_[m].sizeZ_ * sizeof(float));
+    }
+}
+#endif
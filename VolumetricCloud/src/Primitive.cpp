@@ -92,6 +92,19 @@ void Primitive::CreateShaders(const std::wstring& fileName, const std::string& e
     hr = Renderer::device->CreateVertexShader(vsBlob->GetBufferPointer(), vsBlob->GetBufferSize(), nullptr, &vertexShader_);
     hr = Renderer::device->CreatePixelShader(psBlob->GetBufferPointer(), psBlob->GetBufferSize(), nullptr, &pixelShader_);
 
+    // cloud shadow map sampler
+    {
+        D3D11_SAMPLER_DESC sampDesc = {};
+        sampDesc.Filter = D3D11_FILTER_MIN_MAG_MIP_LINEAR;
+        sampDesc.AddressU = D3D11_TEXTURE_ADDRESS_CLAMP;
+        sampDesc.AddressV = D3D11_TEXTURE_ADDRESS_CLAMP;
+        sampDesc.AddressW = D3D11_TEXTURE_ADDRESS_CLAMP;
+        sampDesc.ComparisonFunc = D3D11_COMPARISON_NEVER;
+        sampDesc.MinLOD = 0;
+        sampDesc.MaxLOD = D3D11_FLOAT32_MAX;
+        Renderer::device->CreateSamplerState(&sampDesc, &shadowSampler_);
+    }
+
     // Update input inputLayout_ to match VS_INPUT
     D3D11_INPUT_ELEMENT_DESC layoutDesc[] = {
         { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
@@ -141,7 +154,8 @@ void Primitive::CreateGeometry(std::function<void(std::vector<Primitive::Vertex>
     transform_.CreateBuffer();
 }
 
-void Primitive::Render(float width, float height, ID3D11Buffer** buffers, UINT bufferCount) {
+void Primitive::Render(float width, float height, ID3D11Buffer** buffers, UINT bufferCount,
+    UINT startSlot, UINT numViews, ID3D11ShaderResourceView* const* srvs) {
 
     float clearColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
     Renderer::context->ClearRenderTargetView(colorRTV_.Get(), clearColor);
@@ -164,6 +178,8 @@ void Primitive::Render(float width, float height, ID3D11Buffer** buffers, UINT b
     Renderer::context->VSSetConstantBuffers(0, bufferCount, buffers);
     Renderer::context->VSSetConstantBuffers(bufferCount, 1, transform_.buffer_.GetAddressOf());
     Renderer::context->PSSetConstantBuffers(0, bufferCount, buffers);
+    if (numViews > 0) { Renderer::context->PSSetShaderResources(startSlot, numViews, srvs); }
+    Renderer::context->PSSetSamplers(0, 1, shadowSampler_.GetAddressOf());
     Renderer::context->VSSetShader(vertexShader_.Get(), nullptr, 0);
     Renderer::context->PSSetShader(pixelShader_.Get(), nullptr, 0);
     Renderer::context->IASetInputLayout(inputLayout_.Get());
@@ -194,6 +210,7 @@ void Primitive::Cleanup() {
     inputLayout_.Reset();
     vertexShader_.Reset();
     pixelShader_.Reset();
+    shadowSampler_.Reset();
 }
 
 namespace {
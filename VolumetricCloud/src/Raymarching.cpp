@@ -309,15 +309,23 @@ void Raymarch::CompileShader(const std::wstring& fileName, const std::string& en
         cbDesc.CPUAccessFlags = 0;
 
         D3D11_SUBRESOURCE_DATA dsd = {};
-        dsd.pSysMem = &cbDesc;
+        dsd.pSysMem = &input_;
 
+        // the buffer starts with the current input_, a recompile keeps the cascade and offset
         Renderer::device->CreateBuffer(&cbDesc, &dsd, &inputData_);
+    }
+}
 
-        InputData bf;
-        bf.pixelsize = XMFLOAT4(width_, height_, 0.0f, 0.0f);
+void Raymarch::SetPixelOffset(float x, float y) {
+    input_.pixelsize = XMFLOAT4(width_, height_, x, y);
 
-        Renderer::context->UpdateSubresource(inputData_.Get(), 0, nullptr, &bf, 0, 0);
-    }
+    Renderer::context->UpdateSubresource(inputData_.Get(), 0, nullptr, &input_, 0, 0);
+}
+
+void Raymarch::SetCascade(float start, float end, int stepBudget, bool history) {
+    input_.cascade = XMFLOAT4(start, end, static_cast<float>(stepBudget), history ? 1.0f : 0.0f);
+
+    Renderer::context->UpdateSubresource(inputData_.Get(), 0, nullptr, &input_, 0, 0);
 }
 
 void Raymarch::Render(UINT NumViews, ID3D11ShaderResourceView* const* ppShaderResourceViews, UINT bufferCount, ID3D11Buffer** buffers) {
@@ -0,0 +1,334 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <functional>
+#include <sstream>
+#include <vector>
+
+#include "../includes/TemporalReprojection.h"
+#include "../includes/CloudSdf.h"
+#include "../includes/CpuCloudRenderer.h"
+#include "../includes/DensityField.h"
+#include "../includes/Fmap.h"
+#include "../includes/OccupancyGrid.h"
+
+using namespace hlsl;
+
+namespace temporalreprojection {
+
+    namespace {
+
+        const float kPi = 3.14159265358979f;
+
+        float4 Bilinear(const CpuCloudFrame& frame, float tx, float ty) {
+            const float bx = std::floor(tx), by = std::floor(ty);
+            const float fx = tx - bx, fy = ty - by;
+            const int x0 = std::clamp(static_cast<int>(bx), 0, frame.width_ - 1);
+            const int y0 = std::clamp(static_cast<int>(by), 0, frame.height_ - 1);
+            const int x1 = std::clamp(static_cast<int>(bx) + 1, 0, frame.width_ - 1);
+            const int y1 = std::clamp(static_cast<int>(by) + 1, 0, frame.height_ - 1);
+            const auto at = [&](int x, int y) { return frame.color_[static_cast<size_t>(y) * frame.width_ + x]; };
+            return lerp(lerp(at(x0, y0), at(x1, y0), fx), lerp(at(x0, y1), at(x1, y1), fx), fy);
+        }
+
+        // ray of a pixel of CpuCloudRenderer::Render
+        float3 PixelDir(const CpuCloudRendererSettings& settings, const float3& forward, const float3& right, const float3& up, float x, float y) {
+            const float tanY = std::tan(settings.vFovDeg_ * (kPi / 180.0f) * 0.5f);
+            const float tanX = tanY * settings.width_ / settings.height_;
+            const float ndcX = x / settings.width_ * 2.0f - 1.0f;
+            const float ndcY = 1.0f - y / settings.height_ * 2.0f;
+            return normalize(forward + right * (ndcX * tanX) + up * (ndcY * tanY));
+        }
+
+        // ViewDepthFromDepth of RayMarch.hlsl, R = near / (near - far)
+        float ViewDepth(const CpuCloudRendererSettings& settings, float depth) {
+            const float range = settings.near_ / (settings.near_ - settings.far_);
+            return -range * settings.far_ / (depth - range);
+        }
+
+        float MaxAbs(const float4& a, const float4& b) {
+            const float4 d = a - b;
+            return (std::max)((std::max)(std::fabs(d.x), std::fabs(d.y)), (std::max)(std::fabs(d.z), std::fabs(d.w)));
+        }
+
+    } // namespace
+
+    Matrix Multiply(const Matrix& a, const Matrix& b) {
+        Matrix m;
+        for (int r = 0; r < 4; r++) {
+            m.rows_[r] = b.rows_[0] * a.rows_[r].x + b.rows_[1] * a.rows_[r].y + b.rows_[2] * a.rows_[r].z + b.rows_[3] * a.rows_[r].w;
+        }
+        return m;
+    }
+
+    float4 Transform(const float4& v, const Matrix& m) {
+        return m.rows_[0] * v.x + m.rows_[1] * v.y + m.rows_[2] * v.z + m.rows_[3] * v.w;
+    }
+
+    Matrix ViewProjection(const CpuCloudRendererSettings& settings, const CpuCloudView& view) {
+        float3 forward, right, up;
+        CpuCloudRenderer::CameraBasis(view, forward, right, up);
+
+        // XMMatrixLookAtLH from the origin: the axes are the columns
+        Matrix viewMatrix;
+        viewMatrix.rows_[0] = float4(right.x, up.x, forward.x, 0.0f);
+        viewMatrix.rows_[1] = float4(right.y, up.y, forward.y, 0.0f);
+        viewMatrix.rows_[2] = float4(right.z, up.z, forward.z, 0.0f);
+        viewMatrix.rows_[3] = float4(0.0f, 0.0f, 0.0f, 1.0f);
+
+        // XMMatrixPerspectiveFovLH with near and far swapped
+        const float h = 1.0f / std::tan(settings.vFovDeg_ * (kPi / 180.0f) * 0.5f);
+        const float w = h * settings.height_ / settings.width_;
+        const float range = settings.near_ / (settings.near_ - settings.far_);
+        Matrix projection;
+        projection.rows_[0] = float4(w, 0.0f, 0.0f, 0.0f);
+        projection.rows_[1] = float4(0.0f, h, 0.0f, 0.0f);
+        projection.rows_[2] = float4(0.0f, 0.0f, range, 1.0f);
+        projection.rows_[3] = float4(0.0f, 0.0f, -range * settings.far_, 0.0f);
+        return Multiply(viewMatrix, projection);
+    }
+
+    Matrix PreviousViewProjection(const CpuCloudRendererSettings& settings, const CpuCloudView& current, const CpuCloudView& previous) {
+        const float3 motion = current.eye_ - previous.eye_;
+        Matrix translation;
+        translation.rows_[0] = float4(1.0f, 0.0f, 0.0f, 0.0f);
+        translation.rows_[1] = float4(0.0f, 1.0f, 0.0f, 0.0f);
+        translation.rows_[2] = float4(0.0f, 0.0f, 1.0f, 0.0f);
+        translation.rows_[3] = float4(motion, 1.0f);
+        return Multiply(translation, ViewProjection(settings, previous));
+    }
+
+    bool Reproject(const CpuCloudRendererSettings& settings, const Matrix& previousViewProjection, const float3& forward,
+        const float3& dir, float depth, float2& uv, float& previousViewZ) {
+        float4 pos(dir, 0.0f);
+        if (depth > 0.0f) {
+            pos = float4(dir * (ViewDepth(settings, depth) / dot(dir, forward)), 1.0f);
+        }
+        const float4 clip = Transform(pos, previousViewProjection);
+        if (clip.w <= 0.0f) { return false; }
+        uv = float2(clip.x / clip.w * 0.5f + 0.5f, 0.5f - clip.y / clip.w * 0.5f);
+        previousViewZ = clip.w;
+        return uv.x >= 0.0f && uv.y >= 0.0f && uv.x <= 1.0f && uv.y <= 1.0f;
+    }
+
+    Stats Accumulate(const Params& params, const CpuCloudRendererSettings& settings, const CpuCloudView& view, const CpuCloudView& previous,
+        const CpuCloudFrame& fresh, const CpuCloudFrame* history, CpuCloudFrame& out) {
+        Stats stats;
+        out.width_ = fresh.width_;
+        out.height_ = fresh.height_;
+        out.color_ = fresh.color_;
+        out.depth_ = fresh.depth_;
+        if (!history) { return stats; }
+
+        float3 forward, right, up;
+        CpuCloudRenderer::CameraBasis(view, forward, right, up);
+        const Matrix previousViewProjection = PreviousViewProjection(settings, view, previous);
+        const int w = history->width_, h = history->height_;
+        for (int y = 0; y < fresh.height_; y++) {
+            for (int x = 0; x < fresh.width_; x++) {
+                const size_t i = static_cast<size_t>(y) * fresh.width_ + x;
+                // the history holds pixel centres, whatever point the fresh ray crossed
+                const float3 dir = PixelDir(settings, forward, right, up, x + 0.5f, y + 0.5f);
+                float2 uv;
+                float previousViewZ;
+                if (!Reproject(settings, previousViewProjection, forward, dir, fresh.depth_[i], uv, previousViewZ)) {
+                    stats.offScreen_++;
+                    continue;
+                }
+
+                // half a texel inside like the shader
+                const float u = std::clamp(uv.x, 0.5f / w, 1.0f - 0.5f / w);
+                const float v = std::clamp(uv.y, 0.5f / h, 1.0f - 0.5f / h);
+                out.color_[i] = lerp(Bilinear(*history, u * w - 0.5f, v * h - 0.5f), fresh.color_[i], params.blend_);
+                stats.history_++;
+            }
+        }
+        return stats;
+    }
+
+    std::string Report(DensityField& field, int width, int height, int frames, const std::string& resourceDir) {
+        std::ostringstream ss;
+        if (field.NoiseLarge().texels_.empty()) {
+            ss << "temporal reprojection: density field not initialized\n";
+            return ss.str();
+        }
+
+        const std::string path = resourceDir + "/40100.fmap";
+        if (!std::filesystem::exists(path)) {
+            ss << "temporal reprojection: missing weather map " << path << "\n";
+            return ss.str();
+        }
+        field.SetWeather(Fmap(path));
+        field.SetTime(10.0);
+
+        OccupancyGrid grid;
+        CloudSdf sdf;
+        if (!grid.Build(field) || !sdf.Build(grid)) {
+            ss << "temporal reprojection: occupancy grid or distance volume build failed\n";
+            return ss.str();
+        }
+        CpuCloudSources sources;
+        sources.occupancy_ = &grid;
+        sources.sdf_ = &sdf;
+
+        CpuCloudRendererSettings settings;
+        settings.width_ = width;
+        settings.height_ = height;
+        settings.temporalJitter_ = true;
+        const Params params = settings.temporal_;
+
+        // synthetic camera paths at 30 fps from the default view
+        struct Path {
+            const char* name_;
+            std::function<CpuCloudView(int)> view_;
+        };
+        const CpuCloudView start;
+        const float3 startForward = normalize(start.lookAt_ - start.eye_);
+        const auto turned = [&](float degrees) {
+            const float a = degrees * (kPi / 180.0f);
+            return float3(startForward.x * std::cos(a) - startForward.z * std::sin(a), startForward.y,
+                startForward.x * std::sin(a) + startForward.z * std::cos(a));
+        };
+        const Path paths[] = {
+            { "static", [&](int) { return start; } },
+            { "dolly", [&](int f) { CpuCloudView v = start; v.eye_ = start.eye_ + startForward * (20.0f * f); v.lookAt_ = v.eye_ + startForward * 1000.0f; return v; } },
+            { "pan", [&](int f) { CpuCloudView v = start; v.lookAt_ = v.eye_ + turned(0.5f * f) * 1000.0f; return v; } },
+            { "orbit", [&](int f) {
+                // the eye circles the look at point like the demo mode
+                CpuCloudView v = start;
+                const float3 arm = start.eye_ - start.lookAt_;
+                const float a = 2.0f * f * (kPi / 180.0f);
+                v.eye_ = start.lookAt_ + float3(arm.x * std::cos(a) - arm.z * std::sin(a), arm.y, arm.x * std::sin(a) + arm.z * std::cos(a));
+                return v; } },
+            { "flight", [&](int f) {
+                // Mach 0.9 turning 10 degrees a second
+                CpuCloudView v = start;
+                float3 eye = start.eye_;
+                for (int i = 0; i < f; i++) { eye = eye + turned(i / 3.0f) * (343.0f * 0.9f / 30.0f); }
+                v.eye_ = eye;
+                v.lookAt_ = eye + turned(f / 3.0f) * 1000.0f;
+                return v; } },
+        };
+
+        // the composed matrix has to put a point where the camera before sees it
+        ss << "temporal reprojection at " << width << "x" << height << ", " << frames << " frames per path over 40100.fmap\n";
+        char line[200];
+        snprintf(line, sizeof(line), "  %-8s %14s %14s\n", "path", "max err (px)", "motion (px)");
+        ss << line;
+        bool pass = true;
+        const float viewDepths[] = { 300.0f, 3000.0f, 30000.0f };
+        const float range = settings.near_ / (settings.near_ - settings.far_);
+        const float tanY = std::tan(settings.vFovDeg_ * (kPi / 180.0f) * 0.5f);
+        const float tanX = tanY * width / height;
+        for (const Path& p : paths) {
+            float maxError = 0.0f;
+            double motion = 0.0;
+            int points = 0;
+            for (int f = 1; f < frames; f++) {
+                const CpuCloudView view = p.view_(f), previous = p.view_(f - 1);
+                float3 forward, right, up, pForward, pRight, pUp;
+                CpuCloudRenderer::CameraBasis(view, forward, right, up);
+                CpuCloudRenderer::CameraBasis(previous, pForward, pRight, pUp);
+                const Matrix m = PreviousViewProjection(settings, view, previous);
+                for (int gy = 0; gy < 9; gy++) {
+                    for (int gx = 0; gx < 16; gx++) {
+                        const float px = (gx + 0.5f) * width / 16.0f, py = (gy + 0.5f) * height / 9.0f;
+                        const float3 dir = PixelDir(settings, forward, right, up, px, py);
+                        for (const float viewZ : viewDepths) {
+                            float2 uv;
+                            float previousViewZ;
+                            if (!Reproject(settings, m, forward, dir, range * (viewZ - settings.far_) / viewZ, uv, previousViewZ)) { continue; }
+
+                            // the world point straight into the camera before
+                            const float3 rel = view.eye_ + dir * (viewZ / dot(dir, forward)) - previous.eye_;
+                            const float z = dot(rel, pForward);
+                            const float qx = (dot(rel, pRight) / (z * tanX) + 1.0f) * 0.5f * width;
+                            const float qy = (1.0f - dot(rel, pUp) / (z * tanY)) * 0.5f * height;
+                            maxError = (std::max)(maxError, (std::max)(std::fabs(uv.x * width - qx), std::fabs(uv.y * height - qy)));
+                            motion += std::sqrt((qx - px) * (qx - px) + (qy - py) * (qy - py));
+                            points++;
+                        }
+                    }
+                }
+            }
+            snprintf(line, sizeof(line), "  %-8s %14.2e %14.3f\n", p.name_, maxError, points ? motion / points : 0.0);
+            ss << line;
+            pass = pass && maxError < 0.01f;
+        }
+
+        // jittered marches accumulated, against the mean of plain step marches over the 8 points of
+        // PixelJitter. the march without history takes the plain step
+        CpuCloudRendererSettings plain = settings;
+        plain.temporal_.stepScale_ = 1.0f;
+        plain.temporal_.jitterLength_ = params.jitterLength_ / params.stepScale_;
+        const int referenceMarches = 8;
+        const int warmUp = 4;
+        ss << "  mean rgba error against " << referenceMarches << " plain step marches over the pixel per frame, the first " << warmUp
+           << " frames left out, accumulated at " << params.stepScale_ << " times the step\n";
+        snprintf(line, sizeof(line), "  %-8s %12s %12s %12s %9s %11s\n", "path", "no history", "same pixel", "reprojected", "history", "steps/plain");
+        ss << line;
+        CpuCloudRenderer renderer;
+        for (const Path& p : paths) {
+            CpuCloudFrame samePixel, reprojected;
+            double errors[3] = {};
+            int pixels = 0, historyPixels = 0;
+            uint64_t steps = 0, plainSteps = 0;
+            for (int f = 0; f < frames; f++) {
+                const CpuCloudView view = p.view_(f);
+                const CpuCloudView previous = p.view_((std::max)(f - 1, 0));
+
+                std::vector<float4> reference(static_cast<size_t>(width) * height, float4(0.0f));
+                for (int k = 0; k < referenceMarches; k++) {
+                    plain.jitterFrame_ = 32 + k;
+                    renderer.Initialize(plain);
+                    CpuCloudFrame frame;
+                    renderer.Render(field, view, frame, sources);
+                    for (size_t i = 0; i < reference.size(); i++) { reference[i] += frame.color_[i] * (1.0f / referenceMarches); }
+                }
+
+                plain.jitterFrame_ = f;
+                renderer.Initialize(plain);
+                CpuCloudFrame single;
+                renderer.Render(field, view, single, sources);
+
+                settings.jitterFrame_ = f;
+                renderer.Initialize(settings);
+                CpuCloudFrame fresh;
+                renderer.Render(field, view, fresh, sources);
+
+                // the history of the same pixel, the shader before the reprojection
+                if (f == 0) {
+                    samePixel = fresh;
+                }
+                else {
+                    for (size_t i = 0; i < fresh.color_.size(); i++) { samePixel.color_[i] = lerp(samePixel.color_[i], fresh.color_[i], params.blend_); }
+                }
+                CpuCloudFrame out;
+                const Stats stats = Accumulate(params, settings, view, previous, fresh, f == 0 ? nullptr : &reprojected, out);
+                reprojected = out;
+
+                if (f < warmUp) { continue; }
+                for (size_t i = 0; i < reference.size(); i++) {
+                    errors[0] += MaxAbs(single.color_[i], reference[i]);
+                    errors[1] += MaxAbs(samePixel.color_[i], reference[i]);
+                    errors[2] += MaxAbs(reprojected.color_[i], reference[i]);
+                }
+                pixels += static_cast<int>(reference.size());
+                historyPixels += stats.history_;
+                steps += fresh.marchSteps_;
+                plainSteps += single.marchSteps_;
+            }
+            const double n = (std::max)(pixels, 1);
+            const double stepRatio = plainSteps ? static_cast<double>(steps) / plainSteps : 0.0;
+            snprintf(line, sizeof(line), "  %-8s %12.3e %12.3e %12.3e %8.1f%% %11.3f\n", p.name_, errors[0] / n, errors[1] / n, errors[2] / n,
+                100.0 * historyPixels / n, stepRatio);
+            ss << line;
+            // the accumulation has to beat a single plain march on every path, still or moving, at fewer steps
+            pass = pass && errors[2] < errors[0] && stepRatio < 1.0;
+        }
+        ss << (pass ? "  PASS\n" : "  FAIL\n");
+        return ss.str();
+    }
+
+} // namespace temporalreprojection
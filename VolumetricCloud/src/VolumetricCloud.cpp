@@ -20,6 +20,7 @@
 #define USE_IMGUI
 
 #include <chrono>
+#include <cmath>
 #include <d3d11_1.h>
 #include <d3d11.h>
 #include <d3dcompiler.h>
@@ -40,10 +41,29 @@
 #include "../includes/Renderer.h"
 #include "../includes/Raymarching.h"
 #include "../includes/Noise.h"
+#include "../includes/NoiseParityGpu.h"
+#include "../includes/NoisePrecision.h"
 #include "../includes/Primitive.h"
 #include "../includes/Fmap.h"
 #include "../includes/FinalScene.h"
 #include "../includes/DDSLoader.h"
+#include "../includes/CloudShadowMap.h"
+#include "../includes/DensityClipmap.h"
+#include "../includes/DensityPacket.h"
+#include "../includes/AdaptiveStep.h"
+#include "../includes/CloudBvh.h"
+#include "../includes/BilateralUpsample.h"
+#include "../includes/CloudCascade.h"
+#include "../includes/CloudReconstruct.h"
+#include "../includes/TemporalReprojection.h"
+#include "../includes/CloudRegression.h"
+#include "../includes/CloudSdf.h"
+#include "../includes/CpuCloudRenderer.h"
+#include "../includes/DepthPyramid.h"
+#include "../includes/EarthCurvature.h"
+#include "../includes/FarCloudCache.h"
+#include "../includes/HeightProfileLut.h"
+#include "../includes/OccupancyGrid.h"
 
 #pragma comment(lib, "dxgi.lib")
 
@@ -103,6 +123,10 @@ namespace environment {
 
     ComPtr<ID3D11Buffer> cumulus_buffer;
 
+    // the same instances for the shaders that traverse instead of looping (t12, t13)
+    std::vector<hlsl::float4> cumulusInstances;
+    CloudBvh cumulusBvh;
+
     void CreateCumulusBuffer();
 
     std::vector<float> los_;
@@ -129,12 +153,18 @@ namespace {
     Camera camera(80.0f, 0.1f, 422440.f, 270, -20, 2000.0f);
     Noise fbmSmall(32, 32, 32);
     Noise fbm(128, 128, 128);
+    // one frame of the looping noise, CreateNoiseTexture3DFromVolume stacks the frames along slicePx_
+    constexpr int kNoiseSequenceSize = 64;
+    Noise fbmSequence(kNoiseSequenceSize, kNoiseSequenceSize, kNoiseSequenceSize);
     CubeMap skyMap(512, 512);
     CubeMap skyMapIrradiance(32, 32);
     Raymarch skyBox(2160, 2160);
     Primitive monolith;
-    Raymarch farCloud(256, 256);
+    DepthPyramid depthPyramid; // min / max mips of the monolith depth
+    Raymarch farCloud(256, 256); // far band of cloudCascades
+    Raymarch farCloudCached(256, 256); // the far band looked up from farCloudCache
     Raymarch cloud(512, 512);
+    Raymarch cloudSparse(256, 256); // interleaved march, one pixel of each block of cloudReconstruct
 
     DrawQuad prevFrameCloud;
     DrawQuad cloudMapGenerate;
@@ -153,6 +183,27 @@ namespace {
     DrawQuad fbmDebugBS;
     DrawQuad fbmDebugAS;
     DrawQuad heightRemapTest;
+    NoiseParityGpu noiseParityGpu;
+    DensityField densityField;
+    DensityFieldSettings densityFieldSettings; // the field follows the recipe of fbm
+    std::future<DensityField> densityFieldJob; // the first noise bake, minutes without the cache
+    std::future<NoiseVolume> largeNoiseJob; // "Bake Large Noise on CPU" of largeNoiseJobRecipe
+    NoiseBaker::VolumeRecipe largeNoiseJobRecipe;
+    OccupancyGrid occupancyGrid;
+    CloudSdf cloudSdf;
+    std::future<CloudSdf> cloudSdfJob; // rebuild per weather snapshot
+    HeightProfileLut heightProfileLut;
+    DensityClipmap densityClipmap;
+    constexpr bool kUseDensityClipmap = true; // USE_DENSITY_CLIPMAP of RayMarch.hlsl, nothing reads it without
+    CloudShadowMap cloudShadowMap;
+    constexpr bool kUseDepthPyramid = false; // USE_DEPTH_PYRAMID of RayMarch.hlsl, no pyramid is created or built without
+    CloudReconstruct cloudReconstruct;
+    // near band into cloud / cloudSparse, far band into farCloud
+    std::vector<cloudcascade::Cascade> cloudCascades = cloudcascade::DefaultCascades();
+    uint32_t farCloudAge = UINT32_MAX; // frames since farCloud was marched
+    XMVECTOR farCloudForward = XMVectorZero(); // view direction it was marched with
+    FarCloudCache farCloudCache; // far band around the camera, a few tiles marched per frame
+    uint32_t farCloudCacheFrame = 0;
 
     ComPtr<ID3DUserDefinedAnnotation> annotation;
 
@@ -364,6 +415,10 @@ HRESULT PreRender() {
     fbmSmall.CreateNoiseTexture3DResource();
     fbmSmall.RenderNoiseTexture3D();
 
+    // looping 4D noise, baked on the CPU once and cached on disk
+    fbmSequence.CreateNoiseTexture3DFromVolume(NoiseBaker::BakeCached(NoiseBaker::RecipeNoiseSequence(),
+        kNoiseSequenceSize, kNoiseSequenceSize, kNoiseSequenceSize));
+
 	skyMap.CreateGeometry();
     skyMap.CreateRenderTarget();
 	skyMap.CompileShader(L"shaders/SkyMap.hlsl", "VS", "PS");
@@ -375,12 +430,143 @@ HRESULT PreRender() {
     return S_OK;
 }
 
+// takes over the field baked in the background by Setup once it is done, or waits for it.
+// the weather is set here on the render thread
+void PickUpDensityField(bool wait) {
+    if (!densityFieldJob.valid()) { return; }
+    if (!wait && densityFieldJob.wait_for(std::chrono::seconds(0)) != std::future_status::ready) { return; }
+    densityField = densityFieldJob.get();
+    if (densityField.NoiseLarge().texels_.empty()) { return; }
+    densityField.SetWeather(fmap);
+}
+
+// fbm got another recipe, the CPU copy of the large noise follows so the CPU modules keep
+// matching what RayMarch samples. the cloud shadow map picks it up with its next refresh
+void SetLargeNoiseRecipe(const NoiseBaker::VolumeRecipe& recipe, NoiseVolume baked = {}) {
+    PickUpDensityField(true);
+    densityFieldSettings.noiseRecipe_ = recipe;
+    if (densityField.NoiseLarge().texels_.empty()) { return; }
+    // the texture bake serves the CPU copy as well when the sizes agree
+    const int size = densityFieldSettings.noiseResolution_;
+    const bool reuse = baked.width_ == size && baked.height_ == size && baked.depth_ == size;
+    if (reuse ? !densityField.SetNoiseRecipe(recipe, std::move(baked)) : !densityField.SetNoiseRecipe(recipe)) { return; }
+}
+
+// the noise of "Bake Large Noise on CPU" once its background bake is done: noiseTexture and
+// the CPU copy take it over on the render thread
+void PickUpLargeNoise() {
+    if (!largeNoiseJob.valid() || largeNoiseJob.wait_for(std::chrono::seconds(0)) != std::future_status::ready) { return; }
+    NoiseVolume volume = largeNoiseJob.get();
+    if (volume.texels_.empty()) { return; }
+    fbm.CreateNoiseTexture3DFromVolume(volume);
+    SetLargeNoiseRecipe(largeNoiseJobRecipe, std::move(volume));
+}
+
+// the CPU copies of the textures for a report: the noise is baked on first use, the weather
+// loaded for rendering and the time of this frame are set every call. reports that load their
+// own weather put fmap back after. false with the message in report when the bake failed
+bool EnsureDensityField(std::string& report) {
+    PickUpDensityField(true);
+    if (densityField.NoiseLarge().texels_.empty() && !densityField.Initialize(densityFieldSettings)) {
+        report = "density field initialization failed\n";
+        return false;
+    }
+    densityField.SetWeather(fmap);
+    densityField.SetTime(timer.GetElapsedTime<std::micro>() * 1e-6);
+    return true;
+}
+
+// sparse target and reconstruction for marching one pixel of every pattern x pattern block
+bool SetupInterleavedClouds(int pattern) {
+    CloudReconstructSettings settings;
+    settings.pattern_ = pattern;
+    if (!cloudReconstruct.Initialize(settings, cloud.width_ / pattern * pattern, cloud.height_ / pattern * pattern)
+        || !cloudReconstruct.CreateResources()) {
+        return false;
+    }
+    cloudSparse = Raymarch(cloudReconstruct.SparseWidth(), cloudReconstruct.SparseHeight());
+    cloudSparse.CreateRenderTarget();
+    cloudSparse.CompileShader(L"shaders/RayMarch.hlsl", "VS", "PS");
+    cloudSparse.CreateGeometry();
+    const cloudcascade::Cascade& nearBand = cloudCascades.front();
+    // CloudReconstruct keeps the history of the interleaved march
+    cloudSparse.SetCascade(nearBand.start_, nearBand.end_, nearBand.stepBudget_, false);
+    return true;
+}
+
+// the cloud march at 1/divisor of the screen, 0 keeps the 1024 wide target. the merge brings it
+// to the screen with BilateralUpsample of MergePrimitiveAndCloud.hlsl, and farCloud at the scale
+// of the far band bilinear
+bool SetupCloudTarget(int divisor, int pattern) {
+    const UINT width = divisor > 0 ? Renderer::width / divisor : 1024;
+    const UINT height = divisor > 0 ? Renderer::height / divisor : 1024 * Renderer::height / Renderer::width;
+    const cloudcascade::Cascade& nearBand = cloudCascades.front();
+    cloud = Raymarch(width, height);
+    cloud.CreateRenderTarget();
+    cloud.CompileShader(L"shaders/RayMarch.hlsl", "VS", "PS");
+    cloud.CreateGeometry();
+    cloud.SetCascade(nearBand.start_, nearBand.end_, nearBand.stepBudget_, nearBand.history_);
+
+    const cloudcascade::Cascade& farBand = cloudCascades.back();
+    farCloud = Raymarch((std::max)(static_cast<int>(width * farBand.scale_), 1), (std::max)(static_cast<int>(height * farBand.scale_), 1));
+    farCloud.CreateRenderTarget();
+    farCloud.CompileShader(L"shaders/RayMarch.hlsl", "VS", "PS");
+    farCloud.CreateGeometry();
+    farCloud.SetCascade(farBand.start_, farBand.end_, farBand.stepBudget_, farBand.history_);
+    farCloudAge = UINT32_MAX;
+
+    farCloudCached = Raymarch((std::max)(static_cast<int>(width * farBand.scale_), 1), (std::max)(static_cast<int>(height * farBand.scale_), 1));
+    farCloudCached.CreateRenderTarget();
+    farCloudCached.CompileShader(L"shaders/RayMarch.hlsl", "VS", "PS_FAR_CACHE");
+    farCloudCached.CreateGeometry();
+    farCloudCached.SetCascade(farBand.start_, farBand.end_, farBand.stepBudget_, farBand.history_);
+    return SetupInterleavedClouds(pattern);
+}
+
 HRESULT Setup() {
 
     gpuTimer.Init(Renderer::device.Get(), Renderer::context.Get());
 	timer.Start();
 
     fmap.CreateTexture2DFromData();
+    fmap.CreateLayerBuffer();
+    heightProfileLut.Build(fmap.CloudLayers());
+    heightProfileLut.CreateTexture();
+
+    // low frequency density around the camera, the regions are evaluated by CSDensityClipmap
+    DensityClipmapSettings clipmapSettings;
+    const hlsl::float2 band = DensityClipmap::AltitudeBand(fmap.CloudLayers());
+    clipmapSettings.altitudeMin_ = band.x;
+    clipmapSettings.altitudeMax_ = band.y;
+    densityClipmap.Initialize(clipmapSettings);
+    densityClipmap.CreateResources();
+
+    // the far band in a cube around the camera, refreshed tile by tile by CSFarCloudCache
+    farCloudCache.Initialize(cloudCascades.back());
+    farCloudCache.CreateResources();
+
+    // optical depth toward the sun baked on the CPU a pass at a time on a worker, the noise
+    // comes from the NoiseBaker cache after the first start. the noise bake runs off the
+    // render thread too, the map waits for densityField.Ready
+    densityFieldJob = std::async(std::launch::async, [settings = densityFieldSettings]() {
+        DensityField field;
+        field.Initialize(settings);
+        return field;
+    });
+    CloudShadowMapSettings shadowSettings;
+    shadowSettings.altitudeMin_ = band.x;
+    shadowSettings.altitudeMax_ = band.y;
+    cloudShadowMap.Initialize(shadowSettings);
+    cloudShadowMap.CreateResources();
+
+    // empty space skipping, bounds valid for any UNORM noise until the CPU noise is baked
+    OccupancyGridSettings gridSettings;
+    gridSettings.layers_ = fmap.CloudLayers();
+    occupancyGrid.Build(fmap.X_, fmap.Y_, fmap.ColorTexels(), NoiseBounds(), gridSettings);
+    occupancyGrid.CreateTexture();
+    CloudSdfSettings sdfSettings;
+    sdfSettings.grid_ = gridSettings;
+    cloudSdfJob = CloudSdf::BuildAsync(fmap.X_, fmap.Y_, fmap.ColorTexels(), NoiseBounds(), sdfSettings);
 	cloudMapTest.Load(L"resources/WeatherMap.dds");
 
     camera.Init();
@@ -395,15 +581,9 @@ HRESULT Setup() {
 	monolith.CreateShaders(L"shaders/Primitive.hlsl", "VS", "PS");
 	monolith.CreateGeometry(Primitive::CreateTopologyHealthMonolith);
     // or try CreateTopologyIssueMonolith for your study ...
+    if (kUseDepthPyramid) { depthPyramid.CreateResources(Renderer::width, Renderer::height); }
 
-    farCloud.CreateRenderTarget();
-    farCloud.CompileShader(L"shaders/RayMarch.hlsl", "VS", "PS_FAR");
-    farCloud.CreateGeometry();
-
-	cloud = Raymarch(1024, 1024 * Renderer::height / Renderer::width);
-    cloud.CreateRenderTarget();
-    cloud.CompileShader(L"shaders/RayMarch.hlsl", "VS", "PS");
-    cloud.CreateGeometry();
+    SetupCloudTarget(0, 2);
 
 	cloudMapGenerate.CreateResources(L"shaders/CloudMapGenerate.hlsl", "VS", "PS");
 	cloudMapGenerate.CreateTextures(1024, 1024);
@@ -466,6 +646,32 @@ float texPreviewScale = 1.0;
 bool demoMode = false;
 bool flyThroughMode = false;
 float flyThroughSpeedMach = 0.9;
+std::string noiseParityReport;
+int noiseChannels[4] = { 0, 1, 3, 5 };
+std::string brickReport;
+std::string precisionReport;
+std::string densityReport;
+std::string occupancyReport;
+std::string sdfReport;
+bool sdfReportPending = false;
+std::string profileReport;
+std::string bvhReport;
+std::string curvatureReport;
+std::string clipmapReport;
+std::string shadowMapReport;
+std::string cpuRenderReport;
+std::string regressionReport;
+std::string adaptiveStepReport;
+bool interleavedClouds = true; // CloudReconstruct::Report: a quarter of the steps below the error of the fresh samples alone
+bool interleavedClouds16 = false;
+std::string reconstructReport;
+std::string temporalReport;
+int cloudDivisor = 0;
+std::string upsampleReport;
+std::string depthPyramidReport;
+std::string cascadeReport;
+bool useFarCloudCache = false;
+std::string farCloudCacheReport;
 
 } // namespace imgui_info
 
@@ -531,13 +737,36 @@ void DispImguiInfo(UINT NumBuffs, ID3D11Buffer** Buffs) {
         camera.UpdateBuffer(Renderer::width, Renderer::width);
     }
 
+    // march 1/4 (or 1/16) of the cloud pixels per frame, the rest comes from the reprojected history
+    ImGui::Checkbox("Interleaved Clouds", &imgui_info::interleavedClouds);
+    ImGui::SameLine();
+    if (ImGui::Checkbox("1/16", &imgui_info::interleavedClouds16)) {
+        SetupInterleavedClouds(imgui_info::interleavedClouds16 ? 4 : 2);
+    }
+
+    // the far band from the cube of FarCloudCache instead of its own march every few frames
+    ImGui::Checkbox("Far Cloud Cache", &imgui_info::useFarCloudCache);
+
+    // size of the cloud target against the screen
+    const int cloudDivisor = imgui_info::cloudDivisor;
+    ImGui::RadioButton("Cloud 1024", &imgui_info::cloudDivisor, 0);
+    ImGui::SameLine();
+    ImGui::RadioButton("1/2", &imgui_info::cloudDivisor, 2);
+    ImGui::SameLine();
+    ImGui::RadioButton("1/4", &imgui_info::cloudDivisor, 4);
+    if (imgui_info::cloudDivisor != cloudDivisor) {
+        SetupCloudTarget(imgui_info::cloudDivisor, imgui_info::interleavedClouds16 ? 4 : 2);
+    }
+
     ImGui::NewLine();
 
     if (ImGui::Button("Re-Compile Shaders")) {
 		skyMap.RecompileShader();
 		monolith.RecompileShader();
         farCloud.RecompileShader();
+        farCloudCached.RecompileShader();
         cloud.RecompileShader();
+        cloudSparse.RecompileShader();
 		cloudMapGenerate.RecompileShader();
 		manualMerger.RecompileShader();
 		heightRemapTest.RecompileShader();
@@ -545,13 +774,17 @@ void DispImguiInfo(UINT NumBuffs, ID3D11Buffer** Buffs) {
 
     if (ImGui::Button("Re-Load Weather Map")) {
         cloudMapTest.LoadAgain();
+        farCloudCache.Invalidate();
     }
 
     if (ImGui::Button("Re-Render Noise Texture")) {
         fbmSmall.RecompileShader();
         fbmSmall.RenderNoiseTexture3D();
         fbm.RecompileShader();
+        // the texture may have been replaced by an immutable CPU bake
+        fbm.CreateNoiseTexture3DResource();
 		fbm.RenderNoiseTexture3D();
+        SetLargeNoiseRecipe(NoiseBaker::RecipeFbm());
     }
 
     ImGui::NewLine();
@@ -611,7 +844,7 @@ void DispImguiInfo(UINT NumBuffs, ID3D11Buffer** Buffs) {
             ImGui::Image((ImTextureID)(intptr_t)cloudDepthDebug.colorSRV_.Get(), texPreviewSize);
             ImGui::TableNextRow();
             ImGui::TableSetColumnIndex(0);
-            ImGui::Image((ImTextureID)(intptr_t)farCloud.colorSRV_.Get(), texPreviewSize);
+            ImGui::Image((ImTextureID)(intptr_t)(imgui_info::useFarCloudCache ? farCloudCached : farCloud).colorSRV_.Get(), texPreviewSize);
 
             ImGui::EndTable();
         }
@@ -635,6 +868,49 @@ void DispImguiInfo(UINT NumBuffs, ID3D11Buffer** Buffs) {
 
     if (ImGui::CollapsingHeader("Rendering Resource: 3D noise")) {
 
+        // pick a CPU generator per channel and bake it into the large noise texture
+        const std::vector<NoiseBaker::ChannelRecipe>& presets = NoiseBaker::ChannelPresets();
+        const char* channelLabels[4] = { "Large Noise R", "Large Noise G", "Large Noise B", "Large Noise A" };
+        for (int c = 0; c < 4; c++) {
+            if (ImGui::BeginCombo(channelLabels[c], presets[imgui_info::noiseChannels[c]].name_.c_str())) {
+                for (int i = 0; i < (int)presets.size(); i++) {
+                    if (ImGui::Selectable(presets[i].name_.c_str(), imgui_info::noiseChannels[c] == i)) {
+                        imgui_info::noiseChannels[c] = i;
+                    }
+                }
+                ImGui::EndCombo();
+            }
+        }
+        // the bake takes minutes without the cache, it runs in the background and the texture
+        // is replaced by PickUpLargeNoise when it is done
+        if (largeNoiseJob.valid()) {
+            ImGui::Text("Baking %s ...", largeNoiseJobRecipe.name_.c_str());
+        } else if (ImGui::Button("Bake Large Noise on CPU")) {
+            largeNoiseJobRecipe = NoiseBaker::RecipeFromChannels(
+                presets[imgui_info::noiseChannels[0]], presets[imgui_info::noiseChannels[1]],
+                presets[imgui_info::noiseChannels[2]], presets[imgui_info::noiseChannels[3]]);
+            largeNoiseJob = std::async(std::launch::async, [recipe = largeNoiseJobRecipe, width = fbm.widthPx_, height = fbm.heightPx_,
+                depth = fbm.slicePx_, cacheDir = densityFieldSettings.cacheDir_]() {
+                return NoiseBaker::BakeCached(recipe, width, height, depth, cacheDir);
+            });
+        }
+
+        // memory saved by brick storage on the shipped recipes
+        if (ImGui::Button("Brick Storage Report")) {
+            BrickVolume::Settings settings;
+            imgui_info::brickReport = BrickVolume::Report(fbm.widthPx_, settings);
+            settings.brickSize_ = 16;
+            imgui_info::brickReport += BrickVolume::Report(fbm.widthPx_, settings);
+        }
+        ImGui::TextUnformatted(imgui_info::brickReport.c_str());
+
+        // storage format study: float bake vs quantized through the CloudDensity remap chain
+        if (ImGui::Button("Noise Precision Report")) {
+            imgui_info::precisionReport = NoisePrecision::Run(fbm.widthPx_, fbmSmall.widthPx_).ToString();
+            imgui_info::precisionReport += NoisePrecision::Run(fbm.widthPx_, fbmSmall.widthPx_, 64, true).ToString();
+        }
+        ImGui::TextUnformatted(imgui_info::precisionReport.c_str());
+
         fbmDebugR.Draw(1, fbm.colorSRV_.GetAddressOf(), 0, nullptr);
         fbmDebugG.Draw(1, fbm.colorSRV_.GetAddressOf(), 0, nullptr);
         fbmDebugB.Draw(1, fbm.colorSRV_.GetAddressOf(), 0, nullptr);
@@ -713,6 +989,179 @@ void DispImguiInfo(UINT NumBuffs, ID3D11Buffer** Buffs) {
         }
     }
 
+    if (ImGui::CollapsingHeader("Noise Parity")) {
+        if (ImGui::Button("CPU vs Golden")) {
+            imgui_info::noiseParityReport = NoiseParity::Run().ToString();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("CPU vs GPU")) {
+            imgui_info::noiseParityReport = noiseParityGpu.CompareWithCpu(1 << 16).ToString();
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Write Golden from GPU")) {
+            imgui_info::noiseParityReport = noiseParityGpu.WriteGolden() ? "golden written\n" : "failed to write golden\n";
+        }
+        ImGui::TextUnformatted(imgui_info::noiseParityReport.c_str());
+    }
+
+    if (ImGui::CollapsingHeader("CPU Density")) {
+        if (ImGui::Button("Packet Benchmark")) {
+            // the CPU copies follow the weather loaded for rendering
+            if (EnsureDensityField(imgui_info::densityReport)) {
+                imgui_info::densityReport = DensityPacket::Benchmark(densityField);
+            }
+        }
+        ImGui::TextUnformatted(imgui_info::densityReport.c_str());
+
+        if (ImGui::Button("Occupancy Grid Validate")) {
+            if (EnsureDensityField(imgui_info::occupancyReport)) {
+                // tighten the bounds with the baked noise maxima, the texture keeps its size
+                occupancyGrid.Build(densityField);
+                occupancyGrid.UpdateTexture();
+                imgui_info::occupancyReport = occupancyGrid.Validate(densityField) + occupancyGrid.Report();
+            }
+        }
+        ImGui::TextUnformatted(imgui_info::occupancyReport.c_str());
+
+        if (ImGui::Button("Cloud SDF Report")) {
+            if (!cloudSdfJob.valid() && EnsureDensityField(imgui_info::sdfReport)) {
+                CloudSdfSettings sdfSettings;
+                sdfSettings.grid_.layers_ = densityField.Layers();
+                cloudSdfJob = CloudSdf::BuildAsync(densityField.WeatherWidth(), densityField.WeatherHeight(), densityField.Weather(), NoiseBounds::FromField(densityField), sdfSettings);
+                imgui_info::sdfReport = "rebuilding\n";
+                imgui_info::sdfReportPending = true;
+            }
+        }
+        // Render swaps the finished job in
+        if (imgui_info::sdfReportPending && !cloudSdfJob.valid()) {
+            imgui_info::sdfReport = cloudSdf.Report(densityField);
+            imgui_info::sdfReportPending = false;
+        }
+        ImGui::TextUnformatted(imgui_info::sdfReport.c_str());
+
+        if (ImGui::Button("Height Profile LUT Validate")) {
+            imgui_info::profileReport = heightProfileLut.Validate();
+        }
+        ImGui::TextUnformatted(imgui_info::profileReport.c_str());
+
+        if (ImGui::Button("Cloud BVH Benchmark")) {
+            const int counts[] = { 1000, 10000, 100000 };
+            imgui_info::bvhReport = CloudBvh::Benchmark(counts);
+        }
+        ImGui::TextUnformatted(imgui_info::bvhReport.c_str());
+
+        if (ImGui::Button("Earth Curvature Report")) {
+            imgui_info::curvatureReport = earthcurvature::Report();
+        }
+        ImGui::TextUnformatted(imgui_info::curvatureReport.c_str());
+
+        if (ImGui::Button("Density Clipmap Test")) {
+            std::string validate;
+            if (EnsureDensityField(validate)) {
+                validate = DensityClipmap::Validate(densityField, densityClipmap.settings_);
+            }
+            imgui_info::clipmapReport = DensityClipmap::TestUpdates(densityClipmap.settings_) + validate;
+        }
+        ImGui::TextUnformatted(imgui_info::clipmapReport.c_str());
+
+        if (ImGui::Button("Cloud Shadow Map Validate")) {
+            if (EnsureDensityField(imgui_info::shadowMapReport)) {
+                imgui_info::shadowMapReport = CloudShadowMap::Validate(densityField, cloudShadowMap.settings_);
+            }
+        }
+        ImGui::TextUnformatted(imgui_info::shadowMapReport.c_str());
+
+        if (ImGui::Button("CPU Render Benchmark")) {
+            if (EnsureDensityField(imgui_info::cpuRenderReport)) {
+                const XMVECTOR lightDir = environment::GetLightDir();
+                CpuCloudView view;
+                view.eye_ = hlsl::float3(camera.eyePos_.m128_f32[0], camera.eyePos_.m128_f32[1], camera.eyePos_.m128_f32[2]);
+                view.lookAt_ = hlsl::float3(camera.lookAtPos_.m128_f32[0], camera.lookAtPos_.m128_f32[1], camera.lookAtPos_.m128_f32[2]);
+                view.lightDir_ = hlsl::float3(lightDir.m128_f32[0], lightDir.m128_f32[1], lightDir.m128_f32[2]);
+                CpuCloudRendererSettings settings;
+                settings.vFovDeg_ = camera.vFov_;
+                settings.near_ = camera.near_;
+                settings.far_ = camera.far_;
+                CpuCloudSources sources;
+                sources.occupancy_ = &occupancyGrid;
+                sources.sdf_ = &cloudSdf;
+                imgui_info::cpuRenderReport = CpuCloudRenderer::Benchmark(densityField, settings, view, sources);
+            }
+        }
+        ImGui::TextUnformatted(imgui_info::cpuRenderReport.c_str());
+
+        if (ImGui::Button("Cloud Regression Run")) {
+            if (EnsureDensityField(imgui_info::regressionReport)) {
+                imgui_info::regressionReport = CloudRegression::Run(densityField).ToString();
+                // the cases left their own weather in the field
+                densityField.SetWeather(fmap);
+            }
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Write Cloud Golden")) {
+            if (EnsureDensityField(imgui_info::regressionReport)) {
+                imgui_info::regressionReport = CloudRegression::WriteGolden(densityField) ? "golden written\n" : "failed to write golden\n";
+                densityField.SetWeather(fmap);
+            }
+        }
+        ImGui::TextUnformatted(imgui_info::regressionReport.c_str());
+
+        if (ImGui::Button("Adaptive Step Report")) {
+            if (EnsureDensityField(imgui_info::adaptiveStepReport)) {
+                imgui_info::adaptiveStepReport = adaptivestep::Report(densityField);
+                densityField.SetWeather(fmap);
+            }
+        }
+        ImGui::TextUnformatted(imgui_info::adaptiveStepReport.c_str());
+
+        if (ImGui::Button("Cloud Reconstruct Report")) {
+            if (EnsureDensityField(imgui_info::reconstructReport)) {
+                imgui_info::reconstructReport = CloudReconstruct::Report(densityField);
+                densityField.SetWeather(fmap);
+            }
+        }
+        ImGui::TextUnformatted(imgui_info::reconstructReport.c_str());
+        if (ImGui::Button("Temporal Reprojection Report")) {
+            if (EnsureDensityField(imgui_info::temporalReport)) {
+                imgui_info::temporalReport = temporalreprojection::Report(densityField);
+                densityField.SetWeather(fmap);
+            }
+        }
+        ImGui::TextUnformatted(imgui_info::temporalReport.c_str());
+        if (ImGui::Button("Bilateral Upsample Report")) {
+            if (EnsureDensityField(imgui_info::upsampleReport)) {
+                imgui_info::upsampleReport = bilateralupsample::Report(densityField);
+                densityField.SetWeather(fmap);
+            }
+        }
+        ImGui::TextUnformatted(imgui_info::upsampleReport.c_str());
+        if (ImGui::Button("Depth Pyramid Report")) {
+            if (EnsureDensityField(imgui_info::depthPyramidReport)) {
+                imgui_info::depthPyramidReport = DepthPyramid::Report(densityField);
+                densityField.SetWeather(fmap);
+            }
+        }
+        ImGui::TextUnformatted(imgui_info::depthPyramidReport.c_str());
+
+        // near and far bands against one march over the whole ray, and the steps of a frame
+        if (ImGui::Button("Cloud Cascade Report")) {
+            if (EnsureDensityField(imgui_info::cascadeReport)) {
+                imgui_info::cascadeReport = cloudcascade::Report(densityField);
+                densityField.SetWeather(fmap);
+            }
+        }
+        ImGui::TextUnformatted(imgui_info::cascadeReport.c_str());
+
+        // tile refresh of the far cloud cube on camera paths, and the cruise view against the cascades
+        if (ImGui::Button("Far Cloud Cache Report")) {
+            if (EnsureDensityField(imgui_info::farCloudCacheReport)) {
+                imgui_info::farCloudCacheReport = FarCloudCache::Report(densityField);
+                densityField.SetWeather(fmap);
+            }
+        }
+        ImGui::TextUnformatted(imgui_info::farCloudCacheReport.c_str());
+    }
+
     ImGui::End();
 #endif
 }
@@ -740,6 +1189,19 @@ void CalculateFrameTime(std::function<void()> func) {
 
 void Render() {
 
+    PickUpDensityField(false);
+    PickUpLargeNoise();
+
+    // pick up the distance field of the last weather snapshot
+    if (cloudSdfJob.valid() && cloudSdfJob.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        CloudSdf built = cloudSdfJob.get();
+        const bool sameSize = cloudSdf.sdfTEX_ && built.sizeX_ == cloudSdf.sizeX_ && built.sizeY_ == cloudSdf.sizeY_ && built.sizeZ_ == cloudSdf.sizeZ_;
+        built.sdfTEX_ = cloudSdf.sdfTEX_;
+        built.sdfSRV_ = cloudSdf.sdfSRV_;
+        cloudSdf = std::move(built);
+        if (sameSize) { cloudSdf.UpdateTexture(); } else { cloudSdf.CreateTexture(); }
+    }
+
     camera.UpdateEyePosition();
     camera.UpdateBuffer(Renderer::width, Renderer::height);
     environment::UpdateBuffer();
@@ -770,14 +1232,37 @@ void Render() {
         skyBox.Render(_countof(srvs), srvs, bufferCount, buffers);
     };
 
+    auto updateCloudShadowMap = [&]() {
+        if (!densityField.Ready()) { return; }
+        const double seconds = timer.GetElapsedTime<std::micro>() * 1e-6;
+        const XMVECTOR lightDir = environment::GetLightDir();
+        // toward the sun in world space, SUNDIR of RayMarch.hlsl
+        const hlsl::float3 toSun(lightDir.m128_f32[0], -lightDir.m128_f32[1], lightDir.m128_f32[2]);
+        const hlsl::float3 eye(camera.eyePos_.m128_f32[0], camera.eyePos_.m128_f32[1], camera.eyePos_.m128_f32[2]);
+        // the pass runs on a worker with a copy of the field, a few hundred ms per pass
+        if (cloudShadowMap.PickUp()) {
+            cloudShadowMap.UpdateTexture();
+        }
+        if (cloudShadowMap.NeedsRefresh(eye, toSun, seconds)) {
+            densityField.SetTime(seconds);
+            cloudShadowMap.BeginAsync(densityField, eye, toSun, seconds);
+        }
+    };
+
     auto renderMonolith = [&]() {
 		monolith.UpdateTransform(XMFLOAT3(10,10,10), XMFLOAT3(0,360 * timer.GetElapsedTime<std::micro>() * 0.000001 * 0.0001,0), XMFLOAT3(0,-15000 * 0.304,0));
-        monolith.Render(static_cast<float>(Renderer::width), static_cast<float>(Renderer::height), buffers, bufferCount);
+        ID3D11ShaderResourceView* srvs[] = {
+            cloudShadowMap.shadowSRV_.Get(), // 16
+            cloudShadowMap.descSRV_.Get(), // 17
+        };
+        monolith.Render(static_cast<float>(Renderer::width), static_cast<float>(Renderer::height), buffers, bufferCount, 16, _countof(srvs), srvs);
+        if (kUseDepthPyramid) { depthPyramid.Dispatch(monolith.depthSRV_.Get()); }
     };
 
 	auto renderCloud = [&]() {
 		cloudMapGenerate.Draw(1, fmap.colorSRV_.GetAddressOf(), bufferCount, buffers);
         farCloud.UpdateTransform(camera);
+        farCloudCached.UpdateTransform(camera);
         cloud.UpdateTransform(camera);
         ID3D11ShaderResourceView* srvs[] = {
             skyMapIrradiance.colorSRV_.Get(), // 0 has to match with sky box rendering pipeline
@@ -787,11 +1272,104 @@ void Render() {
             fbmSmall.colorSRV_.Get(), // 4 
             cloudMapGenerate.colorSRV_.Get(), // 5
 			fmap.colorSRV_.Get(), // 6
+            fbmSequence.colorSRV_.Get(), // 7
+            occupancyGrid.occupancySRV_.Get(), // 8
+            cloudSdf.sdfSRV_.Get(), // 9
+            fmap.layerSRV_.Get(), // 10
+            heightProfileLut.profileSRV_.Get(), // 11
+            environment::cumulusBvh.nodeSRV_.Get(), // 12
+            environment::cumulusBvh.instanceSRV_.Get(), // 13
+            densityClipmap.clipmapSRV_.Get(), // 14
+            densityClipmap.levelSRV_.Get(), // 15
+            cloudShadowMap.shadowSRV_.Get(), // 16
+            cloudShadowMap.descSRV_.Get(), // 17
+            nullptr, // 18
+            nullptr, // 19
+            nullptr, // 20
+            depthPyramid.pyramidSRV_.Get(), // 21
+            farCloudCache.cacheSRV_.Get(), // 22
         };
-        //farCloud.Render(_countof(srvs), srvs, bufferCount, buffers);
-		cloud.Render(_countof(srvs), srvs, bufferCount, buffers);
+        const XMVECTOR forward = XMVector3Normalize(XMVectorSubtract(camera.lookAtPos_, camera.eyePos_));
+        if (imgui_info::useFarCloudCache) {
+            // the stalest tiles of the cube are marched, the far target only looks it up
+            const XMVECTOR lightDir = environment::GetLightDir();
+            FarCloudCacheView view;
+            view.eye_ = hlsl::float3(camera.eyePos_.m128_f32[0], camera.eyePos_.m128_f32[1], camera.eyePos_.m128_f32[2]);
+            view.forward_ = hlsl::float3(forward.m128_f32[0], forward.m128_f32[1], forward.m128_f32[2]);
+            view.sunDir_ = hlsl::float3(lightDir.m128_f32[0], -lightDir.m128_f32[1], lightDir.m128_f32[2]);
+            const float halfHeight = std::tan(XMConvertToRadians(camera.vFov_) * 0.5f);
+            const float halfWidth = halfHeight * Renderer::width / Renderer::height;
+            view.viewHalfAngleDeg_ = XMConvertToDegrees(std::atan(std::sqrt(halfWidth * halfWidth + halfHeight * halfHeight)));
+            view.cloudAltitude_ = DensityClipmap::AltitudeBand(fmap.CloudLayers());
+            view.frame_ = farCloudCacheFrame++;
+            farCloudCache.Update(view);
+
+            ID3D11SamplerState* samplers[] = {
+                cloud.depthSampler_.Get(), // 0
+                cloud.noiseSampler_.Get(), // 1
+                cloud.fmapSampler_.Get(), // 2
+                cloud.cubeSampler_.Get(), // 3
+                cloud.linearSampler_.Get(), // 4
+            };
+            // everything but the cube it writes
+            farCloudCache.UpdateTexture(_countof(srvs) - 1, srvs, bufferCount, buffers, _countof(samplers), samplers);
+            farCloudCached.Render(_countof(srvs), srvs, bufferCount, buffers);
+            farCloudAge = UINT32_MAX;
+        }
+        // the far band holds still between its updates, a turn past its limit redraws it at once
+        else if (cloudcascade::Due(cloudCascades.back(), farCloudAge,
+            XMConvertToDegrees(XMVectorGetX(XMVector3AngleBetweenNormals(forward, farCloudForward))))) {
+            farCloud.Render(_countof(srvs), srvs, bufferCount, buffers);
+            farCloudAge = 0;
+            farCloudForward = forward;
+        }
+        farCloudAge = farCloudAge == UINT32_MAX ? farCloudAge : farCloudAge + 1;
+        if (!imgui_info::interleavedClouds) {
+            cloud.Render(_countof(srvs), srvs, bufferCount, buffers);
+            return;
+        }
+
+        // this frame's pixel of every block, then the full resolution from it and the history
+        cloudReconstruct.BeginFrame(
+            hlsl::float3(camera.eyePos_.m128_f32[0], camera.eyePos_.m128_f32[1], camera.eyePos_.m128_f32[2]),
+            hlsl::float3(camera.lookAtPos_.m128_f32[0], camera.lookAtPos_.m128_f32[1], camera.lookAtPos_.m128_f32[2]),
+            camera.vFov_, camera.near_, camera.far_);
+        const hlsl::float2 center = cloudReconstruct.PixelCenter();
+        cloudSparse.UpdateTransform(camera);
+        cloudSparse.SetPixelOffset(center.x - 0.5f, center.y - 0.5f);
+        cloudSparse.Render(_countof(srvs), srvs, bufferCount, buffers);
+        cloudReconstruct.Dispatch(cloudSparse.colorSRV_.Get(), cloudSparse.debugSRV_.Get());
 	};
 
+    auto updateDensityClipmap = [&]() {
+        if (!kUseDensityClipmap) { return; }
+        densityClipmap.Update(hlsl::float3(camera.eyePos_.m128_f32[0], camera.eyePos_.m128_f32[1], camera.eyePos_.m128_f32[2]));
+        ID3D11ShaderResourceView* srvs[] = {
+            skyMapIrradiance.colorSRV_.Get(), // 0 has to match with sky box rendering pipeline
+            prevFrameCloud.colorSRV_.Get(), // 1
+            monolith.depthSRV_.Get(), // 2
+            fbm.colorSRV_.Get(), // 3
+            fbmSmall.colorSRV_.Get(), // 4 
+            cloudMapGenerate.colorSRV_.Get(), // 5
+            fmap.colorSRV_.Get(), // 6
+            fbmSequence.colorSRV_.Get(), // 7
+            occupancyGrid.occupancySRV_.Get(), // 8
+            cloudSdf.sdfSRV_.Get(), // 9
+            fmap.layerSRV_.Get(), // 10
+            heightProfileLut.profileSRV_.Get(), // 11
+            environment::cumulusBvh.nodeSRV_.Get(), // 12
+            environment::cumulusBvh.instanceSRV_.Get(), // 13
+        };
+        ID3D11SamplerState* samplers[] = {
+            cloud.depthSampler_.Get(), // 0
+            cloud.noiseSampler_.Get(), // 1
+            cloud.fmapSampler_.Get(), // 2
+            cloud.cubeSampler_.Get(), // 3
+            cloud.linearSampler_.Get(), // 4
+        };
+        densityClipmap.UpdateTexture(_countof(srvs), srvs, bufferCount, buffers, _countof(samplers), samplers);
+    };
+
     auto computeShadeLOS = [&]() {
         ID3D11ShaderResourceView* srvs[] = {
             skyMapIrradiance.colorSRV_.Get(), // 0 has to match with sky box rendering pipeline
@@ -801,6 +1379,17 @@ void Render() {
             fbmSmall.colorSRV_.Get(), // 4 
             cloudMapGenerate.colorSRV_.Get(), // 5
             fmap.colorSRV_.Get(), // 6
+            fbmSequence.colorSRV_.Get(), // 7
+            occupancyGrid.occupancySRV_.Get(), // 8
+            cloudSdf.sdfSRV_.Get(), // 9
+            fmap.layerSRV_.Get(), // 10
+            heightProfileLut.profileSRV_.Get(), // 11
+            environment::cumulusBvh.nodeSRV_.Get(), // 12
+            environment::cumulusBvh.instanceSRV_.Get(), // 13
+            densityClipmap.clipmapSRV_.Get(), // 14
+            densityClipmap.levelSRV_.Get(), // 15
+            cloudShadowMap.shadowSRV_.Get(), // 16
+            cloudShadowMap.descSRV_.Get(), // 17
         };
         cloud.ComputeShaderFromPointToPoint(camera.eyePos_, camera.lookAtPos_, _countof(srvs), srvs, environment::los_);
     };
@@ -815,9 +1404,9 @@ void Render() {
             skyBox.colorSRV_.Get(),
 			monolith.colorSRV_.Get(),
             monolith.depthSRV_.Get(),
-            farCloud.colorSRV_.Get(),
-            cloud.colorSRV_.Get(),
-            cloud.debugSRV_.Get(),
+            (imgui_info::useFarCloudCache ? farCloudCached : farCloud).colorSRV_.Get(),
+            imgui_info::interleavedClouds ? cloudReconstruct.ColorSRV() : cloud.colorSRV_.Get(),
+            imgui_info::interleavedClouds ? cloudReconstruct.DepthSRV() : cloud.debugSRV_.Get(),
 		};
 		manualMerger.Draw(_countof(srvs), srvs, bufferCount, buffers);
 	};
@@ -829,13 +1418,17 @@ void Render() {
 	};
 
 	auto saveLastCloudFrame = [&]() {
-		prevFrameCloud.Draw(1, cloud.colorSRV_.GetAddressOf(), 0, nullptr);
+        ID3D11ShaderResourceView* const color = imgui_info::interleavedClouds ? cloudReconstruct.ColorSRV() : cloud.colorSRV_.Get();
+		prevFrameCloud.Draw(1, &color, 0, nullptr);
+        camera.EndFrame();
 	};
 
     AnnotateRendering(L"Sky Map", renderSkyMap);
     AnnotateRendering(L"Sky Map Irradiance", renderSkyMapIrradiance);
     AnnotateRendering(L"Sky Box", renderSkyBox);
+    AnnotateRendering(L"Update cloud shadow map", updateCloudShadowMap);
     AnnotateRendering(L"Render monolith as primitive", renderMonolith);
+    AnnotateRendering(L"Update density clipmap", updateDensityClipmap);
 	AnnotateRendering(L"ComputeShadeLOS", computeShadeLOS);
     AnnotateRendering(L"Render clouds using ray marching", [&]() { CalculateFrameTime(renderCloud); });
     AnnotateRendering(L"Save last cloud frame", saveLastCloudFrame);
@@ -915,9 +1508,6 @@ void OnResize(UINT width, UINT height) {
         manualMerger.colorRTV_.Reset();
         manualMerger.colorSRV_.Reset();
         manualMerger.colorTEX_.Reset();
-        cloud.colorRTV_.Reset();
-        cloud.colorSRV_.Reset();
-        cloud.colorTEX_.Reset();
 		monolith.colorRTV_.Reset();
 		monolith.depthSV_.Reset();
 		monolith.colorSRV_.Reset();
@@ -930,7 +1520,10 @@ void OnResize(UINT width, UINT height) {
 
         // Recreate resources with new size
         monolith.CreateRenderTargets(width, height);
-        cloud.CreateRenderTarget();
+        if (kUseDepthPyramid) { depthPyramid.CreateResources(width, height); }
+        // the cloud targets follow the screen at the divisor, the far band and the sparse
+        // target of the interleaved march with them
+        SetupCloudTarget(imgui_info::cloudDivisor, imgui_info::interleavedClouds16 ? 4 : 2);
         manualMerger.CreateTextures(width, height);
         CreateFinalSceneRenderTarget();
     }
@@ -1119,6 +1712,7 @@ void environment::CreateCumulusBuffer() {
     const float SIZE_SCALE = 1000.0f;
 
     // Generate fractal-based clouds
+    cumulusInstances.clear();
     for (int i = 0; i < MAX_CLOUDS; i++) {
         float angle = (float)i / MAX_CLOUDS * XM_2PI;
         float radius = SPACE_SCALE * FBM(cos(angle), sin(angle), 4);
@@ -1129,12 +1723,18 @@ void environment::CreateCumulusBuffer() {
         float size = SIZE_SCALE * (0.5f + 0.5f * FBM(x * 0.2f, z * 0.2f, 2));
 
         clouds->cumulusPos[i] = XMFLOAT4(x, y, z, size);
+        cumulusInstances.push_back(hlsl::float4(x, y, z, size));
     }
 
     clouds->cumulusPos[0] = XMFLOAT4(0, 0, 0, 1);
+    cumulusInstances[0] = hlsl::float4(0, 0, 0, 1);
 
     Renderer::context->Unmap(cumulus_buffer.Get(), 0);
 
+    if (!cumulusBvh.Build(cumulusInstances) || !cumulusBvh.CreateBuffers()) {
+        LogToFile("Failed to create cumulus BVH.");
+    }
+
     // Set to pixel shader
     // Renderer::context->PSSetConstantBuffers(2, 1, cumulus_buffer.GetAddressOf());
 }
\ No newline at end of file